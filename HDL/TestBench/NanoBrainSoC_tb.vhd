@@ -7,6 +7,10 @@ use IEEE.std_logic_1164.all;
 use IEEE.numeric_std.all;
 
 entity NanoBrainSoC_tb is
+  generic (
+    -- write a retirement trace here (see TraceWriter); empty for none
+    TRACE_FILE : string := ""
+    );
 end NanoBrainSoC_tb;
 
 architecture RTL of NanoBrainSoC_tb
@@ -112,6 +116,23 @@ is
 
   end component;
 
+  component TraceWriter is
+    generic (
+      TRACE_FILE : string
+      );
+    port (
+      clk          : in std_logic;
+      reset        : in std_logic;
+      d_address    : in unsigned (23 downto 0);
+      d_wr_data    : in std_logic_vector (15 downto 0);
+      d_wr_grant   : in std_logic;
+      d_n_wr       : in std_logic;
+      port_address : in std_logic_vector (15 downto 0);
+      port_wr_data : in std_logic_vector (15 downto 0);
+      port_n_wr    : in std_logic
+      );
+  end component;
+
   constant clk_period  : time := 0.020 us;
   constant bit_period  : time := 8680.5 ns;
   constant stop_period : time := 8680.5 ns;
@@ -156,6 +177,39 @@ begin
     HEX3     => tb_hex3
     );
 
+  -- The core's buses are internal to the SoC, so reach in with VHDL-2008
+  -- external names (analyse with --std=08)
+
+  trace0 : if TRACE_FILE /= "" generate
+    alias soc_clk          is << signal .NanoBrainSoC_tb.nb0.clk : std_logic >>;
+    alias soc_reset        is << signal .NanoBrainSoC_tb.nb0.reset : std_logic >>;
+    alias soc_d_address    is << signal .NanoBrainSoC_tb.nb0.d_address : unsigned (23 downto 0) >>;
+    alias soc_d_wr_data    is << signal .NanoBrainSoC_tb.nb0.d_wr_data : std_logic_vector (15 downto 0) >>;
+    alias soc_d_wr_grant   is << signal .NanoBrainSoC_tb.nb0.d_wr_grant : std_logic >>;
+    alias soc_d_n_wr       is << signal .NanoBrainSoC_tb.nb0.d_n_wr : std_logic >>;
+    alias soc_port_address is << signal .NanoBrainSoC_tb.nb0.port_address : std_logic_vector (15 downto 0) >>;
+    alias soc_port_wr_data is << signal .NanoBrainSoC_tb.nb0.port_wr_data : std_logic_vector (15 downto 0) >>;
+    alias soc_port_n_wr    is << signal .NanoBrainSoC_tb.nb0.port_n_wr : std_logic >>;
+  begin
+
+    tw0 : TraceWriter
+      generic map (
+        TRACE_FILE => TRACE_FILE
+        )
+      port map (
+        clk          => soc_clk,
+        reset        => soc_reset,
+        d_address    => soc_d_address,
+        d_wr_data    => soc_d_wr_data,
+        d_wr_grant   => soc_d_wr_grant,
+        d_n_wr       => soc_d_n_wr,
+        port_address => soc_port_address,
+        port_wr_data => soc_port_wr_data,
+        port_n_wr    => soc_port_n_wr
+        );
+
+  end generate;
+
   process
   begin
     tb_clock_50 <= '0';
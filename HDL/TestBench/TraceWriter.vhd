@@ -0,0 +1,107 @@
+--
+--      TraceWriter : retirement trace from the RTL, in the same format as
+--      nbsim -t, for lockstep comparison with tools/tracecmp
+--
+--      The CPU core comes from VHDLCores, so the trace is taken from what
+--      the core does on the SoC buses: one "m" record per data write beat
+--      (a clock with d_wr_grant high and d_n_wr low) and one "p" record per
+--      port write (falling edge of port_n_wr). Compare with tracecmp -k mp.
+--
+
+library IEEE;
+use IEEE.std_logic_1164.all;
+use IEEE.numeric_std.all;
+use std.textio.all;
+
+entity TraceWriter is
+  generic (
+    TRACE_FILE : string := "rtl.trace"
+    );
+  port (
+    clk   : in std_logic;
+    reset : in std_logic;
+
+    -- data port of the core
+    d_address  : in unsigned (23 downto 0);
+    d_wr_data  : in std_logic_vector (15 downto 0);
+    d_wr_grant : in std_logic;
+    d_n_wr     : in std_logic;
+
+    -- io port of the core
+    port_address : in std_logic_vector (15 downto 0);
+    port_wr_data : in std_logic_vector (15 downto 0);
+    port_n_wr    : in std_logic
+    );
+end TraceWriter;
+
+architecture RTL of TraceWriter
+is
+
+  -- lower case hex, as nbsim writes it
+  function to_hex (value : std_logic_vector) return string is
+    constant digits : string(1 to 16) := "0123456789abcdef";
+    constant ndigits : natural := (value'length + 3) / 4;
+    variable padded : unsigned (ndigits * 4 - 1 downto 0);
+    variable result : string(1 to ndigits);
+  begin
+    padded := resize(unsigned(value), ndigits * 4);
+    for i in 0 to ndigits - 1 loop
+      result(ndigits - i) := digits(to_integer(padded(i * 4 + 3 downto i * 4)) + 1);
+    end loop;
+    return result;
+  end function;
+
+  file trace : text open write_mode is TRACE_FILE;
+
+begin
+
+  process (clk)
+    variable l          : line;
+    variable beat       : natural := 0;
+    variable last_n_wr  : std_logic := '1';
+    variable header     : boolean := false;
+  begin
+
+    if rising_edge(clk) then
+
+      if not header then
+        write(l, string'("# rtl retirement trace"));
+        writeline(trace, l);
+        header := true;
+      end if;
+
+      if reset = '1' then
+        beat      := 0;
+        last_n_wr := '1';
+      else
+
+        -- bursts present the start address, so count the beats
+
+        if d_wr_grant = '1' and d_n_wr = '0' then
+          write(l, string'("m "));
+          write(l, to_hex(std_logic_vector(d_address + to_unsigned(beat * 2, d_address'length))));
+          write(l, string'(" "));
+          write(l, to_hex(d_wr_data));
+          writeline(trace, l);
+          beat := beat + 1;
+        elsif d_wr_grant = '0' then
+          beat := 0;
+        end if;
+
+        if port_n_wr = '0' and last_n_wr = '1' then
+          write(l, string'("p "));
+          write(l, to_hex(port_address));
+          write(l, string'(" "));
+          write(l, to_hex(port_wr_data));
+          writeline(trace, l);
+        end if;
+
+        last_n_wr := port_n_wr;
+
+      end if;
+
+    end if;
+
+  end process;
+
+end RTL;
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+#   Run the test bench under GHDL, writing a retirement trace for comparison
+#   with nbsim:
+#
+#       VHDLCORES=~/VHDLCores ./ghdl.sh ../../src/NightRider/nightrider.vhd 2ms rtl.trace
+#       nbsim -H -c 100000 -b nightrider.bin -f flash.bin -s sd.img -t sim.trace
+#       tracecmp -k mp sim.trace rtl.trace
+#
+#   The first argument is the boot ROM made by bin2vhd. 50MHz, so 1ms of
+#   simulated time is 50000 nbsim cycles.
+#
+
+if [ $# -lt 1 ]; then
+    echo "Usage: VHDLCORES=<path to VHDLCores> $0 <boot rom.vhd> [stop time] [trace file]"
+    exit 1
+fi
+
+if [ -z "$VHDLCORES" ]; then
+    echo "ERROR: set VHDLCORES to a checkout of VHDLCores (the CPU core and peripherals)"
+    exit 1
+fi
+
+ROM=$1
+STOP_TIME=${2:-1ms}
+TRACE=${3:-rtl.trace}
+
+HERE=$(dirname "$0")
+WORK=$HERE/ghdl-work
+
+GHDLFLAGS="--std=08 -fsynopsys --workdir=$WORK"
+
+mkdir -p "$WORK"
+
+# import everything and let GHDL work out the analysis order
+
+ghdl -i $GHDLFLAGS $(find "$VHDLCORES" -name '*.vhd') \
+    "$HERE"/../SoC/*.vhd "$HERE"/../MemoryController/*.vhd \
+    "$HERE"/NanoBrainSoC_tb.vhd "$HERE"/TraceWriter.vhd "$ROM" || exit 1
+
+ghdl -m $GHDLFLAGS NanoBrainSoC_tb || exit 1
+
+ghdl -r $GHDLFLAGS NanoBrainSoC_tb --stop-time="$STOP_TIME" -gTRACE_FILE="$TRACE"
@@ -99,3 +99,48 @@ static const nbInstructionDecodeInfo instructionInfo[] =
     {UniqueOpCode::DECW,        NB_DECW_INSTRUCTION,       NB_DECW_INSTRUCTION_MASK, "decw"}
 };
 
+
+// Direct lookup from instruction word to its entry in instructionInfo, so
+// decode is a single index rather than a scan of the table. The first
+// matching entry wins, as with the scan.
+
+static const std::uint8_t kInvalidInstructionIndex = 0xff;
+
+struct nbInstructionDecodeTable
+{
+    std::uint8_t index[65536];
+
+    nbInstructionDecodeTable()
+    {
+        const int numEntries = sizeof(instructionInfo) / sizeof(instructionInfo[0]);
+
+        for (std::uint32_t ins = 0; ins < 65536; ins++)
+        {
+            index[ins] = kInvalidInstructionIndex;
+
+            for (int i = 0; i < numEntries; i++)
+            {
+                if ((ins & instructionInfo[i].mask) == instructionInfo[i].instruction)
+                {
+                    index[ins] = i;
+                    break;
+                }
+            }
+        }
+    }
+};
+
+// built on first use (thread safe)
+
+static const std::uint8_t* instructionDecodeTable()
+{
+    static const nbInstructionDecodeTable table;
+    return table.index;
+}
+
+static inline const nbInstructionDecodeInfo* decodeInstruction(const std::uint8_t* table, std::uint16_t instruction)
+{
+    std::uint8_t i = table[instruction];
+
+    return i == kInvalidInstructionIndex ? nullptr : &instructionInfo[i];
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstdint>
+
+#include "types.h"
+
+//
+//  Estimated cycle costs on the RTL core, shared by nbsim's timing model and
+//  nbasm's listing (-l), so a hand count from the listing agrees with what
+//  the simulator reports. They are estimates of the RTL, not measurements:
+//  tune them against the test bench.
+//
+//  An instruction takes nbExecuteCycles() cycles, plus:
+//
+//      - kNbBranchPenalty if control doesn't fall through to the next one
+//      - kNbLoadUseStall if it reads the register loaded by the one before
+//      - for a load, waiting for the memory controller; stores are posted
+//      - on an instruction cache miss, the line fill
+//
+//  Memory and cache stalls depend on addresses and on what ran before, so
+//  only the simulator can model them; the listing assumes cache hits and
+//  loads from block RAM.
+//
+
+enum
+{
+    kNbBranchPenalty    = 3,    // stages in front of execute
+    kNbLoadUseStall     = 1,
+
+    kNbMulCycles        = 2,
+    kNbDivCycles        = 18,
+    kNbFAddCycles       = 3,
+    kNbFMulCycles       = 3,
+    kNbFDivCycles       = 18,
+    kNbPortCycles       = 2,
+
+    kNbNumRegions       = 3     // BRAM, flash, DDR, as nbsim's Memory numbers them
+};
+
+// memory controller, per region: first word, and each word after in a burst
+static const std::uint32_t kNbFirstWordCycles[kNbNumRegions] = { 2, 8, 6 };
+static const std::uint32_t kNbBurstWordCycles[kNbNumRegions] = { 1, 8, 1 };
+
+// Cycles in execute, without stalls
+inline std::uint32_t nbExecuteCycles(UniqueOpCode opcode)
+{
+    switch (opcode)
+    {
+        case UniqueOpCode::MUL_IMM:
+        case UniqueOpCode::MUL_REG:
+        case UniqueOpCode::MULS_IMM:
+        case UniqueOpCode::MULS_REG:
+            return kNbMulCycles;
+        case UniqueOpCode::DIV_IMM:
+        case UniqueOpCode::DIV_REG:
+        case UniqueOpCode::DIVS_IMM:
+        case UniqueOpCode::DIVS_REG:
+            return kNbDivCycles;
+        case UniqueOpCode::FADD:
+        case UniqueOpCode::FSUB:
+        case UniqueOpCode::FCMP:
+        case UniqueOpCode::FINT:
+        case UniqueOpCode::FFLT:
+            return kNbFAddCycles;
+        case UniqueOpCode::FMUL:
+            return kNbFMulCycles;
+        case UniqueOpCode::FDIV:
+            return kNbFDivCycles;
+        case UniqueOpCode::IN:
+        case UniqueOpCode::OUT:
+            return kNbPortCycles;
+        default:
+            return 1;
+    }
+}
+
+// The general purpose registers an instruction reads, for load-use
+// hazards, -1 for none; and the one a load writes, or -1.
+inline void nbRegistersUsed(UniqueOpCode opcode, std::uint16_t instruction, int& srcA, int& srcB, int& loadDest)
+{
+    int regx = (instruction & 0xf0) >> 4;
+    int regy = instruction & 0x0f;
+
+    srcA     = -1;
+    srcB     = -1;
+    loadDest = -1;
+
+    switch (opcode)
+    {
+        case UniqueOpCode::ADD_REG:
+        case UniqueOpCode::ADC_REG:
+        case UniqueOpCode::SUB_REG:
+        case UniqueOpCode::SBB_REG:
+        case UniqueOpCode::AND_REG:
+        case UniqueOpCode::OR_REG:
+        case UniqueOpCode::XOR_REG:
+        case UniqueOpCode::CMP_REG:
+        case UniqueOpCode::TEST_REG:
+        case UniqueOpCode::MUL_REG:
+        case UniqueOpCode::MULS_REG:
+        case UniqueOpCode::DIV_REG:
+        case UniqueOpCode::DIVS_REG:
+        case UniqueOpCode::OUT:
+        case UniqueOpCode::STW_REG:
+            srcA = regx;
+            srcB = regy;
+            break;
+        case UniqueOpCode::LOAD_REG:
+        case UniqueOpCode::IN:
+            srcB = regy;
+            break;
+        case UniqueOpCode::ADD_IMM:
+        case UniqueOpCode::ADC_IMM:
+        case UniqueOpCode::SUB_IMM:
+        case UniqueOpCode::SBB_IMM:
+        case UniqueOpCode::AND_IMM:
+        case UniqueOpCode::OR_IMM:
+        case UniqueOpCode::XOR_IMM:
+        case UniqueOpCode::CMP_IMM:
+        case UniqueOpCode::TEST_IMM:
+        case UniqueOpCode::MUL_IMM:
+        case UniqueOpCode::MULS_IMM:
+        case UniqueOpCode::DIV_IMM:
+        case UniqueOpCode::DIVS_IMM:
+        case UniqueOpCode::SLA:
+        case UniqueOpCode::SLX:
+        case UniqueOpCode::SL0:
+        case UniqueOpCode::SL1:
+        case UniqueOpCode::RL:
+        case UniqueOpCode::SRA:
+        case UniqueOpCode::SRX:
+        case UniqueOpCode::SR0:
+        case UniqueOpCode::SR1:
+        case UniqueOpCode::RR:
+        case UniqueOpCode::BSL:
+        case UniqueOpCode::BSR:
+        case UniqueOpCode::STW_IMM:
+            srcA = regx;
+            break;
+        case UniqueOpCode::LDSPR:
+            srcA = regy & 0x0e;
+            srcB = (regy & 0x0e) + 1;
+            break;
+        case UniqueOpCode::LDW_REG:
+            srcB = regy;
+            loadDest = regx;
+            break;
+        case UniqueOpCode::LDW_IMM:
+            loadDest = regx;
+            break;
+        default:
+            break;
+    }
+}
+
+// Jumps and calls whose taking depends on the flags
+inline bool nbIsConditionalBranch(UniqueOpCode opcode)
+{
+    switch (opcode)
+    {
+        case UniqueOpCode::JUMPZ:
+        case UniqueOpCode::JUMPC:
+        case UniqueOpCode::JUMPNZ:
+        case UniqueOpCode::JUMPNC:
+        case UniqueOpCode::CALLZ:
+        case UniqueOpCode::CALLC:
+        case UniqueOpCode::CALLNZ:
+        case UniqueOpCode::CALLNC:
+        case UniqueOpCode::JUMPZ_REL:
+        case UniqueOpCode::JUMPC_REL:
+        case UniqueOpCode::JUMPNZ_REL:
+        case UniqueOpCode::JUMPNC_REL:
+        case UniqueOpCode::CALLZ_REL:
+        case UniqueOpCode::CALLC_REL:
+        case UniqueOpCode::CALLNZ_REL:
+        case UniqueOpCode::CALLNC_REL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Always leaves the next instruction: jumps, calls, returns and svc
+inline bool nbIsBranch(UniqueOpCode opcode)
+{
+    switch (opcode)
+    {
+        case UniqueOpCode::JUMP:
+        case UniqueOpCode::CALL:
+        case UniqueOpCode::JUMP_REL:
+        case UniqueOpCode::CALL_REL:
+        case UniqueOpCode::SVC:
+        case UniqueOpCode::RET:
+        case UniqueOpCode::RETI:
+        case UniqueOpCode::RETE:
+            return true;
+        default:
+            return false;
+    }
+}
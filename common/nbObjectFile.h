@@ -0,0 +1,308 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+
+//
+//  Relocatable object files, written by nbasm -t obj and linked by nbld.
+//
+//  An object holds one or more sections of assembled words. Addresses in a
+//  section start from zero, unless it was given an address with .org, in
+//  which case it is fixed there. Anything whose encoding depends on where
+//  code ends up is left to the linker as a relocation: a span of words,
+//  what to assemble into them, and the expression giving the value, in the
+//  postfix form nbasm compiles expressions to (ExpressionOpCode in
+//  nbasm/Expression.h, with kPushSymbol's value an index into the symbol
+//  table). The linker may grow a relocation's span - a jump which can't
+//  reach relatively, or an immediate which needs an imm - moving everything
+//  after it, so every reference to a label is a relocation, not just those
+//  to other objects.
+//
+//  Everything is little endian: 32 bit fields, 16 bit words, and strings as
+//  a 32 bit length followed by the characters.
+//
+//      "NBO1"
+//      source file name
+//      sections:       count, then name, flags, address, align, word count, words
+//      symbols:        count, then name, section, value, flags, expression
+//      relocations:    count, then section, offset, kind, opcode, dest and index
+//                      registers, words, repeat, line, expression
+//      expressions:    count, then op, value
+//
+//  Expressions are a start index and length into the expression table.
+//
+
+struct nbObjectSection
+{
+    std::string                name;
+    std::uint32_t              flags     = 0;
+    std::uint32_t              address   = 0;      // if kSectionFixed
+    std::uint32_t              align     = 2;      // bytes
+    std::vector<std::uint16_t> words;
+};
+
+struct nbObjectSymbol
+{
+    std::string   name;
+    std::uint32_t section = 0;      // index, or kUndefinedSection etc. below
+    std::int32_t  value   = 0;      // byte offset into the section, or the value if absolute
+    std::uint32_t flags   = 0;
+
+    // for kExpressionSection: an equate which depends on labels
+    std::uint32_t expression       = 0;
+    std::uint32_t expressionLength = 0;
+};
+
+struct nbObjectRelocation
+{
+    std::uint32_t section = 0;
+    std::uint32_t offset  = 0;      // bytes into the section
+    std::uint32_t kind    = 0;
+    std::uint32_t opcode  = 0;      // OpCode, for instructions
+    std::uint32_t regDest = 0;      // Register
+    std::uint32_t regInd  = 0;
+    std::uint32_t words   = 0;      // words reserved in the section, all repeats
+    std::uint32_t repeat  = 1;      // .times count
+    std::uint32_t lineNum = 0;
+
+    std::uint32_t expression       = 0;
+    std::uint32_t expressionLength = 0;
+};
+
+struct nbObjectExpressionOp
+{
+    std::uint32_t op    = 0;
+    std::int32_t  value = 0;
+};
+
+enum
+{
+    // section flags
+    kSectionFixed       = 1,
+
+    // symbol flags
+    kSymbolGlobal       = 1,
+
+    // relocation kinds
+    kRelocFlowControl   = 1,    // jump or call: relative, absolute, or imm and absolute
+    kRelocImmediate     = 2,    // register and immediate, with an imm if it won't fit
+    kRelocLoadStore     = 3,    // ldw / stw with an offset, likewise
+    kRelocWord          = 4,    // dw
+    kRelocAlign         = 5,    // .align padding; the expression is the alignment
+};
+
+static const std::uint32_t kUndefinedSection  = 0xffffffff;   // defined in another object
+static const std::uint32_t kAbsoluteSection   = 0xfffffffe;   // a constant
+static const std::uint32_t kExpressionSection = 0xfffffffd;   // evaluated at link time
+
+// Sections are laid out in groups, named by the part of the section's
+// name before any '.', so text.OutByte goes with the rest of text. Giving
+// each routine a section of its own lets nbld -g drop those never used.
+inline std::string nbSectionGroup(const std::string& name)
+{
+    return name.substr(0, name.find('.', 1));
+}
+
+class nbObjectFile
+{
+public:
+
+    std::string source;
+
+    std::vector<nbObjectSection>      sections;
+    std::vector<nbObjectSymbol>       symbols;
+    std::vector<nbObjectRelocation>   relocations;
+    std::vector<nbObjectExpressionOp> expressions;
+
+    bool write(const std::string& path) const
+    {
+        std::ofstream out(path, std::ios_base::out | std::ios_base::binary);
+
+        if (! out.is_open())
+            return false;
+
+        out.write(kMagic, 4);
+
+        writeString(out, source);
+
+        write32(out, sections.size());
+
+        for (const nbObjectSection& s : sections)
+        {
+            writeString(out, s.name);
+            write32(out, s.flags);
+            write32(out, s.address);
+            write32(out, s.align);
+            write32(out, s.words.size());
+
+            for (std::uint16_t w : s.words)
+                write16(out, w);
+        }
+
+        write32(out, symbols.size());
+
+        for (const nbObjectSymbol& s : symbols)
+        {
+            writeString(out, s.name);
+            write32(out, s.section);
+            write32(out, s.value);
+            write32(out, s.flags);
+            write32(out, s.expression);
+            write32(out, s.expressionLength);
+        }
+
+        write32(out, relocations.size());
+
+        for (const nbObjectRelocation& r : relocations)
+        {
+            write32(out, r.section);
+            write32(out, r.offset);
+            write32(out, r.kind);
+            write32(out, r.opcode);
+            write32(out, r.regDest);
+            write32(out, r.regInd);
+            write32(out, r.words);
+            write32(out, r.repeat);
+            write32(out, r.lineNum);
+            write32(out, r.expression);
+            write32(out, r.expressionLength);
+        }
+
+        write32(out, expressions.size());
+
+        for (const nbObjectExpressionOp& e : expressions)
+        {
+            write32(out, e.op);
+            write32(out, e.value);
+        }
+
+        return (bool)out;
+    }
+
+    // Returns false if the file can't be read or isn't an object
+    bool read(const std::string& path)
+    {
+        std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+
+        char magic[4];
+
+        if (! in.read(magic, 4) || std::string(magic, 4) != std::string(kMagic, 4))
+            return false;
+
+        source = readString(in);
+
+        sections.resize(readCount(in));
+
+        for (nbObjectSection& s : sections)
+        {
+            s.name    = readString(in);
+            s.flags   = read32(in);
+            s.address = read32(in);
+            s.align   = read32(in);
+
+            s.words.resize(readCount(in));
+
+            for (std::uint16_t& w : s.words)
+                w = read16(in);
+        }
+
+        symbols.resize(readCount(in));
+
+        for (nbObjectSymbol& s : symbols)
+        {
+            s.name             = readString(in);
+            s.section          = read32(in);
+            s.value            = read32(in);
+            s.flags            = read32(in);
+            s.expression       = read32(in);
+            s.expressionLength = read32(in);
+        }
+
+        relocations.resize(readCount(in));
+
+        for (nbObjectRelocation& r : relocations)
+        {
+            r.section          = read32(in);
+            r.offset           = read32(in);
+            r.kind             = read32(in);
+            r.opcode           = read32(in);
+            r.regDest          = read32(in);
+            r.regInd           = read32(in);
+            r.words            = read32(in);
+            r.repeat           = read32(in);
+            r.lineNum          = read32(in);
+            r.expression       = read32(in);
+            r.expressionLength = read32(in);
+        }
+
+        expressions.resize(readCount(in));
+
+        for (nbObjectExpressionOp& e : expressions)
+        {
+            e.op    = read32(in);
+            e.value = read32(in);
+        }
+
+        return (bool)in;
+    }
+
+private:
+
+    static constexpr const char* kMagic = "NBO1";
+
+    // counts beyond this are taken as a corrupt file rather than allocated
+    static const std::uint32_t kMaxCount = 16 * 1024 * 1024;
+
+    static void write16(std::ostream& out, std::uint16_t value)
+    {
+        char bytes[2] = { (char)value, (char)(value >> 8) };
+        out.write(bytes, 2);
+    }
+
+    static void write32(std::ostream& out, std::uint32_t value)
+    {
+        write16(out, value & 0xffff);
+        write16(out, value >> 16);
+    }
+
+    static void writeString(std::ostream& out, const std::string& string)
+    {
+        write32(out, string.size());
+        out.write(string.data(), string.size());
+    }
+
+    static std::uint16_t read16(std::istream& in)
+    {
+        unsigned char bytes[2] = {};
+        in.read((char*)bytes, 2);
+        return bytes[0] | (bytes[1] << 8);
+    }
+
+    static std::uint32_t read32(std::istream& in)
+    {
+        std::uint32_t low = read16(in);
+        return low | ((std::uint32_t)read16(in) << 16);
+    }
+
+    static std::uint32_t readCount(std::istream& in)
+    {
+        std::uint32_t count = read32(in);
+
+        if (count > kMaxCount)
+        {
+            in.setstate(std::ios_base::failbit);
+            return 0;
+        }
+
+        return count;
+    }
+
+    static std::string readString(std::istream& in)
+    {
+        std::string string(readCount(in), '\0');
+        in.read(&string[0], string.size());
+        return string;
+    }
+};
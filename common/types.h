@@ -212,4 +212,6 @@ inline std::ostream& operator << (std::ostream& os, const Register& r)
         else
             os << "s" << std::dec << std::setw(2) << std::setfill('0') << ((uint32_t)r - 16);
     }
+
+    return os;
 }
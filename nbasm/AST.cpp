@@ -7,92 +7,98 @@
 #include <utility>
 #include <cstdint>
 #include <iomanip>
+#include <set>
 #include <fstream>
+#include <algorithm>
+#include <unordered_map>
 
 #include "AST.h"
+#include "nbObjectFile.h"
+#include "nbInstructionDecodeTable.h"
+#include "nbInstructionTiming.h"
 
 void AST::addPlusToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kPlus;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addMinusToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kMinus;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addLeftParenthesisToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kLeftParenthesis;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addRightParenthesisToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kRightParenthesis;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addDivToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kDiv;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addMultToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kMult;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addShiftLeftToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kShiftLeft;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addShiftRightToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kShiftRight;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addAndToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kAnd;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addOrToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kOr;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addXorToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kXor;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addNotToCurrentStatementExpression()
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kNot;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addIntToCurrentStatementExpression(int val)
@@ -100,7 +106,7 @@ void AST::addIntToCurrentStatementExpression(int val)
     ExpressionElement e;
     e.elem = ExpressionElementType::kInt;
     e.v.sval = val;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
 void AST::addUIntToCurrentStatementExpresion(unsigned int val)
@@ -108,85 +114,94 @@ void AST::addUIntToCurrentStatementExpresion(unsigned int val)
     ExpressionElement e;
     e.elem = ExpressionElementType::kUInt;
     e.v.uval = val;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
-void AST::addStringToCurrentStatementExpression(char* string)
+void AST::addStringToCurrentStatementExpression(const char* string)
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kString;
-    e.v.string = string;
-    m_currentStatement.expression.addElement(e);
+    e.v.symbol = m_symbolTable.get(string);
+    m_currentElements.push_back(e);
 }
 
-void AST::addStringLiteralToCurrentStatementExpression(char* string)
+void AST::addStringLiteralToCurrentStatementExpression(const char* string)
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kStringLiteral;
     e.v.string = string;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
 }
 
-void AST::addCharLiteralToCurrentStatementExpression(char* string)
+void AST::addCharLiteralToCurrentStatementExpression(const char* string)
 {
     ExpressionElement e;
     e.elem = ExpressionElementType::kCharLiteral;
     e.v.string = string;
-    m_currentStatement.expression.addElement(e);
+    m_currentElements.push_back(e);
+}
+
+void AST::addCurrentStatement()
+{
+    Statement* s = m_arena.make<Statement>(m_currentStatement);
+
+    s->arena = &m_arena;
+    s->section = m_currentSection;
+    s->expression.build(m_arena, m_currentElements);
+
+    m_statements.push_back(s);
+
+    m_currentStatement.reset();
+    m_currentElements.clear();
 }
 
-void AST::addTwoRegisterOpcode(int linenum, char* opcode, char* regDest, char* regSrc)
+void AST::addTwoRegisterOpcode(int linenum, const char* opcode, const char* regDest, const char* regSrc)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.opcode = convertOpCode(opcode);
     m_currentStatement.regSrc = convertReg(regSrc);
     m_currentStatement.regDest = convertReg(regDest);
     m_currentStatement.type = StatementType::TWO_REGISTER_OPCODE;
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
 }
 
-void AST::addOneRegisterAndExpressionOpcode(int linenum, char* opcode, char* regDest)
+void AST::addOneRegisterAndExpressionOpcode(int linenum, const char* opcode, const char* regDest)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.opcode = convertOpCode(opcode);
     m_currentStatement.regDest = convertReg(regDest);
     m_currentStatement.type = StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION;
     m_currentStatement.expression.lineNum = linenum;
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
 }
 
-void AST::addExpressionOpcode(int linenum, char* opcode)
+void AST::addExpressionOpcode(int linenum, const char* opcode)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.opcode = convertOpCode(opcode);
     m_currentStatement.type = StatementType::OPCODE_WITH_EXPRESSION;
     m_currentStatement.expression.lineNum = linenum;
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
 }
 
-void AST::addStandaloneOpcode(int linenum, char* opcode)
+void AST::addStandaloneOpcode(int linenum, const char* opcode)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.opcode = convertOpCode(opcode);
     m_currentStatement.type = StatementType::STANDALONE_OPCODE;
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
 }
 
-void AST::addExpressionPseudoOp(int linenum, char* pseudoOp)
+void AST::addExpressionPseudoOp(int linenum, const char* pseudoOp)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.pseudoOp = convertPseudoOp(pseudoOp);
     m_currentStatement.expression.lineNum = linenum;
     m_currentStatement.type = StatementType::PSEUDO_OP_WITH_EXPRESSION;
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
 }
 
-void AST::addIndirectAddressingOpcode(int linenum, char* opcode, char* regDest, char* regIdx, char* regOffset)
+void AST::addIndirectAddressingOpcode(int linenum, const char* opcode, const char* regDest, const char* regIdx, const char* regOffset)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.opcode = convertOpCode(opcode);
@@ -194,11 +209,10 @@ void AST::addIndirectAddressingOpcode(int linenum, char* opcode, char* regDest,
     m_currentStatement.regDest = convertReg(regDest);
     m_currentStatement.regInd = convertReg(regIdx);
     m_currentStatement.regOffset = convertReg(regOffset);
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
 }
 
-void AST::addIndirectAddressingOpcodeWithExpression(int linenum, char* opcode, char* regDest, char* regIdx)
+void AST::addIndirectAddressingOpcodeWithExpression(int linenum, const char* opcode, const char* regDest, const char* regIdx)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.opcode = convertOpCode(opcode);
@@ -206,49 +220,75 @@ void AST::addIndirectAddressingOpcodeWithExpression(int linenum, char* opcode, c
     m_currentStatement.regDest = convertReg(regDest);
     m_currentStatement.regInd = convertReg(regIdx);
     m_currentStatement.expression.lineNum = linenum;
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
 }
 
-void AST::addOneRegisterOpcode(int linenum, char* opcode, char* regDest)
+void AST::addOneRegisterOpcode(int linenum, const char* opcode, const char* regDest)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.opcode = convertOpCode(opcode);
     m_currentStatement.regDest = convertReg(regDest);
     m_currentStatement.type = StatementType::ONE_REGISTER_OPCODE;
     m_currentStatement.expression.lineNum = linenum;
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
 }
 
-void AST::addLabel(int linenum, char* label)
+void AST::addDirective(int linenum, const char* directive, const char* name)
+{
+    if (std::string(directive) == ".section")
+    {
+        for (m_currentSection = 0; m_currentSection < m_sections.size(); m_currentSection++)
+            if (std::string(m_sections[m_currentSection]) == name)
+                return;
+
+        m_sections.push_back(name);
+        return;
+    }
+
+    m_currentStatement.lineNum = linenum;
+    m_currentStatement.label = name;
+    m_currentStatement.type = std::string(directive) == ".loop" ? StatementType::LOOP : StatementType::GLOBAL;
+    addCurrentStatement();
+}
+
+void AST::addLabel(int linenum, const char* label)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.label = label;
     m_currentStatement.type = StatementType::LABEL;
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
 }
 
 void AST::addTimes(int linenum)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.type = StatementType::TIMES;
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
 }
 
-void AST::addEqu(int linenum, char* label)
+void AST::addEqu(int linenum, const char* label)
 {
     m_currentStatement.lineNum = linenum;
     m_currentStatement.type = StatementType::EQU;
     m_currentStatement.expression.lineNum = linenum;
     m_currentStatement.label = label;
-    m_statements.push_back(m_currentStatement);
-    m_currentStatement.reset();
+    addCurrentStatement();
+}
+
+void AST::addLiteral(int linenum, const char* label)
+{
+    m_currentStatement.lineNum = linenum;
+    m_currentStatement.type = StatementType::LITERAL;
+    m_currentStatement.expression.lineNum = linenum;
+    m_currentStatement.label = label;
+    addCurrentStatement();
+
+    // kept aside, until buildLiteralPool() places it
+    m_literals.push_back(m_statements.back());
+    m_statements.pop_back();
 }
 
-OpCode AST::convertOpCode(char* opcode)
+OpCode AST::convertOpCode(const char* opcode)
 {
     std::string s(opcode);
 
@@ -492,7 +532,7 @@ OpCode AST::convertOpCode(char* opcode)
 
 }
 
-PseudoOp AST::convertPseudoOp(char* pseudoOp)
+PseudoOp AST::convertPseudoOp(const char* pseudoOp)
 {
 
     std::string s(pseudoOp);
@@ -519,7 +559,7 @@ PseudoOp AST::convertPseudoOp(char* pseudoOp)
 
 }
 
-Register AST::convertReg(char* reg)
+Register AST::convertReg(const char* reg)
 {
 
     std::string s(reg);
@@ -661,8 +701,8 @@ Register AST::convertReg(char* reg)
 
 std::ostream& operator << (std::ostream& os, const AST& ast)
 {
-    for (const Statement& s : ast.m_statements)
-        os << s;
+    for (const Statement* s : ast.m_statements)
+        os << *s;
 
     return os;
 }
@@ -707,6 +747,17 @@ std::ostream& operator << (std::ostream& os, const Statement& s)
         case StatementType::EQU:
             os << "EQU" << " " << s.label << " " << s.expression << std::endl;
         break;
+        case StatementType::GLOBAL:
+            os << ".global" << " " << s.label << std::endl;
+        break;
+        case StatementType::LOOP:
+            os << ".loop" << " " << s.label << std::endl;
+        break;
+        case StatementType::LITERAL:
+            os << ".literal" << " " << s.label << " " << s.expression << std::endl;
+        break;
+        case StatementType::None:
+        break;
     }
 
     return os;
@@ -760,6 +811,8 @@ std::ostream& operator << (std::ostream& os, const ExpressionElement& elem)
             os << elem.v.uval;
             break;
         case ExpressionElementType::kString:
+            os << elem.v.symbol->string;
+            break;
         case ExpressionElementType::kStringLiteral:
         case ExpressionElementType::kCharLiteral:
             os << elem.v.string;
@@ -771,9 +824,9 @@ std::ostream& operator << (std::ostream& os, const ExpressionElement& elem)
 
 std::ostream& operator << (std::ostream& os, const Expression& e)
 {
-    for (ExpressionElement elem : e.elements)
+    for (uint32_t i = 0; i < e.numElements; i++)
     {
-        os << elem;
+        os << e.elements[i];
     }
     return os;
 }
@@ -1040,82 +1093,253 @@ std::ostream& operator << (std::ostream& os, const Symbol& sym)
 {
     os << "Symbol : " << sym.string << " " << "Defined in: " << sym.definedIn;
     os << " Referred to by: ";
-    for (Statement* s : sym.referredBy)
-        os << s << " ";
+    for (SymbolReference* ref = sym.referredBy; ref != nullptr; ref = ref->next)
+        os << ref->statement << " ";
     os << " Evaluated: " << sym.evaluated << " value: " << sym.value;
     return os;
 }
 
-void AST::buildSymbolTable()
+void AST::buildLiteralPool()
 {
-    // iterate over all statements and add symbols
+    // Gather the .literal strings into a pool, in a section of its own so
+    // they aren't scattered through the code. A string which is the same as
+    // another, or the end of a longer one, isn't stored again: its name is
+    // an equate for where it starts in the other. The pool is aligned to
+    // kLiteralPoolAlign, so a base register pointing at it reaches the start
+    // of it with the four bit offset of a load, without an imm.
+    //
+    // Each string in the pool becomes a label and dws, and each shared one
+    // an equate, so from here on they are assembled, relaxed and linked
+    // like any other.
+
+    if (m_literals.empty())
+        return;
+
+    const int kLiteralPoolAlign = 16;
+
+    // the words each holds, with its terminator
 
-    for (Statement& s : m_statements)
+    std::vector<std::vector<uint16_t>> words(m_literals.size());
+
+    for (std::size_t i = 0; i < m_literals.size(); i++)
     {
-        // 1. add all labels
-        // 2. add all equates
-        if (s.type == StatementType::LABEL ||
-            s.type == StatementType::EQU)
+        const char* stringLit;
+
+        if (! m_literals[i]->expression.isStringLiteral(stringLit))
         {
-            Symbol sym;
-            sym.definedIn = &s;
-            sym.string = s.label;
+            std::stringstream ss;
+            ss << ".literal needs a string on line " << m_literals[i]->lineNum << std::endl;
+            throw std::runtime_error(ss.str());
+        }
 
-            bool found = true;
+        char* substitutedString = Expression::substituteSpecialChars(stringLit);
 
-            // check to see if symbol already exists?
-            try
+        uint32_t len = Expression::stringLength(substitutedString);
+
+        for (uint32_t j = 0; j < len; j++)
+            words[i].push_back((uint16_t)substitutedString[j]);
+
+        words[i].push_back(0);
+
+        delete [] substitutedString;
+    }
+
+    // Longest first, so each is only looked for in those already stored.
+    // Those stored keep the order they were written in.
+
+    std::vector<std::size_t> order(m_literals.size());
+
+    for (std::size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [&] (std::size_t a, std::size_t b)
+    {
+        return words[a].size() > words[b].size();
+    });
+
+    const std::size_t kNone = (std::size_t)-1;
+
+    std::vector<std::size_t> storedIn(m_literals.size(), kNone);
+
+    for (std::size_t i : order)
+    {
+        for (std::size_t j : order)
+        {
+            if (words[j].size() < words[i].size())
+                break;
+
+            if (j == i || storedIn[j] != j)
+                continue;
+
+            if (std::equal(words[i].begin(), words[i].end(), words[j].end() - words[i].size()))
+            {
+                storedIn[i] = j;
+                break;
+            }
+        }
+
+        if (storedIn[i] == kNone)
+            storedIn[i] = i;
+    }
+
+    // the pool goes after everything else
+
+    uint16_t section = m_currentSection;
+
+    for (m_currentSection = 0; m_currentSection < m_sections.size(); m_currentSection++)
+        if (std::string(m_sections[m_currentSection]) == "literal")
+            break;
+
+    if (m_currentSection == m_sections.size())
+        m_sections.push_back("literal");
+
+    int lineNum = m_literals[0]->lineNum;
+
+    addIntToCurrentStatementExpression(kLiteralPoolAlign);
+    addExpressionPseudoOp(lineNum, ".align");
+
+    for (std::size_t i = 0; i < m_literals.size(); i++)
+    {
+        Statement* s = m_literals[i];
+
+        if (storedIn[i] == i)
+        {
+            addLabel(s->lineNum, s->label);
+
+            m_currentElements.push_back(s->expression.elements[0]);
+            addExpressionPseudoOp(s->lineNum, "dw");
+
+            addIntToCurrentStatementExpression(0);
+            addExpressionPseudoOp(s->lineNum, "dw");
+        }
+        else
+        {
+            const std::vector<uint16_t>& in = words[storedIn[i]];
+
+            addStringToCurrentStatementExpression(m_literals[storedIn[i]]->label);
+
+            if (in.size() != words[i].size())
             {
-                m_symbolTable.at(s.label);
+                addPlusToCurrentStatementExpression();
+                addIntToCurrentStatementExpression((in.size() - words[i].size()) * sizeof(uint16_t));
             }
-            catch (...)
+
+            addEqu(s->lineNum, s->label);
+        }
+    }
+
+    m_currentSection = section;
+    m_literals.clear();
+}
+
+void AST::buildSymbolTable()
+{
+    buildLiteralPool();
+
+    // gather each section's statements together, and sections in the same group (see
+    // nbSectionGroup()) together, in the order they first appear, as nbld would
+
+    if (m_sections.size() > 1)
+    {
+        std::vector<uint16_t> group(m_sections.size());
+
+        for (uint16_t i = 0; i < m_sections.size(); i++)
+        {
+            group[i] = i;
+
+            for (uint16_t j = 0; j < i; j++)
             {
-                found = false;
+                if (nbSectionGroup(m_sections[j]) == nbSectionGroup(m_sections[i]))
+                {
+                    group[i] = group[j];
+                    break;
+                }
             }
+        }
+
+        std::stable_sort(m_statements.begin(), m_statements.end(), [&] (const Statement* a, const Statement* b)
+        {
+            if (group[a->section] != group[b->section])
+                return group[a->section] < group[b->section];
+
+            return a->section < b->section;
+        });
+    }
+
+    // iterate over all statements and add symbols
+
+    for (Statement* s : m_statements)
+    {
+        if (s->type == StatementType::GLOBAL)
+        {
+            m_symbolTable.get(s->label)->global = true;
+            continue;
+        }
+
+        if (s->type == StatementType::LOOP)
+        {
+            m_loops.push_back(s);
+            continue;
+        }
+
+        // 1. add all labels
+        // 2. add all equates
+        if (s->type == StatementType::LABEL ||
+            s->type == StatementType::EQU)
+        {
+            Symbol* sym = m_symbolTable.get(s->label);
 
-            if (found)
+            // check to see if symbol already exists?
+            if (sym->definedIn != nullptr)
             {
                 std::stringstream ss;
-                ss << "Symbol '" << s.label << "' redefined on line " << s.lineNum << std::endl;
+                ss << "Symbol '" << s->label << "' redefined on line " << s->lineNum << std::endl;
                 throw std::runtime_error(ss.str());
             }
 
-            m_symbolTable.emplace(s.label, sym);
-            m_symbolList.push_back(&m_symbolTable.at(s.label));
+            sym->definedIn = s;
+            m_symbolList.push_back(sym);
         }
     }
 
     // find all references to each symbol
 
-    for (Statement& s : m_statements)
+    for (Statement* s : m_statements)
     {
-        switch(s.type)
+        switch(s->type)
         {
             case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
             case StatementType::OPCODE_WITH_EXPRESSION:
+            case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
             case StatementType::PSEUDO_OP_WITH_EXPRESSION:
             case StatementType::TIMES:
             {
-                // find any string in the expression, which could be a symbol
-                for (ExpressionElement& e : s.expression.elements)
+                // the parser looked up every name in the expression; make sure they were all defined
+                for (uint32_t i = 0; i < s->expression.numElements; i++)
                 {
+                    const ExpressionElement& e = s->expression.elements[i];
 
                     if (e.elem == ExpressionElementType::kString)
                     {
-                        Symbol* sym = nullptr;
+                        Symbol* sym = e.v.symbol;
 
-                        try
+                        if (sym->definedIn == nullptr && m_sharedSymbols != nullptr)
+                            defineSharedSymbol(sym);
+
+                        if (sym->definedIn == nullptr && m_relocatable)
                         {
-                            sym = &m_symbolTable.at(e.v.string);
+                            // imported, for the linker to find
+                            if (sym->referredBy == nullptr)
+                                m_imports.push_back(sym);
                         }
-                        catch (std::out_of_range)
+                        else if (sym->definedIn == nullptr)
                         {
                             std::stringstream ss;
-                            ss << "Undefined symbol '" << e.v.string << "' on line " << s.lineNum << std::endl;
+                            ss << "Undefined symbol '" << sym->string << "' on line " << s->lineNum << std::endl;
                             throw std::runtime_error(ss.str());
                         }
 
-                        sym->referredBy.push_back(&s);
+                        m_symbolTable.addReference(sym, s);
                     }
                 }
                 break;
@@ -1126,141 +1350,966 @@ void AST::buildSymbolTable()
         }
     }
 
+    for (Statement* s : m_loops)
+    {
+        Symbol* sym = m_symbolTable.get(s->label);
+
+        if (sym->definedIn == nullptr || sym->definedIn->type != StatementType::LABEL)
+        {
+            std::stringstream ss;
+            ss << ".loop '" << s->label << "' is not a label on line " << s->lineNum << std::endl;
+            throw std::runtime_error(ss.str());
+        }
+    }
+
+    orderEquates();
+
+    if (m_relocatable)
+        findRelocations();
+
 }
 
-void AST::printSymbolTable()
+bool AST::defineSharedSymbol(Symbol* sym)
 {
-    for (std::pair<const std::string, Symbol>& sp : m_symbolTable)
-        std::cout << sp.second << std::endl;
+    SharedSymbols::const_iterator it = m_sharedSymbols->find(sym->string);
+
+    if (it == m_sharedSymbols->end())
+        return false;
+
+    // as if "<name> equ <value>" were in this file; not added to m_statements,
+    // which is being walked
+
+    Statement* s = m_arena.make<Statement>();
+
+    s->arena = &m_arena;
+    s->type  = StatementType::EQU;
+    s->label = sym->string;
+
+    ExpressionElement e;
+    e.elem = ExpressionElementType::kInt;
+    e.v.sval = it->second;
+
+    s->expression.build(m_arena, std::vector<ExpressionElement> { e });
+
+    sym->definedIn = s;
+    m_symbolList.push_back(sym);
+
+    return true;
 }
 
-void AST::firstPassAssemble()
+void AST::exportConstants(SharedSymbols& constants) const
 {
+    for (const Symbol* sym : m_symbolList)
+    {
+        if (sym->definedIn->type == StatementType::EQU && sym->constant)
+            constants[sym->string] = sym->value;
+    }
+}
 
-    bool assemblyStarted = false;
-    bool orgParsed = false;
-    uint32_t curAddress = 0;
-    bool isTimes = false;
-    Statement* timesStatement = nullptr;
+void AST::orderEquates()
+{
 
-    // Iterate over all statements, insert dummy assembly for each statement, so that in the next
-    // stage, the symbols which refer to an address can be resolved.
+    // Equates can refer to equates defined later, so put them in dependency order:
+    // depth first over each equate's references, adding it once everything it uses
+    // has been added. Those which don't depend on a label never change, so they are
+    // evaluated here, once; the rest are evaluated with every layout.
 
-    for (Statement& s : m_statements)
+    enum
     {
-        switch (s.type)
+        kNotVisited = 0,
+        kVisiting,
+        kVisited
+    };
+
+    struct Frame
+    {
+        Symbol*  sym;
+        uint32_t element;   // next expression element to look at
+        bool     constant;
+    };
+
+    std::vector<Frame> stack;
+
+    for (Symbol* root : m_symbolList)
+    {
+        if (root->definedIn->type != StatementType::EQU || root->visit != kNotVisited)
+            continue;
+
+        root->visit = kVisiting;
+        stack.push_back({root, 0, true});
+
+        while (! stack.empty())
         {
-            case StatementType::LABEL:
-                s.address = curAddress;
-                isTimes = false;
-                break;
-            case StatementType::EQU:
-                isTimes = false;
-                break;
-            case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
-            case StatementType::OPCODE_WITH_EXPRESSION:
-            case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
-                assemblyStarted = true;
+            Frame& frame = stack.back();
+            const Expression& expression = frame.sym->definedIn->expression;
 
-                if (isTimes)
-                {
-                    s.timesStatement = timesStatement;
-                }
+            if (frame.element == expression.numElements)
+            {
+                Symbol* sym = frame.sym;
 
-                s.firstPassAssemble(curAddress, m_symbolTable);
-                isTimes = false;
-                break;
-            case StatementType::ONE_REGISTER_OPCODE:
-            case StatementType::TWO_REGISTER_OPCODE:
-            case StatementType::STANDALONE_OPCODE:
-            case StatementType::INDIRECT_ADDRESSING_OPCODE:
-                assemblyStarted = true;
-                // we can directly assemble the instruction.
+                sym->visit    = kVisited;
+                sym->constant = frame.constant;
 
-                if (isTimes)
+                if (sym->constant)
                 {
-                    s.timesStatement = timesStatement;
-                }
+                    if (! sym->definedIn->expression.evaluate(sym->value))
+                    {
+                        std::stringstream ss;
+                        ss << "could not evaluate expression on line " << sym->definedIn->lineNum << std::endl;
+                        throw std::runtime_error(ss.str());
+                    }
 
-                s.assemble(curAddress);
-                isTimes = false;
-                break;
-            case StatementType::PSEUDO_OP_WITH_EXPRESSION:
+                    sym->evaluated = true;
+                }
 
-                switch (s.pseudoOp)
-                {
-                    case PseudoOp::ORG:
-                        if (assemblyStarted)
-                        {
-                            std::stringstream ss;
-                            ss << ".org statement after assembly started on line " << s.lineNum << std::endl;
-                            throw std::runtime_error(ss.str());
-                        }
-                        if (orgParsed)
-                        {
-                            std::stringstream ss;
-                            ss << ".org statement already processed at this point, on line " << s.lineNum << std::endl;
-                            throw std::runtime_error(ss.str());
-                        }
-                        if (isTimes)
-                        {
-                            std::stringstream ss;
-                            ss << ".org statement preceded by times, on line " << s.lineNum << std::endl;
-                            throw std::runtime_error(ss.str());
-                        }
+                m_equates.push_back(sym);
+                stack.pop_back();
 
-                        if (! s.expression.evaluate(m_orgAddress, m_symbolTable))
-                        {
-                            std::stringstream ss;
-                            ss << ".org statement cannot be evaluated on line " << s.lineNum << std::endl;
-                            throw std::runtime_error(ss.str());
-                        }
+                continue;
+            }
 
-                        curAddress = (uint32_t)m_orgAddress;
+            const ExpressionElement& e = expression.elements[frame.element];
 
-                        break;
-                    default:
+            if (e.elem != ExpressionElementType::kString)
+            {
+                frame.element++;
+                continue;
+            }
 
-                        if (isTimes)
-                        {
-                            s.timesStatement = timesStatement;
-                        }
+            Symbol* dep = e.v.symbol;
 
-                        s.firstPassAssemble(curAddress, m_symbolTable);
-                }
+            if (dep->definedIn == nullptr || dep->definedIn->type == StatementType::LABEL)
+            {
+                frame.constant = false;
+                frame.element++;
+                continue;
+            }
 
-                isTimes = false;
-                break;
-            case StatementType::TIMES:
+            if (dep->visit == kVisiting)
+            {
+                std::stringstream ss;
+                ss << "Circular definition of symbol '" << dep->string << "' on line " << dep->definedIn->lineNum << ": ";
 
-                timesStatement = &s;
+                bool inCycle = false;
 
-                if (! s.expression.evaluate(s.expression.value, m_symbolTable))
+                for (const Frame& f : stack)
                 {
-                    std::stringstream ss;
-                    ss << ".times statement cannot be evaluated on line " << s.lineNum << std::endl;
-                    throw std::runtime_error(ss.str());
+                    if (f.sym == dep)
+                        inCycle = true;
+
+                    if (inCycle)
+                        ss << f.sym->string << " -> ";
                 }
 
-                isTimes = true;
+                ss << dep->string << std::endl;
+                throw std::runtime_error(ss.str());
+            }
 
-                break;
-            default:
-                break;
+            if (dep->visit == kNotVisited)
+            {
+                // come back to this element once it's done
+                dep->visit = kVisiting;
+                stack.push_back({dep, 0, true});
+                continue;
+            }
+
+            frame.constant = frame.constant && dep->constant;
+            frame.element++;
         }
     }
+
 }
 
-void AST::resolveSymbols()
+bool AST::isConstant(const Expression& expression) const
 {
+    // true if the expression only uses equates which don't depend on a label
 
-    // Iterate over all symbols and resolve their values
+    for (uint32_t i = 0; i < expression.numElements; i++)
+    {
+        const ExpressionElement& e = expression.elements[i];
 
-    // 1. get address of all labels
+        if (e.elem != ExpressionElementType::kString)
+            continue;
 
-    for (Symbol* sym : m_symbolList)
-    {
-        Statement* statement = sym->definedIn;
+        Symbol* sym = e.v.symbol;
+
+        if (sym->definedIn == nullptr || sym->definedIn->type != StatementType::EQU || ! sym->constant)
+            return false;
+    }
+
+    return true;
+}
+
+void AST::findRelocations()
+{
+
+    // In an object, nothing is known about where a label ends up: the linker can place
+    // sections anywhere, and relax the code in front of it. So it assembles jumps and
+    // calls, which are encoded relative to their own address, anything using a label or
+    // an import, and alignment padding. The first pass gives these their short forms.
+
+    for (Statement* s : m_statements)
+    {
+        const char* stringLit;
+
+        switch (s->type)
+        {
+            case StatementType::OPCODE_WITH_EXPRESSION:
+                s->relocated = s->isSpanDependent();
+                break;
+            case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
+            case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
+                s->relocated = ! isConstant(s->expression);
+                break;
+            case StatementType::PSEUDO_OP_WITH_EXPRESSION:
+
+                switch (s->pseudoOp)
+                {
+                    case PseudoOp::ALIGN:
+                        s->relocated = true;
+                        break;
+                    case PseudoOp::DW:
+                        s->relocated = ! s->expression.isStringLiteral(stringLit) && ! isConstant(s->expression);
+                        break;
+                    default:
+                        break;
+                }
+
+                break;
+            default:
+                break;
+        }
+    }
+
+}
+
+void AST::printSymbolTable()
+{
+    for (Symbol* sym : m_symbolList)
+        std::cout << *sym << std::endl;
+}
+
+// How an instruction uses a general purpose register, for optimise()
+enum class RegisterUse
+{
+    kNone,
+    kRead,
+    kWritten,       // without being read first
+    kUnknown,       // flow control and I/O: anything could happen after
+};
+
+static RegisterUse registerUse(const Statement* s, Register reg)
+{
+    switch (s->opcode)
+    {
+        case OpCode::OUT:
+        case OpCode::IN:
+        case OpCode::LDSPR:
+        case OpCode::STSPR:
+            return RegisterUse::kUnknown;
+        default:
+            break;
+    }
+
+    bool dest = s->regDest == reg;
+
+    switch (s->type)
+    {
+        case StatementType::TWO_REGISTER_OPCODE:
+        case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
+        {
+            bool src = s->type == StatementType::TWO_REGISTER_OPCODE && s->regSrc == reg;
+
+            if (src)
+                return RegisterUse::kRead;
+
+            // everything else reads its destination before writing it, or only reads it
+            if (s->opcode == OpCode::LOAD)
+                return dest ? RegisterUse::kWritten : RegisterUse::kNone;
+
+            return dest ? RegisterUse::kRead : RegisterUse::kNone;
+        }
+        case StatementType::ONE_REGISTER_OPCODE:
+            return dest ? RegisterUse::kRead : RegisterUse::kNone;
+        case StatementType::INDIRECT_ADDRESSING_OPCODE:
+        case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
+            if (s->regInd == reg || (s->type == StatementType::INDIRECT_ADDRESSING_OPCODE && s->regOffset == reg))
+                return RegisterUse::kRead;
+
+            if (dest)
+                return s->opcode == OpCode::LDW ? RegisterUse::kWritten : RegisterUse::kRead;
+
+            return RegisterUse::kNone;
+        case StatementType::STANDALONE_OPCODE:
+            return s->opcode == OpCode::NOP ? RegisterUse::kNone : RegisterUse::kUnknown;
+        default:
+            return RegisterUse::kUnknown;
+    }
+}
+
+static bool isJump(OpCode opcode)
+{
+    switch (opcode)
+    {
+        case OpCode::JUMP:
+        case OpCode::JUMPZ:
+        case OpCode::JUMPC:
+        case OpCode::JUMPNZ:
+        case OpCode::JUMPNC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Sets both carry and zero without reading either
+static bool setsFlags(const Statement* s)
+{
+    if (s->type != StatementType::TWO_REGISTER_OPCODE &&
+        s->type != StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION)
+        return false;
+
+    switch (s->opcode)
+    {
+        case OpCode::ADD:
+        case OpCode::SUB:
+        case OpCode::AND:
+        case OpCode::OR:
+        case OpCode::XOR:
+        case OpCode::CMP:
+        case OpCode::TEST:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void AST::optimise()
+{
+
+    // Peephole optimisation, on the statements as parsed, before anything has an address:
+    // what is removed here just isn't laid out, so labels stay consistent through
+    // relaxation. Only instructions with nothing but equates between them are looked at
+    // together, as control can arrive at a label from anywhere; a register or the flags
+    // are only taken to be dead if an instruction following overwrites them before
+    // anything reads them, or control can leave.
+    //
+    //      load rX, rX                             removed
+    //      jump L / L:                             the jump removed, and likewise conditional ones
+    //      load rX, a / load rX, b                 the first removed, if b isn't rX
+    //      load rX, 0 / add rX, b                  load rX, b; and for or and xor; if the flags
+    //                                              are dead
+    //      load rX, rA / op rX, b / load rC, rX    load rC, rA / op rC, b, if rX is dead; as
+    //                                              nbcc compiles each operation
+    //
+    // relax() then also shrinks any immediate or jump which no longer needs its long form
+    // once everything has moved up.
+
+    m_optimised = true;
+
+    std::vector<Statement*>& statements = m_statements;
+    std::vector<bool> removed(statements.size(), false);
+
+    const std::size_t kNone = statements.size();
+
+    auto isInstruction = [&] (std::size_t i) -> bool
+    {
+        switch (statements[i]->type)
+        {
+            case StatementType::TWO_REGISTER_OPCODE:
+            case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
+            case StatementType::ONE_REGISTER_OPCODE:
+            case StatementType::INDIRECT_ADDRESSING_OPCODE:
+            case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
+            case StatementType::OPCODE_WITH_EXPRESSION:
+            case StatementType::STANDALONE_OPCODE:
+                // the one after a .times is repeated, so is left alone
+                return i == 0 || statements[i - 1]->type != StatementType::TIMES;
+            default:
+                return false;
+        }
+    };
+
+    // the next statement left which emits anything or can be jumped to
+    auto next = [&] (std::size_t i) -> std::size_t
+    {
+        for (i++; i < statements.size(); i++)
+        {
+            if (! removed[i] && statements[i]->type != StatementType::EQU &&
+                statements[i]->type != StatementType::GLOBAL && statements[i]->type != StatementType::LOOP)
+                return i;
+        }
+
+        return kNone;
+    };
+
+    // the next instruction, if it always follows this one
+    auto following = [&] (std::size_t i) -> std::size_t
+    {
+        std::size_t j = next(i);
+
+        if (j == kNone || ! isInstruction(j) || statements[j]->section != statements[i]->section)
+            return kNone;
+
+        return j;
+    };
+
+    auto isDeadAfter = [&] (std::size_t i, Register reg) -> bool
+    {
+        for (std::size_t j = following(i); j != kNone; j = following(j))
+        {
+            RegisterUse use = registerUse(statements[j], reg);
+
+            if (use == RegisterUse::kWritten)
+                return true;
+
+            if (use != RegisterUse::kNone)
+                return false;
+        }
+
+        return false;
+    };
+
+    auto isLoad = [&] (const Statement* s) -> bool
+    {
+        return s->opcode == OpCode::LOAD && (s->type == StatementType::TWO_REGISTER_OPCODE ||
+                                             s->type == StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION);
+    };
+
+    auto isLoadZero = [&] (Statement* s) -> bool
+    {
+        int32_t value;
+
+        return isLoad(s) && s->type == StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION &&
+               isConstant(s->expression) && s->expression.evaluate(value) && value == 0;
+    };
+
+    // a register operation writing its destination, which can be renamed
+    auto isRenamable = [&] (const Statement* s) -> bool
+    {
+        if (s->type != StatementType::TWO_REGISTER_OPCODE &&
+            s->type != StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION &&
+            s->type != StatementType::ONE_REGISTER_OPCODE)
+            return false;
+
+        switch (s->opcode)
+        {
+            case OpCode::ADD:
+            case OpCode::ADC:
+            case OpCode::SUB:
+            case OpCode::SBB:
+            case OpCode::AND:
+            case OpCode::OR:
+            case OpCode::XOR:
+            case OpCode::SLA:
+            case OpCode::SLX:
+            case OpCode::SL0:
+            case OpCode::SL1:
+            case OpCode::RL:
+            case OpCode::SRA:
+            case OpCode::SRX:
+            case OpCode::SR0:
+            case OpCode::SR1:
+            case OpCode::RR:
+            case OpCode::BSL:
+            case OpCode::BSR:
+                return true;
+            default:
+                return false;
+        }
+    };
+
+    auto remove = [&] (std::size_t i)
+    {
+        removed[i] = true;
+    };
+
+    bool changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (std::size_t i = 0; i < statements.size(); i++)
+        {
+            if (removed[i] || ! isInstruction(i))
+                continue;
+
+            Statement* s = statements[i];
+
+            // load rX, rX
+
+            if (isLoad(s) && s->type == StatementType::TWO_REGISTER_OPCODE && s->regSrc == s->regDest)
+            {
+                remove(i);
+                changed = true;
+                continue;
+            }
+
+            // a jump to the label after it
+
+            if (s->type == StatementType::OPCODE_WITH_EXPRESSION && isJump(s->opcode) &&
+                s->expression.numElements == 1 && s->expression.elements[0].elem == ExpressionElementType::kString)
+            {
+                const Symbol* target = s->expression.elements[0].v.symbol;
+                bool found = false;
+
+                for (std::size_t j = next(i); j != kNone && statements[j]->type == StatementType::LABEL &&
+                                              statements[j]->section == s->section; j = next(j))
+                {
+                    if (m_symbolTable.find(statements[j]->label) == target)
+                    {
+                        found = true;
+                        break;
+                    }
+                }
+
+                if (found)
+                {
+                    remove(i);
+                    changed = true;
+                    continue;
+                }
+            }
+
+            std::size_t j = following(i);
+
+            if (j == kNone)
+                continue;
+
+            Statement* t = statements[j];
+
+            // a load overwritten by the next
+
+            if (isLoad(s) && isLoad(t) && t->regDest == s->regDest &&
+                registerUse(t, s->regDest) == RegisterUse::kWritten)
+            {
+                remove(i);
+                changed = true;
+                continue;
+            }
+
+            // load rX, 0 then add, or or xor to it, from anything but rX itself,
+            // which would be load rX, rX: rX keeping its old value, not 0
+
+            if (isLoadZero(s) && t->regDest == s->regDest &&
+                (t->opcode == OpCode::ADD || t->opcode == OpCode::OR || t->opcode == OpCode::XOR) &&
+                (t->type == StatementType::TWO_REGISTER_OPCODE || t->type == StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION) &&
+                (t->type != StatementType::TWO_REGISTER_OPCODE || t->regSrc != s->regDest))
+            {
+                std::size_t k = following(j);
+
+                if (k != kNone && setsFlags(statements[k]))
+                {
+                    t->opcode = OpCode::LOAD;
+                    t->optimised = true;
+                    remove(i);
+                    changed = true;
+                    continue;
+                }
+            }
+
+            // load rX, rA / op rX, b / load rC, rX
+
+            if (isLoad(s) && s->type == StatementType::TWO_REGISTER_OPCODE && isRenamable(t) &&
+                t->regDest == s->regDest)
+            {
+                std::size_t k = following(j);
+
+                if (k == kNone)
+                    continue;
+
+                Statement* u   = statements[k];
+                Register   reg = s->regDest;
+
+                if (! (isLoad(u) && u->type == StatementType::TWO_REGISTER_OPCODE && u->regSrc == reg &&
+                       u->regDest != reg))
+                    continue;
+
+                Register dest = u->regDest;
+
+                // op rX, rC would read the wrong value once rX is renamed rC
+                if (t->type == StatementType::TWO_REGISTER_OPCODE && t->regSrc == dest)
+                    continue;
+
+                if (! isDeadAfter(k, reg))
+                    continue;
+
+                s->regDest = dest;
+                t->regDest = dest;
+
+                s->optimised = true;
+                t->optimised = true;
+
+                if (t->type == StatementType::TWO_REGISTER_OPCODE && t->regSrc == reg)
+                    t->regSrc = dest;
+
+                remove(k);
+                changed = true;
+            }
+        }
+    }
+
+    // Savings are reported by function: the statements after a label, other than
+    // one which is only jumped to, which is taken to be inside a function (unless
+    // it is the first).
+
+    auto isFunction = [&] (const Statement* label) -> bool
+    {
+        const Symbol* sym = m_symbolTable.find(label->label);
+
+        for (const SymbolReference* ref = sym->referredBy; ref != nullptr; ref = ref->next)
+        {
+            if (ref->statement->type != StatementType::OPCODE_WITH_EXPRESSION || ! isJump(ref->statement->opcode))
+                return true;
+        }
+
+        return sym->referredBy == nullptr;
+    };
+
+    m_functions.assign(1, nullptr);
+
+    std::vector<Statement*> kept;
+
+    for (std::size_t i = 0; i < statements.size(); i++)
+    {
+        Statement* s = statements[i];
+
+        if (s->type == StatementType::LABEL && (m_functions.size() == 1 || isFunction(s)))
+            m_functions.push_back(s->label);
+
+        if (removed[i])
+        {
+            m_removed.push_back({ s, (uint32_t)m_functions.size() - 1, (uint32_t)kept.size() });
+            continue;
+        }
+
+        kept.push_back(s);
+        m_functionOf.push_back(m_functions.size() - 1);
+    }
+
+    m_statements.swap(kept);
+
+}
+
+void AST::printSavings(std::ostream& os)
+{
+    std::vector<int32_t> saved(m_functions.size(), 0);
+
+    for (const RemovedStatement& r : m_removed)
+    {
+        Statement* s = r.statement;
+
+        int32_t words = 1;
+        int32_t value;
+
+        // an immediate load may have needed an imm; one left to the linker is counted short
+        if (s->type == StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION &&
+            s->expression.evaluate(value) && (value < 0 || value >= 16))
+            words = 2;
+
+        saved[r.function] += words;
+    }
+
+    for (std::size_t i = 0; i < m_shrinkBase.size(); i++)
+        saved[m_functionOf[i]] += (int32_t)m_shrinkBase[i] - (int32_t)m_statements[i]->numAssembledWords;
+
+    int32_t total = 0;
+
+    for (int32_t words : saved)
+        total += words;
+
+    os << "Optimisation saved " << std::dec << total << " words" << std::endl;
+
+    for (std::size_t i = 0; i < saved.size(); i++)
+    {
+        if (saved[i] != 0)
+            os << "    " << std::left << std::setw(32) << (m_functions[i] == nullptr ? "(before any label)" : m_functions[i])
+               << std::right << saved[i] << std::endl;
+    }
+}
+
+void AST::firstPassAssemble()
+{
+
+    bool assemblyStarted = false;
+    bool orgParsed = false;
+    uint32_t curAddress = 0;
+    bool isTimes = false;
+    Statement* timesStatement = nullptr;
+    uint16_t section = 0;
+
+    // Iterate over all statements, insert dummy assembly for each statement, so that in the next
+    // stage, the symbols which refer to an address can be resolved.
+
+    for (Statement* s : m_statements)
+    {
+        // in an object, each section starts from zero, and can have its own .org
+
+        if (s->section != section && m_relocatable)
+        {
+            curAddress = 0;
+            assemblyStarted = false;
+        }
+
+        section = s->section;
+
+        switch (s->type)
+        {
+            case StatementType::LABEL:
+                s->address = curAddress;
+                isTimes = false;
+                break;
+            case StatementType::EQU:
+                isTimes = false;
+                break;
+            case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
+            case StatementType::OPCODE_WITH_EXPRESSION:
+            case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
+                assemblyStarted = true;
+
+                if (isTimes)
+                {
+                    s->timesStatement = timesStatement;
+                }
+
+                s->firstPassAssemble(curAddress);
+                isTimes = false;
+                break;
+            case StatementType::ONE_REGISTER_OPCODE:
+            case StatementType::TWO_REGISTER_OPCODE:
+            case StatementType::STANDALONE_OPCODE:
+            case StatementType::INDIRECT_ADDRESSING_OPCODE:
+                assemblyStarted = true;
+                // we can directly assemble the instruction.
+
+                if (isTimes)
+                {
+                    s->timesStatement = timesStatement;
+                }
+
+                s->assemble(curAddress);
+                isTimes = false;
+                break;
+            case StatementType::PSEUDO_OP_WITH_EXPRESSION:
+
+                switch (s->pseudoOp)
+                {
+                    case PseudoOp::ORG:
+                        if (assemblyStarted)
+                        {
+                            std::stringstream ss;
+                            ss << ".org statement after assembly started on line " << s->lineNum << std::endl;
+                            throw std::runtime_error(ss.str());
+                        }
+                        if (orgParsed)
+                        {
+                            std::stringstream ss;
+                            ss << ".org statement already processed at this point, on line " << s->lineNum << std::endl;
+                            throw std::runtime_error(ss.str());
+                        }
+                        if (isTimes)
+                        {
+                            std::stringstream ss;
+                            ss << ".org statement preceded by times, on line " << s->lineNum << std::endl;
+                            throw std::runtime_error(ss.str());
+                        }
+
+                        if (! s->expression.evaluate(m_orgAddress))
+                        {
+                            std::stringstream ss;
+                            ss << ".org statement cannot be evaluated on line " << s->lineNum << std::endl;
+                            throw std::runtime_error(ss.str());
+                        }
+
+                        curAddress = (uint32_t)m_orgAddress;
+                        m_orgSection = s->section;
+
+                        break;
+                    default:
+
+                        if (isTimes)
+                        {
+                            s->timesStatement = timesStatement;
+                        }
+
+                        s->firstPassAssemble(curAddress);
+                }
+
+                isTimes = false;
+                break;
+            case StatementType::TIMES:
+
+                timesStatement = s;
+
+                if (! s->expression.evaluate(s->expression.value))
+                {
+                    std::stringstream ss;
+                    ss << ".times statement cannot be evaluated on line " << s->lineNum << std::endl;
+                    throw std::runtime_error(ss.str());
+                }
+
+                isTimes = true;
+
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void AST::layout()
+{
+    // Assign addresses to statements from their current sizes. Alignment
+    // padding depends on the address, so it is recomputed here too.
+
+    uint32_t curAddress = 0;
+    uint16_t section = 0;
+
+    for (Statement* s : m_statements)
+    {
+        if (s->section != section && m_relocatable)
+            curAddress = 0;
+
+        section = s->section;
+
+        if (s->type == StatementType::PSEUDO_OP_WITH_EXPRESSION && s->pseudoOp == PseudoOp::ORG)
+        {
+            curAddress = (uint32_t)m_orgAddress;
+            continue;
+        }
+
+        if (s->type == StatementType::PSEUDO_OP_WITH_EXPRESSION && s->pseudoOp == PseudoOp::ALIGN)
+        {
+            s->firstPassAssemble(curAddress);
+            continue;
+        }
+
+        s->address = curAddress;
+        curAddress += s->numAssembledWords * 2;
+    }
+}
+
+void AST::relax()
+{
+
+    // The first pass gave every span dependent statement (see Statement::isSpanDependent())
+    // its one word form. Lay the program out, grow the ones that don't fit, and repeat
+    // until nothing grows. Statements only ever grow, so this reaches a fixed point.
+    //
+    // After the first pass, only statements which could have changed are revisited: those
+    // referring to a symbol whose value moved, and jumps and calls which moved themselves.
+    //
+    // Once optimised, growing can leave statements longer than they now need to be, so
+    // those are shrunk and everything grown again, a few times at most as it could go
+    // back and forth; it always ends on a fixed point of growing, so everything fits.
+    //
+    // In an object, the linker does this once it has placed everything.
+
+    if (m_relocatable)
+    {
+        layout();
+        return;
+    }
+
+    grow();
+
+    if (! m_optimised)
+        return;
+
+    m_shrinkBase.resize(m_statements.size());
+
+    for (std::size_t i = 0; i < m_statements.size(); i++)
+        m_shrinkBase[i] = m_statements[i]->numAssembledWords;
+
+    const int kMaxShrinkPasses = 4;
+
+    for (int pass = 0; pass < kMaxShrinkPasses && shrink(); pass++)
+        grow();
+
+}
+
+void AST::grow()
+{
+
+    std::set<Statement*> worklist;
+
+    for (Statement* s : m_statements)
+        if (s->isSpanDependent())
+            worklist.insert(s);
+
+    layout();
+    resolveSymbols();
+
+    std::vector<int32_t>  symbolValues(m_symbolList.size());
+    std::vector<uint32_t> addresses(m_statements.size());
+
+    while (! worklist.empty())
+    {
+        bool grown = false;
+
+        for (Statement* s : worklist)
+            if (s->relax())
+                grown = true;
+
+        worklist.clear();
+
+        if (! grown)
+            break;
+
+        for (std::size_t i = 0; i < m_symbolList.size(); i++)
+            symbolValues[i] = m_symbolList[i]->value;
+
+        for (std::size_t i = 0; i < m_statements.size(); i++)
+            addresses[i] = m_statements[i]->address;
+
+        layout();
+        resolveSymbols();
+
+        for (std::size_t i = 0; i < m_symbolList.size(); i++)
+        {
+            if (m_symbolList[i]->value == symbolValues[i])
+                continue;
+
+            for (SymbolReference* ref = m_symbolList[i]->referredBy; ref != nullptr; ref = ref->next)
+                if (ref->statement->isSpanDependent())
+                    worklist.insert(ref->statement);
+        }
+
+        for (std::size_t i = 0; i < m_statements.size(); i++)
+        {
+            Statement* s = m_statements[i];
+
+            if (s->type == StatementType::OPCODE_WITH_EXPRESSION && s->isSpanDependent() &&
+                s->address != addresses[i])
+                worklist.insert(s);
+        }
+    }
+
+}
+
+bool AST::shrink()
+{
+    bool shrunk = false;
+
+    for (Statement* s : m_statements)
+        if (s->isSpanDependent() && s->shrink())
+            shrunk = true;
+
+    return shrunk;
+}
+
+void AST::resolveSymbols()
+{
+
+    // Resolve the symbols which depend on the layout. This runs on every
+    // relaxation pass; constant equates were evaluated by orderEquates().
+
+    // 1. get address of all labels
+
+    for (Symbol* sym : m_symbolList)
+    {
+        Statement* statement = sym->definedIn;
 
         if (statement->type == StatementType::LABEL)
         {
@@ -1269,15 +2318,21 @@ void AST::resolveSymbols()
         }
     }
 
-    for (Symbol* sym : m_symbolList)
+    // 2. then the equates which use them, in dependency order
+
+    for (Symbol* sym : m_equates)
     {
-        if (! sym->evaluated)
+        if (! sym->constant)
         {
             Statement*  statement = sym->definedIn;
             int32_t		value	  = 0;
 
-            if (! statement->expression.evaluate(value, m_symbolTable))
+            if (! statement->expression.evaluate(value))
             {
+                // one using an import is left to the linker
+                if (m_relocatable)
+                    continue;
+
                 std::stringstream ss;
                 ss << "could not evaluate expression on line " << statement->lineNum << std::endl;
                 throw std::runtime_error(ss.str());
@@ -1295,25 +2350,26 @@ void AST::evaluateExpressions()
 
     // At this point we should be able to evaluate all expressions.
 
-    for (Statement& s : m_statements)
+    for (Statement* s : m_statements)
     {
         int32_t value = 0;
-        char* string = nullptr;
+        const char* string = nullptr;
 
-        if (! (s.type == StatementType::OPCODE_WITH_EXPRESSION ||
-               s.type == StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION ||
-               s.type == StatementType::PSEUDO_OP_WITH_EXPRESSION))
+        if (! (s->type == StatementType::OPCODE_WITH_EXPRESSION ||
+               s->type == StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION ||
+               s->type == StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION ||
+               s->type == StatementType::PSEUDO_OP_WITH_EXPRESSION) || s->relocated)
             continue;
 
-        if (! s.expression.isStringLiteral(string) &&
-            ! s.expression.evaluate(value, m_symbolTable))
+        if (! s->expression.isStringLiteral(string) &&
+            ! s->expression.evaluate(value))
         {
                 std::stringstream ss;
-                ss << "could not evaluate expression on line " << s.lineNum << std::endl;
+                ss << "could not evaluate expression on line " << s->lineNum << std::endl;
                 throw std::runtime_error(ss.str());
         }
 
-        s.expression.value = value;
+        s->expression.value = value;
     }
 
 }
@@ -1323,16 +2379,20 @@ void AST::assemble()
 
     uint32_t curAddress = 0;
 
-    for (Statement& s : m_statements)
+    for (Statement* s : m_statements)
     {
-        switch (s.type)
+        // the linker assembles these
+        if (s->relocated)
+            continue;
+
+        switch (s->type)
         {
             case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
             case StatementType::OPCODE_WITH_EXPRESSION:
             case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
             {
-                curAddress = s.address;
-                s.assemble(curAddress);
+                curAddress = s->address;
+                s->assemble(curAddress);
 
                 break;
             }
@@ -1344,13 +2404,13 @@ void AST::assemble()
                 break;
             case StatementType::PSEUDO_OP_WITH_EXPRESSION:
 
-                switch (s.pseudoOp)
+                switch (s->pseudoOp)
                 {
                     case PseudoOp::DD:
                     case PseudoOp::DW:
                     {
-                        curAddress = s.address;
-                        s.assemble(curAddress);
+                        curAddress = s->address;
+                        s->assemble(curAddress);
                         break;
                     }
                     default:
@@ -1367,19 +2427,25 @@ void AST::assemble()
 
 void AST::writeBinOutput(std::string path)
 {
+    // end of the last statement, so the final instruction isn't cut off
+
     uint32_t maxAddress = m_orgAddress;
 
-    for (Statement& s : m_statements)
-        if (s.address > m_orgAddress)
-            maxAddress = s.address;
+    for (Statement* s : m_statements)
+    {
+        uint32_t end = s->address + s->numAssembledWords * sizeof(uint16_t);
+
+        if (end > maxAddress)
+            maxAddress = end;
+    }
 
     std::vector<uint16_t> assembly;
 
     assembly.resize((maxAddress - m_orgAddress) / sizeof(uint16_t));
 
-    for (Statement& s : m_statements)
-        for (int i = 0; i < s.assembledWords.size(); i++)
-            assembly[(s.address - m_orgAddress) / sizeof(uint16_t) + i] = s.assembledWords[i];
+    for (Statement* s : m_statements)
+        for (uint32_t i = 0; i < s->numAssembledWords; i++)
+            assembly[(s->address - m_orgAddress) / sizeof(uint16_t) + i] = s->assembledWords[i];
 
 
     std::ofstream out;
@@ -1392,22 +2458,492 @@ void AST::writeBinOutput(std::string path)
 
 }
 
+void AST::writeObjectOutput(std::string path, std::string source)
+{
+    nbObjectFile object;
+
+    object.source = source;
+
+    for (const char* name : m_sections)
+    {
+        nbObjectSection section;
+        section.name = name;
+        object.sections.push_back(section);
+    }
+
+    if (m_orgSection != -1)
+    {
+        object.sections[m_orgSection].flags  |= kSectionFixed;
+        object.sections[m_orgSection].address = m_orgAddress;
+    }
+
+    // symbols: labels and equates, then imports
+
+    std::unordered_map<const Symbol*, uint32_t> symbolIndex;
+
+    uint32_t index = 0;
+
+    for (Symbol* sym : m_symbolList)
+        symbolIndex[sym] = index++;
+
+    for (Symbol* sym : m_imports)
+        symbolIndex[sym] = index++;
+
+    // expressions go in postfix, with constant equates folded in
+
+    auto addExpression = [&] (const Expression& expression, uint32_t& start, uint32_t& length)
+    {
+        start = object.expressions.size();
+
+        for (uint32_t i = 0; i < expression.programLength; i++)
+        {
+            const ExpressionOp& op = expression.program[i];
+
+            nbObjectExpressionOp out;
+
+            out.op    = (uint32_t)op.op;
+            out.value = op.v.value;
+
+            if (op.op == ExpressionOpCode::kPushSymbol)
+            {
+                if (op.v.symbol->constant)
+                {
+                    out.op    = (uint32_t)ExpressionOpCode::kPushConstant;
+                    out.value = op.v.symbol->value;
+                }
+                else
+                {
+                    out.value = symbolIndex[op.v.symbol];
+                }
+            }
+
+            object.expressions.push_back(out);
+        }
+
+        length = object.expressions.size() - start;
+    };
+
+    auto sectionStart = [&] (uint16_t section) -> uint32_t
+    {
+        return section == m_orgSection ? m_orgAddress : 0;
+    };
+
+    for (Symbol* sym : m_symbolList)
+    {
+        nbObjectSymbol out;
+
+        out.name  = sym->string;
+        out.flags = sym->global ? kSymbolGlobal : 0;
+
+        const Statement* s = sym->definedIn;
+
+        if (s->type == StatementType::LABEL)
+        {
+            out.section = s->section;
+            out.value   = s->address - sectionStart(s->section);
+        }
+        else if (sym->constant)
+        {
+            out.section = kAbsoluteSection;
+            out.value   = sym->value;
+        }
+        else
+        {
+            out.section = kExpressionSection;
+            addExpression(s->expression, out.expression, out.expressionLength);
+        }
+
+        object.symbols.push_back(out);
+    }
+
+    for (Symbol* sym : m_imports)
+    {
+        nbObjectSymbol out;
+
+        out.name    = sym->string;
+        out.section = kUndefinedSection;
+
+        object.symbols.push_back(out);
+    }
+
+    // section contents, and relocations for what the linker has to fill in
+
+    for (Statement* s : m_statements)
+    {
+        nbObjectSection& section = object.sections[s->section];
+
+        uint32_t offset = s->address - sectionStart(s->section);
+
+        if (s->numAssembledWords != 0)
+        {
+            uint32_t end = offset / 2 + s->numAssembledWords;
+
+            if (end > section.words.size())
+                section.words.resize(end);
+
+            for (uint32_t i = 0; i < s->numAssembledWords; i++)
+                section.words[offset / 2 + i] = s->assembledWords[i];
+        }
+
+        if (! s->relocated)
+            continue;
+
+        nbObjectRelocation reloc;
+
+        reloc.section = s->section;
+        reloc.offset  = offset;
+        reloc.opcode  = (uint32_t)s->opcode;
+        reloc.regDest = (uint32_t)s->regDest;
+        reloc.regInd  = (uint32_t)s->regInd;
+        reloc.words   = s->numAssembledWords;
+        reloc.repeat  = s->repetitionCount;
+        reloc.lineNum = s->lineNum;
+
+        switch (s->type)
+        {
+            case StatementType::OPCODE_WITH_EXPRESSION:
+                reloc.kind = kRelocFlowControl;
+                break;
+            case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
+                reloc.kind = kRelocImmediate;
+                break;
+            case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
+                reloc.kind = kRelocLoadStore;
+                break;
+            default:
+                if (s->pseudoOp == PseudoOp::ALIGN)
+                {
+                    int32_t align = 0;
+                    s->expression.evaluate(align);
+
+                    section.align = std::max(section.align, (uint32_t)align);
+                    reloc.kind    = kRelocAlign;
+                }
+                else
+                {
+                    reloc.kind = kRelocWord;
+                }
+                break;
+        }
+
+        addExpression(s->expression, reloc.expression, reloc.expressionLength);
+
+        object.relocations.push_back(reloc);
+    }
+
+    if (! object.write(path))
+    {
+        std::stringstream ss;
+        ss << "could not write " << path << std::endl;
+        throw std::runtime_error(ss.str());
+    }
+
+}
+
 void AST::printAssembly()
 {
 
-    for (Statement&s : m_statements)
+    for (Statement* s : m_statements)
     {
-        if (s.assembledWords.size() == 0)
+        if (s->numAssembledWords == 0)
             continue;
 
-        std::cout << std::hex << std::setfill('0') << std::setw(6) << s.address << " : ";
+        std::cout << std::hex << std::setfill('0') << std::setw(6) << s->address << " : ";
 
-        for (uint16_t w : s.assembledWords)
+        for (uint32_t i = 0; i < s->numAssembledWords; i++)
         {
-            std::cout << std::setfill('0') << std::setw(4) << w << " ";
+            std::cout << std::setfill('0') << std::setw(4) << s->assembledWords[i] << " ";
         }
 
         std::cout << std::endl;
     }
 
 }
+
+static bool isInstruction(const Statement* s)
+{
+    switch (s->type)
+    {
+        case StatementType::TWO_REGISTER_OPCODE:
+        case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
+        case StatementType::ONE_REGISTER_OPCODE:
+        case StatementType::INDIRECT_ADDRESSING_OPCODE:
+        case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
+        case StatementType::OPCODE_WITH_EXPRESSION:
+        case StatementType::STANDALONE_OPCODE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void AST::writeListing(std::string path, std::string source)
+{
+    std::vector<std::string> lines;
+
+    {
+        std::ifstream in(source.c_str());
+        std::string line;
+
+        while (std::getline(in, line))
+            lines.push_back(line);
+    }
+
+    // Estimate each instruction's cycles from its words, as nbsim's timing
+    // model would, assuming cache hits and loads from block RAM. A label
+    // could be jumped to, so there is no load to stall on after one.
+
+    struct Cost
+    {
+        uint32_t notTaken = 0;
+        uint32_t taken = 0;
+        bool     branch = false;        // leaves the next instruction, at least when taken
+        int32_t  target = -1;           // byte address, for a jump or call to an expression
+    };
+
+    std::vector<Cost> costs(m_statements.size());
+
+    int loadDest = -1;
+
+    for (std::size_t i = 0; i < m_statements.size(); i++)
+    {
+        Statement* s = m_statements[i];
+        Cost& cost = costs[i];
+
+        if (s->type == StatementType::LABEL)
+            loadDest = -1;
+
+        if (! isInstruction(s))
+            continue;
+
+        bool conditional = false;
+        bool unconditional = false;
+
+        for (uint32_t j = 0; j < s->numAssembledWords; j++)
+        {
+            uint16_t word = s->assembledWords[j];
+
+            const nbInstructionDecodeInfo* info = decodeInstruction(instructionDecodeTable(), word);
+            UniqueOpCode opcode = info == nullptr ? UniqueOpCode::None : info->opcode;
+
+            int srcA, srcB, dest;
+
+            nbRegistersUsed(opcode, word, srcA, srcB, dest);
+
+            uint32_t cycles = nbExecuteCycles(opcode);
+
+            if (loadDest != -1 && (srcA == loadDest || srcB == loadDest))
+                cycles += kNbLoadUseStall;
+
+            if (opcode == UniqueOpCode::LDW_REG || opcode == UniqueOpCode::LDW_IMM)
+                cycles += kNbFirstWordCycles[0] - 1;
+
+            loadDest = dest;
+
+            cost.notTaken += cycles;
+
+            conditional   = conditional || nbIsConditionalBranch(opcode);
+            unconditional = unconditional || nbIsBranch(opcode);
+        }
+
+        cost.taken  = cost.notTaken + ((conditional || unconditional) ? kNbBranchPenalty : 0);
+        cost.branch = conditional || unconditional;
+
+        if (unconditional)
+            cost.notTaken = cost.taken;
+
+        if (cost.branch && s->type == StatementType::OPCODE_WITH_EXPRESSION)
+            cost.target = s->expression.value;
+    }
+
+    // A .loop runs from its label to the last jump back to it. The worst
+    // case takes each branch in it whichever way costs more; calls are
+    // counted, but not what they call.
+
+    struct Loop
+    {
+        const Statement* label;
+        const Statement* end;
+        uint32_t         cycles;
+    };
+
+    std::vector<Loop> loops;
+
+    for (Statement* loop : m_loops)
+    {
+        const Statement* label = m_symbolTable.get(loop->label)->definedIn;
+
+        std::size_t first = std::find(m_statements.begin(), m_statements.end(), label) - m_statements.begin();
+        std::size_t last = first;
+
+        for (std::size_t j = first + 1; j < m_statements.size() && m_statements[j]->section == label->section; j++)
+            if (costs[j].branch && costs[j].target == (int32_t)label->address)
+                last = j;
+
+        if (last == first)
+        {
+            std::stringstream ss;
+            ss << "No jump back to '" << loop->label << "' for .loop on line " << loop->lineNum << std::endl;
+            throw std::runtime_error(ss.str());
+        }
+
+        uint32_t cycles = 0;
+
+        for (std::size_t j = first; j <= last; j++)
+            cycles += std::max(costs[j].notTaken, costs[j].taken);
+
+        loops.push_back({ label, m_statements[last], cycles });
+    }
+
+    std::ofstream out;
+
+    out.open(path.c_str(), std::ios_base::out);
+
+    if (! out.is_open())
+    {
+        std::stringstream ss;
+        ss << "could not open " << path << std::endl;
+        throw std::runtime_error(ss.str());
+    }
+
+    out << "; " << source << ": estimated cycles assume cache hits and loads from block RAM;" << std::endl;
+    out << "; a conditional branch is given as not taken / taken" << std::endl << std::endl;
+
+    out << std::setfill(' ') << std::left
+        << std::setw(7) << "line" << std::setw(9) << "address" << std::setw(25) << "words"
+        << std::setw(8) << "cycles" << std::setw(24) << "symbol" << "source" << std::endl;
+
+    const uint32_t kMaxWords = 4;
+
+    auto writeSource = [&] (const Statement* s)
+    {
+        if (s->lineNum >= 1 && s->lineNum <= (int)lines.size())
+            out << lines[s->lineNum - 1];
+    };
+
+    // with -O, what was removed is listed where it was, with no words
+
+    std::size_t removed = 0;
+
+    for (std::size_t i = 0; i <= m_statements.size(); i++)
+    {
+        for (; removed < m_removed.size() && m_removed[removed].before == i; removed++)
+        {
+            const Statement* s = m_removed[removed].statement;
+
+            out << std::setw(7) << s->lineNum << std::setw(9 + 25 + 8 + 24) << "";
+            writeSource(s);
+            out << "    ; removed by -O" << std::endl;
+        }
+
+        if (i == m_statements.size())
+            break;
+
+        Statement* s = m_statements[i];
+        const Cost& cost = costs[i];
+
+        // the statement repeated has the same line
+        if (s->type == StatementType::TIMES)
+            continue;
+
+        std::stringstream address;
+        std::stringstream words;
+        std::stringstream cycles;
+        std::stringstream symbol;
+
+        if (s->numAssembledWords != 0 || s->type == StatementType::LABEL)
+            address << std::hex << std::setfill('0') << std::setw(6) << s->address;
+
+        for (uint32_t j = 0; j < s->numAssembledWords && j < kMaxWords; j++)
+            words << std::hex << std::setfill('0') << std::setw(4) << s->assembledWords[j] << " ";
+
+        if (s->numAssembledWords > kMaxWords)
+            words << "...";
+
+        if (isInstruction(s))
+        {
+            cycles << cost.notTaken;
+
+            if (cost.taken != cost.notTaken)
+                cycles << "/" << cost.taken;
+        }
+
+        if (s->type == StatementType::LABEL || s->type == StatementType::GLOBAL || s->type == StatementType::LOOP)
+            symbol << s->label;
+        else if (s->type == StatementType::EQU)
+            symbol << s->label << " = 0x" << std::hex << m_symbolTable.get(s->label)->value;
+
+        out << std::setw(7) << s->lineNum << std::setw(9) << address.str() << std::setw(25) << words.str()
+            << std::setw(8) << cycles.str() << std::setw(24) << symbol.str();
+
+        writeSource(s);
+
+        // the words are what was emitted; say what they now are
+        if (s->optimised && s->numAssembledWords != 0)
+        {
+            const nbInstructionDecodeInfo* info = decodeInstruction(instructionDecodeTable(),
+                                                                    s->assembledWords[s->numAssembledWords - 1]);
+
+            out << "    ; optimised to " << (info == nullptr ? "?" : info->string);
+        }
+
+        out << std::endl;
+    }
+
+    // from each label to the next, with branches not taken, for labels
+    // with code after them
+
+    out << std::endl << "; blocks, branches not taken" << std::endl << std::endl;
+
+    out << std::setw(32) << "label" << std::setw(9) << "address"
+        << std::setw(8) << "instrs" << "cycles" << std::endl;
+
+    for (std::size_t i = 0; i < m_statements.size(); i++)
+    {
+        Statement* label = m_statements[i];
+
+        if (label->type != StatementType::LABEL)
+            continue;
+
+        uint32_t instructions = 0;
+        uint32_t cycles = 0;
+
+        for (std::size_t j = i + 1; j < m_statements.size(); j++)
+        {
+            Statement* s = m_statements[j];
+
+            if (s->type == StatementType::LABEL || s->section != label->section)
+                break;
+
+            if (isInstruction(s))
+            {
+                instructions++;
+                cycles += costs[j].notTaken;
+            }
+        }
+
+        if (instructions == 0)
+            continue;
+
+        std::stringstream address;
+        address << std::hex << std::setfill('0') << std::setw(6) << label->address;
+
+        out << std::setw(32) << label->label << std::setw(9) << address.str()
+            << std::setw(8) << instructions << cycles << std::endl;
+    }
+
+    if (loops.empty())
+        return;
+
+    out << std::endl << "; loops, worst case per iteration, not counting what they call" << std::endl << std::endl;
+
+    out << std::setw(32) << "loop" << std::setw(14) << "lines" << "cycles" << std::endl;
+
+    for (const Loop& loop : loops)
+    {
+        std::stringstream range;
+        range << loop.label->lineNum << "-" << loop.end->lineNum;
+
+        out << std::setw(32) << loop.label->label << std::setw(14) << range.str() << loop.cycles << std::endl;
+    }
+}
@@ -4,11 +4,14 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <unordered_map>
 
 #include "Statement.h"
 #include "Expression.h"
 #include "types.h"
 #include "Symbol.h"
+#include "Arena.h"
+#include "StringPool.h"
 
 class AST
 {
@@ -30,52 +33,144 @@ public:
 
     void addIntToCurrentStatementExpression(int val);
     void addUIntToCurrentStatementExpresion(unsigned int val);
-    void addStringToCurrentStatementExpression(char* string);
+    void addStringToCurrentStatementExpression(const char* string);
 
-    void addTwoRegisterOpcode(int linenum, char* opcode, char* regDest, char* regSrc);
-    void addOneRegisterAndExpressionOpcode(int linenum, char* opcode, char* regDest);
-    void addExpressionOpcode(int linenum, char* opcode);
-    void addStandaloneOpcode(int linenum, char* opcode);
-    void addIndirectAddressingOpcode(int linenum, char* opcode, char* regDest, char* regIdx, char* regOffset);
-    void addIndirectAddressingOpcodeWithExpression(int linenum, char* opcode, char* regDest, char* regIdx);
-    void addOneRegisterOpcode(int linenum, char* opcode, char* regDest);
+    void addTwoRegisterOpcode(int linenum, const char* opcode, const char* regDest, const char* regSrc);
+    void addOneRegisterAndExpressionOpcode(int linenum, const char* opcode, const char* regDest);
+    void addExpressionOpcode(int linenum, const char* opcode);
+    void addStandaloneOpcode(int linenum, const char* opcode);
+    void addIndirectAddressingOpcode(int linenum, const char* opcode, const char* regDest, const char* regIdx, const char* regOffset);
+    void addIndirectAddressingOpcodeWithExpression(int linenum, const char* opcode, const char* regDest, const char* regIdx);
+    void addOneRegisterOpcode(int linenum, const char* opcode, const char* regDest);
 
-    void addExpressionPseudoOp(int linenum, char* pseudoOp);
+    void addExpressionPseudoOp(int linenum, const char* pseudoOp);
 
-    void addStringLiteralToCurrentStatementExpression(char* string);
-    void addCharLiteralToCurrentStatementExpression(char* string);
+    void addStringLiteralToCurrentStatementExpression(const char* string);
+    void addCharLiteralToCurrentStatementExpression(const char* string);
 
-    void addLabel(int linenum, char* label);
+    // .section <name>, .global <name> and .loop <label>
+    void addDirective(int linenum, const char* directive, const char* name);
+
+    void addLabel(int linenum, const char* label);
     void addTimes(int linenum);
-    void addEqu(int linenum, char* label);
+    void addEqu(int linenum, const char* label);
+
+    // <name> .literal "string": a zero terminated string in the literal
+    // pool, see buildLiteralPool()
+    void addLiteral(int linenum, const char* label);
+
+    // Assemble to a relocatable object for nbld rather than a flat binary:
+    // symbols left undefined are imported, and everything which depends on
+    // where labels end up is left to the linker as a relocation.
+    void setRelocatable(bool relocatable) { m_relocatable = relocatable; }
+
+    // Equates shared between files, by name: one which is used but not
+    // defined here takes its value from these. They are only read, so one
+    // set can be shared by ASTs assembling on different threads.
+    typedef std::unordered_map<std::string, int32_t> SharedSymbols;
+
+    void setSharedSymbols(const SharedSymbols* shared) { m_sharedSymbols = shared; }
+
+    // Add the equates which don't depend on a label, once the symbol
+    // table is built.
+    void exportConstants(SharedSymbols& constants) const;
+
+    // names and literals in this file, as the lexer interns them
+    StringPool& strings() { return m_strings; }
 
     void buildSymbolTable();
     void printSymbolTable();
 
-    OpCode   convertOpCode(char* opcode);
-    PseudoOp convertPseudoOp(char* pseudoOp);
-    Register convertReg(char* reg);
+    OpCode   convertOpCode(const char* opcode);
+    PseudoOp convertPseudoOp(const char* pseudoOp);
+    Register convertReg(const char* reg);
+
+    // Peephole optimisation, for -O, once the symbol table is built: drops
+    // or merges instructions whose effect the next ones redo, and has
+    // relax() shrink what no longer needs its long form.
+    void optimise();
+
+    // Words saved by optimise(), by function, once relaxed
+    void printSavings(std::ostream& os);
 
     void firstPassAssemble();
+    void relax();
     void resolveSymbols();
     void evaluateExpressions();
     void assemble();
     void writeBinOutput(std::string path);
+    void writeObjectOutput(std::string path, std::string source);
 
     void printAssembly();
 
+    // Listing for -l, once assembled: each statement with its source line,
+    // address, words and estimated cycles (see nbInstructionTiming.h), then
+    // the cycles from each label to the next and the worst case of each
+    // .loop.
+    void writeListing(std::string path, std::string source);
+
     friend std::ostream& operator << (std::ostream&, const AST&);
 
 private:
 
+    void buildLiteralPool();
+
+    void layout();
+    void grow();
+    bool shrink();
+    void orderEquates();
+    void findRelocations();
+
+    bool isConstant(const Expression& expression) const;
+    bool defineSharedSymbol(Symbol* sym);
+
     int32_t m_orgAddress = 0;
+    int     m_orgSection = -1;
+
+    // Section names, in the order they first appear. In a flat binary the
+    // sections follow one another; in an object each starts from zero,
+    // except the one with the .org.
+    std::vector<const char*> m_sections = { "text" };
+    uint16_t m_currentSection = 0;
+
+    bool m_relocatable = false;
+
+    const SharedSymbols* m_sharedSymbols = nullptr;
+
+    // for optimise() and its report
+    struct RemovedStatement
+    {
+        Statement* statement;
+        uint32_t   function;    // index into m_functions
+        uint32_t   before;      // index of the statement kept after it, for the listing
+    };
+
+    bool m_optimised = false;
+
+    std::vector<const char*>      m_functions;      // labels, nullptr for anything before the first
+    std::vector<uint32_t>         m_functionOf;     // for each statement
+    std::vector<RemovedStatement> m_removed;
+    std::vector<uint32_t>         m_shrinkBase;     // each statement's words before shrinking
+
+    void addCurrentStatement();
 
     Statement m_currentStatement;
+    std::vector<ExpressionElement> m_currentElements;   // expression being parsed
+
+    StringPool m_strings;
+
+    // statements, their expressions and assembled words live in the arena
+    // and are freed in one go with the AST
+    Arena m_arena;
 
-    std::vector<Statement> m_statements;
+    std::vector<Statement*> m_statements;
 
-    SymbolTable m_symbolTable; // symbol table as a map for fast access when evaluating expressions
-    std::vector<Symbol*> m_symbolList;  // a vector of symbols in order found in file for correct evaluation
+    SymbolTable m_symbolTable; // symbols by interned name, for fast access when parsing expressions
+    std::vector<Symbol*> m_symbolList;  // a vector of symbols in order found in file
+    std::vector<Symbol*> m_equates;     // equates, each after the ones it refers to
+    std::vector<Symbol*> m_imports;     // undefined symbols, in relocatable output
+    std::vector<Statement*> m_loops;    // .loop statements, for the listing
+    std::vector<Statement*> m_literals; // .literal statements, until pooled
 
 };
 
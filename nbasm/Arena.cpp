@@ -0,0 +1,34 @@
+#include "Arena.h"
+
+#include <cstdint>
+#include <algorithm>
+
+Arena::~Arena()
+{
+    for (char* block : m_blocks)
+        delete [] block;
+}
+
+void* Arena::allocate(std::size_t bytes, std::size_t align)
+{
+    std::uintptr_t next = ((std::uintptr_t)m_next + align - 1) & ~(std::uintptr_t)(align - 1);
+
+    if (m_next == nullptr || next + bytes > (std::uintptr_t)m_end)
+    {
+        // big requests get a block to themselves
+
+        std::size_t size = std::max<std::size_t>(kBlockSize, bytes + align);
+
+        char* block = new char[size];
+        m_blocks.push_back(block);
+
+        m_next = block;
+        m_end  = block + size;
+
+        next = ((std::uintptr_t)m_next + align - 1) & ~(std::uintptr_t)(align - 1);
+    }
+
+    m_next = (char*)(next + bytes);
+
+    return (void*)next;
+}
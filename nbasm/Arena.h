@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+//
+//  Bump allocator. Allocations are carved out of large blocks, and all of
+//  them are freed at once when the arena goes away. Destructors are never
+//  run, so only trivially destructible types can live in an arena.
+//
+
+class Arena
+{
+public:
+
+    Arena() = default;
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator = (const Arena&) = delete;
+
+    void* allocate(std::size_t bytes, std::size_t align);
+
+    template <typename T>
+    T* allocateArray(std::size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+private:
+
+    enum
+    {
+        kBlockSize = 256 * 1024
+    };
+
+    std::vector<char*> m_blocks;
+
+    char* m_next = nullptr;
+    char* m_end  = nullptr;
+};
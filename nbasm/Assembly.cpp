@@ -50,6 +50,51 @@ void Assembly::makeArithmeticInstructionWithImmediate(uint16_t opcode, Register
 }
 
 
+uint16_t Assembly::arithmeticImmediateInstruction(OpCode opcode, uint32_t lineNum)
+{
+    switch (opcode)
+    {
+        case OpCode::ADD:
+            return ADD_IMM_INSTRUCTION;
+        case OpCode::ADC:
+            return ADC_IMM_INSTRUCTION;
+        case OpCode::SUB:
+            return SUB_IMM_INSTRUCTION;
+        case OpCode::SBB:
+            return SBB_IMM_INSTRUCTION;
+        case OpCode::AND:
+            return AND_IMM_INSTRUCTION;
+        case OpCode::OR:
+            return OR_IMM_INSTRUCTION;
+        case OpCode::XOR:
+            return XOR_IMM_INSTRUCTION;
+        case OpCode::CMP:
+            return CMP_IMM_INSTRUCTION;
+        case OpCode::TEST:
+            return TEST_IMM_INSTRUCTION;
+        case OpCode::LOAD:
+            return LOAD_IMM_INSTRUCTION;
+        case OpCode::MUL:
+            return MUL_IMM_INSTRUCTION;
+        case OpCode::MULS:
+            return MULS_IMM_INSTRUCTION;
+        case OpCode::DIV:
+            return DIV_IMM_INSTRUCTION;
+        case OpCode::DIVS:
+            return DIVS_IMM_INSTRUCTION;
+        case OpCode::BSL:
+            return BSL_INSTRUCTION;
+        case OpCode::BSR:
+            return BSR_INSTRUCTION;
+        default:
+        {
+            std::stringstream ss;
+            ss << "Error: opcode is not single register with expression on line " << lineNum << std::endl;
+            throw std::runtime_error(ss.str());
+        }
+    }
+}
+
 void Assembly::makeArithmeticInstruction(uint16_t opcode,
                                          Register regDest,
                                          Register regSrc, std::vector<uint16_t>& assembledWords,
@@ -78,6 +123,23 @@ void Assembly::makeArithmeticInstruction(uint16_t opcode,
 }
 
 
+static bool canUseRelative(uint32_t address, uint32_t target)
+{
+    // relative jumps and calls have a signed 9 bit word offset
+
+    int32_t diff = ((int32_t)target - (int32_t)address) / 2;
+
+    return diff >= -256 && diff < 256;
+}
+
+uint32_t Assembly::flowControlWords(uint32_t address, uint32_t target)
+{
+    if (canUseRelative(address, target) || target < 1024)
+        return 1;
+
+    return 2;
+}
+
 void Assembly::makeFlowControlInstruction(OpCode opcode, uint32_t address, uint32_t target, uint32_t lineNum,
                                        std::vector<uint16_t>& assembledWords)
 {
@@ -93,13 +155,8 @@ void Assembly::makeFlowControlInstruction(OpCode opcode, uint32_t address, uint3
 
     // check if relative address is possible
 
-    int32_t diff        = (target - address) / 2;
-    bool    useRelative = false;
-
-    if ((diff >= 0 && diff < 256) || (diff < 0 && diff >= -256))
-    {
-        useRelative = true;
-    }
+    int32_t diff        = ((int32_t)target - (int32_t)address) / 2;
+    bool    useRelative = canUseRelative(address, target);
 
     uint16_t op = NOP_INSTRUCTION;
 
@@ -180,6 +237,12 @@ void Assembly::makeFlowControlInstruction(OpCode opcode, uint32_t address, uint3
         if (assembledWords.size() == 2)
             assembledWords[1] = NOP_INSTRUCTION;
     }
+    else if (target < 1024)
+    {
+        assembledWords[0] = op | ((target & 0x7fe) >> 1);
+        if (assembledWords.size() == 2)
+            assembledWords[1] = NOP_INSTRUCTION;
+    }
     else
     {
         if (assembledWords.size() != 2)
@@ -189,16 +252,10 @@ void Assembly::makeFlowControlInstruction(OpCode opcode, uint32_t address, uint3
             throw std::runtime_error(ss.str());
         }
 
-        if (target < 1024)
-        {
-            assembledWords[0] = op | ((target & 0x7fe) >> 1);
-            assembledWords[1] = NOP_INSTRUCTION;
-        }
-        else
-        {
-            assembledWords[0] = IMM_INSTRUCTION | ((target & 0xfff800) >> 1);
-            assembledWords[1] = op | ((target & 0x7fe) >> 1);
-        }
+        // the jump takes the low 9 bits of the word address, and an imm the rest
+
+        assembledWords[0] = IMM_INSTRUCTION | ((target >> 10) & 0x3fff);
+        assembledWords[1] = op | ((target >> 1) & 0x1ff);
 
     }
 
@@ -256,10 +313,18 @@ void Assembly::makeLoadStoreWithExpression(OpCode opcode, uint32_t lineNum, std:
     if (fitsIn4Bits)
     {
         assembledWords[0] = op | (((uint16_t)value & 0x0f) >> 1);
-        assembledWords[1] = NOP_INSTRUCTION;
+        if (assembledWords.size() == 2)
+            assembledWords[1] = NOP_INSTRUCTION;
     }
     else
     {
+        if (assembledWords.size() != 2)
+        {
+            std::stringstream ss;
+            ss << "Error: not enough space allocated for instruction on line " << lineNum << std::endl;
+            throw std::runtime_error(ss.str());
+        }
+
         assembledWords[0] = IMM_INSTRUCTION | (((uint16_t)value & 0xfff0) >> 4);
         assembledWords[1] = op | ((uint16_t)value & 0x0f);
     }
@@ -17,6 +17,9 @@ public:
                                                        int32_t immediate, std::vector<uint16_t>& assembledWords,
                                                        uint32_t lineNum);
 
+    // The register and immediate form of an arithmetic opcode
+    static uint16_t arithmeticImmediateInstruction(OpCode opcode, uint32_t lineNum);
+
     static void makeArithmeticInstruction(uint16_t opcode,
                                                        Register regDest,
                                                        Register regSrc, std::vector<uint16_t>& assembledWords,
@@ -25,6 +28,10 @@ public:
     static void makeFlowControlInstruction(OpCode opcode, uint32_t address, uint32_t target, uint32_t lineNum,
                                            std::vector<uint16_t>& assembledWords);
 
+    // Words needed by a jump or call at address to target: one if it can be
+    // made relative or the target is in the first 512 words, otherwise two.
+    static uint32_t flowControlWords(uint32_t address, uint32_t target);
+
     static void makeLoadStoreWithExpression(OpCode opcode, uint32_t lineNum, std::vector<uint16_t>& words, int32_t value,
                                             Register regInd, Register regDest);
 
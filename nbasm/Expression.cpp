@@ -4,10 +4,57 @@
 #include <iostream>
 
 #include <string.h>
+#include <algorithm>
 
 const int kMaxStringLength = 1024;
 
-bool Expression::evaluate(int32_t &value, SymbolTable &syms)
+const int kMaxStackDepth = 64;
+
+static int precedence(ExpressionOpCode op)
+{
+    switch (op)
+    {
+        case ExpressionOpCode::kNegate:
+        case ExpressionOpCode::kNot:
+            return 7;
+        case ExpressionOpCode::kMult:
+        case ExpressionOpCode::kDiv:
+            return 6;
+        case ExpressionOpCode::kPlus:
+        case ExpressionOpCode::kMinus:
+            return 5;
+        case ExpressionOpCode::kShiftLeft:
+        case ExpressionOpCode::kShiftRight:
+            return 4;
+        case ExpressionOpCode::kAnd:
+            return 3;
+        case ExpressionOpCode::kXor:
+            return 2;
+        case ExpressionOpCode::kOr:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void Expression::build(Arena& arena, const std::vector<ExpressionElement>& parsed)
+{
+    ExpressionElement* copy = arena.allocateArray<ExpressionElement>(parsed.size());
+
+    std::copy(parsed.begin(), parsed.end(), copy);
+
+    elements    = copy;
+    numElements = parsed.size();
+
+    // string literals are data for dw, not something to evaluate
+
+    const char* stringLit;
+
+    if (numElements != 0 && ! isStringLiteral(stringLit))
+        compile(arena);
+}
+
+void Expression::compile(Arena& arena)
 {
 
     //
@@ -15,279 +62,299 @@ bool Expression::evaluate(int32_t &value, SymbolTable &syms)
     //
     // ((1 + 2) * 7 + 3 ) / 8
     //
-    // They have been tokenised by the lexer and so processing them
-    // is as follows:
+    // They have been tokenised by the lexer. Convert them to postfix (shunting-yard),
+    // with C precedence and associativity:
     //
-    // - scan for sub-expressions and recursively evaluate
-
-    Expression  e, sube;
-    uint32_t    stackDepth = 0;
-    Expression* curExp = &e;
-
-    e.lineNum = lineNum;
+    //      - ~         unary, right to left
+    //      * /
+    //      + -
+    //      << >>
+    //      &
+    //      ^
+    //      |
+    //
+    // Symbols were looked up by the parser; the program keeps pointers to them, so
+    // it sees their values as they are resolved.
 
-    for (ExpressionElement& elem : elements)
+    struct Pending
     {
+        ExpressionOpCode op;
+        bool             parenthesis;
+    };
 
-        switch (elem.elem)
-        {
-            case ExpressionElementType::kLeftParenthesis:
-                if (stackDepth == 0)
-                {
-                    curExp = &sube;
-                    sube.lineNum = lineNum;
-                    sube.reset();
-                }
-                else
-                {
-                    curExp->addElement(elem);
-                }
-                stackDepth++;
-                break;
-            case ExpressionElementType::kRightParenthesis:
-                if (stackDepth == 0)
-                {
-                    std::cout << elem << std::endl;
+    Pending operators[kMaxStackDepth];
+    int     numOperators = 0;
 
-                    std::stringstream ss;
-                    ss << "unbalanced parenthesis, on line " << lineNum << std::endl;
-                    throw std::runtime_error(ss.str());
-                }
+    // the program is never longer than the expression
 
-                stackDepth --;
+    ExpressionOp* ops = arena.allocateArray<ExpressionOp>(numElements);
+    uint32_t      length = 0;
 
-                if (stackDepth == 0)
-                {
-                    curExp = &e;
-                    int32_t subValue = 0;
-                    if (! sube.evaluate(subValue, syms))
-                        return false;
-                    else
-                    {
-                        ExpressionElement subElem;
-                        subElem.elem = ExpressionElementType::kInt;
-                        subElem.v.sval = subValue;
-                        e.addElement(subElem);
-                    }
-                }
-                else
-                {
-                    curExp->addElement(elem);
-                }
+    bool expectOperand = true;
+    int  depth = 0;
+    int  maxDepth = 0;
 
-                break;
-            case ExpressionElementType::kString:
-            {
-                // substitute symbols
+    auto error = [this] (const char* what)
+    {
+        std::stringstream ss;
+        ss << what << ", on line " << lineNum << std::endl;
+        throw std::runtime_error(ss.str());
+    };
 
-                Symbol* sym = nullptr;
+    auto pending = [&] (ExpressionOpCode op, bool parenthesis)
+    {
+        if (numOperators == kMaxStackDepth)
+            error("expression too complex");
 
-                try {
-                    sym = &syms.at(elem.v.string);
-                }
-                catch (std::out_of_range)
-                {
-                    std::stringstream ss;
-                    ss << "undefined symbol" << elem.v.string << ", on line " << lineNum << std::endl;
-                    throw std::runtime_error(ss.str());
-                }
+        operators[numOperators].op = op;
+        operators[numOperators].parenthesis = parenthesis;
+        numOperators++;
+    };
 
-                if (! sym->evaluated)
-                {
-                    return false;
-                }
+    auto emit = [&] (ExpressionOpCode op)
+    {
+        ops[length].op = op;
+        ops[length].v.value = 0;
+        length++;
 
-                ExpressionElement symElem;
-                symElem.elem = ExpressionElementType::kInt;
-                symElem.v.sval = sym->value;
-                curExp->addElement(symElem);
+        if (op != ExpressionOpCode::kNegate && op != ExpressionOpCode::kNot)
+            depth--;
+    };
 
-                break;
-            }
-            default:
-                curExp->addElement(elem);
-                break;
-        }
+    auto push = [&] (const ExpressionOp& e)
+    {
+        if (! expectOperand)
+            error("missing operator in expression");
 
-    }
+        ops[length++] = e;
 
+        depth++;
+        maxDepth = std::max(depth, maxDepth);
 
-    // - recursively reduce expression (TODO: operator precedence?)
+        expectOperand = false;
+    };
 
-        // unary plus / minus, not
+    for (uint32_t i = 0; i < numElements; i++)
+    {
+        const ExpressionElement& elem = elements[i];
 
-        // mult, div
+        ExpressionOpCode op = ExpressionOpCode::kPlus;
 
-    e = e.doOp(ExpressionElementType::kMult, [] (int32_t left, int32_t right) -> int32_t { return left * right; });
-    e = e.doOp(ExpressionElementType::kDiv, [] (int32_t left, int32_t right) -> int32_t { return left / right; });
+        switch (elem.elem)
+        {
+            case ExpressionElementType::kInt:
+            case ExpressionElementType::kUInt:
+            case ExpressionElementType::kCharLiteral:
+            {
+                ExpressionOp e;
+                e.op = ExpressionOpCode::kPushConstant;
+                e.v.value = elem.elem == ExpressionElementType::kCharLiteral ? elem.charLiteralValue() : elem.v.sval;
+                push(e);
+                continue;
+            }
+            case ExpressionElementType::kString:
+            {
+                ExpressionOp e;
+                e.op = ExpressionOpCode::kPushSymbol;
+                e.v.symbol = elem.v.symbol;
+                push(e);
+                continue;
+            }
+            case ExpressionElementType::kLeftParenthesis:
+                if (! expectOperand)
+                    error("missing operator in expression");
 
-        // add, subtract
+                pending(ExpressionOpCode::kPushConstant, true);
+                continue;
+            case ExpressionElementType::kRightParenthesis:
+                if (expectOperand)
+                    error("missing operand in expression");
+
+                while (numOperators != 0 && ! operators[numOperators - 1].parenthesis)
+                    emit(operators[--numOperators].op);
+
+                if (numOperators == 0)
+                    error("unbalanced parenthesis");
+
+                numOperators--;
+                continue;
+            case ExpressionElementType::kNot:
+                if (! expectOperand)
+                    error("missing operator in expression");
+
+                pending(ExpressionOpCode::kNot, false);
+                continue;
+            case ExpressionElementType::kMinus:
+            case ExpressionElementType::kPlus:
+                if (expectOperand)
+                {
+                    // unary; unary plus does nothing
+                    if (elem.elem == ExpressionElementType::kMinus)
+                        pending(ExpressionOpCode::kNegate, false);
+                    continue;
+                }
 
-    e = e.doOp(ExpressionElementType::kPlus, [] (int32_t left, int32_t right) -> int32_t { return left + right; });
-    e = e.doOp(ExpressionElementType::kMinus, [] (int32_t left, int32_t right) -> int32_t { return left - right; });
+                op = elem.elem == ExpressionElementType::kMinus ? ExpressionOpCode::kMinus : ExpressionOpCode::kPlus;
+                break;
+            case ExpressionElementType::kMult:
+                op = ExpressionOpCode::kMult;
+                break;
+            case ExpressionElementType::kDiv:
+                op = ExpressionOpCode::kDiv;
+                break;
+            case ExpressionElementType::kShiftLeft:
+                op = ExpressionOpCode::kShiftLeft;
+                break;
+            case ExpressionElementType::kShiftRight:
+                op = ExpressionOpCode::kShiftRight;
+                break;
+            case ExpressionElementType::kAnd:
+                op = ExpressionOpCode::kAnd;
+                break;
+            case ExpressionElementType::kXor:
+                op = ExpressionOpCode::kXor;
+                break;
+            case ExpressionElementType::kOr:
+                op = ExpressionOpCode::kOr;
+                break;
+            default:
+                error("unexpected element in expression");
+        }
 
-        // shl, shr
+        // binary operator: everything pending which binds at least as tightly goes first
 
-    e = e.doOp(ExpressionElementType::kShiftLeft, [] (int32_t left, int32_t right) -> int32_t { return left << right; });
-    e = e.doOp(ExpressionElementType::kShiftRight, [] (int32_t left, int32_t right) -> int32_t { return left >> right; });
+        if (expectOperand)
+            error("binary operator without left operand");
 
-        // and
+        while (numOperators != 0 && ! operators[numOperators - 1].parenthesis &&
+               precedence(operators[numOperators - 1].op) >= precedence(op))
+            emit(operators[--numOperators].op);
 
-    e = e.doOp(ExpressionElementType::kAnd, [] (int32_t left, int32_t right) -> int32_t { return left & right; });
+        pending(op, false);
+        expectOperand = true;
+    }
 
-        // xor
+    if (expectOperand)
+        error("missing operand in expression");
 
-    e = e.doOp(ExpressionElementType::kXor, [] (int32_t left, int32_t right) -> int32_t { return left ^ right; });
+    while (numOperators != 0)
+    {
+        if (operators[numOperators - 1].parenthesis)
+            error("unbalanced parenthesis");
 
-        // or
+        emit(operators[--numOperators].op);
+    }
 
-    e = e.doOp(ExpressionElementType::kOr, [] (int32_t left, int32_t right) -> int32_t { return left | right; });
+    if (maxDepth > kMaxStackDepth)
+        error("expression too complex");
 
-    // expression should now consist of a single integer
+    program       = ops;
+    programLength = length;
+}
 
-    if (e.elements.size() != 1 ||
-            ! (e.elements[0].elem == ExpressionElementType::kInt ||
-               e.elements[0].elem == ExpressionElementType::kUInt ||
-               e.elements[0].elem == ExpressionElementType::kCharLiteral))
+bool Expression::evaluate(int32_t &value)
+{
+    if (known)
     {
-        std::stringstream ss;
-        ss << "Expression couldn't be reduced on line " << lineNum << " " << e.elements.size() << " " << e << std::endl;
-        throw std::runtime_error(ss.str());
+        value = knownValue;
+        return true;
     }
-    else
+
+    if (program == nullptr)
     {
-        if (e.elements[0].elem == ExpressionElementType::kCharLiteral)
-        {
-            value = e.elements[0].charLiteralValue();
-        }
-        else
-        {
-            value = e.elements[0].v.sval;
-        }
+        std::stringstream ss;
+        ss << "expression cannot be evaluated, on line " << lineNum << std::endl;
+        throw std::runtime_error(ss.str());
     }
 
-    return true;
-}
-
-
-Expression Expression::doOp(ExpressionElementType type, std::function<int32_t (int32_t left, int32_t right)> func)
-{
-
-    Expression e;
-    bool foundOp = false;
+    int32_t stack[kMaxStackDepth] = {};
+    int     sp = 0;
 
-    ExpressionElementType op = ExpressionElementType::kNone;
+    bool constant = true;
 
-    ExpressionElement* left = nullptr;
-
-    int idx = 1;
-
-    e.lineNum = lineNum;
-
-    for (ExpressionElement& mid : elements)
+    for (uint32_t i = 0; i < programLength; i++)
     {
+        const ExpressionOp& op = program[i];
 
-        if (mid.elem == type)
+        switch (op.op)
         {
+            case ExpressionOpCode::kPushConstant:
+                stack[sp++] = op.v.value;
+                continue;
+            case ExpressionOpCode::kPushSymbol:
+                if (! op.v.symbol->evaluated)
+                    return false;
+                if (! op.v.symbol->constant)
+                    constant = false;
+                stack[sp++] = op.v.symbol->value;
+                continue;
+            case ExpressionOpCode::kNegate:
+                stack[sp - 1] = -stack[sp - 1];
+                continue;
+            case ExpressionOpCode::kNot:
+                stack[sp - 1] = ~stack[sp - 1];
+                continue;
+            default:
+                break;
+        }
 
-            foundOp = true;
-
-            ExpressionElement* right;
-
-            try {
-                right = &elements.at(idx);
-            }
-            catch (std::out_of_range)
-            {
-                std::stringstream ss;
-                ss << "multiplication / division without right operand on line " << lineNum << std::endl;
-                throw std::runtime_error(ss.str());
-            }
-
-            int32_t lval, rval;
-
-            if (left == nullptr)
-            {
-                std::stringstream ss;
-                ss << "binary operator " << (uint32_t)type << " without left operand on line " << lineNum << std::endl;
-                throw std::runtime_error(ss.str());
-            }
-
-            switch (left->elem)
-            {
-                case ExpressionElementType::kInt:
-                    lval = left->v.sval;
-                    break;
-                case ExpressionElementType::kUInt:
-                    lval = left->v.uval;
-                    break;
-                case ExpressionElementType::kCharLiteral:
-                    lval = (int32_t)left->v.string[0];
-                    break;
-                default:
-                    std::stringstream ss;
-                    ss << "unexpected element, on line " << lineNum << std::endl;
-                    throw std::runtime_error(ss.str());
-                    break;
-            }
+        int32_t right = stack[--sp];
+        int32_t& left = stack[sp - 1];
 
-            switch (right->elem)
-            {
-                case ExpressionElementType::kInt:
-                    rval = right->v.sval;
-                    break;
-                case ExpressionElementType::kUInt:
-                    rval = right->v.uval;
-                    break;
-                case ExpressionElementType::kCharLiteral:
-                    rval = (int32_t)right->v.string[0];
-                    break;
-                default:
+        switch (op.op)
+        {
+            case ExpressionOpCode::kMult:
+                left = left * right;
+                break;
+            case ExpressionOpCode::kDiv:
+                if (right == 0)
+                {
                     std::stringstream ss;
-                    ss << "unexpected element, on line " << lineNum << std::endl;
+                    ss << "division by zero, on line " << lineNum << std::endl;
                     throw std::runtime_error(ss.str());
-                    break;
-            }
-
-            int32_t value = func(lval, rval);
-
-            ExpressionElement result;
-
-            result.v.sval = value;
-            result.elem = ExpressionElementType::kInt;
-
-            e.addElement(result);
-
-            // Add in rest of elements to expression
-
-            for (int i = idx + 1; i < elements.size(); i++)
-                e.addElement(elements[i]);
-
-            goto done;
-        }
-        else
-        {
-            if (left != nullptr)
-                e.addElement(*left);
+                }
+                left = left / right;
+                break;
+            case ExpressionOpCode::kPlus:
+                left = left + right;
+                break;
+            case ExpressionOpCode::kMinus:
+                left = left - right;
+                break;
+            case ExpressionOpCode::kShiftLeft:
+                left = left << right;
+                break;
+            case ExpressionOpCode::kShiftRight:
+                left = left >> right;
+                break;
+            case ExpressionOpCode::kAnd:
+                left = left & right;
+                break;
+            case ExpressionOpCode::kXor:
+                left = left ^ right;
+                break;
+            case ExpressionOpCode::kOr:
+                left = left | right;
+                break;
+            default:
+                break;
         }
-
-        left = &mid;
-        idx ++;
     }
 
-    if (left != nullptr)
-        e.addElement(*left);
+    value = stack[0];
 
-done:
-    if (foundOp)
-        return e.doOp(type, func);
-    else
-        return e;
+    if (constant)
+    {
+        known = true;
+        knownValue = value;
+    }
+
+    return true;
 }
 
-bool Expression::isStringLiteral(char*& stringLit)
+bool Expression::isStringLiteral(const char*& stringLit) const
 {
-    if (elements.size() == 1 && elements[0].elem == ExpressionElementType::kStringLiteral)
+    if (numElements == 1 && elements[0].elem == ExpressionElementType::kStringLiteral)
     {
         stringLit = elements[0].v.string;
         return true;
@@ -295,7 +362,7 @@ bool Expression::isStringLiteral(char*& stringLit)
     return false;
 }
 
-char* Expression::substituteSpecialChars(char* stringLit)
+char* Expression::substituteSpecialChars(const char* stringLit)
 {
     char* newString = new char[::strlen(stringLit)];
 
@@ -337,7 +404,7 @@ char* Expression::substituteSpecialChars(char* stringLit)
     return newString;
 }
 
-uint32_t Expression::stringLength(char* stringLit)
+uint32_t Expression::stringLength(const char* stringLit)
 {
     char* newString = substituteSpecialChars(stringLit);
     uint32_t len = strlen(newString);
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <cstdint>
-#include <functional>
+#include <vector>
+#include <stdexcept>
 
 #include "Symbol.h"
+#include "Arena.h"
 
 enum class ExpressionElementType : uint32_t
 {
@@ -32,13 +34,14 @@ struct ExpressionElement
     ExpressionElementType elem;
     union
     {
-        char* string;
+        const char* string;     // interned
+        Symbol* symbol;         // for kString
         unsigned int uval;
         int     sval;
         float   fval;
     } v;
 
-    int32_t charLiteralValue()
+    int32_t charLiteralValue() const
     {
         if (elem == ExpressionElementType::kCharLiteral)
         {
@@ -49,33 +52,80 @@ struct ExpressionElement
 
 };
 
-struct Expression
+// Expressions are compiled to postfix once, when their statement is built:
+// a flat program of pushes and operators for a small stack machine.
+
+enum class ExpressionOpCode : uint8_t
+{
+    kPushConstant,
+    kPushSymbol,
+    kNegate,
+    kNot,
+    kMult,
+    kDiv,
+    kPlus,
+    kMinus,
+    kShiftLeft,
+    kShiftRight,
+    kAnd,
+    kXor,
+    kOr,
+};
+
+struct ExpressionOp
 {
-    void addElement(ExpressionElement& e)
+    ExpressionOpCode op;
+    union
     {
-        elements.push_back(e);
-    }
+        int32_t value;
+        Symbol* symbol;
+    } v;
+};
 
-    std::vector<ExpressionElement> elements;
+struct Expression
+{
+    // elements as parsed, and the program compiled from them, both in the
+    // statement arena
+    const ExpressionElement* elements = nullptr;
+    uint32_t                 numElements = 0;
+
+    const ExpressionOp*      program = nullptr;
+    uint32_t                 programLength = 0;
 
     void reset()
     {
-        elements.clear();
+        elements = nullptr;
+        numElements = 0;
+        program = nullptr;
+        programLength = 0;
         lineNum = 0;
         value = 0;
+        known = false;
+        knownValue = 0;
     }
 
     uint32_t lineNum;
 
     int32_t value;
 
-    bool evaluate(int32_t& value, SymbolTable& syms);
-    bool isStringLiteral(char*& stringLit);
+    // Copy the parsed elements into the arena and compile them
+    void build(Arena& arena, const std::vector<ExpressionElement>& parsed);
 
-    Expression doOp(ExpressionElementType type, std::function<int32_t (int32_t left, int32_t right)> func);
+    // Returns false if the expression refers to a symbol which hasn't been
+    // evaluated yet.
+    bool evaluate(int32_t& value);
+    bool isStringLiteral(const char*& stringLit) const;
 
-    static char* substituteSpecialChars(char* stringLit);
-    static uint32_t stringLength(char* stringLit);
+    static char* substituteSpecialChars(const char* stringLit);
+    static uint32_t stringLength(const char* stringLit);
 
-};
+private:
 
+    void compile(Arena& arena);
+
+    // set once evaluated if everything it uses is constant, so it is never
+    // evaluated again
+    bool    known = false;
+    int32_t knownValue = 0;
+
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdio>
+
+#include "StringPool.h"
+
+//
+//  The scanner generated from nbasm.lex is reentrant: everything it keeps
+//  between tokens is in a yyscan_t, with this as its extra data, so each
+//  file can be parsed on its own thread.
+//
+
+typedef void* yyscan_t;
+
+struct LexerState
+{
+    StringPool* strings = nullptr;     // names and literals are interned here, not strdup'ed
+    int         lineNum = 1;
+
+    // string or character literal being scanned
+    static const int kMaxString = 255;
+    char string[kMaxString];
+    int  stringLength = 0;
+};
+
+// from flex
+int         yylex_init_extra(LexerState* state, yyscan_t* scanner);
+void        yyset_in(FILE* in, yyscan_t scanner);
+LexerState* yyget_extra(yyscan_t scanner);
+int         yylex_destroy(yyscan_t scanner);
@@ -18,13 +18,20 @@ void Statement::reset()
     label	 = nullptr;
     regSrc	 = Register::None;
     regDest	 = Register::None;
+    regInd	 = Register::None;
+    regOffset = Register::None;
     timesStatement = nullptr;
     repetitionCount = 1;
-    assembledWords.clear();
+    assembledWords = nullptr;
+    numAssembledWords = 0;
+    assembledWordsCapacity = 0;
     address = 0;
+    section = 0;
+    relocated = false;
+    optimised = false;
 }
 
-void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
+void Statement::firstPassAssemble(uint32_t& curAddress)
 {
 
     address = curAddress;
@@ -59,16 +66,17 @@ void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
 
 
             // can expression be evaluated? If so, see if it's possible to fit any immediate value into
-            // a 4 bit nibble, in which case we don't need an imm
+            // a 4 bit nibble, in which case we don't need an imm. If it can't be evaluated yet, start
+            // with the short form and let relaxation grow it.
 
-            bool expressionCanFitIn4Bits = false;
+            bool expressionCanFitIn4Bits = true;
 
             int32_t exprValue = 0;
 
-            if (expression.evaluate(exprValue, syms))
+            if (expression.evaluate(exprValue))
             {
-                if (exprValue >= 0 && exprValue < 16)
-                    expressionCanFitIn4Bits = true;
+                if (exprValue < 0 || exprValue >= 16)
+                    expressionCanFitIn4Bits = false;
             }
 
             switch (opcode)
@@ -77,7 +85,7 @@ void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
                 case OpCode::NOP:
                 case OpCode::SLEEP:
                     // these instructions are all single word
-                    assembledWords.resize(1 * repetitionCount);
+                    resizeAssembledWords(1 * repetitionCount);
                     break;
                 case OpCode::ADD:
                 case OpCode::ADC:
@@ -94,14 +102,14 @@ void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
                 case OpCode::DIV:
                 case OpCode::DIVS:
                     if (expressionCanFitIn4Bits)
-                        assembledWords.resize(1 * repetitionCount);
+                        resizeAssembledWords(1 * repetitionCount);
                     else
-                        assembledWords.resize(2 * repetitionCount);
+                        resizeAssembledWords(2 * repetitionCount);
                     break;
                 case OpCode::BSL:
                 case OpCode::BSR:
                     // barrel shift instructions are single word
-                    assembledWords.resize(1 * repetitionCount);
+                    resizeAssembledWords(1 * repetitionCount);
                     break;
                 case OpCode::JUMP:
                 case OpCode::JUMPZ:
@@ -113,10 +121,9 @@ void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
                 case OpCode::CALLC:
                 case OpCode::CALLNZ:
                 case OpCode::CALLNC:
-                    // jumps and calls can be made relative. For now, assign 2 words to
-                    // instruction as if it were absolute. We will optimise it to a single
-                    // byte later on.
-                    assembledWords.resize(2 * repetitionCount);
+                    // jumps and calls can usually be made relative. Start with a single
+                    // word, and let relaxation grow the ones that can't reach.
+                    resizeAssembledWords(1 * repetitionCount);
                     break;
                 /*
                 SVC:
@@ -152,14 +159,14 @@ void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
         case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
         {
 
-            bool expressionCanFitIn4Bits = false;
+            bool expressionCanFitIn4Bits = true;
 
             int32_t exprValue = 0;
 
-            if (expression.evaluate(exprValue, syms))
+            if (expression.evaluate(exprValue))
             {
-                if (exprValue >= 0 && exprValue < 16)
-                    expressionCanFitIn4Bits = true;
+                if (exprValue < 0 || exprValue >= 16)
+                    expressionCanFitIn4Bits = false;
             }
 
             switch (opcode)
@@ -168,9 +175,9 @@ void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
                 case OpCode::STW:
                 {
                     if (expressionCanFitIn4Bits)
-                        assembledWords.resize(1 * repetitionCount);
+                        resizeAssembledWords(1 * repetitionCount);
                     else
-                        assembledWords.resize(2 * repetitionCount);
+                        resizeAssembledWords(2 * repetitionCount);
 
                     break;
                 }
@@ -206,7 +213,7 @@ void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
 
                     int32_t exprValue = 0;
 
-                    if (! expression.evaluate(exprValue, syms))
+                    if (! expression.evaluate(exprValue))
                     {
                         std::stringstream ss;
                         ss << "Error: could not evaluate align expression on line " << lineNum << std::endl;
@@ -220,7 +227,7 @@ void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
                         throw std::runtime_error(ss.str());
                     }
 
-                    assembledWords.resize((exprValue - curAddress%exprValue) >> 1);
+                    resizeAssembledWords(((exprValue - curAddress%exprValue) % exprValue) >> 1);
 
                     break;
                 }
@@ -228,25 +235,25 @@ void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
 
                     // If DW string literal, then set the word count to the length of the string
 
-                    char* stringLit;
+                    const char* stringLit;
 
                     if (expression.isStringLiteral(stringLit))
                     {
-                        assembledWords.resize(repetitionCount * Expression::stringLength(stringLit));
+                        resizeAssembledWords(repetitionCount * Expression::stringLength(stringLit));
                     }
                     else
                     {
-                        assembledWords.resize(1 * repetitionCount);
+                        resizeAssembledWords(1 * repetitionCount);
                     }
                     break;
                 case PseudoOp::DD:
                     if (expression.isStringLiteral(stringLit))
                     {
-                        assembledWords.resize(2 * repetitionCount * Expression::stringLength(stringLit));
+                        resizeAssembledWords(2 * repetitionCount * Expression::stringLength(stringLit));
                     }
                     else
                     {
-                        assembledWords.resize(2 * repetitionCount);
+                        resizeAssembledWords(2 * repetitionCount);
                     }
                     break;
             }
@@ -256,10 +263,88 @@ void Statement::firstPassAssemble(uint32_t& curAddress, SymbolTable& syms)
             break;
     }
 
-    curAddress += assembledWords.size() * 2;
+    curAddress += numAssembledWords * 2;
 
 }
 
+void Statement::resizeAssembledWords(uint32_t count)
+{
+    if (count > assembledWordsCapacity)
+    {
+        uint16_t* words = arena->allocateArray<uint16_t>(count);
+
+        for (uint32_t i = 0; i < numAssembledWords; i++)
+            words[i] = assembledWords[i];
+
+        assembledWords = words;
+        assembledWordsCapacity = count;
+    }
+
+    for (uint32_t i = numAssembledWords; i < count; i++)
+        assembledWords[i] = 0;
+
+    numAssembledWords = count;
+}
+
+bool Statement::isSpanDependent() const
+{
+    switch (type)
+    {
+        case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
+            // barrel shifts take a 4 bit shift count, never an imm
+            return opcode != OpCode::BSL && opcode != OpCode::BSR;
+        case StatementType::OPCODE_WITH_EXPRESSION:
+            return opcode != OpCode::IMM && opcode != OpCode::NOP && opcode != OpCode::SLEEP;
+        case StatementType::INDIRECT_ADDRESSING_OPCODE_WITH_EXPRESSION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint32_t Statement::spanWords()
+{
+    int32_t exprValue = 0;
+
+    if (! expression.evaluate(exprValue))
+    {
+        std::stringstream ss;
+        ss << "Error: could not evaluate expression on line " << lineNum << std::endl;
+        throw std::runtime_error(ss.str());
+    }
+
+    if (type == StatementType::OPCODE_WITH_EXPRESSION)
+        return Assembly::flowControlWords(address, exprValue);
+
+    return exprValue < 0 || exprValue >= 16 ? 2 : 1;
+}
+
+bool Statement::relax()
+{
+    uint32_t words = spanWords();
+
+    // only ever grow, so relaxation terminates
+
+    if (words * repetitionCount <= numAssembledWords)
+        return false;
+
+    resizeAssembledWords(words * repetitionCount);
+
+    return true;
+}
+
+bool Statement::shrink()
+{
+    uint32_t words = spanWords();
+
+    if (words * repetitionCount >= numAssembledWords)
+        return false;
+
+    resizeAssembledWords(words * repetitionCount);
+
+    return true;
+}
+
 void Statement::assemble(uint32_t &curAddress)
 {
     address = curAddress;
@@ -271,9 +356,11 @@ void Statement::assemble(uint32_t &curAddress)
         repetitionCount = timesStatement->expression.value;
     }
 
-    std::vector<uint16_t> words;
+    // scratch for one repetition, reused from statement to statement
 
-    words.resize(assembledWords.size() / repetitionCount);
+    static thread_local std::vector<uint16_t> words;
+
+    words.assign(numAssembledWords / repetitionCount, 0);
 
     switch (type)
     {
@@ -297,6 +384,13 @@ void Statement::assemble(uint32_t &curAddress)
                 {
                     words.resize(1);
                     words[0] = NB_RETE_INSTRUCTION;
+                    break;
+                }
+                case OpCode::SVC:
+                {
+                    words.resize(1);
+                    words[0] = NB_SVC_INSTRUCTION;
+                    break;
                 }
                 case OpCode::NOP:
                 {
@@ -557,66 +651,8 @@ void Statement::assemble(uint32_t &curAddress)
         }
         case StatementType::ONE_REGISTER_OPCODE_AND_EXPRESSION:
         {
-            switch (opcode)
-            {
-                case OpCode::ADD:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::ADD_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::ADC:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::ADC_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::SUB:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::SUB_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::SBB:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::SBB_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::AND:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::AND_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::OR:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::OR_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::XOR:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::XOR_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::CMP:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::CMP_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::TEST:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::TEST_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::LOAD:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::LOAD_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::MUL:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::MUL_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::MULS:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::MULS_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::DIV:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::DIV_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::DIVS:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::DIVS_IMM_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::BSL:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::BSL_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                case OpCode::BSR:
-                    Assembly::makeArithmeticInstructionWithImmediate(Assembly::BSR_INSTRUCTION, regDest, expression.value, words, lineNum);
-                    break;
-                default:
-                {
-                    std::stringstream ss;
-                    ss << "Error: opcode is not single register with expression on line " << lineNum << std::endl;
-                    throw std::runtime_error(ss.str());
-
-                    break;
-                }
-            }
-
+            Assembly::makeArithmeticInstructionWithImmediate(Assembly::arithmeticImmediateInstruction(opcode, lineNum),
+                                                             regDest, expression.value, words, lineNum);
             break;
         }
         case StatementType::OPCODE_WITH_EXPRESSION:
@@ -736,7 +772,7 @@ void Statement::assemble(uint32_t &curAddress)
                 {
                     // If the expression is a string literal, repeat the string literal repetition count number of times.
 
-                    char* stringLit;
+                    const char* stringLit;
 
                     if (expression.isStringLiteral(stringLit))
                     {
@@ -776,8 +812,8 @@ void Statement::assemble(uint32_t &curAddress)
 
     // handle repetition count by repeating assembled bytes repetition count number of times.
 
-    if (assembledWords.size() != words.size() * repetitionCount)
-        assembledWords.resize(words.size() * repetitionCount);
+    if (numAssembledWords != words.size() * repetitionCount)
+        resizeAssembledWords(words.size() * repetitionCount);
 
     for (int i = 0; i < repetitionCount; i++)
         for (int j = 0; j < words.size(); j++)
@@ -786,7 +822,7 @@ void Statement::assemble(uint32_t &curAddress)
         }
 
 
-    curAddress += assembledWords.size() * 2;
+    curAddress += numAssembledWords * 2;
 
 }
 
@@ -7,6 +7,7 @@
 #include "Expression.h"
 
 #include "Symbol.h"
+#include "Arena.h"
 
 enum class StatementType
 {
@@ -22,6 +23,9 @@ enum class StatementType
     LABEL,
     TIMES,
     EQU,
+    GLOBAL,
+    LOOP,
+    LITERAL,
 };
 
 struct Statement
@@ -41,17 +45,50 @@ struct Statement
 
     StatementType type;
 
-    char*       label;
+    const char* label;      // interned
+
+    // in the statement arena
+    uint16_t* assembledWords = nullptr;
+    uint32_t  numAssembledWords = 0;
+    uint32_t  assembledWordsCapacity = 0;
+    Arena*    arena = nullptr;
 
-    std::vector<uint16_t> assembledWords;
     uint32_t address;
 
+    uint16_t section = 0;       // index into the AST's sections
+
+    // in relocatable output, assembled by the linker once its value is known
+    bool relocated = false;
+
+    // rewritten by -O, so no longer what its source line says
+    bool optimised = false;
+
     Statement* timesStatement = nullptr;
     int32_t repetitionCount = 1;
 
-    void firstPassAssemble(uint32_t &curAddress, SymbolTable& syms);
+    void firstPassAssemble(uint32_t &curAddress);
+
+    // Jumps, calls, and immediates or offsets which might need an imm are
+    // span dependent: the first pass gives them their short form, and
+    // relax() grows them once symbols have values. Returns true if the
+    // statement grew.
+    bool isSpanDependent() const;
+    bool relax();
+
+    // For optimised code: back to fewer words if that's now enough. Returns
+    // true if the statement shrank.
+    bool shrink();
+
+    // words for one repetition, with the symbols' current values
+    uint32_t spanWords();
+
     void assemble(uint32_t &curAddress);
 
+    void resizeAssembledWords(uint32_t count);
+
+    // the parser only sets the fields each type of statement uses
+    Statement() { reset(); }
+
     void reset();
 
 };
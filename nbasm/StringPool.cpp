@@ -0,0 +1,77 @@
+#include "StringPool.h"
+
+#include <string.h>
+
+static std::uint32_t hashString(const char* string)
+{
+    // FNV-1a
+
+    std::uint32_t hash = 2166136261u;
+
+    for (const char* c = string; *c != '\0'; c++)
+    {
+        hash ^= (std::uint8_t)*c;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+StringPool::StringPool() :
+    m_slots(1024),
+    m_count(0)
+{
+}
+
+const char* StringPool::intern(const char* string)
+{
+    std::uint32_t hash = hashString(string);
+    std::size_t   mask = m_slots.size() - 1;
+
+    for (std::size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        Slot& slot = m_slots[i];
+
+        if (slot.string == nullptr)
+        {
+            std::size_t len = ::strlen(string);
+
+            char* copy = m_arena.allocateArray<char>(len + 1);
+            ::memcpy(copy, string, len + 1);
+
+            slot.string = copy;
+            slot.hash   = hash;
+
+            // keep the table at most half full
+
+            if (++m_count * 2 > m_slots.size())
+                grow();
+
+            return copy;
+        }
+
+        if (slot.hash == hash && ::strcmp(slot.string, string) == 0)
+            return slot.string;
+    }
+}
+
+void StringPool::grow()
+{
+    std::vector<Slot> slots(m_slots.size() * 2);
+    std::size_t mask = slots.size() - 1;
+
+    for (const Slot& slot : m_slots)
+    {
+        if (slot.string == nullptr)
+            continue;
+
+        std::size_t i = slot.hash & mask;
+
+        while (slots[i].string != nullptr)
+            i = (i + 1) & mask;
+
+        slots[i] = slot;
+    }
+
+    m_slots.swap(slots);
+}
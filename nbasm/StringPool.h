@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Arena.h"
+
+//
+//  Interned strings. Each distinct string is stored once, so interned
+//  strings are equal exactly when their pointers are, and the pointer can
+//  be used as the string's id. They live as long as the pool.
+//
+
+class StringPool
+{
+public:
+
+    StringPool();
+
+    const char* intern(const char* string);
+
+private:
+
+    struct Slot
+    {
+        const char*   string;     // nullptr if empty
+        std::uint32_t hash;
+    };
+
+    void grow();
+
+    Arena m_arena;
+
+    std::vector<Slot> m_slots;    // open addressing, power of two sized
+    std::size_t       m_count;
+};
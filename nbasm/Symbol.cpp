@@ -0,0 +1,78 @@
+#include "Symbol.h"
+
+static std::size_t hashName(const char* name)
+{
+    // names are interned, so hash the pointer; the low bits are alignment
+
+    std::uintptr_t p = (std::uintptr_t)name;
+
+    return (std::size_t)((p >> 3) * 2654435761u);
+}
+
+SymbolTable::SymbolTable() :
+    m_slots(256),
+    m_count(0)
+{
+}
+
+Symbol* SymbolTable::find(const char* name) const
+{
+    std::size_t mask = m_slots.size() - 1;
+
+    for (std::size_t i = hashName(name) & mask; m_slots[i] != nullptr; i = (i + 1) & mask)
+        if (m_slots[i]->string == name)
+            return m_slots[i];
+
+    return nullptr;
+}
+
+Symbol* SymbolTable::get(const char* name)
+{
+    std::size_t mask = m_slots.size() - 1;
+    std::size_t i    = hashName(name) & mask;
+
+    for ( ; m_slots[i] != nullptr; i = (i + 1) & mask)
+        if (m_slots[i]->string == name)
+            return m_slots[i];
+
+    Symbol* sym = m_arena.make<Symbol>();
+    sym->string = name;
+
+    m_slots[i] = sym;
+
+    if (++m_count * 2 > m_slots.size())
+        grow();
+
+    return sym;
+}
+
+void SymbolTable::addReference(Symbol* sym, Statement* statement)
+{
+    SymbolReference* ref = m_arena.make<SymbolReference>();
+
+    ref->statement = statement;
+    ref->next      = sym->referredBy;
+
+    sym->referredBy = ref;
+}
+
+void SymbolTable::grow()
+{
+    std::vector<Symbol*> slots(m_slots.size() * 2);
+    std::size_t mask = slots.size() - 1;
+
+    for (Symbol* sym : m_slots)
+    {
+        if (sym == nullptr)
+            continue;
+
+        std::size_t i = hashName(sym->string) & mask;
+
+        while (slots[i] != nullptr)
+            i = (i + 1) & mask;
+
+        slots[i] = sym;
+    }
+
+    m_slots.swap(slots);
+}
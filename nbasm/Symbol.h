@@ -1,19 +1,61 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
-#include <map>
-#include <string>
+
+#include "Arena.h"
 
 struct Statement;
 
+struct SymbolReference
+{
+    Statement*       statement;
+    SymbolReference* next;
+};
+
 struct Symbol
 {
-    char* string;
+    const char* string;     // interned
     int32_t value = 0;
 	bool evaluated = false;
 
-    std::vector<Statement*> referredBy;
-    Statement* definedIn;
+    SymbolReference* referredBy = nullptr;
+    Statement* definedIn = nullptr;
+
+    // an equate which doesn't depend on any label, so is evaluated just once
+    bool constant = false;
+
+    // named by .global, so other objects can refer to it
+    bool global = false;
+
+    // for ordering equates
+    uint8_t visit = 0;
 };
 
-using SymbolTable = std::map<std::string, Symbol>;
+//
+//  Symbols by interned name (see StringPool), in an open addressing hash
+//  table keyed on the name's address. A symbol is created the first time
+//  it is mentioned, so expressions can point straight at it before it is
+//  defined; one which is never defined has definedIn == nullptr.
+//
+
+class SymbolTable
+{
+public:
+
+    SymbolTable();
+
+    Symbol* find(const char* name) const;   // nullptr if never mentioned
+    Symbol* get(const char* name);          // created if need be
+
+    void addReference(Symbol* sym, Statement* statement);
+
+private:
+
+    void grow();
+
+    Arena m_arena;
+
+    std::vector<Symbol*> m_slots;   // power of two sized, nullptr if empty
+    std::size_t          m_count;
+};
@@ -0,0 +1,32 @@
+        .org 0h
+
+        // Cases for the peephole optimiser: assemble with and without -O
+        // and compare the disassembly with the comments.
+
+start:
+
+        // load r1, 0 / add r1, r2 becomes load r1, r2, as the add's flags
+        // are overwritten before they are used
+
+        load r1, 0
+        add  r1, r2
+        add  r3, 1
+
+        // but adding, or'ing or xor'ing r1 to itself leaves r1 0: this
+        // must stay as it is, not become load r1, r1 and be dropped
+
+        load r1, 0
+        add  r1, r1
+        add  r3, 1
+
+        load r1, 0
+        or   r1, r1
+        add  r3, 1
+
+        load r1, 0
+        xor  r1, r1
+        add  r3, 1
+
+        jump start
+
+        .end
@@ -1,22 +1,39 @@
+%code requires {
+#include "Lexer.h"
+
+class AST;
+}
+
 %{
 #include <cstdio>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
 #include "AST.h"
 #include <unistd.h>
 #include <string.h>
 
   using namespace std;
+%}
 
-  // stuff from flex that bison needs to know about:
-  extern "C" int yylex();
-  extern "C" int yyparse();
-  extern "C" FILE *yyin;
-  extern int line_num;
+// The parser is pure and the scanner reentrant, with the AST passed in
+// rather than global, so files can be parsed on several threads at once.
+%define api.pure full
+%lex-param   { yyscan_t scanner }
+%parse-param { yyscan_t scanner } { AST& ast }
 
-  AST g_ast;
+%code {
+  int yylex(YYSTYPE* yylval, yyscan_t scanner);
+  void yyerror(yyscan_t scanner, AST& ast, const char *s);
 
-  void yyerror(const char *s);
-  %}
+  // the line the scanner has reached, for the actions below
+  #define line_num (yyget_extra(scanner)->lineNum)
+}
 
 // Bison fundamentally works by asking flex to get the next token, which it
 // returns as an object of type "yystype".  But tokens could be of any
@@ -26,12 +43,12 @@
 %union {
   int ival;
   unsigned int hval;
-  char *sval;
-  char *lsval;
-  char *cval;
-  char *regval;
-  char *opcval;
-  char *pseudoopval;
+  const char *sval;
+  const char *lsval;
+  const char *cval;
+  const char *regval;
+  const char *opcval;
+  const char *pseudoopval;
 }
 %error-verbose
 
@@ -40,7 +57,7 @@
 %token TIMES OPEN_PARENTHESIS
 %token CLOSE_PARENTHESIS PLUS MINUS MULT SHL SHR AND OR NOT XOR
 %token DIV LABEL
-%token EQU
+%token EQU LITERAL
 %token OPEN_SQUARE_BRACKET CLOSE_SQUARE_BRACKET
 
  // define the "terminal symbol" token types I'm going to use (in CAPS
@@ -53,60 +70,65 @@
 %token <regval> REG
 %token <opcval> OPCODE
 %token <pseudoopval> PSEUDOOP
+%token <sval> DIRECTIVE
 
 %%
 
-asm: body_section footer { cout << "Parsed asm file" << endl; } ;
+asm: body_section footer ;
 
 op_code : op_code_1 | op_code_2 | op_code_3 | op_code_4 | op_code_5 | op_code_6 | op_code_7;
 
-op_code_1: OPCODE REG COMMA REG ENDL { g_ast.addTwoRegisterOpcode(line_num - 1, $1,$2,$4); } ;
-op_code_2 : OPCODE REG COMMA expressions ENDL { g_ast.addOneRegisterAndExpressionOpcode(line_num - 1, $1, $2); } ;
-op_code_3 : OPCODE expressions ENDL { g_ast.addExpressionOpcode(line_num - 1, $1); } ;
-op_code_4 : OPCODE ENDL { g_ast.addStandaloneOpcode(line_num - 1, $1); } ;
-op_code_5 : OPCODE REG COMMA OPEN_SQUARE_BRACKET REG COMMA REG CLOSE_SQUARE_BRACKET ENDL { g_ast.addIndirectAddressingOpcode(line_num - 1, $1, $2, $5, $7); }
-op_code_6 : OPCODE REG COMMA OPEN_SQUARE_BRACKET REG COMMA expressions CLOSE_SQUARE_BRACKET ENDL { g_ast.addIndirectAddressingOpcodeWithExpression(line_num - 1, $1, $2, $5); }
-op_code_7 : OPCODE REG ENDL { g_ast.addOneRegisterOpcode(line_num - 1, $1, $2); }
+op_code_1: OPCODE REG COMMA REG ENDL { ast.addTwoRegisterOpcode(line_num - 1, $1,$2,$4); } ;
+op_code_2 : OPCODE REG COMMA expressions ENDL { ast.addOneRegisterAndExpressionOpcode(line_num - 1, $1, $2); } ;
+op_code_3 : OPCODE expressions ENDL { ast.addExpressionOpcode(line_num - 1, $1); } ;
+op_code_4 : OPCODE ENDL { ast.addStandaloneOpcode(line_num - 1, $1); } ;
+op_code_5 : OPCODE REG COMMA OPEN_SQUARE_BRACKET REG COMMA REG CLOSE_SQUARE_BRACKET ENDL { ast.addIndirectAddressingOpcode(line_num - 1, $1, $2, $5, $7); }
+op_code_6 : OPCODE REG COMMA OPEN_SQUARE_BRACKET REG COMMA expressions CLOSE_SQUARE_BRACKET ENDL { ast.addIndirectAddressingOpcodeWithExpression(line_num - 1, $1, $2, $5); }
+op_code_7 : OPCODE REG ENDL { ast.addOneRegisterOpcode(line_num - 1, $1, $2); }
 
 expressions: expressions expression | expression ;
 expression: hexval | integer | open_parenthesis | close_parenthesis | plus | minus|
             mult | div | and | or | shl | shr | not | xor | string | str_literal | ch_literal;
 
 
-str_literal:            STR_LITERAL         { g_ast.addStringLiteralToCurrentStatementExpression($1); }
-ch_literal:             CH_LITERAL          { g_ast.addCharLiteralToCurrentStatementExpression($1); }
-string:                 STRING              { g_ast.addStringToCurrentStatementExpression($1); }
-open_parenthesis:       OPEN_PARENTHESIS    { g_ast.addLeftParenthesisToCurrentStatementExpression(); }
-close_parenthesis:      CLOSE_PARENTHESIS   { g_ast.addRightParenthesisToCurrentStatementExpression(); }
-plus :                  PLUS                { g_ast.addPlusToCurrentStatementExpression(); }
-minus :                 MINUS               { g_ast.addMinusToCurrentStatementExpression(); }
-mult:                   MULT                { g_ast.addMultToCurrentStatementExpression(); }
-div:                    DIV                 { g_ast.addDivToCurrentStatementExpression(); }
-and :                   AND                 { g_ast.addAndToCurrentStatementExpression(); }
-or :                    OR                  { g_ast.addOrToCurrentStatementExpression(); }
-not :                   NOT                 { g_ast.addNotToCurrentStatementExpression(); }
-xor :                   XOR                 { g_ast.addXorToCurrentStatementExpression(); }
-shl :                   SHL                 { g_ast.addShiftLeftToCurrentStatementExpression();}
-shr :                   SHR                 { g_ast.addShiftRightToCurrentStatementExpression();}
-hexval:                 HEXVAL              { g_ast.addUIntToCurrentStatementExpresion($1);}
-integer:                INT                 { g_ast.addIntToCurrentStatementExpression($1); }
-
-equ: STRING EQU expressions ENDL {g_ast.addEqu(line_num - 1, $1); } ;
+str_literal:            STR_LITERAL         { ast.addStringLiteralToCurrentStatementExpression($1); }
+ch_literal:             CH_LITERAL          { ast.addCharLiteralToCurrentStatementExpression($1); }
+string:                 STRING              { ast.addStringToCurrentStatementExpression($1); }
+open_parenthesis:       OPEN_PARENTHESIS    { ast.addLeftParenthesisToCurrentStatementExpression(); }
+close_parenthesis:      CLOSE_PARENTHESIS   { ast.addRightParenthesisToCurrentStatementExpression(); }
+plus :                  PLUS                { ast.addPlusToCurrentStatementExpression(); }
+minus :                 MINUS               { ast.addMinusToCurrentStatementExpression(); }
+mult:                   MULT                { ast.addMultToCurrentStatementExpression(); }
+div:                    DIV                 { ast.addDivToCurrentStatementExpression(); }
+and :                   AND                 { ast.addAndToCurrentStatementExpression(); }
+or :                    OR                  { ast.addOrToCurrentStatementExpression(); }
+not :                   NOT                 { ast.addNotToCurrentStatementExpression(); }
+xor :                   XOR                 { ast.addXorToCurrentStatementExpression(); }
+shl :                   SHL                 { ast.addShiftLeftToCurrentStatementExpression();}
+shr :                   SHR                 { ast.addShiftRightToCurrentStatementExpression();}
+hexval:                 HEXVAL              { ast.addUIntToCurrentStatementExpresion($1);}
+integer:                INT                 { ast.addIntToCurrentStatementExpression($1); }
+
+equ: STRING EQU expressions ENDL {ast.addEqu(line_num - 1, $1); } ;
+
+literal: STRING LITERAL expressions ENDL {ast.addLiteral(line_num - 1, $1); } ;
 
 times_line: times ;
 
-times: TIMES expressions { g_ast.addTimes(line_num); } ;
+times: TIMES expressions { ast.addTimes(line_num); } ;
 
 pseudoop_line: pseudoop ;
 
-pseudoop: PSEUDOOP expressions ENDL { g_ast.addExpressionPseudoOp(line_num - 1, $1); } ;
+pseudoop: PSEUDOOP expressions ENDL { ast.addExpressionPseudoOp(line_num - 1, $1); } ;
 
-label: STRING LABEL ENDL { g_ast.addLabel(line_num - 1, $1); } ;
+directive: DIRECTIVE STRING ENDL { ast.addDirective(line_num - 1, $1, $2); } ;
+
+label: STRING LABEL ENDL { ast.addLabel(line_num - 1, $1); } ;
 
 body_section: body_lines ;
 body_lines: body_lines body_line | body_line ;
 
-body_line: op_code | times | pseudoop | label | equ | blank_line;
+body_line: op_code | times | pseudoop | directive | label | equ | literal | blank_line;
 
 blank_line: ENDLS;
 
@@ -116,11 +138,160 @@ ENDLS: ENDLS ENDL | ENDL ;
 
 void printUsage(char *arg0)
 {
-    std::cout << "Usage: " << arg0 << " [-t <bin|elf>] [-o <output.o>] <file.asm>" << std::endl;
+    std::cout << "Usage: " << arg0 << " [-t <bin|obj>] [-o <output.o>] [-O] [-l] [-j <jobs>] [-s <equates.asm>] <file.asm> ..." << std::endl;
     std::cout << std::endl;
     std::cout << "      options: " << std::endl;
-    std::cout << "          -t: type (bin / elf) " << std::endl;
+    std::cout << "          -t: type (bin / obj) - obj is a relocatable object, for nbld " << std::endl;
+    std::cout << "          -o: output file, with a single input (default out.bin / out.o); with several, " << std::endl;
+    std::cout << "              each is written beside its input, as file.bin / file.o " << std::endl;
+    std::cout << "          -O: peephole optimise, reporting the words saved in each function " << std::endl;
+    std::cout << "          -l: write a listing with estimated cycles beside the output, as file.lst " << std::endl;
+    std::cout << "          -j: files to assemble at once (default one per hardware thread) " << std::endl;
+    std::cout << "          -s: equates every input may use, as if included in each " << std::endl;
+}
+
+// Parse a file into the AST. Throws std::runtime_error if it can't be
+// opened or has a syntax error.
+void parseFile(const char* path, AST& ast)
+{
+    FILE* file = fopen(path, "r");
+
+    if (file == nullptr)
+    {
+        std::stringstream ss;
+        ss << "could not open " << path << std::endl;
+        throw std::runtime_error(ss.str());
+    }
+
+    LexerState state;
+    state.strings = &ast.strings();
+
+    yyscan_t scanner;
 
+    yylex_init_extra(&state, &scanner);
+    yyset_in(file, scanner);
+
+    try
+    {
+        yyparse(scanner, ast);
+    }
+    catch (...)
+    {
+        yylex_destroy(scanner);
+        fclose(file);
+        throw;
+    }
+
+    yylex_destroy(scanner);
+    fclose(file);
+}
+
+// file.asm -> file.o, for each of several inputs, and out.bin -> out.lst
+std::string outputPath(const std::string& input, const char* extension)
+{
+    std::size_t dot   = input.find_last_of('.');
+    std::size_t slash = input.find_last_of('/');
+
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return input + extension;
+
+    return input.substr(0, dot) + extension;
+}
+
+// Assemble one file with an AST of its own, so several can be assembled
+// at once. With verbose, each stage is reported as it starts; anything
+// else to report goes to messages.
+void assembleFile(const std::string& input, const std::string& output, bool relocatable, bool optimise,
+                  bool listing, const AST::SharedSymbols* shared, bool verbose, std::ostream& messages)
+{
+    auto stage = [&] (const char* message)
+    {
+        if (verbose)
+            messages << message << endl;
+    };
+
+    AST ast;
+
+    ast.setRelocatable(relocatable);
+    ast.setSharedSymbols(shared);
+
+    parseFile(input.c_str(), ast);
+
+    stage("Parsed asm file");
+
+    // build symbol table
+
+    stage("Building symbol table...");
+
+    ast.buildSymbolTable();
+
+    if (optimise)
+    {
+        stage("Optimising...");
+
+        ast.optimise();
+    }
+
+    // first pass assemble
+
+    stage("First pass assembly...");
+
+    ast.firstPassAssemble();
+
+    // relax jumps, calls and immediates to their shortest forms
+
+    stage("Relaxing...");
+
+    ast.relax();
+
+    if (optimise)
+        ast.printSavings(messages);
+
+    // resolve symbols
+
+    stage("Resolving symbols...");
+
+    ast.resolveSymbols();
+
+    // evaluate expressions
+
+    stage("Evaluating expressions...");
+
+    ast.evaluateExpressions();
+
+    // generate assembly
+
+    stage("Assembling...");
+
+    ast.assemble();
+
+    // output binary file
+
+    stage("Writing output...");
+
+    if (relocatable)
+        ast.writeObjectOutput(output, input);
+    else
+        ast.writeBinOutput(output);
+
+    if (listing)
+    {
+        stage("Writing listing...");
+
+        ast.writeListing(outputPath(output, ".lst"), input);
+    }
+}
+
+// The constant equates in a file, for -s. It is only parsed and its symbol
+// table built, so it may hold code, but only equates are shared.
+void loadSharedSymbols(const char* path, AST::SharedSymbols& shared)
+{
+    AST ast;
+
+    parseFile(path, ast);
+
+    ast.buildSymbolTable();
+    ast.exportConstants(shared);
 }
 
 int main(int argc, char** argv) {
@@ -133,9 +304,13 @@ int main(int argc, char** argv) {
 
     char *outputFile = nullptr;
     char *type = nullptr;
-    char c;
+    char *sharedFile = nullptr;
+    bool optimise = false;
+    bool listing = false;
+    unsigned int jobs = std::thread::hardware_concurrency();
+    int c;
 
-    while ((c = getopt (argc, argv, "t:o:")) != -1)
+    while ((c = getopt (argc, argv, "t:o:Olj:s:")) != -1)
     switch (c)
     {
         case 't':
@@ -144,6 +319,18 @@ int main(int argc, char** argv) {
         case 'o':
             outputFile = strdup(optarg);
             break;
+        case 'O':
+            optimise = true;
+            break;
+        case 'l':
+            listing = true;
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 's':
+            sharedFile = strdup(optarg);
+            break;
         default:
             printUsage(argv[0]);
             exit(EXIT_FAILURE);
@@ -152,72 +339,115 @@ int main(int argc, char** argv) {
     if (optind == argc)
     {
         std::cout << "ERROR: no input files" << std::endl;
+        exit(EXIT_FAILURE);
     }
 
-    // open a file handle to a particular file:
-    FILE *myfile = fopen(argv[optind], "r");
-    // make sure it's valid:
-    if (!myfile) {
-    cout << "I can't open Test.asm file!" << endl;
-    return -1;
-    }
-    // set lex to read from it instead of defaulting to STDIN:
-    yyin = myfile;
-
-    // parse through the input until there is no more:
+    bool relocatable = type != nullptr && strcmp(type, "obj") == 0;
 
-    do {
-    yyparse();
-    } while (!feof(yyin));
+    if (relocatable && listing)
+    {
+        std::cout << "ERROR: -l is only for flat binaries, as addresses aren't known until linking" << std::endl;
+        exit(EXIT_FAILURE);
+    }
 
-    //cout << g_ast << endl;
+    std::vector<std::string> inputs(argv + optind, argv + argc);
 
-    // build symbol table
+    if (inputs.size() > 1 && outputFile != nullptr)
+    {
+        std::cout << "ERROR: -o can't be used with more than one input file" << std::endl;
+        exit(EXIT_FAILURE);
+    }
 
-    cout << "Building symbol table..." << endl;
+    AST::SharedSymbols shared;
 
-    g_ast.buildSymbolTable();
+    try
+    {
+        if (sharedFile != nullptr)
+            loadSharedSymbols(sharedFile, shared);
+    }
+    catch (std::runtime_error& e)
+    {
+        std::cout << sharedFile << ": " << e.what();
+        exit(EXIT_FAILURE);
+    }
 
-    // first pass assemble
+    const AST::SharedSymbols* sharedSymbols = sharedFile != nullptr ? &shared : nullptr;
 
-    cout << "First pass assembly..." << endl;
+    // a single file is assembled here, reporting each stage, as it always was
 
-    g_ast.firstPassAssemble();
+    if (inputs.size() == 1)
+    {
+        std::string output = outputFile != nullptr ? outputFile : relocatable ? "out.o" : "out.bin";
+
+        try
+        {
+            assembleFile(inputs[0], output, relocatable, optimise, listing, sharedSymbols, true, std::cout);
+        }
+        catch (std::runtime_error& e)
+        {
+            std::cout << e.what();
+            exit(EXIT_FAILURE);
+        }
 
-    // resolve symbols
+        return 0;
+    }
 
-    cout << "Resolving symbols..." << endl;
+    // Several are shared out between worker threads, each taking the next
+    // file not yet started. Nothing is shared between the ASTs but the -s
+    // equates, which are only read.
 
-    g_ast.resolveSymbols();
+    if (jobs < 1)
+        jobs = 1;
 
-    // evaluate expressions
+    if (jobs > inputs.size())
+        jobs = inputs.size();
 
-    cout << "Evaluating expressions..." << endl;
+    std::atomic<std::size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex outputMutex;
 
-    g_ast.evaluateExpressions();
+    auto worker = [&] ()
+    {
+        for (std::size_t i = next++; i < inputs.size(); i = next++)
+        {
+            const std::string& input = inputs[i];
 
-    // generate assembly
+            std::string output = outputPath(input, relocatable ? ".o" : ".bin");
 
-    cout << "Assembling..." << endl;
+            std::stringstream messages;
 
-    g_ast.assemble();
+            try
+            {
+                assembleFile(input, output, relocatable, optimise, listing, sharedSymbols, false, messages);
 
-    //g_ast.printAssembly();
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cout << input << " -> " << output << std::endl << messages.str();
+            }
+            catch (std::runtime_error& e)
+            {
+                failed = true;
 
-    // TODO: relaxation to remove unnecessary NOPs introduced when assembling
-    // after symbols are known - how to do this?
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cout << input << ": " << e.what();
+            }
+        }
+    };
 
+    std::vector<std::thread> workers;
 
-    // output binary file
+    for (unsigned int i = 1; i < jobs; i++)
+        workers.push_back(std::thread(worker));
 
-    cout << "Writing output..." << endl;
+    worker();
 
-    g_ast.writeBinOutput(outputFile == nullptr ? "out.bin" : outputFile);
+    for (std::thread& t : workers)
+        t.join();
 
+    return failed ? EXIT_FAILURE : 0;
 }
 
-void yyerror(const char *s) {
-    cout << "Parse error on line " << line_num << ": " << s << endl;
-    // might as well halt now:
-    exit(-1);
+void yyerror(yyscan_t scanner, AST& ast, const char *s) {
+    std::stringstream ss;
+    ss << "Parse error on line " << yyget_extra(scanner)->lineNum << ": " << s << std::endl;
+    throw std::runtime_error(ss.str());
 }
@@ -0,0 +1,690 @@
+#include "Linker.h"
+
+#include "Assembly.h"
+
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <map>
+#include <iostream>
+
+void Linker::addObject(std::string path)
+{
+    nbObjectFile object;
+
+    if (! std::ifstream(path).is_open())
+    {
+        std::stringstream ss;
+        ss << "could not open " << path << std::endl;
+        throw std::runtime_error(ss.str());
+    }
+
+    if (! object.read(path))
+    {
+        std::stringstream ss;
+        ss << path << ": not an object file" << std::endl;
+        throw std::runtime_error(ss.str());
+    }
+
+    // symbols: globals and imports are shared by name, the rest are the object's own
+
+    std::vector<Symbol*> symbols;
+
+    for (const nbObjectSymbol& s : object.symbols)
+    {
+        const char* name = m_strings.intern(s.name.c_str());
+
+        Symbol* sym;
+
+        if (s.section == kUndefinedSection)
+        {
+            sym = m_globals.get(name);
+            m_imports.push_back(std::make_pair(sym, path));
+        }
+        else if (s.flags & kSymbolGlobal)
+        {
+            sym = m_globals.get(name);
+
+            auto defined = m_definedIn.find(sym);
+
+            if (defined != m_definedIn.end())
+            {
+                std::stringstream ss;
+                ss << "Symbol '" << name << "' defined in both " << defined->second << " and " << path << std::endl;
+                throw std::runtime_error(ss.str());
+            }
+
+            m_definedIn[sym] = path;
+        }
+        else
+        {
+            sym = m_arena.make<Symbol>();
+            sym->string = name;
+        }
+
+        if (s.section == kAbsoluteSection)
+        {
+            sym->value     = s.value;
+            sym->evaluated = true;
+            sym->constant  = true;
+        }
+        else if (s.section != kUndefinedSection && s.section != kExpressionSection &&
+                 s.section >= object.sections.size())
+        {
+            std::stringstream ss;
+            ss << path << ": symbol '" << name << "' is in a section which doesn't exist" << std::endl;
+            throw std::runtime_error(ss.str());
+        }
+
+        symbols.push_back(sym);
+    }
+
+    // equates which depend on labels, once every symbol they might use exists
+
+    for (uint32_t i = 0; i < object.symbols.size(); i++)
+    {
+        const nbObjectSymbol& s = object.symbols[i];
+
+        if (s.section != kExpressionSection)
+            continue;
+
+        ExpressionSymbol e;
+
+        e.symbol     = symbols[i];
+        e.expression = makeExpression(object, symbols, s.expression, s.expressionLength, 0, path);
+        e.source     = object.source;
+
+        m_expressionSymbols.push_back(e);
+    }
+
+    // sections, with their labels and relocations
+
+    uint32_t first = m_sections.size();
+
+    for (const nbObjectSection& s : object.sections)
+    {
+        Section section;
+
+        section.name         = s.name;
+        section.source       = object.source;
+        section.fixed        = (s.flags & kSectionFixed) != 0;
+        section.fixedAddress = s.address;
+        section.align        = std::max(s.align, 2u);
+        section.words        = s.words;
+        section.address      = 0;
+        section.size         = 0;
+
+        m_sections.push_back(section);
+    }
+
+    for (uint32_t i = 0; i < object.symbols.size(); i++)
+    {
+        const nbObjectSymbol& s = object.symbols[i];
+
+        if (s.section < object.sections.size())
+            m_sections[first + s.section].labels.push_back({ (uint32_t)s.value, symbols[i] });
+    }
+
+    for (const nbObjectRelocation& r : object.relocations)
+    {
+        if (r.section >= object.sections.size() || r.repeat == 0 ||
+            r.offset / 2 + r.words > object.sections[r.section].words.size())
+        {
+            std::stringstream ss;
+            ss << path << ": bad relocation for line " << r.lineNum << std::endl;
+            throw std::runtime_error(ss.str());
+        }
+
+        Relocation reloc;
+
+        reloc.offset         = r.offset;
+        reloc.kind           = r.kind;
+        reloc.opcode         = (OpCode)r.opcode;
+        reloc.regDest        = (Register)r.regDest;
+        reloc.regInd         = (Register)r.regInd;
+        reloc.assembledWords = r.words;
+        reloc.words          = r.words;
+        reloc.repeat         = r.repeat;
+        reloc.lineNum        = r.lineNum;
+        reloc.expression     = makeExpression(object, symbols, r.expression, r.expressionLength, r.lineNum, path);
+        reloc.address        = 0;
+
+        m_sections[first + r.section].relocations.push_back(reloc);
+    }
+
+    for (uint32_t i = first; i < m_sections.size(); i++)
+    {
+        Section& section = m_sections[i];
+
+        std::stable_sort(section.labels.begin(), section.labels.end(), [] (const Label& a, const Label& b)
+        {
+            return a.offset < b.offset;
+        });
+
+        std::stable_sort(section.relocations.begin(), section.relocations.end(), [] (const Relocation& a, const Relocation& b)
+        {
+            return a.offset < b.offset;
+        });
+    }
+}
+
+Expression Linker::makeExpression(const nbObjectFile& object, const std::vector<Symbol*>& symbols,
+                                  std::uint32_t start, std::uint32_t length, std::uint32_t lineNum, std::string path)
+{
+    if (start + length > object.expressions.size() || start + length < start)
+    {
+        std::stringstream ss;
+        ss << path << ": bad expression for line " << lineNum << std::endl;
+        throw std::runtime_error(ss.str());
+    }
+
+    ExpressionOp* program = m_arena.allocateArray<ExpressionOp>(length);
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        const nbObjectExpressionOp& op = object.expressions[start + i];
+
+        program[i].op      = (ExpressionOpCode)op.op;
+        program[i].v.value = op.value;
+
+        if (program[i].op == ExpressionOpCode::kPushSymbol)
+        {
+            if ((uint32_t)op.value >= symbols.size())
+            {
+                std::stringstream ss;
+                ss << path << ": bad symbol in expression for line " << lineNum << std::endl;
+                throw std::runtime_error(ss.str());
+            }
+
+            program[i].v.symbol = symbols[op.value];
+        }
+    }
+
+    Expression expression;
+
+    expression.reset();
+    expression.program       = program;
+    expression.programLength = length;
+    expression.lineNum       = lineNum;
+
+    return expression;
+}
+
+void Linker::removeUnusedSections(const std::vector<std::string>& entries, bool required)
+{
+
+    // Every reference to a label is a relocation, so following relocations from the
+    // roots finds everything which is used. Equates which depend on labels are
+    // followed through to the labels.
+
+    std::unordered_map<const Symbol*, uint32_t> sectionOf;
+
+    for (uint32_t i = 0; i < m_sections.size(); i++)
+        for (const Label& label : m_sections[i].labels)
+            sectionOf[label.symbol] = i;
+
+    std::unordered_map<const Symbol*, ExpressionSymbol*> equateOf;
+
+    for (ExpressionSymbol& e : m_expressionSymbols)
+        equateOf[e.symbol] = &e;
+
+    std::vector<bool>      live(m_sections.size(), false);
+    std::vector<uint32_t>  sections;        // live, still to be followed
+    std::vector<const Symbol*> symbols;     // likewise
+    std::unordered_map<const Symbol*, bool> seen;
+
+    auto use = [&] (const Symbol* sym)
+    {
+        if (! seen[sym])
+        {
+            seen[sym] = true;
+            symbols.push_back(sym);
+        }
+    };
+
+    for (uint32_t i = 0; i < m_sections.size(); i++)
+    {
+        if (m_sections[i].fixed)
+        {
+            live[i] = true;
+            sections.push_back(i);
+        }
+    }
+
+    for (const std::string& entry : entries)
+    {
+        Symbol* sym = m_globals.find(m_strings.intern(entry.c_str()));
+
+        if (sym == nullptr || m_definedIn.find(sym) == m_definedIn.end())
+        {
+            if (! required)
+                continue;
+
+            std::stringstream ss;
+            ss << "Entry symbol '" << entry << "' is not defined by any object (is it .global?)" << std::endl;
+            throw std::runtime_error(ss.str());
+        }
+
+        use(sym);
+    }
+
+    while (! sections.empty() || ! symbols.empty())
+    {
+        if (! symbols.empty())
+        {
+            const Symbol* sym = symbols.back();
+            symbols.pop_back();
+
+            auto section = sectionOf.find(sym);
+
+            if (section != sectionOf.end() && ! live[section->second])
+            {
+                live[section->second] = true;
+                sections.push_back(section->second);
+            }
+
+            auto equate = equateOf.find(sym);
+
+            if (equate != equateOf.end())
+            {
+                const Expression& expression = equate->second->expression;
+
+                for (uint32_t i = 0; i < expression.programLength; i++)
+                    if (expression.program[i].op == ExpressionOpCode::kPushSymbol)
+                        use(expression.program[i].v.symbol);
+            }
+
+            continue;
+        }
+
+        const Section& s = m_sections[sections.back()];
+        sections.pop_back();
+
+        for (const Relocation& r : s.relocations)
+            for (uint32_t i = 0; i < r.expression.programLength; i++)
+                if (r.expression.program[i].op == ExpressionOpCode::kPushSymbol)
+                    use(r.expression.program[i].v.symbol);
+    }
+
+    // drop the rest, and the equates and imports which only they used
+
+    std::vector<Section> kept;
+    uint32_t removed = 0;
+
+    for (uint32_t i = 0; i < m_sections.size(); i++)
+    {
+        if (live[i])
+        {
+            kept.push_back(std::move(m_sections[i]));
+            continue;
+        }
+
+        uint32_t bytes = m_sections[i].words.size() * 2;
+
+        if (bytes == 0)
+            continue;
+
+        std::cout << "Removing unused section '" << m_sections[i].name << "' from " << m_sections[i].source
+                  << " (" << bytes << " bytes)" << std::endl;
+
+        removed += bytes;
+    }
+
+    m_sections = std::move(kept);
+
+    m_expressionSymbols.erase(std::remove_if(m_expressionSymbols.begin(), m_expressionSymbols.end(),
+                                             [&] (const ExpressionSymbol& e) { return ! seen[e.symbol]; }),
+                              m_expressionSymbols.end());
+
+    m_imports.erase(std::remove_if(m_imports.begin(), m_imports.end(),
+                                   [&] (const std::pair<Symbol*, std::string>& i) { return ! seen[i.first]; }),
+                    m_imports.end());
+
+    if (removed != 0)
+        std::cout << "Removed " << removed << " bytes" << std::endl;
+
+}
+
+void Linker::link(std::uint32_t baseAddress)
+{
+
+    for (const auto& import : m_imports)
+    {
+        if (m_definedIn.find(import.first) == m_definedIn.end())
+        {
+            std::stringstream ss;
+            ss << "Undefined symbol '" << import.first->string << "' in " << import.second << std::endl;
+            throw std::runtime_error(ss.str());
+        }
+    }
+
+    // gather sections of the same name together
+
+    std::map<std::string, uint32_t> firstSeen;
+
+    for (const Section& s : m_sections)
+        firstSeen.insert(std::make_pair(nbSectionGroup(s.name), firstSeen.size()));
+
+    std::stable_sort(m_sections.begin(), m_sections.end(), [&] (const Section& a, const Section& b)
+    {
+        return firstSeen[nbSectionGroup(a.name)] < firstSeen[nbSectionGroup(b.name)];
+    });
+
+    // lay out, grow whatever doesn't fit, and repeat until nothing does. Relocations
+    // only ever grow, so this terminates.
+
+    for (;;)
+    {
+        layout(baseAddress);
+
+        bool grown = false;
+
+        for (Section& s : m_sections)
+        {
+            for (Relocation& r : s.relocations)
+            {
+                uint32_t words = relocationWords(r, s);
+
+                if (words > r.words)
+                {
+                    r.words = words;
+                    grown = true;
+                }
+            }
+        }
+
+        if (! grown)
+            break;
+    }
+
+    // assemble the image
+
+    uint32_t start = 0xffffffff;
+    uint32_t end   = 0;
+
+    for (const Section& s : m_sections)
+    {
+        start = std::min(start, s.address);
+        end   = std::max(end, s.address + s.size);
+    }
+
+    if (m_sections.empty())
+        start = end = baseAddress;
+
+    m_imageAddress = start;
+    m_image.assign((end - start) / 2, 0);
+
+    for (Section& s : m_sections)
+    {
+        uint16_t* out = &m_image[(s.address - start) / 2];
+        uint32_t  in  = 0;     // word in the section as assembled
+
+        for (Relocation& r : s.relocations)
+        {
+            while (in < r.offset / 2)
+                *out++ = s.words[in++];
+
+            encode(r, s, out);
+
+            out += r.words;
+            in  += r.assembledWords;
+        }
+
+        while (in < s.words.size())
+            *out++ = s.words[in++];
+    }
+
+}
+
+void Linker::layout(std::uint32_t baseAddress)
+{
+    uint32_t address = baseAddress;
+
+    for (Section& s : m_sections)
+    {
+        if (s.fixed)
+        {
+            if (s.fixedAddress < address)
+            {
+                std::stringstream ss;
+                ss << "Section '" << s.name << "' from " << s.source << " at 0x" << std::hex << s.fixedAddress
+                   << " overlaps the one before it, which ends at 0x" << address << std::endl;
+                throw std::runtime_error(ss.str());
+            }
+
+            address = s.fixedAddress;
+        }
+        else
+        {
+            address += (s.align - address % s.align) % s.align;
+        }
+
+        s.address = address;
+
+        // everything after a relocation moves by however much it has grown
+
+        int32_t  moved = 0;
+        uint32_t label = 0;
+
+        for (Relocation& r : s.relocations)
+        {
+            for (; label < s.labels.size() && s.labels[label].offset <= r.offset; label++)
+            {
+                s.labels[label].symbol->value     = s.address + s.labels[label].offset + moved;
+                s.labels[label].symbol->evaluated = true;
+            }
+
+            r.address = s.address + r.offset + moved;
+
+            if (r.kind == kRelocAlign)
+            {
+                int32_t align = evaluate(r.expression, s, r.lineNum);
+
+                if (align <= 0 || (align & 1) != 0)
+                {
+                    std::stringstream ss;
+                    ss << s.source << ": invalid alignment expression on line " << r.lineNum << std::endl;
+                    throw std::runtime_error(ss.str());
+                }
+
+                r.words = ((align - r.address % align) % align) >> 1;
+            }
+
+            moved += ((int32_t)r.words - (int32_t)r.assembledWords) * 2;
+        }
+
+        for (; label < s.labels.size(); label++)
+        {
+            s.labels[label].symbol->value     = s.address + s.labels[label].offset + moved;
+            s.labels[label].symbol->evaluated = true;
+        }
+
+        s.size  = s.words.size() * 2 + moved;
+        address = s.address + s.size;
+    }
+
+    evaluateExpressionSymbols();
+}
+
+void Linker::evaluateExpressionSymbols()
+{
+
+    // Equates using labels can use each other, across objects too, so
+    // evaluate whichever can be until all have been.
+
+    for (ExpressionSymbol& e : m_expressionSymbols)
+        e.symbol->evaluated = false;
+
+    uint32_t remaining = m_expressionSymbols.size();
+
+    while (remaining != 0)
+    {
+        uint32_t before = remaining;
+
+        for (ExpressionSymbol& e : m_expressionSymbols)
+        {
+            if (e.symbol->evaluated)
+                continue;
+
+            int32_t value = 0;
+
+            if (e.expression.evaluate(value))
+            {
+                e.symbol->value     = value;
+                e.symbol->evaluated = true;
+                remaining--;
+            }
+        }
+
+        if (remaining == before)
+        {
+            for (ExpressionSymbol& e : m_expressionSymbols)
+            {
+                if (! e.symbol->evaluated)
+                {
+                    std::stringstream ss;
+                    ss << e.source << ": could not evaluate symbol '" << e.symbol->string << "', it is circular" << std::endl;
+                    throw std::runtime_error(ss.str());
+                }
+            }
+        }
+    }
+
+}
+
+int32_t Linker::evaluate(Expression& expression, const Section& section, std::uint32_t lineNum)
+{
+    int32_t value = 0;
+
+    try
+    {
+        if (expression.evaluate(value))
+            return value;
+    }
+    catch (std::runtime_error& e)
+    {
+        throw std::runtime_error(section.source + ": " + e.what());
+    }
+
+    std::stringstream ss;
+    ss << section.source << ": could not evaluate expression on line " << lineNum << std::endl;
+    throw std::runtime_error(ss.str());
+}
+
+std::uint32_t Linker::relocationWords(Relocation& r, const Section& section)
+{
+    // words each relocation needs where it is now, as Statement::relax()
+
+    uint32_t words = 1;
+
+    switch (r.kind)
+    {
+        case kRelocFlowControl:
+            words = Assembly::flowControlWords(r.address, evaluate(r.expression, section, r.lineNum));
+            break;
+        case kRelocImmediate:
+        case kRelocLoadStore:
+        {
+            // barrel shifts take a 4 bit shift count, never an imm
+
+            if (r.opcode == OpCode::BSL || r.opcode == OpCode::BSR)
+                break;
+
+            int32_t value = evaluate(r.expression, section, r.lineNum);
+
+            if (value < 0 || value >= 16)
+                words = 2;
+
+            break;
+        }
+        case kRelocWord:
+            break;
+        default:
+            return r.words;
+    }
+
+    return words * r.repeat;
+}
+
+void Linker::encode(Relocation& r, const Section& section, std::uint16_t* out)
+{
+    if (r.kind == kRelocAlign)
+        return;     // padding is zero
+
+    std::vector<uint16_t> words(r.words / r.repeat, 0);
+
+    int32_t value = evaluate(r.expression, section, r.lineNum);
+
+    try
+    {
+        switch (r.kind)
+        {
+            case kRelocFlowControl:
+                Assembly::makeFlowControlInstruction(r.opcode, r.address, value, r.lineNum, words);
+                break;
+            case kRelocImmediate:
+                Assembly::makeArithmeticInstructionWithImmediate(Assembly::arithmeticImmediateInstruction(r.opcode, r.lineNum),
+                                                                 r.regDest, value, words, r.lineNum);
+                break;
+            case kRelocLoadStore:
+                Assembly::makeLoadStoreWithExpression(r.opcode, r.lineNum, words, value, r.regInd, r.regDest);
+                break;
+            case kRelocWord:
+                words[0] = value;
+                break;
+            default:
+            {
+                std::stringstream ss;
+                ss << "unknown relocation on line " << r.lineNum << std::endl;
+                throw std::runtime_error(ss.str());
+            }
+        }
+    }
+    catch (std::runtime_error& e)
+    {
+        throw std::runtime_error(section.source + ": " + e.what());
+    }
+
+    for (uint32_t i = 0; i < r.repeat; i++)
+        for (uint32_t j = 0; j < words.size(); j++)
+            out[i * words.size() + j] = words[j];
+}
+
+void Linker::writeBinOutput(std::string path) const
+{
+    std::ofstream out;
+
+    out.open(path.c_str(), std::ios_base::out | std::ios_base::binary);
+
+    if (! out.is_open())
+    {
+        std::stringstream ss;
+        ss << "could not write " << path << std::endl;
+        throw std::runtime_error(ss.str());
+    }
+
+    for (uint16_t word : m_image)
+        out.write((char*)&word, sizeof(uint16_t));
+}
+
+void Linker::writeSymbolFile(std::string path) const
+{
+    std::multimap<uint32_t, const char*> labels;
+
+    for (const Section& s : m_sections)
+        for (const Label& label : s.labels)
+            labels.insert(std::make_pair((uint32_t)label.symbol->value, label.symbol->string));
+
+    std::ofstream out(path);
+
+    if (! out.is_open())
+    {
+        std::stringstream ss;
+        ss << "could not write " << path << std::endl;
+        throw std::runtime_error(ss.str());
+    }
+
+    for (const auto& label : labels)
+        out << std::hex << std::setw(8) << std::setfill('0') << label.first << " " << label.second << std::endl;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "nbObjectFile.h"
+#include "types.h"
+
+#include "Expression.h"
+#include "Symbol.h"
+#include "StringPool.h"
+#include "Arena.h"
+
+//
+//  Links objects from nbasm -t obj into a flat binary.
+//
+//  Sections in the same group (see nbSectionGroup()) are gathered
+//  together, in the order the groups first appear, and within that in the
+//  order of the objects. Each is placed after the one before it, aligned
+//  to the largest .align in it, unless it has its own address from an .org.
+//
+//  Relocations start at the sizes the assembler gave them. Once everything
+//  is placed, those which don't fit - a jump too far to be relative, an
+//  immediate needing an imm - grow, which moves what follows, so layout is
+//  repeated until nothing grows, as nbasm does for a single file.
+//
+
+class Linker
+{
+public:
+
+    // These throw std::runtime_error, with the object or source file and
+    // line in the message.
+    void addObject(std::string path);
+
+    // Drop the sections which can't be reached, before linking: those with
+    // an .org (the vectors) and those defining an entry symbol are kept,
+    // then whatever they refer to, and so on. An entry symbol which isn't
+    // defined is an error if required, otherwise ignored.
+    void removeUnusedSections(const std::vector<std::string>& entries, bool required);
+
+    void link(std::uint32_t baseAddress);
+
+    void writeBinOutput(std::string path) const;
+
+    // "<hex byte address> <name>" for each label, as nbsim -y reads
+    void writeSymbolFile(std::string path) const;
+
+private:
+
+    struct Relocation
+    {
+        std::uint32_t offset;       // bytes into the section, as assembled
+        std::uint32_t kind;
+        OpCode        opcode;
+        Register      regDest;
+        Register      regInd;
+        std::uint32_t assembledWords;
+        std::uint32_t words;        // now, with all repeats
+        std::uint32_t repeat;
+        std::uint32_t lineNum;
+        Expression    expression;
+
+        std::uint32_t address;      // once laid out
+    };
+
+    struct Label
+    {
+        std::uint32_t offset;
+        Symbol*       symbol;
+    };
+
+    struct Section
+    {
+        std::string   name;
+        std::string   source;       // for messages
+        bool          fixed;
+        std::uint32_t fixedAddress;
+        std::uint32_t align;
+
+        std::vector<std::uint16_t> words;
+        std::vector<Relocation>    relocations;     // by offset
+        std::vector<Label>         labels;          // by offset
+
+        std::uint32_t address;      // once laid out
+        std::uint32_t size;
+    };
+
+    struct ExpressionSymbol
+    {
+        Symbol*     symbol;
+        Expression  expression;
+        std::string source;
+    };
+
+    void layout(std::uint32_t baseAddress);
+    void evaluateExpressionSymbols();
+
+    std::uint32_t relocationWords(Relocation& r, const Section& section);
+    void encode(Relocation& r, const Section& section, std::uint16_t* out);
+
+    int32_t evaluate(Expression& expression, const Section& section, std::uint32_t lineNum);
+
+    Expression makeExpression(const nbObjectFile& object, const std::vector<Symbol*>& symbols,
+                              std::uint32_t start, std::uint32_t length, std::uint32_t lineNum, std::string path);
+
+    StringPool  m_strings;
+    Arena       m_arena;        // symbols and expression programs
+
+    SymbolTable m_globals;
+    std::unordered_map<const Symbol*, std::string> m_definedIn;            // globals, by the object defining them
+    std::vector<std::pair<Symbol*, std::string>>   m_imports;              // and by an object using them
+
+    std::vector<Section>          m_sections;   // in layout order, once linked
+    std::vector<ExpressionSymbol> m_expressionSymbols;
+
+    std::vector<std::uint16_t> m_image;
+    std::uint32_t              m_imageAddress = 0;
+};
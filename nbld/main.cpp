@@ -0,0 +1,100 @@
+//
+//  nbld: link relocatable objects from nbasm -t obj into a flat binary,
+//  so modules can be assembled separately and only those which changed
+//  reassembled.
+//
+
+#include "Linker.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+void printUsage(char* exe)
+{
+    std::cout << "Usage: " << exe << " [-b <base address>] [-g] [-e <entry symbol>] [-o <output.bin>] [-y <symbol file>] <object.o> ..." << std::endl;
+    std::cout << std::endl;
+    std::cout << "      options: " << std::endl;
+    std::cout << "          -b: address to place the first section at, unless it has an .org (default 0) " << std::endl;
+    std::cout << "          -g: remove sections which can't be reached from an .org'd section or an entry symbol " << std::endl;
+    std::cout << "          -e: entry symbol for -g, may be repeated (default _reset, if there is one) " << std::endl;
+    std::cout << "          -y: write the address of every label, for nbsim -y " << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 1)
+    {
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    std::string outputFile = "out.bin";
+    std::string symbolFile;
+    std::uint32_t baseAddress = 0;
+    bool removeUnused = false;
+    std::vector<std::string> entries;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:ge:o:y:")) != -1)
+    switch (c)
+    {
+        case 'b':
+            baseAddress = strtoul(optarg, nullptr, 0);
+            break;
+        case 'g':
+            removeUnused = true;
+            break;
+        case 'e':
+            entries.push_back(optarg);
+            break;
+        case 'o':
+            outputFile = optarg;
+            break;
+        case 'y':
+            symbolFile = optarg;
+            break;
+        default:
+            printUsage(argv[0]);
+            exit(EXIT_FAILURE);
+    }
+
+    if (optind == argc)
+    {
+        std::cout << "ERROR: no input files" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    Linker linker;
+
+    try
+    {
+        for (int i = optind; i < argc; i++)
+            linker.addObject(argv[i]);
+
+        if (removeUnused)
+        {
+            if (entries.empty())
+                linker.removeUnusedSections({ "_reset" }, false);
+            else
+                linker.removeUnusedSections(entries, true);
+        }
+
+        linker.link(baseAddress);
+
+        linker.writeBinOutput(outputFile);
+
+        if (! symbolFile.empty())
+            linker.writeSymbolFile(symbolFile);
+    }
+    catch (std::runtime_error& e)
+    {
+        std::cout << "Error: " << e.what();
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include "audiocon.h"
+
+AudioCon::AudioCon(Memory& mem, EventScheduler& sched) :
+    m_memory(mem),
+    m_scheduler(sched),
+    m_control(0),
+    m_status(0),
+    m_bufferAddr(0),
+    m_bufferLength(0),
+    m_writePointer(0),
+    m_readPointer(0),
+    m_samplePeriod(kDefaultSamplePeriod),
+    m_running(false),
+    m_eventId(0),
+    m_muted(false),
+    m_block(kBlockSamples),
+    m_sink(new NullAudioSink)
+{
+}
+
+void AudioCon::setAudioSink(std::unique_ptr<IAudioSink> sink)
+{
+    m_sink = std::move(sink);
+    m_sink->setSampleRate(kCPUClock / m_samplePeriod);
+}
+
+void AudioCon::hardReset()
+{
+    stop();
+
+    m_control      = 0;
+    m_status       = 0;
+    m_bufferAddr   = 0;
+    m_bufferLength = 0;
+    m_writePointer = 0;
+    m_readPointer  = 0;
+    m_samplePeriod = kDefaultSamplePeriod;
+}
+
+void AudioCon::shutDown()
+{
+    m_sink->shutDown();
+}
+
+std::uint16_t AudioCon::inPort(std::uint16_t reg)
+{
+    switch ((AudioConReg)reg)
+    {
+        case AudioConReg::Control:
+            return m_control;
+        case AudioConReg::Status:
+            return m_status;
+        case AudioConReg::BufferAddrLo:
+            return m_bufferAddr & 0xffff;
+        case AudioConReg::BufferAddrHi:
+            return m_bufferAddr >> 16;
+        case AudioConReg::BufferLength:
+            return m_bufferLength;
+        case AudioConReg::WritePointer:
+            return m_writePointer;
+        case AudioConReg::ReadPointer:
+            return m_readPointer;
+        case AudioConReg::SamplePeriod:
+            return m_samplePeriod;
+        default:
+            return 0;
+    }
+}
+
+void AudioCon::outPort(std::uint16_t reg, std::uint16_t value)
+{
+    switch ((AudioConReg)reg)
+    {
+        case AudioConReg::Control:
+        {
+            bool wasEnabled = m_control & kControlEnable;
+
+            m_control = value;
+
+            if (! wasEnabled && (m_control & kControlEnable))
+                start();
+            else if (wasEnabled && ! (m_control & kControlEnable))
+                stop();
+
+            updateInterrupt();
+            break;
+        }
+        case AudioConReg::Status:
+            m_status &= ~(value & (kStatusUnderrun | kStatusBlockDone));
+            updateInterrupt();
+            break;
+        case AudioConReg::BufferAddrLo:
+            m_bufferAddr = (m_bufferAddr & 0xffff0000) | value;
+            break;
+        case AudioConReg::BufferAddrHi:
+            m_bufferAddr = (m_bufferAddr & 0x0000ffff) | ((std::uint32_t)value << 16);
+            break;
+        case AudioConReg::BufferLength:
+            m_bufferLength = value;
+
+            // the pointers may be past the end of a shorter ring
+            m_writePointer = wrapPointer(m_writePointer);
+            m_readPointer  = wrapPointer(m_readPointer);
+            break;
+        case AudioConReg::WritePointer:
+            m_writePointer = wrapPointer(value);
+            break;
+        case AudioConReg::SamplePeriod:
+            m_samplePeriod = value == 0 ? 1 : value;
+            m_sink->setSampleRate(kCPUClock / m_samplePeriod);
+            break;
+        default:
+            break;
+    }
+}
+
+std::uint32_t AudioCon::wrapPointer(std::uint32_t pointer) const
+{
+    return m_bufferLength == 0 ? 0 : pointer % m_bufferLength;
+}
+
+void AudioCon::start()
+{
+    m_readPointer = 0;
+    m_running     = true;
+    m_eventId     = m_scheduler.schedule((std::uint64_t)kBlockSamples * m_samplePeriod, [this] () { transferBlock(); });
+}
+
+void AudioCon::stop()
+{
+    if (m_running)
+        m_scheduler.cancel(m_eventId);
+    m_running = false;
+}
+
+void AudioCon::transferBlock()
+{
+    // A block's worth of samples has been played out since the last
+    // event; fetch them from the ring in one go.
+
+    std::uint32_t length    = m_bufferLength;
+    std::uint32_t available = 0;
+
+    if (length != 0)
+        available = (m_writePointer + length - m_readPointer) % length;
+
+    std::uint32_t count = available < kBlockSamples ? available : kBlockSamples;
+
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        m_block[i]    = (std::int16_t)m_memory.dmaReadWord(m_bufferAddr + m_readPointer);
+        m_readPointer = (m_readPointer + 1) % length;
+    }
+
+    if (count < kBlockSamples)
+    {
+        // Underrun: the DAC plays silence for the rest of the block
+
+        for (std::uint32_t i = count; i < kBlockSamples; i++)
+            m_block[i] = 0;
+
+        m_status |= kStatusUnderrun;
+    }
+
+    m_status |= kStatusBlockDone;
+
+    if (! m_muted)
+        m_sink->writeSamples(m_block.data(), kBlockSamples);
+
+    updateInterrupt();
+
+    m_eventId = m_scheduler.schedule((std::uint64_t)kBlockSamples * m_samplePeriod, [this] () { transferBlock(); });
+}
+
+void AudioCon::updateInterrupt()
+{
+    bool irq = ((m_status & kStatusUnderrun)  && (m_control & kControlUnderrunInterruptEnable)) ||
+               ((m_status & kStatusBlockDone) && (m_control & kControlBlockInterruptEnable));
+
+    if (m_intDel != nullptr)
+        m_intDel->setIRQ(kAudioIRQ, irq);
+}
+
+AudioCon::State AudioCon::saveState() const
+{
+    State state;
+
+    state.control      = m_control;
+    state.status       = m_status;
+    state.bufferAddr   = m_bufferAddr;
+    state.bufferLength = m_bufferLength;
+    state.writePointer = m_writePointer;
+    state.readPointer  = m_readPointer;
+    state.samplePeriod = m_samplePeriod;
+    state.running      = m_running;
+    state.eventId      = m_eventId;
+
+    return state;
+}
+
+void AudioCon::restoreState(const State& state)
+{
+    m_control      = state.control;
+    m_status       = state.status;
+    m_bufferAddr   = state.bufferAddr;
+    m_bufferLength = state.bufferLength;
+    m_writePointer = state.writePointer;
+    m_readPointer  = state.readPointer;
+    m_samplePeriod = state.samplePeriod;
+    m_running      = state.running;
+    m_eventId      = state.eventId;
+
+    m_sink->setSampleRate(kCPUClock / m_samplePeriod);
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "iportsink.h"
+#include "memory.h"
+#include "eventscheduler.h"
+#include "audiosink.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+--      0                       |       Control
+--      1                       |       Status
+--      2                       |       Buffer address lo (word address of sample ring in memory)
+--      3                       |       Buffer address hi
+--      4                       |       Buffer length (samples)
+--      5                       |       Write pointer (sample index, written by software)
+--      6                       |       Read pointer (sample index, read only)
+--      7                       |       Sample period (CPU cycles per sample)
+*/
+
+enum class AudioConReg
+{
+    Control         = 0,
+    Status          = 1,
+    BufferAddrLo    = 2,
+    BufferAddrHi    = 3,
+    BufferLength    = 4,
+    WritePointer    = 5,
+    ReadPointer     = 6,
+    SamplePeriod    = 7
+};
+
+class AudioCon : public IPortSink
+{
+public:
+
+    AudioCon(Memory& mem, EventScheduler& sched);
+
+    virtual std::uint16_t inPort(std::uint16_t reg) override;
+    virtual void          outPort(std::uint16_t reg, std::uint16_t value) override;
+
+    virtual void          setInterruptDelegate(IInterruptDelegate* intDel) override { m_intDel = intDel; }
+
+    void setAudioSink(std::unique_ptr<IAudioSink> sink);
+
+    void hardReset();
+    void shutDown();
+
+    // While muted, blocks are still fetched (and interrupts raised) but
+    // not sent to the sink; used when re-executing history.
+    void setMuted(bool muted) { m_muted = muted; }
+
+    struct State
+    {
+        std::uint16_t control;
+        std::uint16_t status;
+        std::uint32_t bufferAddr;
+        std::uint16_t bufferLength;
+        std::uint16_t writePointer;
+        std::uint16_t readPointer;
+        std::uint16_t samplePeriod;
+        bool          running;
+        int           eventId;
+    };
+
+    State saveState() const;
+    void  restoreState(const State& state);
+
+    const std::uint16_t kControlEnable                  = 1 << 0;
+    const std::uint16_t kControlUnderrunInterruptEnable = 1 << 1;
+    const std::uint16_t kControlBlockInterruptEnable    = 1 << 2;
+
+    const std::uint16_t kStatusUnderrun     = 1 << 0;   // write 1 to clear
+    const std::uint16_t kStatusBlockDone    = 1 << 1;   // write 1 to clear
+
+    const int kAudioIRQ = 2;
+
+    const std::uint32_t kCPUClock            = 50000000;
+    const std::uint16_t kDefaultSamplePeriod = 1042;    // ~48kHz
+
+    // Samples are moved from memory in blocks, one scheduler event per
+    // block, so the CPU loop pays nothing per sample.
+    const std::uint32_t kBlockSamples = 256;
+
+private:
+
+    // a ring index, within the current buffer length
+    std::uint32_t wrapPointer(std::uint32_t pointer) const;
+
+    void start();
+    void stop();
+    void transferBlock();
+    void updateInterrupt();
+
+    Memory&         m_memory;
+    EventScheduler& m_scheduler;
+
+    std::uint16_t m_control;
+    std::uint16_t m_status;
+    std::uint32_t m_bufferAddr;
+    std::uint16_t m_bufferLength;
+    std::uint16_t m_writePointer;
+    std::uint16_t m_readPointer;
+    std::uint16_t m_samplePeriod;
+
+    bool m_running;
+    int  m_eventId;
+    bool m_muted;
+
+    std::vector<std::int16_t> m_block;
+
+    std::unique_ptr<IAudioSink> m_sink;
+
+    IInterruptDelegate* m_intDel = nullptr;
+};
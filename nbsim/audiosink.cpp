@@ -0,0 +1,125 @@
+#include "audiosink.h"
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+
+WavFileAudioSink::WavFileAudioSink(std::string path)    :
+    m_sampleRate(48000),
+    m_samplesWritten(0)
+{
+    m_file.open(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+
+    if (! m_file.is_open())
+    {
+        std::cout << "Error: could not open audio output " << path << std::endl;
+        return;
+    }
+
+    // placeholder header, sizes are filled in on shut down
+    writeHeader();
+}
+
+WavFileAudioSink::~WavFileAudioSink()
+{
+    shutDown();
+}
+
+void WavFileAudioSink::writeSamples(const std::int16_t* samples, std::size_t count)
+{
+    if (! m_file.is_open())
+        return;
+
+    m_file.write((const char*)samples, count * sizeof(std::int16_t));
+    m_samplesWritten += count;
+}
+
+void WavFileAudioSink::shutDown()
+{
+    if (! m_file.is_open())
+        return;
+
+    m_file.seekp(0);
+    writeHeader();
+    m_file.close();
+}
+
+void WavFileAudioSink::writeHeader()
+{
+    auto write16 = [this] (std::uint16_t v) { m_file.write((const char*)&v, 2); };
+    auto write32 = [this] (std::uint32_t v) { m_file.write((const char*)&v, 4); };
+
+    std::uint32_t dataBytes = m_samplesWritten * sizeof(std::int16_t);
+
+    m_file.write("RIFF", 4);
+    write32(36 + dataBytes);
+    m_file.write("WAVE", 4);
+
+    m_file.write("fmt ", 4);
+    write32(16);                // chunk size
+    write16(1);                 // PCM
+    write16(1);                 // mono
+    write32(m_sampleRate);
+    write32(m_sampleRate * 2);  // byte rate
+    write16(2);                 // block align
+    write16(16);                // bits per sample
+
+    m_file.write("data", 4);
+    write32(dataBytes);
+}
+
+RingBufferAudioSink::RingBufferAudioSink(std::unique_ptr<IAudioSink> sink)  :
+    m_sink(std::move(sink)),
+    m_ring(kRingSize),
+    m_dropped(0),
+    m_threadExit(false),
+    m_drainThread([] (RingBufferAudioSink* rb) { rb->drainThread(); }, this)
+{
+}
+
+RingBufferAudioSink::~RingBufferAudioSink()
+{
+    shutDown();
+}
+
+void RingBufferAudioSink::writeSamples(const std::int16_t* samples, std::size_t count)
+{
+    std::size_t written = m_ring.write(samples, count);
+
+    // If the host side can't keep up we drop rather than block the CPU thread
+    if (written != count)
+        m_dropped += count - written;
+}
+
+void RingBufferAudioSink::shutDown()
+{
+    if (! m_drainThread.joinable())
+        return;
+
+    m_threadExit = true;
+    m_drainThread.join();
+    m_sink->shutDown();
+
+    if (m_dropped != 0)
+        std::cout << "Warning: " << m_dropped << " audio samples dropped" << std::endl;
+}
+
+void RingBufferAudioSink::drainThread()
+{
+    std::vector<std::int16_t> block(kDrainSize);
+
+    while (true)
+    {
+        bool exiting = m_threadExit;
+
+        std::size_t n;
+
+        while ((n = m_ring.read(block.data(), block.size())) != 0)
+            m_sink->writeSamples(block.data(), n);
+
+        if (exiting)
+            break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(kDrainIntervalMs));
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "ringbuffer.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+//
+//  Destinations for PCM samples produced by the audio controller.
+//  Samples are signed 16 bit mono.
+//
+
+class IAudioSink
+{
+public:
+
+    virtual ~IAudioSink() {}
+
+    virtual void setSampleRate(std::uint32_t rate) { }
+    virtual void writeSamples(const std::int16_t* samples, std::size_t count) = 0;
+    virtual void shutDown() { }
+};
+
+class NullAudioSink : public IAudioSink
+{
+public:
+
+    virtual void writeSamples(const std::int16_t* samples, std::size_t count) override { }
+};
+
+class WavFileAudioSink : public IAudioSink
+{
+public:
+
+    WavFileAudioSink(std::string path);
+    ~WavFileAudioSink();
+
+    virtual void setSampleRate(std::uint32_t rate) override { m_sampleRate = rate; }
+    virtual void writeSamples(const std::int16_t* samples, std::size_t count) override;
+    virtual void shutDown() override;
+
+private:
+
+    void writeHeader();
+
+    std::ofstream m_file;
+    std::uint32_t m_sampleRate;
+    std::uint32_t m_samplesWritten;
+};
+
+//
+//  Decouples the CPU thread from a live audio device. The audio controller
+//  pushes blocks into a lock-free ring buffer and a drain thread forwards
+//  them to the real sink, so device I/O never stalls emulation; samples
+//  that don't fit are dropped, and counted. Not for files, which should
+//  get every sample.
+//
+
+class RingBufferAudioSink : public IAudioSink
+{
+public:
+
+    RingBufferAudioSink(std::unique_ptr<IAudioSink> sink);
+    ~RingBufferAudioSink();
+
+    virtual void setSampleRate(std::uint32_t rate) override { m_sink->setSampleRate(rate); }
+    virtual void writeSamples(const std::int16_t* samples, std::size_t count) override;
+    virtual void shutDown() override;
+
+    std::uint64_t droppedSamples() const { return m_dropped; }
+
+private:
+
+    const std::size_t kRingSize  = 65536;
+    const std::size_t kDrainSize = 4096;
+    const int kDrainIntervalMs   = 10;
+
+    void drainThread();
+
+    std::unique_ptr<IAudioSink> m_sink;
+    RingBuffer<std::int16_t>    m_ring;
+
+    std::atomic<std::uint64_t>  m_dropped;
+    std::atomic<bool>           m_threadExit;
+    std::thread                 m_drainThread;
+};
@@ -0,0 +1,28 @@
+//
+//  ALU loop: register and short immediate arithmetic, logic and shifts.
+//  No memory access other than instruction fetch.
+//
+
+        .org 0h
+
+start:
+        load r1, 0
+        load r2, 3
+        load r3, 0
+        load r4, 5
+
+alu_loop:
+        add  r1, 1
+        xor  r3, r1
+        add  r3, r2
+        sub  r3, 1
+        and  r3, r4
+        or   r4, 2
+        sl0  r2
+        sr0  r2
+        adc  r5, r3
+        sbb  r5, 1
+        cmp  r3, r5
+        jump alu_loop
+
+        .end
@@ -0,0 +1,149 @@
+//
+//  nbsim-bench: run each benchmark program flat out for a fixed number of
+//  cycles and report instructions per second of host time, as JSON.
+//
+//  The interpreter is the only execution engine the simulator has, so each
+//  result is tagged with the engine name to leave room for others.
+//
+
+#include "nbsoc.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+struct BenchResult
+{
+    std::string name;
+    SimStats    stats;
+};
+
+void printUsage(char* exe)
+{
+    std::cout << "Usage: " << exe << " [-c <cycles per benchmark>] [-o <results.json>] <program.bin> ..." << std::endl;
+}
+
+std::string benchName(std::string path)
+{
+    std::size_t slash = path.find_last_of('/');
+
+    if (slash != std::string::npos)
+        path = path.substr(slash + 1);
+
+    std::size_t dot = path.find_last_of('.');
+
+    if (dot != std::string::npos)
+        path = path.substr(0, dot);
+
+    return path;
+}
+
+BenchResult runBenchmark(std::string path, std::uint64_t cycles)
+{
+    BenchResult result;
+
+    result.name = benchName(path);
+
+    // no flash image: the benchmarks run from block ram
+
+    nbSoC nanobrain;
+
+    nanobrain.configureBlockRam(path);
+    nanobrain.setThrottle(false);
+    nanobrain.stopAfter(cycles);
+
+    nanobrain.start();
+    nanobrain.waitForStop();
+    nanobrain.shutDown();
+
+    result.stats = nanobrain.getStats();
+
+    return result;
+}
+
+void writeResults(std::ostream& os, const std::vector<BenchResult>& results, std::uint64_t cycles)
+{
+    os << "{" << std::endl;
+    os << "  \"cycles_per_benchmark\": " << cycles << "," << std::endl;
+    os << "  \"results\": [";
+
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const SimStats& stats = results[i].stats;
+        double seconds = (double)stats.hostNs / 1e9;
+
+        os << (i == 0 ? "" : ",") << std::endl;
+        os << "    {" << std::endl;
+        os << "      \"benchmark\": \"" << results[i].name << "\"," << std::endl;
+        os << "      \"engine\": \"interpreter\"," << std::endl;
+        os << "      \"cycles\": " << stats.cycles << "," << std::endl;
+        os << "      \"instructions\": " << stats.instructions << "," << std::endl;
+        os << "      \"irqs\": " << stats.irqs << "," << std::endl;
+        os << "      \"host_seconds\": " << seconds << "," << std::endl;
+        os << "      \"instructions_per_second\": " << (seconds == 0.0 ? 0.0 : stats.instructions / seconds) << std::endl;
+        os << "    }";
+    }
+
+    os << std::endl << "  ]" << std::endl;
+    os << "}" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::uint64_t cycles = 100000000;
+    char* outFile = nullptr;
+
+    int c;
+
+    while ((c = getopt (argc, argv, "c:o:")) != -1)
+    switch (c)
+    {
+        case 'c':
+            cycles = strtoull(optarg, nullptr, 0);
+            break;
+        case 'o':
+            outFile = optarg;
+            break;
+        default:
+            printUsage(argv[0]);
+            exit(EXIT_FAILURE);
+    }
+
+    if (optind == argc)
+    {
+        printUsage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<BenchResult> results;
+
+    for (int i = optind; i < argc; i++)
+    {
+        results.push_back(runBenchmark(argv[i], cycles));
+
+        std::cerr << results.back().name << ": ";
+        results.back().stats.writeSummary(std::cerr);
+        std::cerr << std::endl;
+    }
+
+    if (outFile != nullptr)
+    {
+        std::ofstream out(outFile);
+
+        if (! out.is_open())
+        {
+            std::cout << "Error: could not open " << outFile << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        writeResults(out, results, cycles);
+    }
+    else
+    {
+        writeResults(std::cout, results, cycles);
+    }
+
+    return 0;
+}
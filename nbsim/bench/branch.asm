@@ -0,0 +1,27 @@
+//
+//  Tight conditional branches, alternately taken and not taken.
+//
+
+        .org 0h
+
+start:
+        load r1, 0
+        load r2, 0
+        load r3, 0
+
+branch_loop:
+        add    r1, 1
+        test   r1, 1
+        jumpz  branch_even
+        add    r2, 1
+        jump   branch_next
+branch_even:
+        add    r3, 1
+branch_next:
+        test   r1, 2
+        jumpnz branch_loop
+        cmp    r1, 0
+        jumpz  branch_loop
+        jump   branch_loop
+
+        .end
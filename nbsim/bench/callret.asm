@@ -0,0 +1,32 @@
+//
+//  Call / return chains: a loop calling short leaf functions, with a
+//  two deep chain which saves the link register in a scratch register.
+//
+
+        .org 0h
+
+start:
+        load r1, 0
+
+call_loop:
+        call leaf1
+        call leaf2
+        call outer
+        jump call_loop
+
+outer:
+        stspr r6, s1
+        call  leaf1
+        call  leaf2
+        ldspr s1, r6
+        ret
+
+leaf1:
+        add r1, 1
+        ret
+
+leaf2:
+        sub r1, 1
+        ret
+
+        .end
@@ -0,0 +1,22 @@
+//
+//  Immediates too wide for the instruction word, so every one of them
+//  takes an IMM prefix.
+//
+
+        .org 0h
+
+start:
+        load r1, 0
+
+imm_loop:
+        load r2, 0x1234
+        add  r2, 0x5678
+        xor  r2, 0x9abc
+        and  r2, 0xdef0
+        or   r2, 0x0f0f
+        sub  r2, 0x1111
+        cmp  r2, 0x2222
+        add  r1, 0x0101
+        jump imm_loop
+
+        .end
@@ -0,0 +1,63 @@
+//
+//  Interrupt storm: the timer auto-reloads every 64 cycles with its
+//  interrupt enabled, while the main loop does ALU work.
+//
+
+        .org 0h
+
+vectors:
+reset:
+        jump start
+        .align 4
+interrupt:
+        jump interruptHandler
+        .align 4
+exception:
+        rete
+        .align 4
+svc_vector:
+        nop
+        nop
+
+start:
+        // enable the timer interrupt at the interrupt controller
+
+        load r0, 0xb001
+        load r1, 0x0001
+        out  r1, r0
+
+        // timer: reload 64, enable | load | auto reload | interrupt enable
+
+        load r0, 64
+        load r1, 0xc003
+        out  r0, r1
+        load r0, 0x0f
+        load r1, 0xc000
+        out  r0, r1
+
+        // enable interrupts
+
+        load  r0, 1
+        load  r1, 0
+        ldspr s0, r0
+
+        load r2, 0
+        load r3, 0
+
+storm_loop:
+        add  r2, 1
+        xor  r3, r2
+        jump storm_loop
+
+interruptHandler:
+        // clear the timer's interrupt, which drops its IRQ line
+
+        load r8, 1
+        load r9, 0xc001
+        out  r8, r9
+
+        add  r10, 1
+
+        reti
+
+        .end
@@ -0,0 +1,27 @@
+//
+//  Load / store stream through a 2KiB window of DDR.
+//
+
+        .org 0h
+
+start:
+        // s9 = DDR base (byte address 0x800000)
+
+        load  r0, 0
+        load  r1, 0x80
+        ldspr s9, r0
+
+        load  r1, 0
+        load  r3, 0
+
+ldst_loop:
+        stw   r1, [s9, r1]
+        ldw   r2, [s9, r1]
+        add   r3, r2
+        stw   r3, [s9, 2]
+        ldw   r4, [s9, 2]
+        add   r1, 2
+        and   r1, 0x7fe
+        jump  ldst_loop
+
+        .end
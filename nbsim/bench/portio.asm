@@ -0,0 +1,37 @@
+//
+//  Port I/O: LED and hex display writes, switch reads and timer count
+//  reads, through the port dispatch table.
+//
+
+        .org 0h
+
+start:
+        // free running timer, so count reads do some work
+
+        load r0, 0xffff
+        load r1, 0xc003
+        out  r0, r1
+        load r0, 0x07
+        load r1, 0xc000
+        out  r0, r1
+
+        load r4, 0
+
+port_loop:
+        add  r4, 1
+
+        load r0, 0x1000
+        out  r4, r0
+        load r0, 0x1001
+        out  r4, r0
+        load r0, 0x1003
+        out  r4, r0
+
+        load r0, 0x1002
+        in   r5, r0
+        load r0, 0xc002
+        in   r6, r0
+
+        jump port_loop
+
+        .end
@@ -1,4 +1,5 @@
 #include "cpu.h"
+#include "timetravel.h"
 
 #include "nbInstructionSet.h"
 #include "nbInstructionDecodeTable.h"
@@ -7,6 +8,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <iostream>
 #include <sstream>
 #include <iomanip>
 
@@ -15,17 +17,32 @@
 
 //#define DEBUG_INSTRUCTIONS
 
-CPU::CPU(Memory &mem, IOPorts& ioports) :
+CPU::CPU(Memory &mem, IOPorts& ioports, EventScheduler& sched) :
+    m_executing(false),
     m_memory(mem),
     m_ioports(ioports),
-    m_cpuThread([] (CPU* cpu) { cpu->runThread(); }, this),
+    m_scheduler(sched),
+    m_decodeTable(instructionDecodeTable()),
     m_threadExit(false),
     m_threadPause(false),
-    m_sleep(false),
     m_singleStep(false),
-    m_paused(true)
+    m_resume(false),
+    m_paused(true),
+    m_sleep(false),
+    m_replaying(false),
+    m_throttle(true),
+    m_throttleCycle(0),
+    m_timeTravel(nullptr),
+    m_trace(nullptr),
+    m_timing(nullptr),
+    m_semihost(nullptr),
+    m_opcodeCounts(),
+    m_irqCount(0),
+    m_sleepCycles(0),
+    m_hostNs(0),
+    m_blocksSincePublish(0),
+    m_cpuThread([] (CPU* cpu) { cpu->runThread(); }, this)
 {
-        m_ioports.setCPUInterruptDelegate(this);
 }
 
 void CPU::hardReset()
@@ -44,19 +61,33 @@ void CPU::hardReset()
         m_sprRegisters[i] = 0;
     }
 
-    m_interrupt = 0;
-    m_exception = 0;
-    m_svc = 0;
+    m_exception = false;
+    m_exceptionCause = 0;
+    m_exceptionPC = 0;
+    m_sleep = false;
 
     m_ioports.hardReset();
+
+    resetStats();
+
+    if (m_timing != nullptr)
+        m_timing->reset();
+
+    if (m_timeTravel != nullptr)
+        m_timeTravel->reset();
+
+    if (m_semihost != nullptr)
+        m_semihost->reset();
 }
 
 void CPU::run()
 {
-    // Spawn a thread that will execute instructions at 50MHz
+    // Release the CPU thread, which executes instructions at 50MHz
 
-    m_cond.notify_all();
+    std::unique_lock<std::mutex> lock(m_mutex);
 
+    m_resume = true;
+    m_cond.notify_all();
 }
 
 void CPU::pause()
@@ -67,15 +98,44 @@ void CPU::pause()
 
     m_threadPause = true;
     m_cond.notify_all();
-    m_pauseCond.wait(lock);
+
+    while (! m_paused)
+        m_pauseCond.wait(lock);
 }
 
 void CPU::singleStep()
 {
     std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (! m_paused) return;
+
     m_singleStep = true;
     m_cond.notify_all();
-    m_singleStepCond.wait(lock);
+
+    while (m_singleStep)
+        m_singleStepCond.wait(lock);
+}
+
+void CPU::wake()
+{
+    // Taking the lock means the CPU thread is either running or already
+    // waiting, so the notify can't be lost.
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.notify_all();
+}
+
+void CPU::halt()
+{
+    // Called on the CPU thread, so just flag it: the pause is taken at
+    // the end of the current block.
+
+    m_threadPause = true;
+
+    // a halt re-fired while replaying history has been reported already
+
+    if (m_onHalt && ! m_replaying)
+        m_onHalt();
 }
 
 void CPU::shutDown()
@@ -83,378 +143,507 @@ void CPU::shutDown()
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         m_threadExit = true;
+        m_cond.notify_all();
     }
 
-    m_cond.notify_all();
     m_cpuThread.join();
 }
 
-std::string CPU::dumpRegisters()
+CPU::RegisterSnapshot CPU::getRegisterSnapshot()
 {
     std::unique_lock<std::mutex> lock(m_mutex);
 
-    std::stringstream ss;
+    RegisterSnapshot snap;
 
-    ss << "pc = " << std::hex << std::setw(4) << std::setfill('0') << (m_pc << 1) <<
-          " C=" << m_C << " Z=" << m_Z << std::endl;
+    snap.pc = m_pc;
+    snap.C  = m_C;
+    snap.Z  = m_Z;
 
     for (int i = 0; i < 16; i ++)
     {
-        if (i && (i%8 == 0))
-            ss << std::endl;
-        ss << "r" << std::dec << std::setw(2) << std::setfill('0') << i << "=" << std::hex << std::setw(4) << std::setfill('0') << m_gprRegisters[i] << " ";
+        snap.gpr[i] = m_gprRegisters[i];
+        snap.spr[i] = m_sprRegisters[i];
     }
 
-    ss << std::endl;
+    return snap;
+}
 
-    for (int i = 0; i < 16; i ++)
-    {
-        if (i && (i%4 == 0))
-            ss << std::endl;
-        ss << "s" << std::dec << std::setw(2) << i << "=" << std::hex << std::setw(8) << std::setfill('0') << m_sprRegisters[i] << " ";
-    }
+std::uint32_t CPU::getPC()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
 
-    return ss.str();
+    return m_pc;
 }
 
-std::string CPU::dumpDisas()
+void CPU::runThread()
 {
-    std::stringstream ss;
-    std::unique_lock<std::mutex> lock(m_mutex);
+    // The lock is held while instructions run and dropped between blocks
+    // (and while waiting), so the debugger can get in. Pause and exit
+    // requests are atomic flags checked after every instruction.
 
-    uint32_t immediate = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
 
-    for (int pc = std::max(0, (int)m_pc - 2*7); pc < m_pc + 2*7; pc ++)
+    while (! m_threadExit)
     {
-        uint16_t instruction = m_memory.readWord(pc);
-
-        UniqueOpCode opcode = UniqueOpCode::None;
+        if (m_threadPause)
+        {
+            if (! m_paused)
+                m_hostNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_runStart).count();
 
-        if (pc == m_pc)
-            ss << "==>";
-        else
-            ss << "   ";
+            m_threadPause = false;
+            m_paused = true;
+            m_resume = false;
 
-        ss << std::hex << std::setw(6) << std::setfill('0') << (pc << 1) << ":\t";
-        ss << std::hex << std::setw(4) << std::setfill('0') << instruction << "\t";
+            publishStats();
+            m_pauseCond.notify_all();
+        }
 
-        for (const nbInstructionDecodeInfo& info : instructionInfo)
+        if (m_paused)
         {
-            if ((instruction & info.mask) == info.instruction)
-            {
-                ss << info.string;
-
-                for (int i = 0; i < 8 - strlen(info.string); i++)
-                    ss << " ";
+            while (! m_resume && ! m_singleStep && ! m_threadExit)
+                m_cond.wait(lock);
 
-                opcode = info.opcode;
+            if (m_threadExit)
                 break;
+
+            if (! m_resume)
+            {
+                // Asleep, a step runs to the next device event. With none
+                // pending nothing can wake the CPU, so there is nothing to do.
+
+                if (m_sleep)
+                {
+                    if (m_scheduler.hasPendingEvents())
+                        sleepUntil(m_scheduler.nextEventTime());
+                }
+                else if (m_trace != nullptr || m_timing != nullptr)
+                    clockTickObserved();
+                else
+                    clockTick();
+
+                m_singleStep = false;
+                m_singleStepCond.notify_all();
+                continue;
             }
-        }
 
-        // Determine how to format parameters
+            m_resume = false;
+            m_paused = false;
 
-        bool immSet = false;
+            m_runStart = std::chrono::steady_clock::now();
+            resetThrottle();
+        }
 
-        switch (opcode)
+        if (m_sleep)
         {
-            case UniqueOpCode::IMM:
-                immSet = true;
-                immediate = (instruction & 0x3fff);
+            // Nothing happens while asleep until a device event fires,
+            // so skip virtual time straight to the next one (no faster
+            // than real time, if throttled). Interrupts
+            // are only raised on this thread, and other threads wake us
+            // with the lock held, so there is no lost wakeup here. If
+            // paused, the CPU stays asleep.
 
-                ss << std::hex << immediate;
-                break;
-            case UniqueOpCode::ADD_IMM:
-            case UniqueOpCode::ADC_IMM:
-            case UniqueOpCode::SUB_IMM:
-            case UniqueOpCode::SBB_IMM:
-            case UniqueOpCode::AND_IMM:
-            case UniqueOpCode::OR_IMM:
-            case UniqueOpCode::XOR_IMM:
-            case UniqueOpCode::CMP_IMM:
-            case UniqueOpCode::TEST_IMM:
-            case UniqueOpCode::LOAD_IMM:
-            case UniqueOpCode::MUL_IMM:
-            case UniqueOpCode::MULS_IMM:
-            case UniqueOpCode::DIV_IMM:
-            case UniqueOpCode::DIVS_IMM:
-            {
-                int regx = (instruction & 0xf0) >> 4;
-                uint32_t immval = (instruction & 0x0f);
+            std::uint64_t sleepStart = m_scheduler.now();
 
-                ss << (Register)regx << ", " << std::hex << immval << "\t; " << ((immediate << 4) | immval);
+            // the CPU is idle, so a good time to publish the counters
+            publishStats();
 
-                break;
-            }
-            case UniqueOpCode::ADD_REG:
-            case UniqueOpCode::ADC_REG:
-            case UniqueOpCode::SUB_REG:
-            case UniqueOpCode::SBB_REG:
-            case UniqueOpCode::AND_REG:
-            case UniqueOpCode::OR_REG:
-            case UniqueOpCode::XOR_REG:
-            case UniqueOpCode::CMP_REG:
-            case UniqueOpCode::TEST_REG:
-            case UniqueOpCode::LOAD_REG:
-            case UniqueOpCode::MUL_REG:
-            case UniqueOpCode::MULS_REG:
-            case UniqueOpCode::DIV_REG:
-            case UniqueOpCode::DIVS_REG:
-            case UniqueOpCode::OUT:
-            case UniqueOpCode::IN:
+            while (! m_ioports.interruptPending() && ! m_threadPause && ! m_threadExit)
             {
-                int regx = (instruction & 0xf0) >> 4;
-                int regy = (instruction & 0x0f);
+                if (m_scheduler.hasPosted())
+                    m_scheduler.runPosted();
+                else if (m_scheduler.hasPendingEvents())
+                {
+                    m_scheduler.advanceTo(m_scheduler.nextEventTime());
+
+                    // held to real time, as when running
+                    throttle(lock);
+                }
+                else
+                    m_cond.wait(lock);
+            }
 
-                ss << (Register)regx << ", " << (Register)regy;
+            m_sleepCycles += m_scheduler.now() - sleepStart;
 
-                break;
-            }
-            case UniqueOpCode::SLA:
-            case UniqueOpCode::SLX:
-            case UniqueOpCode::SL0:
-            case UniqueOpCode::SL1:
-            case UniqueOpCode::RL:
-            case UniqueOpCode::SRA:
-            case UniqueOpCode::SRX:
-            case UniqueOpCode::SR0:
-            case UniqueOpCode::SR1:
-            case UniqueOpCode::RR:
-            {
-                int regx = (instruction & 0xf0) >> 4;
+            if (m_ioports.interruptPending())
+                m_sleep = false;
+            continue;
+        }
 
-                ss << (Register)regx;
+        bool checkBreakpoints = ! m_breakpoints.empty();
+        bool observe = m_trace != nullptr || m_timing != nullptr;
 
-                break;
-            }
-            case UniqueOpCode::BSL:
-            case UniqueOpCode::BSR:
-            {
-                int regx = (instruction & 0xf0) >> 4;
-                int immval = (instruction & 0x0f);
+        for (int i = 0; i < kInstructionsPerBlock; i++)
+        {
+            if (observe)
+                clockTickObserved();
+            else
+                clockTick();
 
-                ss << (Register)regx << ", " << (Register)immval;
+            if (checkBreakpoints && m_breakpoints.count(m_pc))
+                m_threadPause = true;
 
+            if (m_sleep || m_threadPause || m_threadExit)
                 break;
-            }
-            case UniqueOpCode::FMUL:
-            case UniqueOpCode::FDIV:
-            case UniqueOpCode::FADD:
-            case UniqueOpCode::FSUB:
-            case UniqueOpCode::FCMP:
-            case UniqueOpCode::FINT:
-            case UniqueOpCode::FFLT:
-            {
-                break;
-            }
-            case UniqueOpCode::NOP:
-            case UniqueOpCode::SLEEP:
-            {
-                break;
-            }
-            case UniqueOpCode::JUMP:
-            case UniqueOpCode::JUMPZ:
-            case UniqueOpCode::JUMPC:
-            case UniqueOpCode::JUMPNZ:
-            case UniqueOpCode::JUMPNC:
-            case UniqueOpCode::CALL:
-            case UniqueOpCode::CALLZ:
-            case UniqueOpCode::CALLC:
-            case UniqueOpCode::CALLNZ:
-            case UniqueOpCode::CALLNC:
-            {
-                uint32_t addr = (instruction & 0x1ff);
+        }
 
-                ss << addr << "\t;" << (((immediate << 9) | addr) << 1);
+        if (m_timeTravel != nullptr && m_timeTravel->checkpointDue())
+            m_timeTravel->takeCheckpoint(saveState());
 
-                break;
-            }
-            case UniqueOpCode::JUMP_REL:
-            case UniqueOpCode::JUMPZ_REL:
-            case UniqueOpCode::JUMPC_REL:
-            case UniqueOpCode::JUMPNZ_REL:
-            case UniqueOpCode::JUMPNC_REL:
-            case UniqueOpCode::CALL_REL:
-            case UniqueOpCode::CALLZ_REL:
-            case UniqueOpCode::CALLC_REL:
-            case UniqueOpCode::CALLNZ_REL:
-            case UniqueOpCode::CALLNC_REL:
-            {
-                int32_t addr = (instruction & 0x1ff);
+        if (++m_blocksSincePublish == kBlocksPerStatsPublish)
+            publishStats();
 
-                if (addr & 0x100)
-                    addr |= 0xfe00;
+        throttle(lock);
+    }
 
-                ss << addr << "\t; " << ((pc + (int)addr) << 1);
+    if (! m_paused)
+        m_hostNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_runStart).count();
 
-                break;
-            }
-            case UniqueOpCode::SVC:
-            case UniqueOpCode::RET:
-            case UniqueOpCode::RETI:
-            case UniqueOpCode::RETE:
-            {
-                break;
-            }
-            case UniqueOpCode::LDW_IMM:
-            case UniqueOpCode::STW_IMM:
-            {
-                int regx = (instruction & 0xf0) >> 4;
-                int immVal = (immediate << 4) | (instruction & 0x0f);
-                int regi = (instruction & 0x300) >> 8;
+    m_paused = true;
+    publishStats();
+}
 
-                ss << (Register)regx << ", [" << (Register)(regi + 16 + 8) << ", " << immVal << "]";
+void CPU::resetStats()
+{
+    for (int i = 0; i < SimStats::kNumOpcodeCounters; i++)
+        m_opcodeCounts[i] = 0;
 
-                break;
-            }
-            case UniqueOpCode::LDW_REG:
-            case UniqueOpCode::STW_REG:
-            {
-                int regx = (instruction & 0xf0) >> 4;
-                int regy = (instruction & 0x0f);
-                int regi = (instruction & 0x300) >> 8;
+    m_irqCount    = 0;
+    m_sleepCycles = 0;
+    m_hostNs      = 0;
+    m_runStart    = std::chrono::steady_clock::now();
 
-                ss << (Register)regx << ", [" << (Register)(regi + 16 + 8) << ", " << (Register)regy << "]";
+    m_memory.resetAccessCounts();
+    m_ioports.resetAccessCounts();
 
-                break;
-            }
-            case UniqueOpCode::LDSPR:
-            {
-                int regx = (instruction & 0xe0) >> 4;
-                int regy = (instruction & 0x0f);
+    publishStats();
+}
 
-                ss << (Register)(regx + 16) << ", " << (Register)regy;
+CPU::Counters CPU::saveCounters() const
+{
+    Counters counters;
 
-                break;
-            }
-            case UniqueOpCode::STSPR:
-            {
-                int regx = (instruction & 0xe0) >> 4;
-                int regy = (instruction & 0x0f);
+    for (int i = 0; i < SimStats::kNumOpcodeCounters; i++)
+        counters.opcodeCounts[i] = m_opcodeCounts[i];
 
-                ss << (Register)regx << ", " << (Register)(regy + 16);
+    counters.irqCount    = m_irqCount;
+    counters.sleepCycles = m_sleepCycles;
+    counters.memory      = m_memory.saveAccessCounts();
+    counters.ports       = m_ioports.saveAccessCounts();
 
-                break;
-            }
-            case UniqueOpCode::INCW:
-            case UniqueOpCode::DECW:
-            {
-                int regx = (instruction & 0xf0) >> 4;
+    return counters;
+}
 
-                ss << (Register)(regx + 16);
+void CPU::restoreCounters(const Counters& counters)
+{
+    for (int i = 0; i < SimStats::kNumOpcodeCounters; i++)
+        m_opcodeCounts[i] = counters.opcodeCounts[i];
 
-                break;
-            }
-        }
+    m_irqCount    = counters.irqCount;
+    m_sleepCycles = counters.sleepCycles;
+
+    m_memory.restoreAccessCounts(counters.memory);
+    m_ioports.restoreAccessCounts(counters.ports);
+}
+
+void CPU::publishStats()
+{
+    SimStats stats;
+
+    stats.cycles       = m_scheduler.now();
+    stats.instructions = 0;
+    stats.irqs         = m_irqCount;
+    stats.sleepCycles  = m_sleepCycles;
+    stats.hostNs       = m_hostNs;
 
-        if (! immSet)
-            immediate = 0;
+    if (! m_paused)
+        stats.hostNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_runStart).count();
 
-        ss << std::endl;
+    for (int i = 0; i < SimStats::kNumOpcodeCounters; i++)
+    {
+        stats.opcodeCounts[i] = m_opcodeCounts[i];
+        stats.instructions   += m_opcodeCounts[i];
     }
 
-    return ss.str();
+    for (int i = 0; i < Memory::kNumRegions; i++)
+    {
+        stats.memReads[i]  = m_memory.getReads(i);
+        stats.memWrites[i] = m_memory.getWrites(i);
+    }
+
+    for (int i = 0; i < IOPorts::kNumPorts; i++)
+    {
+        stats.portReads[i]  = m_ioports.getPortReads(i);
+        stats.portWrites[i] = m_ioports.getPortWrites(i);
+    }
 
+    m_stats.publish(stats);
+    m_blocksSincePublish = 0;
 }
 
-void CPU::setIRQ(bool level)
+CPU::State CPU::saveState() const
 {
-    if (level)
+    State state;
+
+    state.pc = m_pc;
+    state.imm = m_imm;
+    state.C = m_C;
+    state.Z = m_Z;
+
+    for (int i = 0; i < 16; i ++)
     {
-        m_interrupt = true;
-        // wake sleeping thread.
-        if (! m_paused)
-            m_cond.notify_all();
+        state.gpr[i] = m_gprRegisters[i];
+        state.spr[i] = m_sprRegisters[i];
     }
-    else
+
+    state.exception = m_exception;
+    state.exceptionCause = m_exceptionCause;
+    state.exceptionPC = m_exceptionPC;
+    state.sleep = m_sleep;
+    state.instruction = m_instruction;
+
+    return state;
+}
+
+void CPU::restoreState(const State& state)
+{
+    m_pc = state.pc;
+    m_imm = state.imm;
+    m_C = state.C;
+    m_Z = state.Z;
+
+    for (int i = 0; i < 16; i ++)
     {
-        m_interrupt = false;
-        // wake sleeping thread.
-        if (! m_paused)
-            m_cond.notify_all();
+        m_gprRegisters[i] = state.gpr[i];
+        m_sprRegisters[i] = state.spr[i];
     }
+
+    m_exception = state.exception;
+    m_exceptionCause = state.exceptionCause;
+    m_exceptionPC = state.exceptionPC;
+    m_sleep = state.sleep;
+    m_instruction = state.instruction;
 }
 
-void CPU::runThread()
+bool CPU::sleepUntil(std::uint64_t limit)
 {
+    // Skip virtual time while asleep, as far as limit. Returns true once
+    // an interrupt has woken the CPU.
+
+    std::uint64_t sleepStart = m_scheduler.now();
+    bool woken = true;
+
+    while (! m_ioports.interruptPending())
     {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        m_cond.wait(lock);
+        if (! m_scheduler.hasPendingEvents() || m_scheduler.nextEventTime() > limit)
+        {
+            if (limit != kNoCycle)
+                m_scheduler.advanceTo(limit);
+            woken = false;
+            break;
+        }
+
+        m_scheduler.advanceTo(m_scheduler.nextEventTime());
     }
 
-    while (! m_threadExit)
-    {
+    m_sleepCycles += m_scheduler.now() - sleepStart;
 
-        {
-            std::unique_lock<std::mutex> lock(m_mutex);
+    if (woken)
+        m_sleep = false;
 
-            if (m_sleep)
-            {
-                if (! m_paused)
-                    m_cond.wait(lock);
-                m_sleep = false;
-            }
-        }
+    return woken;
+}
 
-        {
-            std::unique_lock<std::mutex> lock(m_mutex);
+void CPU::setBreakpoint(std::uint32_t address, bool set)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
 
-            if (m_threadPause)
-            {
-                m_paused = true;
-                m_threadPause = false;
-                m_pauseCond.notify_all();
-                m_cond.wait(lock);
-            }
-        }
+    if (set)
+        m_breakpoints.insert(address);
+    else
+        m_breakpoints.erase(address);
+}
 
-        {
-            std::unique_lock<std::mutex> lock(m_mutex);
+std::set<std::uint32_t> CPU::getBreakpoints()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
 
-            m_paused = false;
-            clockTick();
-        }
+    return m_breakpoints;
+}
+
+bool CPU::reverseStep()
+{
+    return reverse(false);
+}
+
+bool CPU::reverseContinue()
+{
+    return reverse(true);
+}
 
-        struct timespec tm1, tm2;
+bool CPU::reverse(bool toBreakpoint)
+{
+    // Runs on the caller's thread with the CPU thread parked. Re-execute
+    // from the newest checkpoint before now to find the cycle to go back
+    // to, then restore and re-execute again to stop there. If there is
+    // nothing to stop at after that checkpoint, try the one before, up to
+    // where the last search started.
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (! m_paused || m_timeTravel == nullptr)
+        return false;
+
+    std::uint64_t now = m_scheduler.now();
+    int index = m_timeTravel->findCheckpointBefore(now);
+
+    if (index < 0)
+        return false;
+
+    // Posted host input waits until we're done, and output which has
+    // already been seen once isn't repeated.
+
+    m_scheduler.holdPosted(true);
+    m_ioports.setReplaying(true);
+    m_replaying = true;
+
+    Counters counters = saveCounters();
+
+    bool moved = false;
 
-        tm1.tv_sec = 0;
-        tm1.tv_nsec = 20;
-        nanosleep(&tm1, &tm2);
-        //usleep(1000);
+    std::uint64_t searchLimit = now;
 
+    for (; index >= 0 && ! moved; index--)
+    {
+        std::uint64_t lastStart      = kNoCycle;
+        std::uint64_t lastBreakpoint = kNoCycle;
+
+        restoreState(m_timeTravel->restoreCheckpoint(index, searchLimit));
+        replayTo(searchLimit, &lastStart, toBreakpoint ? &lastBreakpoint : nullptr);
+
+        std::uint64_t target = toBreakpoint ? lastBreakpoint : lastStart;
+
+        if (target == kNoCycle)
         {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            if (m_singleStep)
+            if (index > 0)
             {
-                m_singleStep = false;
-                m_paused = true;
-                m_singleStepCond.notify_all();
-                m_cond.wait(lock);
+                searchLimit = m_timeTravel->getCheckpointCycle(index);
+                continue;
             }
+
+            // Nothing found in the whole history: stop at the start of it
+
+            target = m_timeTravel->getCheckpointCycle(0);
         }
+
+        restoreState(m_timeTravel->restoreCheckpoint(index, target));
+        replayTo(target, nullptr, nullptr);
+
+        m_timeTravel->truncate(index, target);
+        moved = true;
     }
 
+    restoreCounters(counters);
+
+    m_replaying = false;
+    m_ioports.setReplaying(false);
+    m_scheduler.holdPosted(false);
+
+    // a halt scheduled in the past will have fired again
+    m_threadPause = false;
+
+    return moved;
+}
+
+void CPU::replayTo(std::uint64_t target, std::uint64_t* lastStart, std::uint64_t* lastBreakpoint)
+{
+    // Execute up to cycle target the same way runThread() does, noting the
+    // last cycle an instruction started on, and the last cycle a
+    // breakpoint was reached on.
+
+    for (;;)
+    {
+        if (m_sleep && ! sleepUntil(target))
+            break;
+
+        if (m_scheduler.now() >= target)
+            break;
+
+        if (lastStart != nullptr)
+            *lastStart = m_scheduler.now();
+
+        if (lastBreakpoint != nullptr && m_breakpoints.count(m_pc))
+            *lastBreakpoint = m_scheduler.now();
+
+        clockTick();
+    }
+}
+
+void CPU::setThrottle(bool throttle)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_throttle = throttle;
+    resetThrottle();
+}
+
+void CPU::resetThrottle()
+{
+    m_throttleStart = std::chrono::steady_clock::now();
+    m_throttleCycle = m_scheduler.now();
+}
+
+void CPU::throttle(std::unique_lock<std::mutex>& lock)
+{
+    // Hold virtual time to real time at 50MHz (20ns per cycle). Waiting on
+    // the condition variable releases the lock and lets pause / exit in.
+
+    if (! m_throttle)
+    {
+        lock.unlock();
+        lock.lock();
+        return;
+    }
+
+    auto deadline = m_throttleStart + std::chrono::nanoseconds((m_scheduler.now() - m_throttleCycle) * kNsPerCycle);
+    auto now      = std::chrono::steady_clock::now();
+
+    if (deadline <= now)
+    {
+        // Behind real time. Don't try to catch up after a long stall
+        // (host busy, debugger), just carry on from here.
+
+        if (now - deadline > std::chrono::milliseconds(100))
+            resetThrottle();
+
+        lock.unlock();
+        lock.lock();
+        return;
+    }
+
+    m_cond.wait_until(lock, deadline, [this] () { return m_threadPause || m_threadExit; });
 }
 
 void CPU::holdInReset(bool hold)
 {
     if (hold)
     {
-        m_threadPause = true;
-        while (m_threadPause)
-            usleep(100);
+        pause();
         hardReset();
     }
     else
     {
-        m_cond.notify_all();
+        run();
     }
 }
 
 void CPU::clockTick()
 {
 
-    if (m_interrupt && (m_sprRegisters[SPR_MSR] & MSR_IE))
+    if (m_exception)
+    {
+        takeException();
+    }
+    else if (m_ioports.interruptPending() && (m_sprRegisters[SPR_MSR] & MSR_IE))
     {
 
         std::uint32_t vbar = m_sprRegisters[SPR_VBAR];
@@ -465,21 +654,128 @@ void CPU::clockTick()
         m_sprRegisters[SPR_MSR] &= ~MSR_IE; // disable further interrupts.
         m_pc = addr;
 
+        m_irqCount++;
+
     }
-    else if (m_exception && (m_sprRegisters[SPR_MSR] & MSR_EE))
+    else
     {
+        // a fetch from a bad address reads 0, which is a harmless imm
 
+        m_executing = true;
+        fetchInstruction();
+        executeInstruction();
+        m_executing = false;
     }
-    else if (m_svc)
+
+    m_scheduler.tick();
+
+}
+
+void CPU::raiseException(std::uint32_t cause)
+{
+    // called while executing, so m_pc is still the faulting instruction
+
+    m_exception = true;
+    m_exceptionCause = cause;
+    m_exceptionPC = m_pc;
+}
+
+void CPU::takeException()
+{
+    m_exception = false;
+
+    std::uint32_t vbar = m_sprRegisters[SPR_VBAR];
+
+    std::uint32_t faultPC = m_exceptionCause == kCauseSVC ? m_exceptionPC + 1 : m_exceptionPC;
+
+    if (! (m_sprRegisters[SPR_MSR] & MSR_EE))
+    {
+        // Exceptions are off, either not yet enabled or already in a
+        // handler: nowhere to go, so stop at the faulting instruction.
+
+        if (! m_replaying)
+            std::cout << "Error: unhandled exception, cause " << m_exceptionCause
+                      << " at " << std::hex << (m_exceptionPC << 1) << std::dec << std::endl;
+
+        m_pc = m_exceptionPC;
+        halt();
+        return;
+    }
+
+    m_sprRegisters[SPR_ELR] = faultPC;
+    m_sprRegisters[SPR_CAUSE] = m_exceptionCause;
+    m_sprRegisters[SPR_MSR] &= ~MSR_EE;
+
+    m_pc = vbar + (m_exceptionCause == kCauseSVC ? 6 : 4); // svc vector, exception vector
+}
+
+void CPU::busError(std::uint32_t /* address */)
+{
+    // DMA from devices uses Memory's dma accessors, which don't come here
+
+    if (m_executing && ! m_exception)
+        raiseException(kCauseBusError);
+}
+
+void CPU::clockTickObserved()
+{
+    // The trace and timing model look at each instruction from outside:
+    // register writes are found by comparing the register file before and
+    // after, which keeps them out of every instruction's code.
+
+    std::uint32_t pc = m_pc;
+    std::uint16_t imm = m_imm;
+    std::uint64_t irqs = m_irqCount;
+    bool exception = m_exception;
+    bool C = m_C;
+    bool Z = m_Z;
+
+    std::uint16_t gpr[16];
+    std::uint32_t spr[16];
+
+    for (int i = 0; i < 16; i++)
     {
+        gpr[i] = m_gprRegisters[i];
+        spr[i] = m_sprRegisters[i];
+    }
 
+    clockTick();
+
+    // taking an interrupt or exception retires nothing
+    bool irq = m_irqCount != irqs || exception;
+
+    if (m_timing != nullptr)
+    {
+        if (irq)
+            m_timing->interrupt(pc);
+        else
+            m_timing->retire(pc, m_pc, m_instruction, imm, gpr, spr);
     }
+
+    if (m_trace == nullptr)
+        return;
+
+    if (irq)
+        m_trace->interrupt(m_pc << 1);
     else
+        m_trace->retire(pc << 1, m_instruction);
+
+    for (int i = 0; i < 16; i++)
     {
-        fetchInstruction();
-        executeInstruction();
+        if (gpr[i] != m_gprRegisters[i])
+            m_trace->gprWrite(i, m_gprRegisters[i]);
     }
 
+    for (int i = 0; i < 16; i++)
+    {
+        if (spr[i] != m_sprRegisters[i])
+            m_trace->sprWrite(i, m_sprRegisters[i]);
+    }
+
+    if (C != m_C || Z != m_Z)
+        m_trace->flags(m_C, m_Z);
+
+    m_trace->endInstruction();
 }
 
 void CPU::fetchInstruction()
@@ -491,9 +787,8 @@ void CPU::fetchInstruction()
 void CPU::executeInstruction()
 {
 
-    std::stringstream instructionText;
-
     #ifdef DEBUG_INSTRUCTIONS
+        std::stringstream instructionText;
         #define MAKE_DBG(x) instructionText << x
     #else
         #define MAKE_DBG(x)
@@ -504,14 +799,18 @@ void CPU::executeInstruction()
 
     UniqueOpCode opcode = UniqueOpCode::None;
 
-    for (const nbInstructionDecodeInfo& info : instructionInfo)
+    const nbInstructionDecodeInfo* info = decodeInstruction(m_decodeTable, m_instruction);
+
+    m_opcodeCounts[m_decodeTable[m_instruction]]++;
+
+    if (info != nullptr)
     {
-        if ((m_instruction & info.mask) == info.instruction)
-        {
-            MAKE_DBG (info.string << " ");
-            opcode = info.opcode;
-            break;
-        }
+        MAKE_DBG (info->string << " ");
+        opcode = info->opcode;
+    }
+    else
+    {
+        raiseException(kCauseInvalidInstruction);
     }
 
     std::uint32_t pcNext = m_pc + 1;
@@ -1279,7 +1578,39 @@ void CPU::executeInstruction()
             break;
         }
         case UniqueOpCode::SVC:
+        {
+            if (m_semihost == nullptr)
+                raiseException(kCauseSVC);
+            else if (m_replaying)
+            {
+                // The host has already seen this call, so don't repeat it.
+                // Every call after a checkpoint should be logged; if one
+                // isn't, make it again rather than carry on with stale
+                // registers.
+
+                if (! m_timeTravel->replaySemihost(m_gprRegisters))
+                {
+                    std::cout << "Warning: semihosting call at cycle " << m_scheduler.now()
+                              << " missing from the time travel log, made again" << std::endl;
+
+                    m_semihost->call(m_gprRegisters);
+                }
+            }
+            else
+            {
+                std::uint32_t op = m_gprRegisters[0];
+
+                bool exited = m_semihost->call(m_gprRegisters);
+
+                if (m_timeTravel != nullptr)
+                    m_timeTravel->logSemihost(op, m_gprRegisters);
+
+                if (exited)
+                    halt();
+            }
+
             break;
+        }
         case UniqueOpCode::RET:
         {
             pcNext = m_sprRegisters[SPR_LR];
@@ -1292,7 +1623,11 @@ void CPU::executeInstruction()
             break;
         }
         case UniqueOpCode::RETE:
+        {
+            m_sprRegisters[SPR_MSR] |= MSR_EE; // restore exceptions
+            pcNext = m_sprRegisters[SPR_ELR];
             break;
+        }
         case UniqueOpCode::LDW_REG:
         {
             int regx = (m_instruction & 0xf0) >> 4;
@@ -1302,7 +1637,9 @@ void CPU::executeInstruction()
             std::uint32_t memOffset = m_gprRegisters[regy] + m_sprRegisters[regi + 8];
             std::uint16_t word      = m_memory.readWord(memOffset >> 1);
 
-            m_gprRegisters[regx] = word;
+            // a bus error leaves the destination as it was, for the handler
+            if (! m_exception)
+                m_gprRegisters[regx] = word;
 
             MAKE_DBG((Register)regx << ",[" << (Register)(regi + 16 + 8) << "," << (Register)regy << "]");
 
@@ -1317,7 +1654,9 @@ void CPU::executeInstruction()
             std::uint32_t memOffset = m_sprRegisters[regi + 8] + immVal;
             std::uint16_t word      = m_memory.readWord(memOffset >> 1);
 
-            m_gprRegisters[regx] = word;
+            // a bus error leaves the destination as it was, for the handler
+            if (! m_exception)
+                m_gprRegisters[regx] = word;
 
             MAKE_DBG((Register)regx << ",[" << (Register)(regi + 16 + 8) << "," << immVal << "]");
 
@@ -1332,6 +1671,9 @@ void CPU::executeInstruction()
             std::uint32_t memOffset = m_gprRegisters[regy] + m_sprRegisters[regi + 8];
             m_memory.writeWord(memOffset >> 1, m_gprRegisters[regx]);
 
+            if (m_trace != nullptr)
+                m_trace->memoryWrite(memOffset & ~1, m_gprRegisters[regx]);
+
             MAKE_DBG((Register)regx << ",[" << (Register)(regi + 16 + 8) << "," << (Register)regy << "]");
 
             break;
@@ -1345,6 +1687,9 @@ void CPU::executeInstruction()
             std::uint32_t memOffset = m_sprRegisters[regi + 8] + immVal;
             m_memory.writeWord(memOffset >> 1, m_gprRegisters[regx]);
 
+            if (m_trace != nullptr)
+                m_trace->memoryWrite(memOffset & ~1, m_gprRegisters[regx]);
+
             MAKE_DBG((Register)regx << ",[" << (Register)(regi + 16 + 8) << "," << immVal << "]");
 
             break;
@@ -1389,6 +1734,9 @@ void CPU::executeInstruction()
 
             m_ioports.outPort(m_gprRegisters[regy], m_gprRegisters[regx]);
 
+            if (m_trace != nullptr)
+                m_trace->portWrite(m_gprRegisters[regy], m_gprRegisters[regx]);
+
             MAKE_DBG((Register)regx << "," << (Register)regy);
 
             break;
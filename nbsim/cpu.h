@@ -2,18 +2,31 @@
 
 #include "memory.h"
 #include "ioports.h"
-#include "iinterruptdelegate.h"
+#include "eventscheduler.h"
+#include "simstats.h"
+#include "snapshotpublisher.h"
+#include "retirementtrace.h"
+#include "timingmodel.h"
+#include "ibuserrordelegate.h"
+#include "semihost.h"
 
 #include <cstdint>
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <limits>
+#include <functional>
 
-class CPU   : public ICPUInterruptDelegate
+class TimeTravel;
+
+class CPU : public IBusErrorDelegate
 {
 public:
 
-    CPU(Memory& mem, IOPorts& ioports);
+    CPU(Memory& mem, IOPorts& ioports, EventScheduler& sched);
     ~CPU() {}
 
     void hardReset();
@@ -22,21 +35,131 @@ public:
     void singleStep();
     void shutDown();
 
+    // wake a sleeping CPU so it picks up events posted to the scheduler
+    void wake();
+
+    // pause from the CPU thread itself (i.e. from a scheduler event, or
+    // an unhandled exception)
+    void halt();
+
+    // called on the CPU thread when it halts itself
+    void onHalt(std::function<void ()> func) { m_onHalt = func; }
+
+    // bad address from memory: an exception if it was the CPU's own access
+    virtual void busError(std::uint32_t address) override;
+
     void runThread();
 
     void holdInReset(bool hold);
 
-    virtual void setIRQ(bool level) override;
-
-    std::string dumpRegisters();
-    std::string dumpDisas();
+    // run at 50MHz real time (the default), or as fast as possible
+    void setThrottle(bool throttle);
+
+    struct RegisterSnapshot
+    {
+        std::uint32_t pc;
+        bool          C;
+        bool          Z;
+        std::uint16_t gpr[16];
+        std::uint32_t spr[16];
+    };
+
+    // consistent copy of the register file, taken between instruction blocks
+    RegisterSnapshot getRegisterSnapshot();
+
+    // word address of the next instruction
+    std::uint32_t getPC();
+
+    // Thread safe: counters as last published by the CPU thread, which
+    // happens every kBlocksPerStatsPublish blocks and whenever it sleeps
+    // or pauses
+    SimStats getStats() const { return m_stats.read(); }
+
+    // Breakpoints (word addresses): the CPU pauses before executing them
+    void setBreakpoint(std::uint32_t address, bool set);
+    std::set<std::uint32_t> getBreakpoints();
+
+    // Reverse debugging, when the SoC keeps history (see TimeTravel). Both
+    // need the CPU paused. reverseStep() goes back to before the last
+    // instruction; reverseContinue() back to the last time a breakpoint
+    // was reached, or as far as history goes. Return false if they
+    // couldn't move.
+    void setTimeTravel(TimeTravel* tt) { m_timeTravel = tt; }
+
+    bool reverseStep();
+    bool reverseContinue();
+
+    // Write a retirement trace as instructions execute (call before
+    // running; nullptr to stop). Instructions re-executed when going
+    // backwards are not traced.
+    void setTrace(RetirementTrace* trace) { m_trace = trace; }
+
+    // Feed retired instructions to a timing model, likewise
+    void setTimingModel(TimingModel* timing) { m_timing = timing; }
+
+    // Handle svc as a semihosting call instead of trapping (see Semihost)
+    void setSemihost(Semihost* semihost) { m_semihost = semihost; }
+
+    // Architectural state, for checkpoints
+    struct State
+    {
+        std::uint32_t pc;
+        std::uint16_t imm;
+        bool          C;
+        bool          Z;
+        std::uint16_t gpr[16];
+        std::uint32_t spr[16];
+        bool          exception;
+        std::uint32_t exceptionCause;
+        std::uint32_t exceptionPC;
+        bool          sleep;
+        std::uint16_t instruction;
+    };
 
 private:
 
+    State saveState() const;
+    void  restoreState(const State& state);
+
+    bool sleepUntil(std::uint64_t limit);
+
+    bool reverse(bool toBreakpoint);
+    void replayTo(std::uint64_t target, std::uint64_t* lastStart, std::uint64_t* lastBreakpoint);
+
+    const std::uint64_t kNoCycle = std::numeric_limits<std::uint64_t>::max();
+
     void clockTick();
+    void clockTickObserved();
+
+    void raiseException(std::uint32_t cause);
+    void takeException();
     void fetchInstruction();
     void executeInstruction();
 
+    void resetThrottle();
+    void throttle(std::unique_lock<std::mutex>& lock);
+
+    void resetStats();
+    void publishStats();
+
+    // Everything counted for the stats, saved and put back around
+    // replays so re-executed history isn't counted again
+    struct Counters
+    {
+        std::uint64_t          opcodeCounts[SimStats::kNumOpcodeCounters];
+        std::uint64_t          irqCount;
+        std::uint64_t          sleepCycles;
+        Memory::AccessCounts   memory;
+        IOPorts::AccessCounts  ports;
+    };
+
+    Counters saveCounters() const;
+    void     restoreCounters(const Counters& counters);
+
+    const int kInstructionsPerBlock = 1000;
+    const int kBlocksPerStatsPublish = 64;
+    const std::uint64_t kNsPerCycle = 20;
+
     const std::uint32_t SPR_MSR = 0;
     const std::uint32_t MSR_IE  = 1 << 0;
     const std::uint32_t MSR_EE  = 1 << 1;
@@ -45,8 +168,18 @@ private:
 
     const std::uint32_t SPR_ILR = 2;
 
+    // Exceptions and supervisor calls: the vector is taken with MSR_EE
+    // cleared, ELR pointing at the faulting instruction (the one after, for
+    // svc) and the cause in SPR_CAUSE. RETE returns.
+    const std::uint32_t SPR_ELR   = 3;
+    const std::uint32_t SPR_CAUSE = 4;
+
     const std::uint32_t SPR_VBAR = 5;
 
+    const std::uint32_t kCauseInvalidInstruction = 1;
+    const std::uint32_t kCauseBusError           = 2;
+    const std::uint32_t kCauseSVC                = 3;
+
     std::uint32_t m_pc;
     std::uint16_t m_imm;
     bool m_C;
@@ -55,14 +188,23 @@ private:
     std::uint16_t m_gprRegisters[16];
     std::uint32_t m_sprRegisters[16];
 
-    bool m_interrupt;
+    // pending exception, taken on the next clock tick
     bool m_exception;
-    bool m_svc;
+    std::uint32_t m_exceptionCause;
+    std::uint32_t m_exceptionPC;
+
+    // fetching or executing, so bus errors are the CPU's (not DMA's)
+    bool m_executing;
+
+    std::function<void ()> m_onHalt;
 
     std::uint16_t m_instruction;
 
     Memory& m_memory;
     IOPorts& m_ioports;
+    EventScheduler& m_scheduler;
+
+    const std::uint8_t* m_decodeTable;
 
     std::mutex m_mutex;
     std::condition_variable m_cond;
@@ -70,13 +212,44 @@ private:
     std::condition_variable m_pauseCond;
     std::condition_variable m_singleStepCond;
 
-    std::thread m_cpuThread;
-
-    bool m_threadExit;
-    volatile bool m_threadPause;
+    std::atomic<bool> m_threadExit;
+    std::atomic<bool> m_threadPause;
     bool m_singleStep;
+    bool m_resume;
 
     bool m_paused;
 
     bool m_sleep;
+
+    // re-executing history in reverse(): semihosting calls are answered
+    // from the time travel log
+    bool m_replaying;
+
+    bool m_throttle;
+    std::chrono::steady_clock::time_point m_throttleStart;
+    std::uint64_t m_throttleCycle;
+
+    std::set<std::uint32_t> m_breakpoints;
+
+    TimeTravel* m_timeTravel;
+
+    RetirementTrace* m_trace;
+    TimingModel* m_timing;
+
+    Semihost* m_semihost;
+
+    // Counters, owned by the CPU thread. Instructions are counted per
+    // opcode only; the total is summed when publishing.
+
+    std::uint64_t m_opcodeCounts[SimStats::kNumOpcodeCounters];
+    std::uint64_t m_irqCount;
+    std::uint64_t m_sleepCycles;
+    std::uint64_t m_hostNs;
+    std::chrono::steady_clock::time_point m_runStart;
+    int m_blocksSincePublish;
+
+    SnapshotPublisher<SimStats> m_stats;
+
+    // last, so everything the thread touches is constructed before it starts
+    std::thread m_cpuThread;
 };
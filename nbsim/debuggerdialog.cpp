@@ -2,6 +2,7 @@
 #include "ui_debuggerdialog.h"
 
 #include <iostream>
+#include <sstream>
 
 DebuggerDialog::DebuggerDialog(nbSoC* nb, QWidget *parent) :
     QDialog(parent),
@@ -9,6 +10,58 @@ DebuggerDialog::DebuggerDialog(nbSoC* nb, QWidget *parent) :
     m_nanobrain(nb)
 {
     ui->setupUi(this);
+
+    m_disasModel = new DisassemblyModel(*nb->getMemory(), m_disassembler, this);
+
+    ui->disasWidget->setModel(m_disasModel);
+
+    m_memoryModel = new MemoryModel(*nb->getMemory(), this);
+    ui->memoryView->setModel(m_memoryModel);
+
+    m_registerModel = new RegisterModel(this);
+    ui->registerView->setModel(m_registerModel);
+
+    m_refreshTimer = new QTimer(this);
+    connect(m_refreshTimer, SIGNAL(timeout()), this, SLOT(refreshViews()));
+}
+
+void DebuggerDialog::showEvent(QShowEvent* e)
+{
+    refreshViews();
+    m_refreshTimer->start(100);
+
+    QDialog::showEvent(e);
+}
+
+void DebuggerDialog::hideEvent(QHideEvent* e)
+{
+    m_refreshTimer->stop();
+
+    QDialog::hideEvent(e);
+}
+
+void DebuggerDialog::refreshViews()
+{
+    // Memory is read by page snapshot and registers are copied between
+    // instruction blocks, so neither holds up the CPU for long.
+
+    m_registerModel->setRegisters(m_nanobrain->getCPU()->getRegisterSnapshot());
+    m_memoryModel->refresh();
+
+    std::stringstream stats;
+    m_nanobrain->getStats().writeSummary(stats);
+    ui->statsLabel->setText(QString::fromStdString(stats.str()));
+}
+
+void DebuggerDialog::onGotoAddress()
+{
+    bool ok;
+    std::uint32_t address = ui->memAddrEdit->text().toUInt(&ok, 16);
+
+    if (! ok)
+        return;
+
+    ui->memoryView->scrollTo(m_memoryModel->index(m_memoryModel->rowForAddress(address), 0), QAbstractItemView::PositionAtTop);
 }
 
 DebuggerDialog::~DebuggerDialog()
@@ -35,17 +88,42 @@ void DebuggerDialog::onStep()
     updateDisassembly();
 }
 
+void DebuggerDialog::onReverseStep()
+{
+    if (! m_nanobrain->getCPU()->reverseStep())
+        std::cout << "Reverse step: needs the CPU paused and history recorded (-r)" << std::endl;
+
+    updateDisassembly();
+}
+
+void DebuggerDialog::onReverseContinue()
+{
+    if (! m_nanobrain->getCPU()->reverseContinue())
+        std::cout << "Reverse continue: needs the CPU paused and history recorded (-r)" << std::endl;
+
+    updateDisassembly();
+}
+
+void DebuggerDialog::onToggleBreakpoint(const QModelIndex& index)
+{
+    CPU* cpu = m_nanobrain->getCPU();
+    std::uint32_t address = index.row();
+
+    cpu->setBreakpoint(address, cpu->getBreakpoints().count(address) == 0);
+
+    m_disasModel->setBreakpoints(cpu->getBreakpoints());
+}
+
 void DebuggerDialog::updateDisassembly()
 {
-    std::string registers = m_nanobrain->getCPU()->dumpRegisters();
+    refreshViews();
 
-    ui->textWidget->clear();
-    ui->textWidget->insertPlainText(QString(registers.c_str()));
+    std::uint32_t pc = m_nanobrain->getCPU()->getPC();
 
-    std::string disas = m_nanobrain->getCPU()->dumpDisas();
+    m_disasModel->refresh();
+    m_disasModel->setPC(pc);
 
-    ui->disasWidget->clear();
-    ui->disasWidget->insertPlainText(QString(disas.c_str()));
+    ui->disasWidget->scrollTo(m_disasModel->index(pc), QAbstractItemView::PositionAtCenter);
 
 }
 
@@ -54,13 +132,19 @@ void DebuggerDialog::keyPressEvent(QKeyEvent * e)
     switch (e->key())
     {
         case Qt::Key_S:
-            onStep();
+            if (e->modifiers() & Qt::ShiftModifier)
+                onReverseStep();
+            else
+                onStep();
             break;
         case Qt::Key_P:
             onPause();
             break;
         case Qt::Key_R:
-            onRun();
+            if (e->modifiers() & Qt::ShiftModifier)
+                onReverseContinue();
+            else
+                onRun();
             break;
     }
 }
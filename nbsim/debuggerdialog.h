@@ -2,9 +2,14 @@
 
 #include <QDialog>
 #include <QKeyEvent>
+#include <QTimer>
 
 #include "nbsoc.h"
 #include "cpu.h"
+#include "disassembler.h"
+#include "disassemblymodel.h"
+#include "memorymodel.h"
+#include "registermodel.h"
 
 namespace Ui {
 class DebuggerDialog;
@@ -20,19 +25,38 @@ public slots:
     void onPause();
     void onStep();
     void onReset();
+    void onGotoAddress();
+    void onReverseStep();
+    void onReverseContinue();
+    void onToggleBreakpoint(const QModelIndex& index);
+
+    void refreshViews();
 
 public:
     explicit DebuggerDialog(nbSoC* nb, QWidget *parent = 0);
     ~DebuggerDialog();
 
+    bool loadSymbols(std::string path) { return m_disassembler.loadSymbols(path); }
+
 private:
 
     void keyPressEvent(QKeyEvent * e);
 
     void updateDisassembly();
 
+    void showEvent(QShowEvent* e);
+    void hideEvent(QHideEvent* e);
+
     Ui::DebuggerDialog *ui;
     nbSoC*              m_nanobrain;
+
+    Disassembler        m_disassembler;
+    DisassemblyModel*   m_disasModel;
+    MemoryModel*        m_memoryModel;
+    RegisterModel*      m_registerModel;
+
+    // live update of memory and registers while the dialog is open
+    QTimer*             m_refreshTimer;
 };
 
 
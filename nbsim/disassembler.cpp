@@ -0,0 +1,244 @@
+#include "disassembler.h"
+
+#include "nbInstructionSet.h"
+#include "types.h"
+
+#include <iomanip>
+#include <sstream>
+
+#include <string.h>
+
+Disassembler::Disassembler()    :
+    m_decodeTable(instructionDecodeTable())
+{
+}
+
+void Disassembler::formatTarget(std::stringstream& ss, std::uint32_t byteAddress) const
+{
+    ss << std::hex << byteAddress;
+
+    const std::string* sym = symbolAt(byteAddress);
+
+    if (sym != nullptr)
+        ss << " <" << *sym << ">";
+}
+
+std::string Disassembler::disassemble(std::uint32_t pc, std::uint16_t instruction, std::uint16_t prevInstruction) const
+{
+    std::stringstream ss;
+
+    const nbInstructionDecodeInfo* info = decodeInstruction(m_decodeTable, instruction);
+
+    if (info == nullptr)
+        return "???";
+
+    UniqueOpCode opcode = info->opcode;
+
+    ss << info->string;
+
+    for (int i = strlen(info->string); i < 8; i++)
+        ss << " ";
+
+    // an imm prefix supplies the upper bits of the following instruction's immediate
+
+    std::uint32_t immediate = 0;
+
+    const nbInstructionDecodeInfo* prevInfo = decodeInstruction(m_decodeTable, prevInstruction);
+
+    if (prevInfo != nullptr && prevInfo->opcode == UniqueOpCode::IMM)
+        immediate = prevInstruction & 0x3fff;
+
+    // Determine how to format parameters
+
+    switch (opcode)
+    {
+        case UniqueOpCode::IMM:
+            ss << std::hex << (instruction & 0x3fff);
+            break;
+        case UniqueOpCode::ADD_IMM:
+        case UniqueOpCode::ADC_IMM:
+        case UniqueOpCode::SUB_IMM:
+        case UniqueOpCode::SBB_IMM:
+        case UniqueOpCode::AND_IMM:
+        case UniqueOpCode::OR_IMM:
+        case UniqueOpCode::XOR_IMM:
+        case UniqueOpCode::CMP_IMM:
+        case UniqueOpCode::TEST_IMM:
+        case UniqueOpCode::LOAD_IMM:
+        case UniqueOpCode::MUL_IMM:
+        case UniqueOpCode::MULS_IMM:
+        case UniqueOpCode::DIV_IMM:
+        case UniqueOpCode::DIVS_IMM:
+        {
+            int regx = (instruction & 0xf0) >> 4;
+            uint32_t immval = (instruction & 0x0f);
+
+            ss << (Register)regx << ", " << std::hex << immval << "\t; " << ((immediate << 4) | immval);
+
+            break;
+        }
+        case UniqueOpCode::ADD_REG:
+        case UniqueOpCode::ADC_REG:
+        case UniqueOpCode::SUB_REG:
+        case UniqueOpCode::SBB_REG:
+        case UniqueOpCode::AND_REG:
+        case UniqueOpCode::OR_REG:
+        case UniqueOpCode::XOR_REG:
+        case UniqueOpCode::CMP_REG:
+        case UniqueOpCode::TEST_REG:
+        case UniqueOpCode::LOAD_REG:
+        case UniqueOpCode::MUL_REG:
+        case UniqueOpCode::MULS_REG:
+        case UniqueOpCode::DIV_REG:
+        case UniqueOpCode::DIVS_REG:
+        case UniqueOpCode::OUT:
+        case UniqueOpCode::IN:
+        {
+            int regx = (instruction & 0xf0) >> 4;
+            int regy = (instruction & 0x0f);
+
+            ss << (Register)regx << ", " << (Register)regy;
+
+            break;
+        }
+        case UniqueOpCode::SLA:
+        case UniqueOpCode::SLX:
+        case UniqueOpCode::SL0:
+        case UniqueOpCode::SL1:
+        case UniqueOpCode::RL:
+        case UniqueOpCode::SRA:
+        case UniqueOpCode::SRX:
+        case UniqueOpCode::SR0:
+        case UniqueOpCode::SR1:
+        case UniqueOpCode::RR:
+        {
+            int regx = (instruction & 0xf0) >> 4;
+
+            ss << (Register)regx;
+
+            break;
+        }
+        case UniqueOpCode::BSL:
+        case UniqueOpCode::BSR:
+        {
+            int regx = (instruction & 0xf0) >> 4;
+            int immval = (instruction & 0x0f);
+
+            ss << (Register)regx << ", " << (Register)immval;
+
+            break;
+        }
+        case UniqueOpCode::FMUL:
+        case UniqueOpCode::FDIV:
+        case UniqueOpCode::FADD:
+        case UniqueOpCode::FSUB:
+        case UniqueOpCode::FCMP:
+        case UniqueOpCode::FINT:
+        case UniqueOpCode::FFLT:
+        {
+            break;
+        }
+        case UniqueOpCode::NOP:
+        case UniqueOpCode::SLEEP:
+        {
+            break;
+        }
+        case UniqueOpCode::JUMP:
+        case UniqueOpCode::JUMPZ:
+        case UniqueOpCode::JUMPC:
+        case UniqueOpCode::JUMPNZ:
+        case UniqueOpCode::JUMPNC:
+        case UniqueOpCode::CALL:
+        case UniqueOpCode::CALLZ:
+        case UniqueOpCode::CALLC:
+        case UniqueOpCode::CALLNZ:
+        case UniqueOpCode::CALLNC:
+        {
+            uint32_t addr = (instruction & 0x1ff);
+
+            ss << addr << "\t; ";
+            formatTarget(ss, ((immediate << 9) | addr) << 1);
+
+            break;
+        }
+        case UniqueOpCode::JUMP_REL:
+        case UniqueOpCode::JUMPZ_REL:
+        case UniqueOpCode::JUMPC_REL:
+        case UniqueOpCode::JUMPNZ_REL:
+        case UniqueOpCode::JUMPNC_REL:
+        case UniqueOpCode::CALL_REL:
+        case UniqueOpCode::CALLZ_REL:
+        case UniqueOpCode::CALLC_REL:
+        case UniqueOpCode::CALLNZ_REL:
+        case UniqueOpCode::CALLNC_REL:
+        {
+            int32_t addr = (instruction & 0x1ff);
+
+            if (addr & 0x100)
+                addr |= ~0x1ff;
+
+            ss << std::dec << addr << "\t; ";
+            formatTarget(ss, (pc + (int)addr) << 1);
+
+            break;
+        }
+        case UniqueOpCode::SVC:
+        case UniqueOpCode::RET:
+        case UniqueOpCode::RETI:
+        case UniqueOpCode::RETE:
+        {
+            break;
+        }
+        case UniqueOpCode::LDW_IMM:
+        case UniqueOpCode::STW_IMM:
+        {
+            int regx = (instruction & 0xf0) >> 4;
+            int immVal = (immediate << 4) | (instruction & 0x0f);
+            int regi = (instruction & 0x300) >> 8;
+
+            ss << (Register)regx << ", [" << (Register)(regi + 16 + 8) << ", " << immVal << "]";
+
+            break;
+        }
+        case UniqueOpCode::LDW_REG:
+        case UniqueOpCode::STW_REG:
+        {
+            int regx = (instruction & 0xf0) >> 4;
+            int regy = (instruction & 0x0f);
+            int regi = (instruction & 0x300) >> 8;
+
+            ss << (Register)regx << ", [" << (Register)(regi + 16 + 8) << ", " << (Register)regy << "]";
+
+            break;
+        }
+        case UniqueOpCode::LDSPR:
+        {
+            int regx = (instruction & 0xf0) >> 4;
+            int regy = (instruction & 0x0e);
+
+            ss << (Register)(regx + 16) << ", " << (Register)regy;
+
+            break;
+        }
+        case UniqueOpCode::STSPR:
+        {
+            int regx = (instruction & 0xe0) >> 4;
+            int regy = (instruction & 0x0f);
+
+            ss << (Register)regx << ", " << (Register)(regy + 16);
+
+            break;
+        }
+        case UniqueOpCode::INCW:
+        case UniqueOpCode::DECW:
+        {
+            int regx = (instruction & 0xf0) >> 4;
+
+            ss << (Register)(regx + 16);
+
+            break;
+        }
+    }
+
+    return ss.str();
+}
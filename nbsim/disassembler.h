@@ -0,0 +1,37 @@
+#pragma once
+
+#include "nbInstructionDecodeTable.h"
+#include "symboltable.h"
+
+#include <cstdint>
+#include <string>
+#include <sstream>
+
+//
+//  Stateless instruction formatter for the debugger. Each instruction is
+//  disassembled from its own word and the one before it (for an imm
+//  prefix), so results can be cached per address.
+//
+
+class Disassembler
+{
+public:
+
+    Disassembler();
+
+    // pc is the word address of instruction
+    std::string disassemble(std::uint32_t pc, std::uint16_t instruction, std::uint16_t prevInstruction) const;
+
+    // Symbol file: one "<hex byte address> <name>" per line
+    bool loadSymbols(std::string path) { return m_symbols.load(path); }
+
+    const std::string* symbolAt(std::uint32_t byteAddress) const { return m_symbols.symbolAt(byteAddress); }
+
+private:
+
+    void formatTarget(std::stringstream& ss, std::uint32_t byteAddress) const;
+
+    const std::uint8_t* m_decodeTable;
+
+    SymbolTable m_symbols;
+};
@@ -0,0 +1,153 @@
+#include "disassemblymodel.h"
+
+#include <QBrush>
+#include <QColor>
+
+DisassemblyModel::DisassemblyModel(Memory& mem, const Disassembler& disas, QObject* parent)   :
+    QAbstractListModel(parent),
+    m_memory(mem),
+    m_disassembler(disas),
+    m_pc(0)
+{
+}
+
+int DisassemblyModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return m_memory.getNumPages() * m_memory.getPageSizeInWords();
+}
+
+DisassemblyModel::Page& DisassemblyModel::getPage(std::uint32_t page) const
+{
+    auto it = m_pages.find(page);
+
+    if (it != m_pages.end())
+        return it->second;
+
+    Page& p = m_pages[page];
+
+    p.words.resize(m_memory.getPageSizeInWords());
+    p.lines.resize(m_memory.getPageSizeInWords());
+    p.generation = m_memory.snapshotPage(page, p.words.data());
+
+    return p;
+}
+
+QVariant DisassemblyModel::data(const QModelIndex& index, int role) const
+{
+    if (! index.isValid())
+        return QVariant();
+
+    std::uint32_t address = index.row();
+
+    if (role == Qt::BackgroundRole)
+    {
+        if (address == m_pc)
+            return QBrush(QColor(255, 255, 160));
+        if (m_breakpoints.count(address))
+            return QBrush(QColor(255, 180, 180));
+        return QVariant();
+    }
+
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    // The view only asks for what's on screen, so the cache stays small
+    // unless it's scrolled a long way; just start again when it's full.
+
+    if (m_pages.size() > kMaxCachedPages)
+        m_pages.clear();
+
+    std::uint32_t pageSize = m_memory.getPageSizeInWords();
+    std::uint32_t pageNum  = address / pageSize;
+    std::uint32_t offset   = address % pageSize;
+
+    std::uint16_t prev = 0;
+
+    if (offset != 0)
+        prev = getPage(pageNum).words[offset - 1];
+    else if (pageNum != 0)
+        prev = getPage(pageNum - 1).words[pageSize - 1];
+
+    Page& page = getPage(pageNum);
+
+    if (page.lines[offset].isEmpty())
+    {
+        std::uint16_t word = page.words[offset];
+
+        QString label;
+        const std::string* sym = m_disassembler.symbolAt(address << 1);
+
+        if (sym != nullptr)
+            label = QString::fromStdString(*sym) + ":";
+
+        page.lines[offset] = QString("%1  %2  %3  %4")
+                                .arg(address << 1, 6, 16, QChar('0'))
+                                .arg(word, 4, 16, QChar('0'))
+                                .arg(label, -16)
+                                .arg(QString::fromStdString(m_disassembler.disassemble(address, word, prev)));
+    }
+
+    return page.lines[offset];
+}
+
+void DisassemblyModel::setPC(std::uint32_t pc)
+{
+    std::uint32_t old = m_pc;
+
+    m_pc = pc;
+
+    emit dataChanged(index(old), index(old));
+    emit dataChanged(index(pc), index(pc));
+}
+
+void DisassemblyModel::setBreakpoints(const std::set<std::uint32_t>& breakpoints)
+{
+    std::set<std::uint32_t> old;
+
+    old.swap(m_breakpoints);
+    m_breakpoints = breakpoints;
+
+    for (std::uint32_t address : old)
+        emit dataChanged(index(address), index(address));
+
+    for (std::uint32_t address : m_breakpoints)
+        emit dataChanged(index(address), index(address));
+}
+
+void DisassemblyModel::refresh()
+{
+    std::vector<std::uint32_t> stale;
+
+    for (const auto& p : m_pages)
+    {
+        if (m_memory.getPageGeneration(p.first) != p.second.generation)
+            stale.push_back(p.first);
+    }
+
+    for (std::uint32_t page : stale)
+    {
+        m_pages.erase(page);
+
+        // the first line of the next page depends on the last word of this one
+
+        auto next = m_pages.find(page + 1);
+        if (next != m_pages.end())
+            next->second.lines[0].clear();
+
+        emitPageChanged(page);
+    }
+}
+
+void DisassemblyModel::emitPageChanged(std::uint32_t page)
+{
+    int first = page * m_memory.getPageSizeInWords();
+    int last  = first + m_memory.getPageSizeInWords();
+
+    if (last >= rowCount())
+        last = rowCount() - 1;
+
+    emit dataChanged(index(first), index(last));
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QString>
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "memory.h"
+#include "disassembler.h"
+
+//
+//  One row per word of the address space, decoded lazily as the view asks
+//  for rows. Memory is read a page at a time by snapshot (never under the
+//  CPU lock) and decoded lines are cached per page until the page's
+//  generation changes.
+//
+
+class DisassemblyModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+
+    DisassemblyModel(Memory& mem, const Disassembler& disas, QObject* parent = 0);
+
+    virtual int      rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    // highlight the row at pc (word address)
+    void setPC(std::uint32_t pc);
+
+    // drop cached pages which have been written since they were decoded
+    void refresh();
+
+    // mark rows with breakpoints (word addresses)
+    void setBreakpoints(const std::set<std::uint32_t>& breakpoints);
+
+private:
+
+    struct Page
+    {
+        std::uint32_t           generation;
+        std::vector<std::uint16_t> words;
+        std::vector<QString>    lines;  // empty string until decoded
+    };
+
+    Page& getPage(std::uint32_t page) const;
+
+    void emitPageChanged(std::uint32_t page);
+
+    Memory&             m_memory;
+    const Disassembler& m_disassembler;
+
+    std::uint32_t m_pc;
+
+    std::set<std::uint32_t> m_breakpoints;
+
+    const std::size_t kMaxCachedPages = 64;
+
+    mutable std::map<std::uint32_t, Page> m_pages;
+};
@@ -0,0 +1,141 @@
+#include "eventscheduler.h"
+
+#include <algorithm>
+#include <limits>
+
+EventScheduler::EventScheduler()  :
+    m_now(0),
+    m_nextEventTime(std::numeric_limits<std::uint64_t>::max()),
+    m_seq(0),
+    m_nextId(1),
+    m_posted(false),
+    m_holdPosted(false)
+{
+}
+
+bool EventScheduler::laterThan(const Event& a, const Event& b)
+{
+    if (a.when != b.when)
+        return a.when > b.when;
+    return a.seq > b.seq;
+}
+
+int EventScheduler::schedule(std::uint64_t delay, Callback func)
+{
+    Event e;
+
+    e.when = m_now + delay;
+    e.seq  = m_seq++;
+    e.id   = m_nextId++;
+    e.func = func;
+
+    m_events.push_back(e);
+    std::push_heap(m_events.begin(), m_events.end(), laterThan);
+
+    updateNextEventTime();
+
+    return e.id;
+}
+
+void EventScheduler::cancel(int id)
+{
+    // cancellation is rare (device reset, reprogramming) so a linear search is fine
+
+    for (std::size_t i = 0; i < m_events.size(); i++)
+    {
+        if (m_events[i].id == id)
+        {
+            m_events.erase(m_events.begin() + i);
+            std::make_heap(m_events.begin(), m_events.end(), laterThan);
+            break;
+        }
+    }
+
+    updateNextEventTime();
+}
+
+void EventScheduler::advanceTo(std::uint64_t cycle)
+{
+    while (! m_events.empty() && m_events.front().when <= cycle)
+    {
+        m_now = m_events.front().when;
+        runEvents();
+    }
+
+    if (cycle > m_now)
+        m_now = cycle;
+}
+
+void EventScheduler::runEvents()
+{
+    // Events may schedule further events, so pop one at a time.
+
+    while (! m_events.empty() && m_events.front().when <= m_now)
+    {
+        std::pop_heap(m_events.begin(), m_events.end(), laterThan);
+        Event e = m_events.back();
+        m_events.pop_back();
+
+        updateNextEventTime();
+
+        e.func();
+    }
+
+    updateNextEventTime();
+}
+
+void EventScheduler::updateNextEventTime()
+{
+    if (m_events.empty())
+        m_nextEventTime = std::numeric_limits<std::uint64_t>::max();
+    else
+        m_nextEventTime = m_events.front().when;
+}
+
+void EventScheduler::post(Callback func)
+{
+    std::unique_lock<std::mutex> lock(m_postMutex);
+
+    m_postedEvents.push_back(func);
+    m_posted.store(true, std::memory_order_release);
+}
+
+void EventScheduler::runPosted()
+{
+    std::vector<Callback> posted;
+
+    if (m_holdPosted)
+        return;
+
+    {
+        std::unique_lock<std::mutex> lock(m_postMutex);
+
+        posted.swap(m_postedEvents);
+        m_posted.store(false, std::memory_order_relaxed);
+    }
+
+    for (Callback& func : posted)
+        func();
+}
+
+EventScheduler::State EventScheduler::saveState() const
+{
+    State state;
+
+    state.now    = m_now;
+    state.seq    = m_seq;
+    state.nextId = m_nextId;
+    state.events = m_events;
+
+    return state;
+}
+
+void EventScheduler::restoreState(const State& state)
+{
+    m_now    = state.now;
+    m_seq    = state.seq;
+    m_nextId = state.nextId;
+    m_events = state.events;
+
+    updateNextEventTime();
+}
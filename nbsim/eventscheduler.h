@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+//
+//  Virtual time for the SoC. One tick is one CPU clock (50MHz). Devices
+//  schedule timed operations (flash program / erase, DMA bursts, etc.)
+//  as events, which are run by the CPU thread when virtual time passes
+//  them. All methods except post() must be called from the CPU thread.
+//
+
+class EventScheduler
+{
+public:
+
+    typedef std::function<void ()> Callback;
+
+    struct Event
+    {
+        std::uint64_t when;
+        std::uint64_t seq;  // keeps events scheduled for the same cycle in order
+        int           id;
+        Callback      func;
+    };
+
+    EventScheduler();
+
+    std::uint64_t now() const { return m_now; }
+
+    // advance virtual time, running any events which become due
+
+    void tick(std::uint64_t cycles = 1)
+    {
+        m_now += cycles;
+
+        if (m_now >= m_nextEventTime)
+            runEvents();
+
+        if (m_posted.load(std::memory_order_relaxed))
+            runPosted();
+    }
+
+    // schedule func to run delay cycles from now; returns an id which can
+    // be passed to cancel()
+
+    int  schedule(std::uint64_t delay, Callback func);
+    void cancel(int id);
+
+    bool          hasPendingEvents() const { return ! m_events.empty(); }
+    std::uint64_t nextEventTime() const    { return m_nextEventTime; }
+
+    // fast-forward virtual time to cycle, running events on the way.
+    // Used to skip idle loops and sleep.
+
+    void advanceTo(std::uint64_t cycle);
+
+    // Thread safe: queue func to run on the CPU thread at the next tick.
+    // Used to inject host events (key presses etc.) at a well defined
+    // point in virtual time.
+
+    void post(Callback func);
+    bool hasPosted() const { return m_posted.load(std::memory_order_relaxed); }
+    void runPosted();
+
+    // while held, posted events stay queued (used while replaying history)
+    void holdPosted(bool hold) { m_holdPosted = hold; }
+
+    // Checkpointing: pending events are copied along with the time, so the
+    // device state saved alongside must refer to the same event ids.
+
+    struct State
+    {
+        std::uint64_t      now;
+        std::uint64_t      seq;
+        int                nextId;
+        std::vector<Event> events;
+    };
+
+    State saveState() const;
+    void  restoreState(const State& state);
+
+private:
+
+    static bool laterThan(const Event& a, const Event& b);
+
+    void runEvents();
+    void updateNextEventTime();
+
+    std::uint64_t m_now;
+    std::uint64_t m_nextEventTime;
+    std::uint64_t m_seq;
+    int           m_nextId;
+
+    std::vector<Event> m_events;  // min-heap on (when, seq)
+
+    std::mutex            m_postMutex;
+    std::vector<Callback> m_postedEvents;
+    std::atomic<bool>     m_posted;
+    bool                  m_holdPosted;
+};
@@ -0,0 +1,368 @@
+#include "flashcon.h"
+
+#include <fstream>
+#include <iostream>
+#include <chrono>
+
+FlashCon::FlashCon(Memory& mem, EventScheduler& sched)  :
+    m_memory(mem),
+    m_scheduler(sched),
+    m_flash(mem.getFlash()),
+    m_flashSizeInWords(mem.getFlashSizeInWords()),
+    m_command(0),
+    m_status(0),
+    m_flashAddr(0),
+    m_memAddr(0),
+    m_count(0),
+    m_opFlashAddr(0),
+    m_opMemAddr(0),
+    m_opCount(0),
+    m_busyUntil(0),
+    m_eventId(0),
+    m_fastForward(true),
+    m_dirtySectors(mem.getFlashSizeInWords() / kSectorSizeInWords, false),
+    m_anyDirty(false),
+    m_threadExit(false),
+    m_persistThread([] (FlashCon* fc) { fc->persistThread(); }, this)
+{
+}
+
+FlashCon::~FlashCon()
+{
+    if (m_persistThread.joinable())
+        shutDown();
+}
+
+void FlashCon::configureFlash(std::string flashFile)
+{
+    std::unique_lock<std::mutex> lock(m_flashMutex);
+    m_flashFile = flashFile;
+}
+
+void FlashCon::hardReset()
+{
+    if (m_status & kStatusBusy)
+        m_scheduler.cancel(m_eventId);
+
+    m_command   = 0;
+    m_status    = 0;
+    m_flashAddr = 0;
+    m_memAddr   = 0;
+    m_count     = 0;
+
+    m_opFlashAddr = 0;
+    m_opMemAddr   = 0;
+    m_opCount     = 0;
+}
+
+void FlashCon::shutDown()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_flashMutex);
+        m_threadExit = true;
+    }
+
+    m_persistCond.notify_all();
+    m_persistThread.join();
+}
+
+std::uint16_t FlashCon::inPort(std::uint16_t reg)
+{
+    switch ((FlashConReg)reg)
+    {
+        case FlashConReg::Command:
+            return m_command;
+        case FlashConReg::Status:
+
+            // Firmware spins on the busy bit; rather than execute the loop
+            // we jump virtual time to when the operation completes.
+
+            if ((m_status & kStatusBusy) && m_fastForward)
+                m_scheduler.advanceTo(m_busyUntil);
+
+            return m_status;
+        case FlashConReg::FlashAddrLo:
+            return m_flashAddr & 0xffff;
+        case FlashConReg::FlashAddrHi:
+            return m_flashAddr >> 16;
+        case FlashConReg::MemAddrLo:
+            return m_memAddr & 0xffff;
+        case FlashConReg::MemAddrHi:
+            return m_memAddr >> 16;
+        case FlashConReg::Count:
+            return m_count;
+        default:
+            return 0;
+    }
+}
+
+void FlashCon::outPort(std::uint16_t reg, std::uint16_t value)
+{
+    switch ((FlashConReg)reg)
+    {
+        case FlashConReg::Command:
+            startOperation(value);
+            break;
+        case FlashConReg::Status:
+        {
+            std::uint16_t clear = value & (kStatusDone | kStatusError);
+
+            if ((m_status & clear) && (m_command & kCommandInterruptEnable))
+            {
+                if (m_intDel != nullptr)
+                    m_intDel->setIRQ(kFlashIRQ, false);
+            }
+
+            m_status &= ~clear;
+            break;
+        }
+        case FlashConReg::FlashAddrLo:
+            m_flashAddr = (m_flashAddr & 0xffff0000) | value;
+            break;
+        case FlashConReg::FlashAddrHi:
+            m_flashAddr = (m_flashAddr & 0x0000ffff) | ((std::uint32_t)value << 16);
+            break;
+        case FlashConReg::MemAddrLo:
+            m_memAddr = (m_memAddr & 0xffff0000) | value;
+            break;
+        case FlashConReg::MemAddrHi:
+            m_memAddr = (m_memAddr & 0x0000ffff) | ((std::uint32_t)value << 16);
+            break;
+        case FlashConReg::Count:
+            m_count = value;
+            break;
+        default:
+            break;
+    }
+}
+
+void FlashCon::startOperation(std::uint16_t command)
+{
+    // Commands issued while busy are ignored, as on the real part
+
+    if (m_status & kStatusBusy)
+    {
+        m_status |= kStatusError;
+        return;
+    }
+
+    m_command = command;
+
+    m_opFlashAddr = m_flashAddr;
+    m_opMemAddr   = m_memAddr;
+    m_opCount     = m_count;
+
+    std::uint64_t cycles = 0;
+    std::uint16_t op     = command & kCommand_mask;
+
+    if (op == kCommandRead)
+    {
+        cycles = kCommandCycles + (std::uint64_t)m_opCount * kCyclesPerWord;
+    }
+    else if (op == kCommandPageProgram)
+    {
+        // Page program wraps within the page, as SPI NOR flash does.
+        // Data is shifted out of memory now; it lands in the array when
+        // the program cycle completes.
+
+        std::uint32_t count = m_opCount > kPageSizeInWords ? kPageSizeInWords : m_opCount;
+
+        m_programBuffer.resize(count);
+
+        for (std::uint32_t i = 0; i < count; i++)
+            m_programBuffer[i] = m_memory.dmaReadWord(m_opMemAddr + i);
+
+        cycles = kCommandCycles + count * kCyclesPerWord + kPageProgramCycles;
+    }
+    else if (op == kCommandSectorErase)
+    {
+        cycles = kCommandCycles + kSectorEraseCycles;
+    }
+    else
+    {
+        m_status |= kStatusError;
+        return;
+    }
+
+    m_status   |= kStatusBusy;
+    m_status   &= ~kStatusDone;
+    m_busyUntil = m_scheduler.now() + cycles;
+    m_eventId   = m_scheduler.schedule(cycles, [this] () { completeOperation(); });
+}
+
+void FlashCon::completeOperation()
+{
+    std::uint32_t addr = m_opFlashAddr % m_flashSizeInWords;
+
+    std::uint16_t op   = m_command & kCommand_mask;
+
+    if (op == kCommandRead)
+    {
+        // Burst: whole transfer lands in memory at the end of the operation
+
+        for (std::uint32_t i = 0; i < m_opCount; i++)
+            m_memory.dmaWriteWord(m_opMemAddr + i, m_flash[(addr + i) % m_flashSizeInWords]);
+    }
+    else if (op == kCommandPageProgram)
+    {
+        std::uint32_t pageBase = addr & ~(kPageSizeInWords - 1);
+
+        std::unique_lock<std::mutex> lock(m_flashMutex);
+
+        // programming can only clear bits
+
+        for (std::uint32_t i = 0; i < m_programBuffer.size(); i++)
+        {
+            std::uint32_t a = pageBase + ((addr - pageBase + i) % kPageSizeInWords);
+            m_flash[a] &= m_programBuffer[i];
+        }
+
+        markDirty(pageBase, kPageSizeInWords);
+        m_memory.markFlashWritten(pageBase, kPageSizeInWords);
+    }
+    else if (op == kCommandSectorErase)
+    {
+        std::uint32_t sectorBase = addr & ~(kSectorSizeInWords - 1);
+
+        std::unique_lock<std::mutex> lock(m_flashMutex);
+
+        for (std::uint32_t i = 0; i < kSectorSizeInWords; i++)
+            m_flash[sectorBase + i] = 0xffff;
+
+        markDirty(sectorBase, kSectorSizeInWords);
+        m_memory.markFlashWritten(sectorBase, kSectorSizeInWords);
+    }
+
+    m_status &= ~kStatusBusy;
+    m_status |= kStatusDone;
+
+    if (m_command & kCommandInterruptEnable)
+    {
+        if (m_intDel != nullptr)
+            m_intDel->setIRQ(kFlashIRQ, true);
+    }
+}
+
+void FlashCon::markDirty(std::uint32_t flashAddr, std::uint32_t count)
+{
+    // m_flashMutex must be held
+
+    for (std::uint32_t s = flashAddr / kSectorSizeInWords; s <= (flashAddr + count - 1) / kSectorSizeInWords; s++)
+        m_dirtySectors[s] = true;
+
+    m_anyDirty = true;
+}
+
+void FlashCon::persistThread()
+{
+    std::unique_lock<std::mutex> lock(m_flashMutex);
+
+    while (! m_threadExit)
+    {
+        m_persistCond.wait_for(lock, std::chrono::milliseconds(kPersistIntervalMs));
+
+        if (m_anyDirty)
+        {
+            lock.unlock();
+            persistDirtySectors();
+            lock.lock();
+        }
+    }
+
+    // final flush on shutdown
+
+    lock.unlock();
+    persistDirtySectors();
+}
+
+void FlashCon::persistDirtySectors()
+{
+    // Copy dirty sectors out under the lock so the CPU thread is only
+    // held up for a memcpy, then write them without the lock.
+
+    std::vector<std::pair<std::uint32_t, std::vector<std::uint16_t>>> sectors;
+    std::string flashFile;
+
+    {
+        std::unique_lock<std::mutex> lock(m_flashMutex);
+
+        if (! m_anyDirty || m_flashFile.empty())
+            return;
+
+        for (std::uint32_t s = 0; s < m_dirtySectors.size(); s++)
+        {
+            if (m_dirtySectors[s])
+            {
+                std::uint16_t* base = &m_flash[s * kSectorSizeInWords];
+                sectors.emplace_back(s, std::vector<std::uint16_t>(base, base + kSectorSizeInWords));
+                m_dirtySectors[s] = false;
+            }
+        }
+
+        m_anyDirty = false;
+        flashFile  = m_flashFile;
+    }
+
+    std::fstream out;
+
+    out.open(flashFile, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+
+    if (! out.is_open())
+    {
+        // image doesn't exist yet - create it
+        out.open(flashFile, std::ios_base::in | std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    }
+
+    if (! out.is_open())
+    {
+        std::cout << "Error: could not write flash image " << flashFile << std::endl;
+        return;
+    }
+
+    for (auto& sector : sectors)
+    {
+        out.seekp((std::streamoff)sector.first * kSectorSizeInWords * sizeof(std::uint16_t));
+        out.write((char*)sector.second.data(), sector.second.size() * sizeof(std::uint16_t));
+    }
+}
+
+FlashCon::State FlashCon::saveState() const
+{
+    State state;
+
+    state.command       = m_command;
+    state.status        = m_status;
+    state.flashAddr     = m_flashAddr;
+    state.memAddr       = m_memAddr;
+    state.count         = m_count;
+    state.opFlashAddr   = m_opFlashAddr;
+    state.opMemAddr     = m_opMemAddr;
+    state.opCount       = m_opCount;
+    state.programBuffer = m_programBuffer;
+    state.busyUntil     = m_busyUntil;
+    state.eventId       = m_eventId;
+
+    return state;
+}
+
+void FlashCon::restoreState(const State& state)
+{
+    m_command       = state.command;
+    m_status        = state.status;
+    m_flashAddr     = state.flashAddr;
+    m_memAddr       = state.memAddr;
+    m_count         = state.count;
+    m_opFlashAddr   = state.opFlashAddr;
+    m_opMemAddr     = state.opMemAddr;
+    m_opCount       = state.opCount;
+    m_programBuffer = state.programBuffer;
+    m_busyUntil     = state.busyUntil;
+    m_eventId       = state.eventId;
+}
+
+void FlashCon::flashRestored(std::uint32_t flashAddr, std::uint32_t count)
+{
+    // m_flashMutex must be held (see lockFlash())
+
+    markDirty(flashAddr, count);
+}
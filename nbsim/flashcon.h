@@ -0,0 +1,158 @@
+#pragma once
+
+#include "iportsink.h"
+#include "memory.h"
+#include "eventscheduler.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+--      0                       |       Command (write starts operation)
+--      1                       |       Status
+--      2                       |       Flash address lo (word address in flash)
+--      3                       |       Flash address hi
+--      4                       |       Memory address lo (word address, CPU address space)
+--      5                       |       Memory address hi
+--      6                       |       Count (words)
+*/
+
+enum class FlashConReg
+{
+    Command         = 0,
+    Status          = 1,
+    FlashAddrLo     = 2,
+    FlashAddrHi     = 3,
+    MemAddrLo       = 4,
+    MemAddrHi       = 5,
+    Count           = 6
+};
+
+class FlashCon : public IPortSink
+{
+public:
+
+    FlashCon(Memory& mem, EventScheduler& sched);
+    ~FlashCon();
+
+    virtual std::uint16_t inPort(std::uint16_t reg) override;
+    virtual void          outPort(std::uint16_t reg, std::uint16_t value) override;
+
+    virtual void          setInterruptDelegate(IInterruptDelegate* intDel) override { m_intDel = intDel; }
+
+    void configureFlash(std::string flashFile);
+
+    void hardReset();
+    void shutDown();
+
+    // When set, polling the status register while an operation is in
+    // progress skips virtual time to the end of the operation.
+    void setFastForwardPolling(bool ff) { m_fastForward = ff; }
+
+    // Register state. Flash contents are checkpointed with the rest of
+    // memory; whoever restores them must hold lockFlash() while doing so,
+    // and call flashRestored() for each range restored, so only those
+    // sectors of the image file are rewritten.
+
+    struct State
+    {
+        std::uint16_t command;
+        std::uint16_t status;
+        std::uint32_t flashAddr;
+        std::uint32_t memAddr;
+        std::uint16_t count;
+        std::uint32_t opFlashAddr;
+        std::uint32_t opMemAddr;
+        std::uint16_t opCount;
+        std::vector<std::uint16_t> programBuffer;
+        std::uint64_t busyUntil;
+        int           eventId;
+    };
+
+    State saveState() const;
+    void  restoreState(const State& state);
+
+    void  flashRestored(std::uint32_t flashAddr, std::uint32_t count);
+
+    std::unique_lock<std::mutex> lockFlash() { return std::unique_lock<std::mutex>(m_flashMutex); }
+
+    // Command register
+    const std::uint16_t kCommand_mask           = 0x000f;
+    const std::uint16_t kCommandRead            = 1;    // burst read count words from flash to memory
+    const std::uint16_t kCommandPageProgram     = 2;    // program up to a page from memory into flash
+    const std::uint16_t kCommandSectorErase     = 3;    // erase sector containing flash address
+    const std::uint16_t kCommandInterruptEnable = 1 << 8;
+
+    // Status register
+    const std::uint16_t kStatusBusy             = 1 << 0;
+    const std::uint16_t kStatusDone             = 1 << 1;   // write 1 to clear
+    const std::uint16_t kStatusError            = 1 << 2;   // write 1 to clear
+
+    const int kFlashIRQ = 4;
+
+    // Geometry (in 16 bit words)
+    const std::uint32_t kPageSizeInWords    = 128;  // 256 byte program page
+    const std::uint32_t kSectorSizeInWords  = 2048; // 4KiB erase sector
+
+    // Timing, in CPU cycles at 50MHz. SPI clock is CPU clock / 2, so each
+    // bit on the wire costs two cycles.
+    const std::uint64_t kCommandCycles      = (8 + 24 + 8) * 2;     // opcode + address + dummy byte
+    const std::uint64_t kCyclesPerWord      = 16 * 2;
+    const std::uint64_t kPageProgramCycles  = 35000;                // tPP  = 0.7ms
+    const std::uint64_t kSectorEraseCycles  = 2250000;              // tSE  = 45ms
+
+    // Dirty sectors are written back to the image file in batches
+    const int kPersistIntervalMs = 500;
+
+private:
+
+    void startOperation(std::uint16_t command);
+    void completeOperation();
+
+    void markDirty(std::uint32_t flashAddr, std::uint32_t count);
+
+    void persistThread();
+    void persistDirtySectors();
+
+    Memory&         m_memory;
+    EventScheduler& m_scheduler;
+
+    std::uint16_t*  m_flash;
+    std::uint32_t   m_flashSizeInWords;
+
+    std::uint16_t m_command;
+    std::uint16_t m_status;
+    std::uint32_t m_flashAddr;
+    std::uint32_t m_memAddr;
+    std::uint16_t m_count;
+
+    // the operation in progress, latched when it starts: firmware may set
+    // up the next transfer while this one is busy
+    std::uint32_t m_opFlashAddr;
+    std::uint32_t m_opMemAddr;
+    std::uint16_t m_opCount;
+
+    std::vector<std::uint16_t> m_programBuffer;   // page data latched when program starts
+
+    std::uint64_t m_busyUntil;
+    int           m_eventId;
+    bool          m_fastForward;
+
+    IInterruptDelegate* m_intDel = nullptr;
+
+    // Persistence - m_flashMutex guards flash contents against the
+    // persistence thread, which copies dirty sectors out under the lock
+    // and writes them to disk outside of it.
+
+    std::string             m_flashFile;
+    std::mutex              m_flashMutex;
+    std::condition_variable m_persistCond;
+    std::vector<bool>       m_dirtySectors;
+    bool                    m_anyDirty;
+    bool                    m_threadExit;
+    std::thread             m_persistThread;
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+class IBusErrorDelegate
+{
+public:
+
+    // an access to an address with nothing behind it (word address)
+    virtual void busError(std::uint32_t address) = 0;
+
+};
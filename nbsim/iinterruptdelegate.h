@@ -8,11 +8,3 @@ public:
 
 
 };
-
-class ICPUInterruptDelegate
-{
-public:
-
-    virtual void setIRQ(bool level) = 0;
-};
-
@@ -2,6 +2,13 @@
 
 #include <iostream>
 
+IntCon::IntCon()    :
+    m_control(0),
+    m_interruptEnable(0),
+    m_interruptStatus(0)
+{
+}
+
 std::uint16_t IntCon::inPort(std::uint16_t reg)
 {
     switch ((IntConPort)reg)
@@ -26,8 +33,7 @@ void          IntCon::outPort(std::uint16_t reg, std::uint16_t value)
             m_control = value;
             break;
         case IntConPort::InterruptStatus:
-            m_interruptStatus &= ~value;    // write to clear
-            updateInterrupts();
+            m_interruptStatus.fetch_and(~value, std::memory_order_release);    // write to clear
             break;
         case IntConPort::InterruptEnable:
             m_interruptEnable = value;
@@ -46,18 +52,26 @@ void IntCon::setIRQ(int IRQ, bool level)
     }
 
     if (level)
-        m_interruptStatus |= 1 << IRQ;
+        m_interruptStatus.fetch_or(1 << IRQ, std::memory_order_release);
     else
-        m_interruptStatus &= ~(1 << IRQ);
+        m_interruptStatus.fetch_and(~(1 << IRQ), std::memory_order_release);
+
+}
+
+IntCon::State IntCon::saveState() const
+{
+    State state;
 
-    updateInterrupts();
+    state.control         = m_control;
+    state.interruptEnable = m_interruptEnable.load(std::memory_order_relaxed);
+    state.interruptStatus = m_interruptStatus.load(std::memory_order_relaxed);
 
+    return state;
 }
 
-void IntCon::updateInterrupts()
+void IntCon::restoreState(const State& state)
 {
-    if (m_interruptEnable & m_interruptStatus)
-        m_cpuDel->setIRQ(true);
-    else
-        m_cpuDel->setIRQ(false);
+    m_control = state.control;
+    m_interruptEnable.store(state.interruptEnable, std::memory_order_relaxed);
+    m_interruptStatus.store(state.interruptStatus, std::memory_order_release);
 }
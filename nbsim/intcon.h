@@ -3,6 +3,8 @@
 #include "iinterruptdelegate.h"
 #include "iportsink.h"
 
+#include <atomic>
+
 enum class IntConPort
 {
     Control = 0,
@@ -10,9 +12,16 @@ enum class IntConPort
     InterruptStatus = 2,
 };
 
+//
+//  Pending and enabled IRQs are kept as atomic bitmasks. Devices raise and
+//  lower lines with setIRQ(); the CPU samples interruptPending() at
+//  instruction boundaries rather than being called back.
+//
+
 class IntCon    : public IInterruptDelegate, public IPortSink
 {
 public:
+    IntCon();
     virtual ~IntCon() {}
 
     virtual std::uint16_t inPort(std::uint16_t reg) override;
@@ -20,20 +29,29 @@ public:
 
     virtual void setIRQ(int IRQ, bool level) override;
 
-    void setCPUInterruptDelegate(ICPUInterruptDelegate* cpu) { m_cpuDel = cpu; }
+    struct State
+    {
+        std::uint16_t control;
+        std::uint16_t interruptEnable;
+        std::uint16_t interruptStatus;
+    };
+
+    State saveState() const;
+    void  restoreState(const State& state);
+
+    bool interruptPending() const
+    {
+        return (m_interruptStatus.load(std::memory_order_acquire) &
+                m_interruptEnable.load(std::memory_order_relaxed)) != 0;
+    }
 
 private:
 
     const int kControlInterruptEnable = 0;
 
-    void updateInterrupts();
-
     std::uint16_t m_control;
-    std::uint16_t m_interruptEnable;
-    std::uint16_t m_interruptStatus;
-
-    ICPUInterruptDelegate* m_cpuDel;
+    std::atomic<std::uint16_t> m_interruptEnable;
+    std::atomic<std::uint16_t> m_interruptStatus;
 
 };
 
-
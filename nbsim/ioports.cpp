@@ -6,81 +6,94 @@
 #define MAKE_PORT_NUM(x) ((x & 0xf000) >> 12)
 #define MAKE_PORT_REG(x) (x & 0xfff)
 
-IOPorts::IOPorts()
+IOPorts::IOPorts(Memory& mem, EventScheduler& sched)   :
+    m_timerCounter(sched),
+    m_flashCon(mem, sched),
+    m_audioCon(mem, sched),
+    m_kbdCon(sched),
+    m_countAccesses(false)
 {
-    m_timerCounter.setInterruptDelegate(&m_intCon);
+    for (int i = 0; i < kNumPorts; i++)
+    {
+        m_nullPorts[i].setPortNumber(i);
+        m_ports[i] = &m_nullPorts[i];
+    }
+
+    resetAccessCounts();
+
+    registerPort(kPortUART,      &m_uart);
+    registerPort(kPortLEDSwitch, &m_ledSwitch);
+    registerPort(kPortAudioCon,  &m_audioCon);
+    registerPort(kPortFlashCon,  &m_flashCon);
+    registerPort(kPortKbdCon,    &m_kbdCon);
+    registerPort(kPortIntCon,    &m_intCon);
+    registerPort(kPortTimer,     &m_timerCounter);
+}
+
+void IOPorts::registerPort(int port, IPortSink* sink)
+{
+    m_ports[port] = sink;
+    sink->setInterruptDelegate(&m_intCon);
 }
 
 std::uint16_t IOPorts::inPort(std::uint16_t port)
 {
+    int num = MAKE_PORT_NUM(port);
 
-    switch (MAKE_PORT_NUM(port))
-    {
-        case kPortUART:
-            return m_uart.inPort(MAKE_PORT_REG(port));
-        case kPortLEDSwitch:
-            return m_ledSwitch.inPort(MAKE_PORT_REG(port));
-        case kPortVGACon:
-        case kPortAudioCon:
-        case kPortBlitCon:
-        case kPortTexCon0:
-        case kPortTexCon1:
-        case kPortTexCon2:
-        case kPortSDCon:
-        case kPortFlashCon:
-        case kPortKbdCon:
-        case kPortIntCon:
-            return m_intCon.inPort(MAKE_PORT_REG(port));
-        case kPortTimer:
-            return m_timerCounter.inPort(MAKE_PORT_REG(port));
-        default:
-            return 0;
-    }
+    if (m_countAccesses)
+        m_portReads[num]++;
 
+    return m_ports[num]->inPort(MAKE_PORT_REG(port));
 }
 
 void          IOPorts::outPort(std::uint16_t port, std::uint16_t value)
 {
-    switch (MAKE_PORT_NUM(port))
+    int num = MAKE_PORT_NUM(port);
+
+    if (m_countAccesses)
+        m_portWrites[num]++;
+
+    m_ports[num]->outPort(MAKE_PORT_REG(port), value);
+}
+
+void IOPorts::resetAccessCounts()
+{
+    for (int i = 0; i < kNumPorts; i++)
     {
-        case kPortUART:
-            m_uart.outPort(MAKE_PORT_REG(port), value);
-            break;
-        case kPortLEDSwitch:
-            m_ledSwitch.outPort(MAKE_PORT_REG(port), value);
-            break;
-        case kPortVGACon:
-        case kPortAudioCon:
-        case kPortBlitCon:
-        case kPortTexCon0:
-        case kPortTexCon1:
-        case kPortTexCon2:
-        case kPortSDCon:
-        case kPortFlashCon:
-        case kPortKbdCon:
-        case kPortIntCon:
-            m_intCon.outPort(MAKE_PORT_REG(port), value);
-            break;
-        case kPortTimer:
-            m_timerCounter.outPort(MAKE_PORT_REG(port), value);
-            break;
-        default:
-            break;
+        m_portReads[i]  = 0;
+        m_portWrites[i] = 0;
     }
 }
 
-void IOPorts::onLedGreenWrite(std::function<void (uint16_t)> func )
+IOPorts::AccessCounts IOPorts::saveAccessCounts() const
 {
-    m_ledSwitch.onLedGreenWrite(func);
+    AccessCounts counts;
+
+    for (int i = 0; i < kNumPorts; i++)
+    {
+        counts.reads[i]  = m_portReads[i];
+        counts.writes[i] = m_portWrites[i];
+    }
+
+    return counts;
 }
 
-void IOPorts::onLedRedWrite(std::function<void (uint16_t)> func )
+void IOPorts::restoreAccessCounts(const AccessCounts& counts)
 {
-    m_ledSwitch.onLedRedWrite(func);
+    for (int i = 0; i < kNumPorts; i++)
+    {
+        m_portReads[i]  = counts.reads[i];
+        m_portWrites[i] = counts.writes[i];
+    }
 }
 
-void IOPorts::onHexWrite(std::function<void (int, uint16_t)> func )
+const char* IOPorts::getPortName(int port)
 {
-    m_ledSwitch.onHexWrite(func);
-}
+    static const char* names[kNumPorts] =
+    {
+        "uart", "ledswitch", "vgacon", "audiocon", "blitcon", "texcon0", "texcon1", "texcon2",
+        "sdcon", "flashcon", "kbdcon", "intcon", "timer", "port13", "port14", "port15"
+    };
 
+    return names[port];
+}
@@ -7,6 +7,12 @@
 #include "uart.h"
 #include "timercounter.h"
 #include "intcon.h"
+#include "flashcon.h"
+#include "audiocon.h"
+#include "kbdcon.h"
+#include "nullportsink.h"
+#include "memory.h"
+#include "eventscheduler.h"
 
 class IOPorts
 {
@@ -27,34 +33,132 @@ public:
         kPortFlashCon   = 9,
         kPortKbdCon     = 10,
         kPortIntCon     = 11,
-        kPortTimer      = 12
+        kPortTimer      = 12,
+
+        kNumPorts       = 16
     };
 
-    IOPorts();
+    IOPorts(Memory& mem, EventScheduler& sched);
 
     std::uint16_t inPort(std::uint16_t port);
     void          outPort(std::uint16_t port, std::uint16_t value);
 
-    void onLedGreenWrite(std::function<void (uint16_t)> func);
-    void onLedRedWrite  (std::function<void (uint16_t)> func);
-    void onHexWrite     (std::function<void (int, uint16_t)> func);
+    PanelState getPanelState() const { return m_ledSwitch.getPanelState(); }
+
+    void configureFlash(std::string flashFile) { m_flashCon.configureFlash(flashFile); }
+    void setAudioSink(std::unique_ptr<IAudioSink> sink) { m_audioCon.setAudioSink(std::move(sink)); }
+
+    bool loadKeyboardScript(std::string path)   { return m_kbdCon.loadScript(path); }
+    bool recordKeyboard(std::string path)       { return m_kbdCon.recordScript(path); }
+    void injectScancodes(const std::vector<std::uint8_t>& codes) { m_kbdCon.injectHostScancodes(codes); }
+    void replayScancodes(const std::vector<std::uint8_t>& codes) { m_kbdCon.replayScancodes(codes); }
 
     void hardReset()
     {
         m_ledSwitch.hardReset();
+        m_timerCounter.hardReset();
+        m_flashCon.hardReset();
+        m_audioCon.hardReset();
+        m_kbdCon.hardReset();
     }
 
     void shutDown()
     {
-        m_timerCounter.shutDown();
+        m_flashCon.shutDown();
+        m_audioCon.shutDown();
+        m_kbdCon.shutDown();
+    }
+
+    // Device state for checkpointing. The UART and unimplemented ports
+    // have no state.
+
+    struct State
+    {
+        LedSwitch::State    ledSwitch;
+        TimerCounter::State timerCounter;
+        IntCon::State       intCon;
+        FlashCon::State     flashCon;
+        AudioCon::State     audioCon;
+        KbdCon::State       kbdCon;
+    };
+
+    State saveState() const
+    {
+        State state;
+
+        state.ledSwitch    = m_ledSwitch.saveState();
+        state.timerCounter = m_timerCounter.saveState();
+        state.intCon       = m_intCon.saveState();
+        state.flashCon     = m_flashCon.saveState();
+        state.audioCon     = m_audioCon.saveState();
+        state.kbdCon       = m_kbdCon.saveState();
+
+        return state;
+    }
+
+    void restoreState(const State& state)
+    {
+        m_ledSwitch.restoreState(state.ledSwitch);
+        m_timerCounter.restoreState(state.timerCounter);
+        m_intCon.restoreState(state.intCon);
+        m_flashCon.restoreState(state.flashCon);
+        m_audioCon.restoreState(state.audioCon);
+        m_kbdCon.restoreState(state.kbdCon);
+    }
+
+    std::unique_lock<std::mutex> lockFlash() { return m_flashCon.lockFlash(); }
+
+    // flash words restored from a checkpoint, with lockFlash() held
+    void flashRestored(std::uint32_t flashOffset, std::uint32_t count) { m_flashCon.flashRestored(flashOffset, count); }
+
+    // mute host side output (UART, audio) while re-executing history
+    void setReplaying(bool replaying)
+    {
+        m_uart.setMuted(replaying);
+        m_audioCon.setMuted(replaying);
     }
 
-    void setCPUInterruptDelegate(ICPUInterruptDelegate* cpu) { m_intCon.setCPUInterruptDelegate(cpu); }
+    // sampled by the CPU at instruction boundaries
+    bool interruptPending() const { return m_intCon.interruptPending(); }
+
+    // Per port access counters, off by default to keep port I/O cheap
+
+    void setCountAccesses(bool count) { m_countAccesses = count; }
+    void resetAccessCounts();
+
+    // put back around re-executed history, so it isn't counted twice
+    struct AccessCounts
+    {
+        std::uint64_t reads[kNumPorts];
+        std::uint64_t writes[kNumPorts];
+    };
+
+    AccessCounts saveAccessCounts() const;
+    void         restoreAccessCounts(const AccessCounts& counts);
+
+    std::uint64_t getPortReads(int port)  const { return m_portReads[port]; }
+    std::uint64_t getPortWrites(int port) const { return m_portWrites[port]; }
+
+    static const char* getPortName(int port);
 
 private:
 
+    void registerPort(int port, IPortSink* sink);
+
     UART m_uart;
     LedSwitch m_ledSwitch;
     TimerCounter m_timerCounter;
     IntCon m_intCon;
+    FlashCon m_flashCon;
+    AudioCon m_audioCon;
+    KbdCon m_kbdCon;
+
+    // Dispatch table indexed by port number; unregistered ports go to a null sink
+
+    IPortSink*   m_ports[kNumPorts];
+    NullPortSink m_nullPorts[kNumPorts];
+
+    bool          m_countAccesses;
+    std::uint64_t m_portReads[kNumPorts];
+    std::uint64_t m_portWrites[kNumPorts];
 };
@@ -0,0 +1,220 @@
+#include "kbdcon.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+KbdCon::KbdCon(EventScheduler& sched)   :
+    m_scheduler(sched),
+    m_fifoHead(0),
+    m_fifoCount(0),
+    m_status(0),
+    m_control(0),
+    m_scriptPos(0)
+{
+}
+
+void KbdCon::hardReset()
+{
+    m_fifoHead  = 0;
+    m_fifoCount = 0;
+    m_status    = 0;
+    m_control   = 0;
+}
+
+void KbdCon::shutDown()
+{
+    if (m_record.is_open())
+        m_record.close();
+}
+
+std::uint16_t KbdCon::inPort(std::uint16_t reg)
+{
+    switch ((KbdConReg)reg)
+    {
+        case KbdConReg::Data:
+        {
+            if (m_fifoCount == 0)
+                return 0;
+
+            std::uint8_t code = m_fifo[m_fifoHead];
+
+            m_fifoHead = (m_fifoHead + 1) % kFifoSize;
+            m_fifoCount--;
+
+            if (m_fifoCount == 0)
+                m_status &= ~kStatusDataAvailable;
+
+            updateInterrupt();
+
+            return code;
+        }
+        case KbdConReg::Status:
+            return m_status;
+        case KbdConReg::Control:
+            return m_control;
+        default:
+            return 0;
+    }
+}
+
+void KbdCon::outPort(std::uint16_t reg, std::uint16_t value)
+{
+    switch ((KbdConReg)reg)
+    {
+        case KbdConReg::Status:
+            m_status &= ~(value & kStatusOverflow);
+            break;
+        case KbdConReg::Control:
+            m_control = value;
+            updateInterrupt();
+            break;
+        default:
+            break;
+    }
+}
+
+void KbdCon::injectHostScancodes(const std::vector<std::uint8_t>& codes)
+{
+    if (m_record.is_open())
+    {
+        m_record << std::dec << m_scheduler.now();
+
+        for (std::uint8_t code : codes)
+            m_record << " " << std::hex << std::setw(2) << std::setfill('0') << (int)code;
+
+        m_record << std::endl;
+    }
+
+    pushScancodes(codes);
+}
+
+void KbdCon::pushScancodes(const std::vector<std::uint8_t>& codes)
+{
+    for (std::uint8_t code : codes)
+    {
+        if (m_fifoCount == kFifoSize)
+        {
+            m_status |= kStatusOverflow;
+            break;
+        }
+
+        m_fifo[(m_fifoHead + m_fifoCount) % kFifoSize] = code;
+        m_fifoCount++;
+    }
+
+    if (m_fifoCount != 0)
+        m_status |= kStatusDataAvailable;
+
+    updateInterrupt();
+}
+
+void KbdCon::updateInterrupt()
+{
+    if (m_intDel != nullptr)
+        m_intDel->setIRQ(kKbdIRQ, (m_control & kControlInterruptEnable) && m_fifoCount != 0);
+}
+
+bool KbdCon::loadScript(std::string path)
+{
+    std::ifstream in(path);
+
+    if (! in.is_open())
+    {
+        std::cout << "Error: could not open keyboard script " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNum = 0;
+
+    m_script.clear();
+
+    while (std::getline(in, line))
+    {
+        lineNum++;
+
+        std::stringstream ss(line);
+        ScriptEntry entry;
+
+        if (! (ss >> std::dec >> entry.cycle))
+            continue;   // blank or comment
+
+        unsigned int code;
+
+        while (ss >> std::hex >> code)
+            entry.codes.push_back(code & 0xff);
+
+        if (! m_script.empty() && entry.cycle < m_script.back().cycle)
+        {
+            std::cout << "Error: keyboard script not in time order on line " << lineNum << std::endl;
+            return false;
+        }
+
+        m_script.push_back(entry);
+    }
+
+    m_scriptPos = 0;
+    scheduleNextScriptEntry();
+
+    return true;
+}
+
+bool KbdCon::recordScript(std::string path)
+{
+    m_record.open(path, std::ios_base::out | std::ios_base::trunc);
+
+    if (! m_record.is_open())
+    {
+        std::cout << "Error: could not open keyboard record file " << path << std::endl;
+        return false;
+    }
+
+    m_record << "# nbsim keyboard script: <cycle> <scancodes...>" << std::endl;
+
+    return true;
+}
+
+void KbdCon::scheduleNextScriptEntry()
+{
+    if (m_scriptPos >= m_script.size())
+        return;
+
+    std::uint64_t when  = m_script[m_scriptPos].cycle;
+    std::uint64_t delay = when > m_scheduler.now() ? when - m_scheduler.now() : 0;
+
+    m_scheduler.schedule(delay, [this] ()
+    {
+        pushScancodes(m_script[m_scriptPos].codes);
+        m_scriptPos++;
+        scheduleNextScriptEntry();
+    });
+}
+
+KbdCon::State KbdCon::saveState() const
+{
+    State state;
+
+    for (std::size_t i = 0; i < kFifoSize; i++)
+        state.fifo[i] = m_fifo[i];
+
+    state.fifoHead  = m_fifoHead;
+    state.fifoCount = m_fifoCount;
+    state.status    = m_status;
+    state.control   = m_control;
+    state.scriptPos = m_scriptPos;
+
+    return state;
+}
+
+void KbdCon::restoreState(const State& state)
+{
+    for (std::size_t i = 0; i < kFifoSize; i++)
+        m_fifo[i] = state.fifo[i];
+
+    m_fifoHead  = state.fifoHead;
+    m_fifoCount = state.fifoCount;
+    m_status    = state.status;
+    m_control   = state.control;
+    m_scriptPos = state.scriptPos;
+}
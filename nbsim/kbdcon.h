@@ -0,0 +1,109 @@
+#pragma once
+
+#include "iportsink.h"
+#include "eventscheduler.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+
+/*
+--      0                       |       Data (read pops scancode FIFO)
+--      1                       |       Status
+--      2                       |       Control
+*/
+
+enum class KbdConReg
+{
+    Data    = 0,
+    Status  = 1,
+    Control = 2
+};
+
+class KbdCon : public IPortSink
+{
+public:
+
+    KbdCon(EventScheduler& sched);
+
+    virtual std::uint16_t inPort(std::uint16_t reg) override;
+    virtual void          outPort(std::uint16_t reg, std::uint16_t value) override;
+
+    virtual void          setInterruptDelegate(IInterruptDelegate* intDel) override { m_intDel = intDel; }
+
+    void hardReset();
+    void shutDown();
+
+    // Scancodes from the host keyboard. Must be called on the CPU thread
+    // (post through the scheduler); injections are recorded if recording.
+    void injectHostScancodes(const std::vector<std::uint8_t>& codes);
+
+    // Scancodes re-delivered from the input log when re-executing history;
+    // not recorded again.
+    void replayScancodes(const std::vector<std::uint8_t>& codes) { pushScancodes(codes); }
+
+    // Replay a script of timestamped scancodes. Each line is
+    //
+    //      <virtual cycle> <scancode> [<scancode> ...]
+    //
+    // with scancodes in hex (PS/2 set 2, so a break is "f0 xx"). Blank
+    // lines and lines starting with '#' are ignored.
+    bool loadScript(std::string path);
+
+    // Record host key events in the same format, for later replay
+    bool recordScript(std::string path);
+
+    // The script position is part of the state, as the pending script event
+    // is restored with the scheduler.
+
+    struct State
+    {
+        std::uint8_t  fifo[16];
+        std::size_t   fifoHead;
+        std::size_t   fifoCount;
+        std::uint16_t status;
+        std::uint16_t control;
+        std::size_t   scriptPos;
+    };
+
+    State saveState() const;
+    void  restoreState(const State& state);
+
+    const std::uint16_t kStatusDataAvailable = 1 << 0;
+    const std::uint16_t kStatusOverflow      = 1 << 1;  // write 1 to clear
+
+    const std::uint16_t kControlInterruptEnable = 1 << 0;
+
+    const int kKbdIRQ = 3;
+
+    const std::size_t kFifoSize = 16;
+
+private:
+
+    struct ScriptEntry
+    {
+        std::uint64_t cycle;
+        std::vector<std::uint8_t> codes;
+    };
+
+    void pushScancodes(const std::vector<std::uint8_t>& codes);
+    void scheduleNextScriptEntry();
+    void updateInterrupt();
+
+    EventScheduler& m_scheduler;
+
+    std::uint8_t  m_fifo[16];
+    std::size_t   m_fifoHead;
+    std::size_t   m_fifoCount;
+
+    std::uint16_t m_status;
+    std::uint16_t m_control;
+
+    std::vector<ScriptEntry> m_script;
+    std::size_t              m_scriptPos;
+
+    std::ofstream m_record;
+
+    IInterruptDelegate* m_intDel = nullptr;
+};
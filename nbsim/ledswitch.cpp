@@ -1,5 +1,16 @@
 #include "ledswitch.h"
 
+LedSwitch::LedSwitch()  :
+    m_slideSwitches(0),
+    m_greenLeds(0),
+    m_redLeds(0),
+    m_hex0(0),
+    m_hex1(0),
+    m_hex2(0),
+    m_hex3(0)
+{
+}
+
 std::uint16_t LedSwitch::inPort(std::uint16_t reg)
 {
     switch ((LedSwitchPort)reg)
@@ -27,23 +38,27 @@ std::uint16_t LedSwitch::inPort(std::uint16_t reg)
 void LedSwitch::hardReset()
 {
     m_greenLeds = 0;
-    m_onLedGreenWrite(0);
-
     m_redLeds = 0;
-    m_onLedRedWrite(0);
-
     m_hex0 = 0;
-    m_onHexWrite(0, 0);
-
     m_hex1 = 0;
-    m_onHexWrite(1, 0);
-
     m_hex2 = 0;
-    m_onHexWrite(2, 0);
-
     m_hex3 = 0;
-    m_onHexWrite(3, 0);
 
+    publishPanel();
+}
+
+void LedSwitch::publishPanel()
+{
+    PanelState panel;
+
+    panel.greenLeds = m_greenLeds;
+    panel.redLeds   = m_redLeds;
+    panel.hex[0]    = m_hex0;
+    panel.hex[1]    = m_hex1;
+    panel.hex[2]    = m_hex2;
+    panel.hex[3]    = m_hex3;
+
+    m_panel.publish(panel);
 }
 
 void          LedSwitch::outPort(std::uint16_t reg, std::uint16_t value)
@@ -51,48 +66,56 @@ void          LedSwitch::outPort(std::uint16_t reg, std::uint16_t value)
     switch ((LedSwitchPort)reg)
     {
         case LedSwitchPort::SlideSwitches:
-            break;
+            return;
         case LedSwitchPort::GreenLeds:
             m_greenLeds = value;
-            m_onLedGreenWrite(value);
             break;
         case LedSwitchPort::RedLeds:
             m_redLeds = value;
-            m_onLedRedWrite(value);
             break;
         case LedSwitchPort::Hex0:
             m_hex0 = value;
-            m_onHexWrite(0, value);
             break;
         case LedSwitchPort::Hex1:
             m_hex1 = value;
-            m_onHexWrite(1, value);
             break;
         case LedSwitchPort::Hex2:
             m_hex2 = value;
-            m_onHexWrite(2, value);
             break;
         case LedSwitchPort::Hex3:
             m_hex3 = value;
-            m_onHexWrite(3, value);
             break;
         default:
-            break;
+            return;
     }
 
+    publishPanel();
 }
 
-void LedSwitch::onLedGreenWrite(std::function<void (uint16_t)> func )
+LedSwitch::State LedSwitch::saveState() const
 {
-    m_onLedGreenWrite = func;
-}
+    State state;
 
-void LedSwitch::onLedRedWrite(std::function<void (uint16_t)> func )
-{
-    m_onLedRedWrite = func;
+    state.greenLeds = m_greenLeds;
+    state.redLeds   = m_redLeds;
+    state.hex[0]    = m_hex0;
+    state.hex[1]    = m_hex1;
+    state.hex[2]    = m_hex2;
+    state.hex[3]    = m_hex3;
+
+    return state;
 }
 
-void LedSwitch::onHexWrite(std::function<void (int, uint16_t)> func )
+void LedSwitch::restoreState(const State& state)
 {
-    m_onHexWrite = func;
+    // the slide switches are inputs, so are left as they are
+
+    m_greenLeds = state.greenLeds;
+    m_redLeds   = state.redLeds;
+    m_hex0      = state.hex[0];
+    m_hex1      = state.hex[1];
+    m_hex2      = state.hex[2];
+    m_hex3      = state.hex[3];
+
+    publishPanel();
 }
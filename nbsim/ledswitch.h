@@ -1,8 +1,7 @@
 #pragma once
 
 #include "iportsink.h"
-
-#include <functional>
+#include "snapshotpublisher.h"
 
 /*
 --      0                       |       green LEDs
@@ -25,21 +24,42 @@ enum class LedSwitchPort
     Hex3            = 6
 };
 
+// What the front panel shows, published for the GUI to pick up at its own rate
+
+struct PanelState
+{
+    std::uint16_t greenLeds;
+    std::uint16_t redLeds;
+    std::uint16_t hex[4];
+};
+
 class LedSwitch : public IPortSink
 {
 public:
+    LedSwitch();
+
     virtual std::uint16_t inPort(std::uint16_t reg) override;
     virtual void          outPort(std::uint16_t reg, std::uint16_t value) override;
 
-    void onLedGreenWrite(std::function<void (uint16_t)> func );
-    void onLedRedWrite(std::function<void (uint16_t)> func );
-    void onHexWrite(std::function<void (int, uint16_t)> func );
-
     void hardReset();
 
+    struct State
+    {
+        std::uint16_t greenLeds;
+        std::uint16_t redLeds;
+        std::uint16_t hex[4];
+    };
+
+    State saveState() const;
+    void  restoreState(const State& state);
+
+    // safe to call from any thread
+    PanelState getPanelState() const { return m_panel.read(); }
 
 private:
 
+    void publishPanel();
+
     std::uint16_t m_slideSwitches;
     std::uint16_t m_greenLeds;
     std::uint16_t m_redLeds;
@@ -48,9 +68,7 @@ private:
     std::uint16_t m_hex2;
     std::uint16_t m_hex3;
 
-    std::function<void (uint16_t)> m_onLedGreenWrite;
-    std::function<void (uint16_t)> m_onLedRedWrite;
-    std::function<void (int, uint16_t)> m_onHexWrite;
+    SnapshotPublisher<PanelState> m_panel;
 };
 
 
@@ -5,11 +5,42 @@
 #include <QApplication>
 
 #include <iostream>
+#include <fstream>
 #include <unistd.h>
 
 void printUsage(char* exe)
 {
-    std::cout << "Usage:" << exe << "-s <sd card img> -f <flash img> -b <block ram> " << std::endl;
+    std::cout << "Usage:" << exe << "-s <sd card img> -f <flash img> -b <block ram> [-a <audio out.wav>]" << std::endl;
+    std::cout << "       [-k <keyboard script>] [-K <record keyboard to>] [-H (headless)] [-c <cycles to run>]" << std::endl;
+    std::cout << "       [-y <symbol file for debugger>] [-r (record history for reverse debugging)]" << std::endl;
+    std::cout << "       [-j <write stats as JSON at exit>] [-t <write retirement trace to>]" << std::endl;
+    std::cout << "       [-p <write timing model estimates at exit (symbols from -y)>] [-e (semihosting)]" << std::endl;
+}
+
+void writeTimingReport(nbSoC& nanobrain, const char* timingFile)
+{
+    std::ofstream out(timingFile);
+
+    if (! out.is_open())
+    {
+        std::cout << "Error: could not open timing report " << timingFile << std::endl;
+        return;
+    }
+
+    nanobrain.getTimingModel()->writeReport(out);
+}
+
+void writeStats(nbSoC& nanobrain, const char* statsFile)
+{
+    std::ofstream out(statsFile);
+
+    if (! out.is_open())
+    {
+        std::cout << "Error: could not open stats file " << statsFile << std::endl;
+        return;
+    }
+
+    nanobrain.getStats().writeJSON(out);
 }
 
 int main(int argc, char** argv)
@@ -20,10 +51,21 @@ int main(int argc, char** argv)
     char* blockRamImg = nullptr;
     char* flashImg = nullptr;
     char* sdImg = nullptr;
+    char* audioWav = nullptr;
+    char* kbdScript = nullptr;
+    char* kbdRecord = nullptr;
+    char* symbolFile = nullptr;
+    char* statsFile = nullptr;
+    char* traceFile = nullptr;
+    char* timingFile = nullptr;
+    bool headless = false;
+    bool reverseDebugging = false;
+    bool semihosting = false;
+    std::uint64_t cycles = 0;
 
     char c;
 
-    while ((c = getopt (argc, argv, "b:f:s:")) != -1)
+    while ((c = getopt (argc, argv, "b:f:s:a:k:K:Hc:y:rj:t:p:e")) != -1)
     switch (c)
     {
         case 's':
@@ -35,6 +77,39 @@ int main(int argc, char** argv)
         case 'b':
             blockRamImg = strdup(optarg);
             break;
+        case 'a':
+            audioWav = strdup(optarg);
+            break;
+        case 'k':
+            kbdScript = strdup(optarg);
+            break;
+        case 'K':
+            kbdRecord = strdup(optarg);
+            break;
+        case 'H':
+            headless = true;
+            break;
+        case 'c':
+            cycles = strtoull(optarg, nullptr, 0);
+            break;
+        case 'y':
+            symbolFile = strdup(optarg);
+            break;
+        case 'r':
+            reverseDebugging = true;
+            break;
+        case 'j':
+            statsFile = strdup(optarg);
+            break;
+        case 't':
+            traceFile = strdup(optarg);
+            break;
+        case 'p':
+            timingFile = strdup(optarg);
+            break;
+        case 'e':
+            semihosting = true;
+            break;
         default:
             printUsage(argv[0]);
             exit(EXIT_FAILURE);
@@ -78,6 +153,81 @@ int main(int argc, char** argv)
 
     nanobrain.configureSDCard(sdImg);
 
+    // Audio output: optional, otherwise samples are discarded
+
+    if (audioWav != nullptr)
+        nanobrain.configureAudio(audioWav);
+
+    // Keyboard: replay a script of timed scancodes and / or record host key presses
+
+    if (kbdScript != nullptr && ! nanobrain.configureKeyboardScript(kbdScript))
+        exit(EXIT_FAILURE);
+
+    if (kbdRecord != nullptr && ! nanobrain.configureKeyboardRecord(kbdRecord))
+        exit(EXIT_FAILURE);
+
+    if (cycles != 0)
+        nanobrain.stopAfter(cycles);
+
+    // Reverse debugging: checkpoints cost memory and a little time, so off by default
+
+    if (reverseDebugging)
+        nanobrain.enableReverseDebugging(true);
+
+    // Retirement trace, for lockstep comparison with the RTL (tools/tracecmp)
+
+    if (traceFile != nullptr && ! nanobrain.enableTrace(traceFile))
+        exit(EXIT_FAILURE);
+
+    // Timing model: cycle estimates for the FPGA, per function if there are symbols
+
+    if (timingFile != nullptr)
+    {
+        nanobrain.enableTimingModel();
+
+        if (symbolFile != nullptr && ! nanobrain.getTimingModel()->loadSymbols(symbolFile))
+            exit(EXIT_FAILURE);
+    }
+
+    // Semihosting: svc does host file I/O and exit instead of trapping
+
+    if (semihosting)
+        nanobrain.enableSemihosting();
+
+    // Headless: no UI, run flat out until the cycle count expires. Everything
+    // is in virtual time, so a replayed keyboard script gives the same run every time.
+
+    if (headless)
+    {
+        if (cycles == 0)
+            std::cout << "Warning: headless with no cycle count, running until killed" << std::endl;
+
+        nanobrain.setThrottle(false);
+        nanobrain.start();
+
+        // progress line once a second, on stderr so it stays out of the UART output
+
+        while (! nanobrain.waitForStop(1000))
+        {
+            nanobrain.getStats().writeSummary(std::cerr);
+            std::cerr << std::endl;
+        }
+
+        nanobrain.shutDown();
+
+        nanobrain.getStats().writeSummary(std::cerr);
+        std::cerr << std::endl;
+
+        if (statsFile != nullptr)
+            writeStats(nanobrain, statsFile);
+
+        if (timingFile != nullptr)
+            writeTimingReport(nanobrain, timingFile);
+
+        // firmware can report pass / fail through a semihosting exit
+        return nanobrain.getExitCode();
+    }
+
     // Create UI
     // Run GUI
 
@@ -93,20 +243,30 @@ int main(int argc, char** argv)
 
     DebuggerDialog d(&nanobrain, &w);
 
+    if (symbolFile != nullptr)
+        d.loadSymbols(symbolFile);
+
     // Set signals.
 
     nanobrain.onBlitToGfxRam ([&] ()         { w.onBlitToGfxRam(nanobrain); });
-    nanobrain.onLedGreenWrite([&] (uint16_t ledGreen) { w.onLedGreenWrite(ledGreen); });
-    nanobrain.onLedRedWrite([&]   (uint16_t ledRed)   { w.onLedRedWrite(ledRed); });
-    nanobrain.onHexWrite([&]   (int hex, uint16_t val)   { w.onHexWrite(hex, val); });
+    w.setPanelSource([&] () { return nanobrain.getPanelState(); });
 
     w.onResetButtonPressed([&] (bool pressed) { nanobrain.onResetButtonPressed(pressed); });
     w.onDebugButtonPressed([&] () { d.show(); });
+    w.onKeyEvent([&] (const std::vector<std::uint8_t>& codes) { nanobrain.onKeyEvent(codes); });
 
     // Boot cpu
 
     nanobrain.start();
 
-    return a.exec();
+    int ret = a.exec();
+
+    if (statsFile != nullptr)
+        writeStats(nanobrain, statsFile);
+
+    if (timingFile != nullptr)
+        writeTimingReport(nanobrain, timingFile);
+
+    return ret;
 
 }
@@ -6,9 +6,16 @@
 
 Memory::Memory()
 {
-    m_ddr   = new std::uint16_t [kDDRSizeInWords];
+    m_ddr   = new std::uint16_t [kDDRSizeInWords]();     // zeroed, so runs are repeatable
     m_bram  = new std::uint16_t [kBRAMSizeInWords];
     m_flash = new std::uint16_t [kFlashSizeInWords];
+
+    m_pageGenerations = new std::atomic<std::uint32_t> [kNumPages];
+
+    for (std::uint32_t i = 0; i < kNumPages; i++)
+        m_pageGenerations[i] = 0;
+
+    resetAccessCounts();
 }
 
 Memory::~Memory()
@@ -16,6 +23,7 @@ Memory::~Memory()
     delete [] m_ddr;
     delete [] m_bram;
     delete [] m_flash;
+    delete [] m_pageGenerations;
 
 }
 
@@ -39,53 +47,207 @@ void Memory::configureBlockRam(std::string bramFile)
 
 void Memory::configureFlash(std::string flashFile)
 {
+    std::ifstream flashData;
+
+    // Unprogrammed flash reads back as all ones
+
+    for (std::uint32_t i = 0; i < kFlashSizeInWords; i++)
+        m_flash[i] = 0xffff;
+
+    flashData.open(flashFile, std::ios_base::in | std::ios_base::binary);
+
+    if (! flashData.is_open())
+    {
+        std::cout << "Warning: could not open flash image " << flashFile << ", flash will be blank" << std::endl;
+        return;
+    }
 
+    flashData.read((char*)m_flash, kFlashSizeInWords * sizeof(std::uint16_t));
 }
 
-std::uint16_t Memory::readWord(std::uint32_t address)
+std::uint16_t Memory::read(std::uint32_t address, bool busError)
 {
 
     if (address <= kBRAMEndAddress)
     {
+        m_reads[kRegionBRAM]++;
         address &= kBRAMAddressMask;
         return m_bram[address];
     }
     else if (address <= kFlashEndAddress)
     {
+        m_reads[kRegionFlash]++;
         address -= kFlashStartAddress;
         return m_flash[address];
     }
     else if (address <= kDDREndAddress)
     {
+        m_reads[kRegionDDR]++;
         address -= kDDRStartAddress;
         return m_ddr[address];
     }
     else
     {
-        throw std::runtime_error("Invalid memory access");
+        if (busError && m_busErrDel != nullptr)
+            m_busErrDel->busError(address);
+
+        return 0;
     }
 
 }
 
-void Memory::writeWord(std::uint32_t address, std::uint16_t word)
+void Memory::write(std::uint32_t address, std::uint16_t word, bool busError)
 {
     if (address <= kBRAMEndAddress)
     {
-        address &= kBRAMAddressMask;
-        m_bram[address] = word;
+        m_writes[kRegionBRAM]++;
+        m_bram[address & kBRAMAddressMask] = word;
+        bumpGeneration(address);
     }
     else if (address <= kFlashEndAddress)
     {
         // Flash is read only from memory interface.
+        m_writes[kRegionFlash]++;
     }
     else if (address <= kDDREndAddress)
     {
-        address -= kDDRStartAddress;
-        m_ddr[address] = word;
+        m_writes[kRegionDDR]++;
+        m_ddr[address - kDDRStartAddress] = word;
+        bumpGeneration(address);
+    }
+    else
+    {
+        if (busError && m_busErrDel != nullptr)
+            m_busErrDel->busError(address);
+    }
+}
+
+void Memory::markFlashWritten(std::uint32_t flashOffset, std::uint32_t count)
+{
+    std::uint32_t first = (kFlashStartAddress + flashOffset) >> kPageShift;
+    std::uint32_t last  = (kFlashStartAddress + flashOffset + count - 1) >> kPageShift;
+
+    for (std::uint32_t page = first; page <= last; page++)
+        bumpGeneration(page << kPageShift);
+}
+
+std::uint32_t Memory::snapshotPage(std::uint32_t page, std::uint16_t* words)
+{
+    // The CPU writes the word before bumping the generation, so if the
+    // generation is the same either side of the copy, the copy is at least
+    // as new as that generation.
+
+    std::uint32_t base = page << kPageShift;
+    std::atomic<std::uint32_t>& gen = m_pageGenerations[generationSlot(base)];
+    const std::uint16_t* src = pageData(page);
+
+    for (;;)
+    {
+        std::uint32_t before = gen.load(std::memory_order_acquire);
+
+        for (std::uint32_t i = 0; i < kPageSizeInWords; i++)
+            words[i] = src[i];
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (gen.load(std::memory_order_relaxed) == before)
+            return before;
     }
+}
+
+std::uint16_t* Memory::pageData(std::uint32_t page)
+{
+    // pages never straddle regions; BRAM pages all alias the one page
+
+    std::uint32_t base = page << kPageShift;
+
+    if (base <= kBRAMEndAddress)
+        return m_bram;
+    else if (base <= kFlashEndAddress)
+        return m_flash + (base - kFlashStartAddress);
     else
+        return m_ddr + (base - kDDRStartAddress);
+}
+
+void Memory::restorePage(std::uint32_t page, const std::uint16_t* words)
+{
+    std::uint32_t base = page << kPageShift;
+    std::uint16_t* dest = pageData(page);
+
+    for (std::uint32_t i = 0; i < kPageSizeInWords; i++)
+        dest[i] = words[i];
+
+    bumpGeneration(base);
+}
+
+bool Memory::readBytes(std::uint32_t byteAddress, std::uint8_t* bytes, std::uint32_t count)
+{
+    if (! isValidRange(byteAddress, count))
+        return false;
+
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        std::uint32_t address = (byteAddress + i) >> 1;
+        std::uint16_t word = pageData(address >> kPageShift)[address & (kPageSizeInWords - 1)];
+
+        bytes[i] = (byteAddress + i) & 1 ? word >> 8 : word & 0xff;
+    }
+
+    return true;
+}
+
+bool Memory::writeBytes(std::uint32_t byteAddress, const std::uint8_t* bytes, std::uint32_t count)
+{
+    if (! isValidRange(byteAddress, count))
+        return false;
+
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+        std::uint32_t address = (byteAddress + i) >> 1;
+
+        if (getRegion(address) == kRegionFlash)
+            continue;
+
+        std::uint16_t& word = pageData(address >> kPageShift)[address & (kPageSizeInWords - 1)];
+
+        if ((byteAddress + i) & 1)
+            word = (word & 0x00ff) | (bytes[i] << 8);
+        else
+            word = (word & 0xff00) | bytes[i];
+
+        bumpGeneration(address);
+    }
+
+    return true;
+}
+
+void Memory::resetAccessCounts()
+{
+    for (int i = 0; i < kNumRegions; i++)
+    {
+        m_reads[i]  = 0;
+        m_writes[i] = 0;
+    }
+}
+
+Memory::AccessCounts Memory::saveAccessCounts() const
+{
+    AccessCounts counts;
+
+    for (int i = 0; i < kNumRegions; i++)
     {
-        throw std::runtime_error("Invalid memory access");
+        counts.reads[i]  = m_reads[i];
+        counts.writes[i] = m_writes[i];
     }
+
+    return counts;
 }
 
+void Memory::restoreAccessCounts(const AccessCounts& counts)
+{
+    for (int i = 0; i < kNumRegions; i++)
+    {
+        m_reads[i]  = counts.reads[i];
+        m_writes[i] = counts.writes[i];
+    }
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "ibuserrordelegate.h"
+
 #include <cstdint>
 #include <string>
+#include <atomic>
 
 class Memory
 {
@@ -9,14 +12,118 @@ public:
     Memory();
     ~Memory();
 
-    std::uint16_t readWord(std::uint32_t address); // word address
-    void          writeWord(std::uint32_t address, std::uint16_t word); // word address
+    // Word addresses. Accesses past the end of DDR go to the bus error
+    // delegate; reads return 0 and writes are dropped.
+    std::uint16_t readWord(std::uint32_t address)                   { return read(address, true); }
+    void          writeWord(std::uint32_t address, std::uint16_t word) { write(address, word, true); }
+
+    // For device DMA, which may be started by an OUT while the CPU is
+    // executing: a bad address isn't a bus error, reads just return 0.
+    std::uint16_t dmaReadWord(std::uint32_t address)                   { return read(address, false); }
+    void          dmaWriteWord(std::uint32_t address, std::uint16_t word) { write(address, word, false); }
+
+    void setBusErrorDelegate(IBusErrorDelegate* busErrDel) { m_busErrDel = busErrDel; }
 
     void configureBlockRam(std::string bramFile);
     void configureFlash(std::string flashFile);
 
+    // Backing store for the flash controller, which programs and erases
+    // flash directly (flash is read only through the memory interface).
+
+    std::uint16_t* getFlash()                   { return m_flash; }
+    std::uint32_t  getFlashSizeInWords() const  { return kFlashSizeInWords; }
+
+    // called after the flash controller changes flash contents
+    void markFlashWritten(std::uint32_t flashOffset, std::uint32_t count);
+
+    // Every page of the address space has a generation counter, bumped on
+    // writes, so viewers on other threads can cache what they have read and
+    // notice changes without locking the CPU. BRAM is aliased across its
+    // whole range so shares one counter.
+
+    std::uint32_t getNumPages() const       { return kNumPages; }
+    std::uint32_t getPageSizeInWords() const { return kPageSizeInWords; }
+
+    std::uint32_t getPageGeneration(std::uint32_t page) const
+    {
+        return m_pageGenerations[generationSlot(page << kPageShift)].load(std::memory_order_acquire);
+    }
+
+    // Copy a page (from any thread); returns the generation of the copy
+    std::uint32_t snapshotPage(std::uint32_t page, std::uint16_t* words);
+
+    // Pages 1 onwards of the BRAM range are aliases of page 0, so there
+    // is nothing to save for them when checkpointing.
+    bool isAliasPage(std::uint32_t page) const
+    {
+        return page != 0 && (page << kPageShift) <= kBRAMEndAddress;
+    }
+
+    // Overwrite a page from a checkpoint, flash included. CPU thread (or
+    // with the CPU paused) only; flash pages need the flash controller's lock.
+    void restorePage(std::uint32_t page, const std::uint16_t* words);
+
+    // whether a page is flash, and if so its offset into flash in words
+    bool isFlashPage(std::uint32_t page, std::uint32_t& flashOffset) const
+    {
+        std::uint32_t base = page << kPageShift;
+
+        if (base < kFlashStartAddress || base > kFlashEndAddress)
+            return false;
+
+        flashOffset = base - kFlashStartAddress;
+        return true;
+    }
+
+    // Bulk access from the host (semihosting): bytes are packed two to a
+    // word, low byte first. Return false if the range runs off the end of
+    // memory. Writes to flash are dropped, as from the CPU. CPU thread only.
+    bool readBytes(std::uint32_t byteAddress, std::uint8_t* bytes, std::uint32_t count);
+    bool writeBytes(std::uint32_t byteAddress, const std::uint8_t* bytes, std::uint32_t count);
+
+    // Access counters per region (CPU and DMA), read on the CPU thread only
+
+    enum
+    {
+        kRegionBRAM     = 0,
+        kRegionFlash    = 1,
+        kRegionDDR      = 2,
+
+        kNumRegions     = 3
+    };
+
+    // region of a word address
+    int getRegion(std::uint32_t address) const
+    {
+        return address <= kBRAMEndAddress ? kRegionBRAM : address <= kFlashEndAddress ? kRegionFlash : kRegionDDR;
+    }
+
+    std::uint64_t getReads(int region) const  { return m_reads[region]; }
+    std::uint64_t getWrites(int region) const { return m_writes[region]; }
+    void resetAccessCounts();
+
+    // put back around re-executed history, so it isn't counted twice
+    struct AccessCounts
+    {
+        std::uint64_t reads[kNumRegions];
+        std::uint64_t writes[kNumRegions];
+    };
+
+    AccessCounts saveAccessCounts() const;
+    void         restoreAccessCounts(const AccessCounts& counts);
+
 private:
 
+    std::uint16_t read(std::uint32_t address, bool busError);
+    void          write(std::uint32_t address, std::uint16_t word, bool busError);
+
+    std::uint16_t* pageData(std::uint32_t page);
+
+    bool isValidRange(std::uint32_t byteAddress, std::uint32_t count) const
+    {
+        return (std::uint64_t)byteAddress + count <= (std::uint64_t)(kDDREndAddress + 1) * 2;
+    }
+
     const std::uint32_t kDDRSizeInWords   = 4*1024*1024; // 8MiB
     const std::uint32_t kFlashSizeInWords = 2*1024*1024; // 4 MiB
     const std::uint32_t kBRAMSizeInWords  = 1024; // 2048k
@@ -33,8 +140,32 @@ private:
     const std::uint32_t kFlashEndAddress = 0x3FFFFF;
     const std::uint32_t kDDREndAddress   = 0x7FFFFF;
 
+    const std::uint32_t kPageShift       = 10;
+    const std::uint32_t kPageSizeInWords = 1 << 10;
+    const std::uint32_t kNumPages        = (kDDREndAddress + 1) >> 10;
+
+    std::uint32_t generationSlot(std::uint32_t address) const
+    {
+        return address <= kBRAMEndAddress ? 0 : address >> kPageShift;
+    }
+
+    void bumpGeneration(std::uint32_t address)
+    {
+        // only the CPU thread writes, so no need for an atomic increment
+
+        std::atomic<std::uint32_t>& gen = m_pageGenerations[generationSlot(address)];
+        gen.store(gen.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    std::atomic<std::uint32_t>* m_pageGenerations;
+
     std::uint16_t* m_ddr;
     std::uint16_t* m_flash;
     std::uint16_t* m_bram;
+
+    std::uint64_t m_reads[kNumRegions];
+    std::uint64_t m_writes[kNumRegions];
+
+    IBusErrorDelegate* m_busErrDel = nullptr;
 };
 
@@ -0,0 +1,142 @@
+#include "memorymodel.h"
+
+#include <QBrush>
+#include <QColor>
+#include <QString>
+
+MemoryModel::MemoryModel(Memory& mem, QObject* parent) :
+    QAbstractTableModel(parent),
+    m_memory(mem)
+{
+}
+
+int MemoryModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return m_memory.getNumPages() * m_memory.getPageSizeInWords() / kWordsPerRow;
+}
+
+int MemoryModel::columnCount(const QModelIndex& parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return kWordsPerRow + 1;
+}
+
+MemoryModel::Page& MemoryModel::getPage(std::uint32_t page) const
+{
+    auto it = m_pages.find(page);
+
+    if (it != m_pages.end())
+        return it->second;
+
+    if (m_pages.size() >= kMaxCachedPages)
+        m_pages.clear();
+
+    Page& p = m_pages[page];
+
+    p.words.resize(m_memory.getPageSizeInWords());
+    p.generation = m_memory.snapshotPage(page, p.words.data());
+
+    return p;
+}
+
+QVariant MemoryModel::data(const QModelIndex& index, int role) const
+{
+    if (! index.isValid())
+        return QVariant();
+
+    std::uint32_t pageSize = m_memory.getPageSizeInWords();
+    std::uint32_t address  = index.row() * kWordsPerRow;
+
+    Page& page = getPage(address / pageSize);
+
+    std::uint32_t offset = address % pageSize;
+
+    if (index.column() == textColumn())
+    {
+        if (role != Qt::DisplayRole)
+            return QVariant();
+
+        // words are stored little endian
+
+        QString text;
+
+        for (int i = 0; i < kWordsPerRow; i++)
+        {
+            std::uint16_t word = page.words[offset + i];
+
+            for (int b = 0; b < 2; b++)
+            {
+                char c = (b == 0) ? (word & 0xff) : (word >> 8);
+                text += (c >= 0x20 && c < 0x7f) ? QChar(c) : QChar('.');
+            }
+        }
+
+        return text;
+    }
+
+    offset += index.column();
+
+    if (role == Qt::DisplayRole)
+        return QString("%1").arg(page.words[offset], 4, 16, QChar('0'));
+
+    if (role == Qt::BackgroundRole)
+    {
+        if (! page.previous.empty() && page.previous[offset] != page.words[offset])
+            return QBrush(QColor(255, 200, 200));
+    }
+
+    return QVariant();
+}
+
+QVariant MemoryModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    if (orientation == Qt::Vertical)
+        return QString("%1").arg(section * kWordsPerRow * 2, 6, 16, QChar('0'));
+
+    if (section == textColumn())
+        return QString();
+
+    return QString("+%1").arg(section * 2, 0, 16);
+}
+
+void MemoryModel::refresh()
+{
+    std::vector<std::uint32_t> changed;
+
+    for (auto& p : m_pages)
+    {
+        Page& page = p.second;
+
+        if (m_memory.getPageGeneration(p.first) != page.generation)
+        {
+            page.previous = page.words;
+            page.generation = m_memory.snapshotPage(p.first, page.words.data());
+            changed.push_back(p.first);
+        }
+        else if (! page.previous.empty())
+        {
+            // highlighted last time round: clear it
+
+            page.previous.clear();
+            changed.push_back(p.first);
+        }
+    }
+
+    for (std::uint32_t page : changed)
+        emitPageChanged(page);
+}
+
+void MemoryModel::emitPageChanged(std::uint32_t page)
+{
+    int rowsPerPage = m_memory.getPageSizeInWords() / kWordsPerRow;
+
+    emit dataChanged(index(page * rowsPerPage, 0), index((page + 1) * rowsPerPage - 1, columnCount() - 1));
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QAbstractTableModel>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "memory.h"
+
+//
+//  Hex view of the whole address space, eight words to a row. Only pages
+//  the view asks for are read, by snapshot, so the CPU is never locked.
+//  Words which changed at the last refresh() are highlighted.
+//
+
+class MemoryModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+
+    MemoryModel(Memory& mem, QObject* parent = 0);
+
+    virtual int      rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    virtual int      columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    // re-read pages which have been written since the last refresh
+    void refresh();
+
+    // row holding a byte address
+    int rowForAddress(std::uint32_t byteAddress) const { return (byteAddress >> 1) / kWordsPerRow; }
+
+private:
+
+    struct Page
+    {
+        std::uint32_t              generation;
+        std::vector<std::uint16_t> words;
+        std::vector<std::uint16_t> previous;    // empty unless changed at the last refresh
+    };
+
+    Page& getPage(std::uint32_t page) const;
+
+    void emitPageChanged(std::uint32_t page);
+
+    const int kWordsPerRow = 8;
+
+    // columns: the words, then the row as text
+    int textColumn() const { return kWordsPerRow; }
+
+    Memory& m_memory;
+
+    const std::size_t kMaxCachedPages = 32;
+
+    mutable std::map<std::uint32_t, Page> m_pages;
+};
@@ -1,8 +1,28 @@
 #include "nbsoc.h"
 
 nbSoC::nbSoC() :
-    m_cpu(m_memory, m_ioports)
+    m_ioports(m_memory, m_scheduler),
+    m_timeTravel(m_memory, m_ioports, m_scheduler),
+    m_timingModel(m_memory),
+    m_semihost(m_memory, m_scheduler),
+    m_cpu(m_memory, m_ioports, m_scheduler),
+    m_stopped(false)
 {
+    m_cpu.setTimeTravel(&m_timeTravel);
+
+    m_memory.setBusErrorDelegate(&m_cpu);
+
+    // the CPU halts itself when the cycle count runs out, or on an
+    // unhandled exception
+    m_cpu.onHalt([this] ()
+    {
+        std::unique_lock<std::mutex> lock(m_stopMutex);
+        m_stopped = true;
+        m_stopCond.notify_all();
+    });
+
+    // port counts are part of the stats
+    m_ioports.setCountAccesses(true);
 }
 
 void nbSoC::configureBlockRam(std::string blockRamImg)
@@ -13,32 +33,46 @@ void nbSoC::configureBlockRam(std::string blockRamImg)
 void nbSoC::configureFlash(std::string flashImg)
 {
     m_memory.configureFlash(flashImg);
+    m_ioports.configureFlash(flashImg);
 }
 
 void nbSoC::configureSDCard(std::string configureSDCard)
 {
 }
 
-void nbSoC::onBlitToGfxRam(std::function<void ()> func)
+void nbSoC::configureAudio(std::string wavFile)
 {
+    // Written straight from the CPU thread: the file has to get every
+    // sample, and running behind real time doesn't matter for it
+
+    m_ioports.setAudioSink(std::unique_ptr<IAudioSink>(new WavFileAudioSink(wavFile)));
 }
 
+bool nbSoC::configureKeyboardScript(std::string scriptFile)
+{
+    return m_ioports.loadKeyboardScript(scriptFile);
+}
 
-void nbSoC::onLedGreenWrite(std::function<void (uint16_t)> func )
+bool nbSoC::configureKeyboardRecord(std::string recordFile)
 {
-    m_ioports.onLedGreenWrite(func);
+    return m_ioports.recordKeyboard(recordFile);
 }
 
-void nbSoC::onLedRedWrite(std::function<void (uint16_t)> func )
+bool nbSoC::enableTrace(std::string traceFile)
 {
-    m_ioports.onLedRedWrite(func);
+    if (! m_trace.open(traceFile))
+        return false;
+
+    m_cpu.setTrace(&m_trace);
+
+    return true;
 }
 
-void nbSoC::onHexWrite(std::function<void (int, uint16_t)> func )
+void nbSoC::onBlitToGfxRam(std::function<void ()> func)
 {
-    m_ioports.onHexWrite(func);
 }
 
+
 void nbSoC::start()
 {
 
@@ -59,3 +93,36 @@ void nbSoC::onResetButtonPressed(bool pressed)
     m_cpu.holdInReset(pressed);
 }
 
+
+void nbSoC::onKeyEvent(const std::vector<std::uint8_t>& scancodes)
+{
+    m_scheduler.post([this, scancodes] ()
+    {
+        m_timeTravel.logInput(scancodes);
+        m_ioports.injectScancodes(scancodes);
+    });
+    m_cpu.wake();
+}
+
+void nbSoC::stopAfter(std::uint64_t cycles)
+{
+    m_scheduler.schedule(cycles, [this] ()
+    {
+        m_cpu.halt();
+    });
+}
+
+void nbSoC::waitForStop()
+{
+    std::unique_lock<std::mutex> lock(m_stopMutex);
+
+    while (! m_stopped)
+        m_stopCond.wait(lock);
+}
+
+bool nbSoC::waitForStop(int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_stopMutex);
+
+    return m_stopCond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] () { return m_stopped; });
+}
@@ -3,8 +3,14 @@
 #include "cpu.h"
 #include "memory.h"
 #include "ioports.h"
+#include "eventscheduler.h"
+#include "timetravel.h"
+#include "retirementtrace.h"
 
 #include <functional>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
 
 class nbSoC
 {
@@ -16,25 +22,75 @@ public:
     void configureBlockRam(std::string blockRamImg);
     void configureFlash(std::string flashImg);
     void configureSDCard(std::string configureSDCard);
+    void configureAudio(std::string wavFile);
+    bool configureKeyboardScript(std::string scriptFile);
+    bool configureKeyboardRecord(std::string recordFile);
 
     void onBlitToGfxRam(std::function<void ()> func);
-    void onLedGreenWrite(std::function<void (uint16_t)> func );
-    void onLedRedWrite(std::function<void (uint16_t)> func );
-    void onHexWrite(std::function<void (int, uint16_t)> func );
+
+    // Thread safe: LEDs and hex displays as last written by the CPU
+    PanelState getPanelState() const { return m_ioports.getPanelState(); }
 
     void onResetButtonPressed(bool pressed);
 
+    // Thread safe: scancodes from the host keyboard, delivered to the
+    // keyboard controller at the next instruction boundary
+    void onKeyEvent(const std::vector<std::uint8_t>& scancodes);
+
+    // Headless runs: halt the CPU once cycles have elapsed (call before start()),
+    // and block until it has halted
+    void stopAfter(std::uint64_t cycles);
+    void setThrottle(bool throttle) { m_cpu.setThrottle(throttle); }
+    void waitForStop();
+
+    // as above, giving up after timeoutMs; returns true if the CPU has halted
+    bool waitForStop(int timeoutMs);
+
+    // Thread safe: simulator counters, as of the last few thousand instructions
+    SimStats getStats() const { return m_cpu.getStats(); }
+
+    // Keep checkpoints and an input log so the debugger can step and
+    // continue backwards (call before start())
+    void enableReverseDebugging(bool enable) { m_timeTravel.setEnabled(enable); }
+
+    // Write a retirement trace for comparison with the RTL (call before start())
+    bool enableTrace(std::string traceFile);
+
+    // Estimate cycles on the FPGA with a model of the pipeline, icache and
+    // memory controller (call before start(); read once stopped)
+    void enableTimingModel() { m_cpu.setTimingModel(&m_timingModel); }
+    TimingModel* getTimingModel() { return &m_timingModel; }
+
+    // svc calls the simulator for host I/O and exit (see Semihost; call
+    // before start())
+    void enableSemihosting() { m_cpu.setSemihost(&m_semihost); }
+
+    // exit code the guest passed to a semihosting exit call, 0 if it hasn't
+    int getExitCode() const { return m_semihost.getExitCode(); }
+
     void start();
     void shutDown();
 
     CPU* getCPU() { return &m_cpu; }
+    Memory* getMemory() { return &m_memory; }
 
 private:
 
+    EventScheduler m_scheduler;
 
     Memory m_memory;
     IOPorts m_ioports;
 
+    TimeTravel m_timeTravel;
+
+    RetirementTrace m_trace;
+    TimingModel m_timingModel;
+    Semihost m_semihost;
+
     CPU m_cpu;
 
+    std::mutex              m_stopMutex;
+    std::condition_variable m_stopCond;
+    bool                    m_stopped;
+
 };
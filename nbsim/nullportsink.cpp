@@ -0,0 +1,33 @@
+#include "nullportsink.h"
+
+#include <iostream>
+#include <iomanip>
+
+NullPortSink::NullPortSink()    :
+    m_port(0),
+    m_logged(false)
+{
+}
+
+std::uint16_t NullPortSink::inPort(std::uint16_t reg)
+{
+    logAccess("read from", reg);
+    return 0;
+}
+
+void NullPortSink::outPort(std::uint16_t reg, std::uint16_t value)
+{
+    logAccess("write to", reg);
+}
+
+void NullPortSink::logAccess(const char* type, std::uint16_t reg)
+{
+    if (m_logged)
+        return;
+
+    std::cout << "Warning: " << type << " unimplemented port " << m_port
+              << " reg 0x" << std::hex << reg << std::dec
+              << " (further accesses not logged)" << std::endl;
+
+    m_logged = true;
+}
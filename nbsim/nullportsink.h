@@ -0,0 +1,28 @@
+#pragma once
+
+#include "iportsink.h"
+
+//
+//  Sink for port numbers with no device behind them. Reads return 0 and
+//  writes are dropped; the first access is logged so a driver talking to
+//  an unimplemented device is obvious.
+//
+
+class NullPortSink : public IPortSink
+{
+public:
+
+    NullPortSink();
+
+    void setPortNumber(int port) { m_port = port; }
+
+    virtual std::uint16_t inPort(std::uint16_t reg) override;
+    virtual void          outPort(std::uint16_t reg, std::uint16_t value) override;
+
+private:
+
+    void logAccess(const char* type, std::uint16_t reg);
+
+    int  m_port;
+    bool m_logged;
+};
@@ -0,0 +1,71 @@
+#include "registermodel.h"
+
+#include <QBrush>
+#include <QColor>
+#include <QString>
+
+RegisterModel::RegisterModel(QObject* parent)   :
+    QAbstractTableModel(parent),
+    m_regs(),
+    m_previous(),
+    m_valid(false)
+{
+}
+
+int RegisterModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : kRows;
+}
+
+int RegisterModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : kColumns;
+}
+
+QString RegisterModel::cellText(int row, int col, const CPU::RegisterSnapshot& regs) const
+{
+    int reg = (row % 2) * kColumns + col;
+
+    if (row < 2)
+        return QString("r%1=%2").arg(reg, 2, 10, QChar('0')).arg(regs.gpr[reg], 4, 16, QChar('0'));
+
+    if (row < 4)
+        return QString("s%1=%2").arg(reg, 2, 10, QChar('0')).arg(regs.spr[reg], 8, 16, QChar('0'));
+
+    switch (col)
+    {
+        case 0:
+            return QString("pc=%1").arg(regs.pc << 1, 6, 16, QChar('0'));
+        case 1:
+            return QString("C=%1").arg(regs.C);
+        case 2:
+            return QString("Z=%1").arg(regs.Z);
+        default:
+            return QString();
+    }
+}
+
+QVariant RegisterModel::data(const QModelIndex& index, int role) const
+{
+    if (! index.isValid() || ! m_valid)
+        return QVariant();
+
+    QString text = cellText(index.row(), index.column(), m_regs);
+
+    if (role == Qt::DisplayRole)
+        return text;
+
+    if (role == Qt::BackgroundRole && text != cellText(index.row(), index.column(), m_previous))
+        return QBrush(QColor(255, 200, 200));
+
+    return QVariant();
+}
+
+void RegisterModel::setRegisters(const CPU::RegisterSnapshot& regs)
+{
+    m_previous = m_valid ? m_regs : regs;
+    m_regs     = regs;
+    m_valid    = true;
+
+    emit dataChanged(index(0, 0), index(kRows - 1, kColumns - 1));
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QAbstractTableModel>
+
+#include "cpu.h"
+
+//
+//  Register file as a grid: r0-r15 and s0-s15 eight to a row, then pc and
+//  flags. Registers which changed at the last update are highlighted.
+//
+
+class RegisterModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+
+    RegisterModel(QObject* parent = 0);
+
+    virtual int      rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    virtual int      columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    void setRegisters(const CPU::RegisterSnapshot& regs);
+
+private:
+
+    // formatted register for a cell
+    QString cellText(int row, int col, const CPU::RegisterSnapshot& regs) const;
+
+    const int kColumns = 8;
+    const int kRows    = 5;
+
+    CPU::RegisterSnapshot m_regs;
+    CPU::RegisterSnapshot m_previous;
+    bool                  m_valid;
+};
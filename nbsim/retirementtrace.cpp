@@ -0,0 +1,81 @@
+#include "retirementtrace.h"
+
+#include <iostream>
+#include <iomanip>
+
+RetirementTrace::RetirementTrace()
+{
+}
+
+RetirementTrace::~RetirementTrace()
+{
+    close();
+}
+
+bool RetirementTrace::open(std::string traceFile)
+{
+    m_trace.open(traceFile);
+
+    if (! m_trace.is_open())
+    {
+        std::cout << "Error: could not open trace file " << traceFile << std::endl;
+        return false;
+    }
+
+    m_trace << std::hex << std::setfill('0');
+    m_trace << "# nbsim retirement trace" << std::endl;
+
+    return true;
+}
+
+void RetirementTrace::close()
+{
+    if (m_trace.is_open())
+        m_trace.close();
+}
+
+void RetirementTrace::retire(std::uint32_t pc, std::uint16_t instruction)
+{
+    m_trace << "i " << std::setw(6) << pc << " " << std::setw(4) << instruction << "\n";
+}
+
+void RetirementTrace::interrupt(std::uint32_t vector)
+{
+    m_trace << "x " << std::setw(6) << vector << "\n";
+}
+
+void RetirementTrace::gprWrite(int reg, std::uint16_t value)
+{
+    m_trace << "r " << std::setw(1) << reg << " " << std::setw(4) << value << "\n";
+}
+
+void RetirementTrace::sprWrite(int reg, std::uint32_t value)
+{
+    m_trace << "s " << std::setw(1) << reg << " " << std::setw(8) << value << "\n";
+}
+
+void RetirementTrace::flags(bool C, bool Z)
+{
+    m_trace << "f " << (C ? '1' : '0') << (Z ? '1' : '0') << "\n";
+}
+
+void RetirementTrace::memoryWrite(std::uint32_t address, std::uint16_t value)
+{
+    m_pendingWrites.push_back({'m', address, value});
+}
+
+void RetirementTrace::portWrite(std::uint16_t port, std::uint16_t value)
+{
+    m_pendingWrites.push_back({'p', port, value});
+}
+
+void RetirementTrace::endInstruction()
+{
+    for (const Write& w : m_pendingWrites)
+    {
+        m_trace << w.kind << " " << std::setw(w.kind == 'm' ? 6 : 4) << w.address
+                << " " << std::setw(4) << w.value << "\n";
+    }
+
+    m_pendingWrites.clear();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <vector>
+
+//
+//  Retirement trace, for lockstep comparison against the RTL (see
+//  tools/tracecmp and HDL/TestBench/TraceWriter.vhd). Text, one record per
+//  line, in the order the effects happen:
+//
+//      i <pc> <instruction>        instruction retired (pc is a byte address)
+//      x <pc>                      interrupt or exception taken, pc is the vector
+//      r <n> <value>               general purpose register written
+//      s <n> <value>               special purpose register written
+//      f <C><Z>                    flags changed
+//      m <address> <value>         memory word written (byte address)
+//      p <port> <value>            port written
+//
+//  Numbers are fixed width lower case hex, so traces from either side can
+//  be compared record by record. Lines starting with # are comments.
+//
+//  Written on the CPU thread only.
+//
+
+class RetirementTrace
+{
+public:
+
+    RetirementTrace();
+    ~RetirementTrace();
+
+    bool open(std::string traceFile);
+    void close();
+
+    bool isOpen() const { return m_trace.is_open(); }
+
+    void retire(std::uint32_t pc, std::uint16_t instruction);
+    void interrupt(std::uint32_t vector);
+
+    void gprWrite(int reg, std::uint16_t value);
+    void sprWrite(int reg, std::uint32_t value);
+    void flags(bool C, bool Z);
+
+    // Memory and port writes happen while an instruction executes, before
+    // it has retired; they are held back and written by endInstruction()
+    // so they follow its record.
+    void memoryWrite(std::uint32_t address, std::uint16_t value);
+    void portWrite(std::uint16_t port, std::uint16_t value);
+
+    void endInstruction();
+
+private:
+
+    struct Write
+    {
+        char          kind;
+        std::uint32_t address;
+        std::uint16_t value;
+    };
+
+    std::vector<Write> m_pendingWrites;
+
+    std::ofstream m_trace;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+//
+//  Single producer / single consumer lock-free ring buffer. One thread
+//  may call write(), one other thread may call read().
+//
+
+template <typename T>
+class RingBuffer
+{
+public:
+
+    RingBuffer(std::size_t size) :
+        m_buffer(size + 1),
+        m_head(0),
+        m_tail(0)
+    {
+    }
+
+    // returns number of elements written, which may be less than count if full
+
+    std::size_t write(const T* data, std::size_t count)
+    {
+        std::size_t head = m_head.load(std::memory_order_relaxed);
+        std::size_t tail = m_tail.load(std::memory_order_acquire);
+
+        std::size_t space = (tail + m_buffer.size() - head - 1) % m_buffer.size();
+
+        if (count > space)
+            count = space;
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            m_buffer[head] = data[i];
+            head = (head + 1) % m_buffer.size();
+        }
+
+        m_head.store(head, std::memory_order_release);
+
+        return count;
+    }
+
+    // returns number of elements read
+
+    std::size_t read(T* data, std::size_t count)
+    {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        std::size_t head = m_head.load(std::memory_order_acquire);
+
+        std::size_t avail = (head + m_buffer.size() - tail) % m_buffer.size();
+
+        if (count > avail)
+            count = avail;
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            data[i] = m_buffer[tail];
+            tail = (tail + 1) % m_buffer.size();
+        }
+
+        m_tail.store(tail, std::memory_order_release);
+
+        return count;
+    }
+
+    std::size_t available() const
+    {
+        std::size_t tail = m_tail.load(std::memory_order_acquire);
+        std::size_t head = m_head.load(std::memory_order_acquire);
+
+        return (head + m_buffer.size() - tail) % m_buffer.size();
+    }
+
+private:
+
+    std::vector<T>           m_buffer;
+    std::atomic<std::size_t> m_head;    // written by producer
+    std::atomic<std::size_t> m_tail;    // written by consumer
+};
@@ -0,0 +1,223 @@
+#include "semihost.h"
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+
+Semihost::Semihost(Memory& mem, EventScheduler& sched) :
+    m_memory(mem),
+    m_scheduler(sched),
+    m_exited(false),
+    m_exitCode(0)
+{
+}
+
+void Semihost::reset()
+{
+    m_files.clear();
+
+    m_exited = false;
+    m_exitCode = 0;
+}
+
+bool Semihost::call(std::uint16_t* gpr)
+{
+    std::uint32_t op      = gpr[0];
+    std::uint32_t arg     = gpr[1];
+    std::uint32_t pointer = gpr[2] | ((std::uint32_t)gpr[3] << 16);
+    std::uint32_t length  = gpr[4] | ((std::uint32_t)gpr[5] << 16);
+
+    std::uint32_t result = kError;
+
+    switch (op)
+    {
+        case kOpen:
+            result = open(arg, pointer);
+            break;
+        case kClose:
+            result = close(arg);
+            break;
+        case kRead:
+            result = read(arg, pointer, length);
+            break;
+        case kWrite:
+            result = write(arg, pointer, length);
+            break;
+        case kSeek:
+            result = seek(arg, length);
+            break;
+        case kClock:
+            result = (std::uint32_t)m_scheduler.now();
+            break;
+        case kExit:
+            m_exited = true;
+            m_exitCode = (std::int16_t)arg;
+            result = 0;
+            break;
+        default:
+            std::cout << "Warning: unknown semihosting call " << op << std::endl;
+            break;
+    }
+
+    gpr[0] = result & 0xffff;
+    gpr[1] = result >> 16;
+
+    return m_exited;
+}
+
+std::fstream* Semihost::getFile(std::uint32_t handle)
+{
+    if (handle < kFirstFileHandle || handle - kFirstFileHandle >= m_files.size())
+        return nullptr;
+
+    return m_files[handle - kFirstFileHandle].get();
+}
+
+std::uint32_t Semihost::open(std::uint32_t mode, std::uint32_t path)
+{
+    std::string fileName;
+
+    for (std::uint32_t i = 0; i < kMaxPath; i++)
+    {
+        std::uint8_t c;
+
+        if (! m_memory.readBytes(path + i, &c, 1))
+            return kError;
+
+        if (c == 0)
+            break;
+
+        fileName += (char)c;
+    }
+
+    std::ios_base::openmode flags = std::ios_base::binary;
+
+    switch (mode)
+    {
+        case 0:
+            flags |= std::ios_base::in;
+            break;
+        case 1:
+            flags |= std::ios_base::out | std::ios_base::trunc;
+            break;
+        case 2:
+            flags |= std::ios_base::out | std::ios_base::app;
+            break;
+        default:
+            return kError;
+    }
+
+    std::unique_ptr<std::fstream> file(new std::fstream(fileName, flags));
+
+    if (! file->is_open())
+        return kError;
+
+    // reuse a closed handle if there is one
+
+    for (std::uint32_t i = 0; i < m_files.size(); i++)
+    {
+        if (m_files[i] == nullptr)
+        {
+            m_files[i] = std::move(file);
+            return i + kFirstFileHandle;
+        }
+    }
+
+    m_files.push_back(std::move(file));
+
+    return m_files.size() - 1 + kFirstFileHandle;
+}
+
+std::uint32_t Semihost::close(std::uint32_t handle)
+{
+    if (getFile(handle) == nullptr)
+        return kError;
+
+    m_files[handle - kFirstFileHandle].reset();
+
+    return 0;
+}
+
+std::uint32_t Semihost::read(std::uint32_t handle, std::uint32_t buffer, std::uint32_t length)
+{
+    std::fstream* file = getFile(handle);
+
+    if (file == nullptr)
+        return kError;
+
+    std::uint32_t total = 0;
+
+    m_buffer.resize(kChunkSize);
+
+    while (total < length)
+    {
+        std::uint32_t chunk = std::min(length - total, kChunkSize);
+
+        file->read((char*)m_buffer.data(), chunk);
+
+        std::uint32_t got = file->gcount();
+
+        if (! m_memory.writeBytes(buffer + total, m_buffer.data(), got))
+            return kError;
+
+        total += got;
+
+        if (got < chunk)
+            break;
+    }
+
+    // a short read leaves eof set, which would stop the next seek
+    file->clear();
+
+    return total;
+}
+
+std::uint32_t Semihost::write(std::uint32_t handle, std::uint32_t buffer, std::uint32_t length)
+{
+    std::ostream* out = handle == 1 ? &std::cout : handle == 2 ? &std::cerr : getFile(handle);
+
+    if (out == nullptr)
+        return kError;
+
+    std::uint32_t total = 0;
+
+    m_buffer.resize(kChunkSize);
+
+    while (total < length)
+    {
+        std::uint32_t chunk = std::min(length - total, kChunkSize);
+
+        if (! m_memory.readBytes(buffer + total, m_buffer.data(), chunk))
+            return kError;
+
+        out->write((const char*)m_buffer.data(), chunk);
+
+        if (! *out)
+            return kError;
+
+        total += chunk;
+    }
+
+    out->flush();
+
+    return total;
+}
+
+std::uint32_t Semihost::seek(std::uint32_t handle, std::uint32_t offset)
+{
+    std::fstream* file = getFile(handle);
+
+    if (file == nullptr)
+        return kError;
+
+    file->seekg(offset);
+    file->seekp(offset);
+
+    if (! *file)
+    {
+        file->clear();
+        return kError;
+    }
+
+    return offset;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "memory.h"
+#include "eventscheduler.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+//
+//  Semihosting: with it enabled, svc is a call to the simulator instead of
+//  a trap, so test firmware and benchmarks can do bulk file I/O on the host
+//  and report an exit code without a console.
+//
+//      r0          operation (below)
+//      r1          handle, open mode or exit code
+//      r2:r3       pointer (byte address, low word in r2)
+//      r4:r5       length or offset (low word in r4)
+//
+//  The result comes back in r0:r1, 0xffffffff on error. Buffers are bytes,
+//  packed two to a word, low byte first; paths are nul terminated.
+//
+//      kOpen   r1 mode (0 read, 1 write, 2 append), r2:r3 path  -> handle
+//      kClose  r1 handle                                       -> 0
+//      kRead   r1 handle, r2:r3 buffer, r4:r5 length           -> bytes read
+//      kWrite  r1 handle, r2:r3 buffer, r4:r5 length           -> bytes written
+//      kSeek   r1 handle, r4:r5 offset from the start          -> offset
+//      kClock                                                  -> cycles (low 32 bits)
+//      kExit   r1 exit code                                    -> (the CPU halts)
+//
+//  Handles 1 and 2 are the host's stdout and stderr.
+//
+//  With reverse debugging, calls re-executed while going back are answered
+//  from the time travel log instead of being made again, but host files
+//  aren't rewound. CPU thread only.
+//
+
+class Semihost
+{
+public:
+
+    Semihost(Memory& mem, EventScheduler& sched);
+
+    // Perform the call in the registers. Returns true if the guest has
+    // asked to exit.
+    bool call(std::uint16_t* gpr);
+
+    // close the guest's files and forget its exit (on reset)
+    void reset();
+
+    bool hasExited() const  { return m_exited; }
+    int  getExitCode() const { return m_exitCode; }
+
+    enum
+    {
+        kOpen   = 1,
+        kClose  = 2,
+        kRead   = 3,
+        kWrite  = 4,
+        kSeek   = 5,
+        kClock  = 6,
+        kExit   = 7
+    };
+
+private:
+
+    std::uint32_t open(std::uint32_t mode, std::uint32_t path);
+    std::uint32_t close(std::uint32_t handle);
+    std::uint32_t read(std::uint32_t handle, std::uint32_t buffer, std::uint32_t length);
+    std::uint32_t write(std::uint32_t handle, std::uint32_t buffer, std::uint32_t length);
+    std::uint32_t seek(std::uint32_t handle, std::uint32_t offset);
+
+    std::fstream* getFile(std::uint32_t handle);
+
+    const std::uint32_t kError = 0xffffffff;
+
+    const std::uint32_t kMaxPath = 1024;
+
+    // reads and writes go through a buffer this big at a time
+    const std::uint32_t kChunkSize = 64 * 1024;
+
+    const std::uint32_t kFirstFileHandle = 3;
+
+    Memory& m_memory;
+    EventScheduler& m_scheduler;
+
+    // indexed by handle - kFirstFileHandle; nullptr once closed
+    std::vector<std::unique_ptr<std::fstream>> m_files;
+
+    std::vector<std::uint8_t> m_buffer;
+
+    bool m_exited;
+    int  m_exitCode;
+};
@@ -0,0 +1,94 @@
+#include "simstats.h"
+
+#include "nbInstructionDecodeTable.h"
+
+#include <map>
+#include <string>
+#include <iomanip>
+
+double SimStats::mips() const
+{
+    if (hostNs == 0)
+        return 0.0;
+
+    return (double)instructions * 1000.0 / (double)hostNs;
+}
+
+void SimStats::writeSummary(std::ostream& os) const
+{
+    double sleepPercent = cycles == 0 ? 0.0 : 100.0 * (double)sleepCycles / (double)cycles;
+
+    os << "cycles " << cycles
+       << " instructions " << instructions
+       << " irqs " << irqs
+       << " sleep " << std::fixed << std::setprecision(1) << sleepPercent << "%"
+       << " MIPS " << std::setprecision(2) << mips();
+}
+
+void SimStats::writeJSON(std::ostream& os) const
+{
+    static const char* regionNames[Memory::kNumRegions] = { "bram", "flash", "ddr" };
+
+    os << "{" << std::endl;
+    os << "  \"cycles\": " << cycles << "," << std::endl;
+    os << "  \"instructions\": " << instructions << "," << std::endl;
+    os << "  \"irqs\": " << irqs << "," << std::endl;
+    os << "  \"sleep_cycles\": " << sleepCycles << "," << std::endl;
+    os << "  \"host_seconds\": " << std::fixed << std::setprecision(6) << (double)hostNs / 1e9 << "," << std::endl;
+    os << "  \"mips\": " << std::setprecision(3) << mips() << "," << std::endl;
+
+    // Instructions with immediate and register forms share a mnemonic, so
+    // count by mnemonic.
+
+    std::map<std::string, std::uint64_t> opcodes;
+
+    for (int i = 0; i < kNumOpcodeCounters; i++)
+    {
+        if (opcodeCounts[i] == 0)
+            continue;
+
+        if (i == kInvalidInstructionIndex)
+            opcodes["invalid"] += opcodeCounts[i];
+        else
+            opcodes[instructionInfo[i].string] += opcodeCounts[i];
+    }
+
+    os << "  \"opcodes\": {";
+
+    const char* sep = "";
+
+    for (const auto& op : opcodes)
+    {
+        os << sep << std::endl << "    \"" << op.first << "\": " << op.second;
+        sep = ",";
+    }
+
+    os << std::endl << "  }," << std::endl;
+
+    os << "  \"memory\": {";
+
+    for (int i = 0; i < Memory::kNumRegions; i++)
+    {
+        os << (i == 0 ? "" : ",") << std::endl;
+        os << "    \"" << regionNames[i] << "\": { \"reads\": " << memReads[i] << ", \"writes\": " << memWrites[i] << " }";
+    }
+
+    os << std::endl << "  }," << std::endl;
+
+    os << "  \"ports\": {";
+
+    sep = "";
+
+    for (int i = 0; i < IOPorts::kNumPorts; i++)
+    {
+        if (portReads[i] == 0 && portWrites[i] == 0)
+            continue;
+
+        os << sep << std::endl;
+        os << "    \"" << IOPorts::getPortName(i) << "\": { \"reads\": " << portReads[i] << ", \"writes\": " << portWrites[i] << " }";
+        sep = ",";
+    }
+
+    os << std::endl << "  }" << std::endl;
+    os << "}" << std::endl;
+}
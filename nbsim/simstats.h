@@ -0,0 +1,40 @@
+#pragma once
+
+#include "memory.h"
+#include "ioports.h"
+
+#include <cstdint>
+#include <ostream>
+
+//
+//  Simulator counters. The CPU thread counts into plain members as it
+//  goes and publishes a copy of them every so often (see CPU), so reading
+//  stats never touches the hot path.
+//
+
+struct SimStats
+{
+    static const int kNumOpcodeCounters = 256;  // indexed like instructionInfo; kInvalidInstructionIndex for bad opcodes
+
+    std::uint64_t cycles;           // virtual time
+    std::uint64_t instructions;     // retired
+    std::uint64_t irqs;             // interrupts taken
+    std::uint64_t sleepCycles;      // virtual time spent asleep
+    std::uint64_t hostNs;           // host time spent running (not paused)
+
+    std::uint64_t opcodeCounts[kNumOpcodeCounters];
+
+    std::uint64_t memReads[Memory::kNumRegions];
+    std::uint64_t memWrites[Memory::kNumRegions];
+
+    std::uint64_t portReads[IOPorts::kNumPorts];
+    std::uint64_t portWrites[IOPorts::kNumPorts];
+
+    // millions of instructions per second of host time
+    double mips() const;
+
+    // one line, for the console and debugger
+    void writeSummary(std::ostream& os) const;
+
+    void writeJSON(std::ostream& os) const;
+};
@@ -8,7 +8,8 @@
 
 SimulatorWindow::SimulatorWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::SimulatorWindow)
+    ui(new Ui::SimulatorWindow),
+    m_panelValid(false)
 {
     ui->setupUi(this);
 
@@ -38,16 +39,6 @@ void SimulatorWindow::onBlitToGfxRam(nbSoC& nanobrain)
 
 }
 
-void SimulatorWindow::onLedGreenWrite(uint16_t val)
-{
-    m_ledGreen = val;
-}
-
-void SimulatorWindow::onLedRedWrite(uint16_t val)
-{
-    m_ledRed = val;
-}
-
 void SimulatorWindow::closeEvent(QCloseEvent *ev)
 {
     m_onCloseEvent();
@@ -55,55 +46,66 @@ void SimulatorWindow::closeEvent(QCloseEvent *ev)
 
 void SimulatorWindow::update()
 {
+    if (! m_panelSource)
+        return;
+
+    PanelState panel = m_panelSource();
+
+    // Restyling is expensive, so only touch the widgets that changed
+
     QLabel* greenLEDs[] = {ui->greenLed0, ui->greenLed1, ui->greenLed2, ui->greenLed3,
                            ui->greenLed4, ui->greenLed5, ui->greenLed6, ui->greenLed7};
 
-
-    std::uint16_t gled = m_ledGreen;
-    for (int i = 0; i < 8; i++)
+    if (! m_panelValid || panel.greenLeds != m_panel.greenLeds)
     {
-        if ((gled & 1))
+        std::uint16_t gled = panel.greenLeds;
+        for (int i = 0; i < 8; i++)
         {
-            greenLEDs[i]->setStyleSheet("QLabel { background: url(:/images/assets/LED-green.png) no-repeat };");
+            if ((gled & 1))
+            {
+                greenLEDs[i]->setStyleSheet("QLabel { background: url(:/images/assets/LED-green.png) no-repeat };");
+            }
+            else
+            {
+                greenLEDs[i]->setStyleSheet("QLabel { background: url(:/images/assets/LED.png) no-repeat };");
+            }
+            gled >>= 1;
         }
-        else
-        {
-            greenLEDs[i]->setStyleSheet("QLabel { background: url(:/images/assets/LED.png) no-repeat };");
-        }
-        gled >>= 1;
     }
 
     QLabel* redLEDs[] = {ui->redLed0, ui->redLed1, ui->redLed2, ui->redLed3,
                          ui->redLed4, ui->redLed5, ui->redLed6, ui->redLed7,
                          ui->redLed8, ui->redLed9 };
 
-
-    std::uint16_t rled = m_ledRed;
-    for (int i = 0; i < 10; i++)
+    if (! m_panelValid || panel.redLeds != m_panel.redLeds)
     {
-        if ((rled & 1))
+        std::uint16_t rled = panel.redLeds;
+        for (int i = 0; i < 10; i++)
         {
-            redLEDs[i]->setStyleSheet("QLabel { background: url(:/images/assets/LED-red.png) no-repeat };");
+            if ((rled & 1))
+            {
+                redLEDs[i]->setStyleSheet("QLabel { background: url(:/images/assets/LED-red.png) no-repeat };");
+            }
+            else
+            {
+                redLEDs[i]->setStyleSheet("QLabel { background: url(:/images/assets/LED.png) no-repeat };");
+            }
+            rled >>= 1;
         }
-        else
-        {
-            redLEDs[i]->setStyleSheet("QLabel { background: url(:/images/assets/LED.png) no-repeat };");
-        }
-        rled >>= 1;
     }
 
-    // Update hex widgets
+    // Update hex widgets: hex 0 is the rightmost display
     for (int i = 0; i < 4; i ++)
     {
-        m_hexLabels[i]->setValue(m_hexVals[i]);
-        m_hexLabels[i]->update();
+        if (! m_panelValid || panel.hex[i] != m_panel.hex[i])
+        {
+            m_hexLabels[3 - i]->setValue(panel.hex[i]);
+            m_hexLabels[3 - i]->update();
+        }
     }
-}
 
-void SimulatorWindow::onHexWrite(int hex, std::uint16_t val)
-{
-    if (hex >= 0 && hex < 4)
-        m_hexVals[3 - hex] = val;
+    m_panel = panel;
+    m_panelValid = true;
 }
 
 void SimulatorWindow::onResetPressed()
@@ -120,3 +122,83 @@ void SimulatorWindow::onDebugPressed()
 {
     m_onDebuggerPressed();
 }
+
+bool SimulatorWindow::scancodeForKey(int key, std::vector<std::uint8_t>& codes)
+{
+    // PS/2 scan code set 2 make codes. Extended keys are prefixed with e0.
+
+    static const struct { int key; std::uint8_t code; bool extended; } keyMap[] =
+    {
+        {Qt::Key_A, 0x1c, false}, {Qt::Key_B, 0x32, false}, {Qt::Key_C, 0x21, false},
+        {Qt::Key_D, 0x23, false}, {Qt::Key_E, 0x24, false}, {Qt::Key_F, 0x2b, false},
+        {Qt::Key_G, 0x34, false}, {Qt::Key_H, 0x33, false}, {Qt::Key_I, 0x43, false},
+        {Qt::Key_J, 0x3b, false}, {Qt::Key_K, 0x42, false}, {Qt::Key_L, 0x4b, false},
+        {Qt::Key_M, 0x3a, false}, {Qt::Key_N, 0x31, false}, {Qt::Key_O, 0x44, false},
+        {Qt::Key_P, 0x4d, false}, {Qt::Key_Q, 0x15, false}, {Qt::Key_R, 0x2d, false},
+        {Qt::Key_S, 0x1b, false}, {Qt::Key_T, 0x2c, false}, {Qt::Key_U, 0x3c, false},
+        {Qt::Key_V, 0x2a, false}, {Qt::Key_W, 0x1d, false}, {Qt::Key_X, 0x22, false},
+        {Qt::Key_Y, 0x35, false}, {Qt::Key_Z, 0x1a, false},
+
+        {Qt::Key_0, 0x45, false}, {Qt::Key_1, 0x16, false}, {Qt::Key_2, 0x1e, false},
+        {Qt::Key_3, 0x26, false}, {Qt::Key_4, 0x25, false}, {Qt::Key_5, 0x2e, false},
+        {Qt::Key_6, 0x36, false}, {Qt::Key_7, 0x3d, false}, {Qt::Key_8, 0x3e, false},
+        {Qt::Key_9, 0x46, false},
+
+        {Qt::Key_Space,     0x29, false}, {Qt::Key_Return,    0x5a, false},
+        {Qt::Key_Enter,     0x5a, false}, {Qt::Key_Escape,    0x76, false},
+        {Qt::Key_Backspace, 0x66, false}, {Qt::Key_Tab,       0x0d, false},
+        {Qt::Key_Shift,     0x12, false}, {Qt::Key_Control,   0x14, false},
+        {Qt::Key_Alt,       0x11, false}, {Qt::Key_Minus,     0x4e, false},
+        {Qt::Key_Equal,     0x55, false}, {Qt::Key_Comma,     0x41, false},
+        {Qt::Key_Period,    0x49, false}, {Qt::Key_Slash,     0x4a, false},
+        {Qt::Key_Semicolon, 0x4c, false},
+
+        {Qt::Key_Up,    0x75, true}, {Qt::Key_Down,  0x72, true},
+        {Qt::Key_Left,  0x6b, true}, {Qt::Key_Right, 0x74, true},
+        {Qt::Key_Home,  0x6c, true}, {Qt::Key_End,   0x69, true},
+        {Qt::Key_Insert,0x70, true}, {Qt::Key_Delete,0x71, true},
+    };
+
+    for (const auto& entry : keyMap)
+    {
+        if (entry.key == key)
+        {
+            if (entry.extended)
+                codes.push_back(0xe0);
+            codes.push_back(entry.code);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SimulatorWindow::keyPressEvent(QKeyEvent *ev)
+{
+    // Auto repeat is passed through: a real keyboard repeats the make code too
+
+    std::vector<std::uint8_t> codes;
+
+    if (m_onKeyEvent && scancodeForKey(ev->key(), codes))
+        m_onKeyEvent(codes);
+    else
+        QMainWindow::keyPressEvent(ev);
+}
+
+void SimulatorWindow::keyReleaseEvent(QKeyEvent *ev)
+{
+    std::vector<std::uint8_t> codes;
+
+    if (ev->isAutoRepeat())
+        return;
+
+    if (m_onKeyEvent && scancodeForKey(ev->key(), codes))
+    {
+        // break code: f0 goes after any e0 prefix
+
+        codes.insert(codes.end() - 1, 0xf0);
+        m_onKeyEvent(codes);
+    }
+    else
+        QMainWindow::keyReleaseEvent(ev);
+}
@@ -5,8 +5,10 @@
 #include <QString>
 #include <QTimer>
 #include <QCloseEvent>
+#include <QKeyEvent>
 
 #include <functional>
+#include <vector>
 
 #include <cstdint>
 
@@ -27,16 +29,20 @@ public:
     ~SimulatorWindow();
 
     void onBlitToGfxRam(nbSoC& nanobrain);
-    void onLedGreenWrite(std::uint16_t val);
-    void onLedRedWrite(std::uint16_t val);
-    void onHexWrite(int hex, std::uint16_t val);
+
+    // polled at the refresh rate; must be thread safe
+    void setPanelSource(std::function<PanelState ()> func) { m_panelSource = func; }
 
     void onResetButtonPressed(std::function<void (bool)> func) { m_onResetButton = func; }
     void setOnCloseEvent(std::function<void()> func) { m_onCloseEvent = func; }
     void onDebugButtonPressed(std::function<void()> func) { m_onDebuggerPressed = func; }
+    void onKeyEvent(std::function<void (const std::vector<std::uint8_t>&)> func) { m_onKeyEvent = func; }
 
     void closeEvent(QCloseEvent *ev);
 
+    void keyPressEvent(QKeyEvent *ev);
+    void keyReleaseEvent(QKeyEvent *ev);
+
 public slots:
     void update();
 
@@ -45,20 +51,24 @@ public slots:
     void onDebugPressed();
 
 private:
+    bool scancodeForKey(int key, std::vector<std::uint8_t>& codes);
+
     Ui::SimulatorWindow *ui;
     QString m_str;
     QTimer* m_timer;
 
-    std::uint16_t m_ledGreen;
-    std::uint16_t m_ledRed;
+    std::function<PanelState ()> m_panelSource;
+    PanelState m_panel;
+    bool m_panelValid;
 
     HexDisplayLabel* m_hexLabels[4];
-    std::uint16_t m_hexVals[4];
 
     std::function<void()>       m_onCloseEvent;
     std::function<void (bool)>  m_onResetButton;
 
     std::function<void()>       m_onDebuggerPressed;
+
+    std::function<void (const std::vector<std::uint8_t>&)> m_onKeyEvent;
 };
 
 #endif // SIMULATORWINDOW_H
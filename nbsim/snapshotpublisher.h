@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+//
+//  Single writer, many reader snapshot of a small POD, for publishing
+//  device state from the CPU thread to the GUI without either side
+//  blocking the other.
+//
+//  Two buffers and a sequence number (a seqlock): the writer fills the
+//  buffer readers aren't looking at, then bumps the sequence. The sequence
+//  is odd while a write is in progress. A reader only retries if the
+//  writer has lapped it and started on the buffer it was copying.
+//
+
+template <typename T>
+class SnapshotPublisher
+{
+public:
+
+    static_assert(std::is_trivially_copyable<T>::value, "snapshot type must be trivially copyable");
+
+    SnapshotPublisher()  :
+        m_seq(0)
+    {
+        m_buffers[0] = T();
+        m_buffers[1] = T();
+    }
+
+    // writer thread only
+
+    void publish(const T& value)
+    {
+        std::uint32_t seq = m_seq.load(std::memory_order_relaxed);
+
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        m_buffers[((seq >> 1) + 1) & 1] = value;
+
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // any thread
+
+    T read() const
+    {
+        for (;;)
+        {
+            std::uint32_t seq1 = m_seq.load(std::memory_order_acquire);
+
+            T value = m_buffers[(seq1 >> 1) & 1];
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            std::uint32_t seq2 = m_seq.load(std::memory_order_relaxed);
+
+            // the buffer we read is next written when the sequence goes
+            // to (seq1 | 1) + 2
+
+            if (seq2 - seq1 < (seq1 | 1) + 2 - seq1)
+                return value;
+        }
+    }
+
+    // bumped on every publish, so a reader can cheaply tell if anything changed
+
+    std::uint32_t sequence() const { return m_seq.load(std::memory_order_acquire); }
+
+private:
+
+    std::atomic<std::uint32_t> m_seq;
+    T m_buffers[2];
+};
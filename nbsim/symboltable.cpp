@@ -0,0 +1,64 @@
+#include "symboltable.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iterator>
+#include <limits>
+
+bool SymbolTable::load(std::string path)
+{
+    std::ifstream in(path);
+
+    if (! in.is_open())
+    {
+        std::cout << "Error: could not open symbol file " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+
+    while (std::getline(in, line))
+    {
+        std::stringstream ss(line);
+
+        std::uint32_t address;
+        std::string   name;
+
+        if (! (ss >> std::hex >> address >> name))
+            continue;   // blank or comment
+
+        m_symbols[address] = name;
+    }
+
+    return true;
+}
+
+const std::string* SymbolTable::symbolAt(std::uint32_t byteAddress) const
+{
+    auto it = m_symbols.find(byteAddress);
+
+    if (it == m_symbols.end())
+        return nullptr;
+
+    return &it->second;
+}
+
+const std::string* SymbolTable::symbolContaining(std::uint32_t byteAddress, std::uint32_t* start, std::uint32_t* end) const
+{
+    auto next = m_symbols.upper_bound(byteAddress);
+
+    *end = next == m_symbols.end() ? std::numeric_limits<std::uint32_t>::max() : next->first;
+
+    if (next == m_symbols.begin())
+    {
+        *start = 0;
+        return nullptr;
+    }
+
+    auto it = std::prev(next);
+
+    *start = it->first;
+
+    return &it->second;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <map>
+
+//
+//  Symbols from a symbol file: one "<hex byte address> <name>" per line.
+//
+
+class SymbolTable
+{
+public:
+
+    bool load(std::string path);
+
+    bool empty() const { return m_symbols.empty(); }
+
+    // symbol at exactly this address, or nullptr
+    const std::string* symbolAt(std::uint32_t byteAddress) const;
+
+    // nearest symbol at or below this address (the function it is in),
+    // or nullptr; [start, end) is set to the range up to the next symbol
+    const std::string* symbolContaining(std::uint32_t byteAddress, std::uint32_t* start, std::uint32_t* end) const;
+
+private:
+
+    std::map<std::uint32_t, std::string> m_symbols;
+};
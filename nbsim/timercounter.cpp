@@ -1,116 +1,123 @@
 #include "timercounter.h"
 
-#include <sys/time.h>
-
-TimerCounter::TimerCounter()    :
+TimerCounter::TimerCounter(EventScheduler& sched)    :
+    m_scheduler(sched),
     m_control(0),
     m_status(0),
     m_count(0),
     m_loadCount(0),
     m_prescaleCount(0),
-    m_threadExit(false),
-    m_counterThread([] (TimerCounter* tc) { tc->runThread(); }, this)
+    m_lastUpdate(0),
+    m_eventPending(false),
+    m_eventId(0)
 {
-    // Start thread to tick counter in
 }
 
-void TimerCounter::shutDown()
+void TimerCounter::hardReset()
 {
-    m_threadExit = true;
-    m_counterThread.join();
+    if (m_eventPending)
+        m_scheduler.cancel(m_eventId);
+
+    m_eventPending  = false;
+
+    m_control       = 0;
+    m_status        = 0;
+    m_count         = 0;
+    m_loadCount     = 0;
+    m_prescaleCount = 0;
+    m_lastUpdate    = m_scheduler.now();
 }
 
-void TimerCounter::runThread()
+void TimerCounter::update()
 {
-    const int kPeriod = 20;
+    std::uint64_t now = m_scheduler.now();
 
-    struct timeval tv1;
-    gettimeofday(&tv1, nullptr);
-    // uint64_t couldn't possibly overflow, could it?
-    //uint64_t nsec1 = (uint64_t)tv1.tv_sec * 1000000000 + tv1.tv_usec * 1000;
+    timerTick(now - m_lastUpdate);
 
-    uint64_t nsecElapsed = 0;
+    m_lastUpdate = now;
+}
 
-    while (! m_threadExit)
-    {
+void TimerCounter::timerTick(std::uint64_t cycles)
+{
+    if (! (m_control & kControlEnable))
+        return;
 
-        struct timeval tv2;
-        gettimeofday(&tv2, nullptr);
-        uint64_t nsec2 = (uint64_t)(tv2.tv_sec - tv1.tv_sec) * 1000000000 + (tv2.tv_usec - tv1.tv_usec) * 1000;
+    std::uint64_t scale = prescale();
+    std::uint64_t total = m_prescaleCount + cycles;
 
-        int loops = 0;
+    std::uint64_t counts = total / scale;
+    m_prescaleCount      = total % scale;
 
-        loops = (nsec2 - nsecElapsed) / kPeriod;
+    if (counts == 0)
+        return;
 
-        timerTick(loops);
+    if (m_count > counts)
+    {
+        m_count -= counts;
+        return;
+    }
 
-        nsecElapsed += loops * kPeriod;
+    std::uint64_t countRem = counts - m_count;
 
-        //printf("Elapsed: %llu %d\n", nsecElapsed, loops);
+    m_count = 0;
 
-        struct timespec tm1, tm2;
+    expire();
 
-        tm1.tv_sec = 0;
-        tm1.tv_nsec = kPeriod;
-        nanosleep(&tm1, &tm2);
+    if ((m_control & kControlAutoReload) && m_loadCount != 0)
+    {
+        // any further wraps inside this interval are folded into the one
+        // interrupt, which is level triggered anyway
 
+        m_count = m_loadCount - (countRem % m_loadCount);
     }
 }
 
-void TimerCounter::timerTick(int loops)
+void TimerCounter::expire()
 {
-    int countRem = 0;
-
-    if (m_control & kControlEnable)
+    if (! (m_status & kStatusInterrupt))
     {
-        int scale = 1 << ((m_control & kControlPrescale_mask) >> kControlPrescale_shift);
-
-        int prescaleCounts = loops / scale;
-        int prescaleRem = loops % scale;
+        m_status |= kStatusInterrupt;
 
-        m_prescaleCount += prescaleRem;
-
-        if (m_prescaleCount > scale)
-        {
-            m_prescaleCount -= scale;
-            prescaleCounts++;
-        }
-
-        if (m_count > prescaleCounts)
+        if (m_control & kControlInterruptEnable)
         {
-            m_count -= prescaleCounts;
-        }
-        else
-        {
-            m_count = 0;
-            countRem = prescaleCounts - m_count;
-            countRem %= 65536;
+            // signal interrupt controller
+            if (m_intDel != nullptr)
+                m_intDel->setIRQ(kTimerIRQ, true);
         }
     }
+}
+
+void TimerCounter::reschedule()
+{
+    if (m_eventPending)
+        m_scheduler.cancel(m_eventId);
+
+    m_eventPending = false;
 
-    if ((m_control & kControlEnable) && m_count == 0)
+    if (! (m_control & kControlEnable))
+        return;
+
+    if (m_count == 0)
     {
-        if (! (m_status & kStatusInterrupt))
-        {
-            m_status |= kStatusInterrupt;
+        // enabled with nothing to count: expires straight away
 
-            if (m_control & kControlInterruptEnable)
-            {
-                // signal interrupt controller
-                if (m_intDel != nullptr)
-                    m_intDel->setIRQ(kTimerIRQ, true);
-            }
-        }
+        expire();
 
-        if (m_control & kControlAutoReload)
-        {
+        if ((m_control & kControlAutoReload) && m_loadCount != 0)
             m_count = m_loadCount;
-            if (m_count > countRem)
-                m_count -= countRem;
-            else
-                m_count = (m_count + 65536 - countRem);
-        }
+        else
+            return;
     }
+
+    std::uint64_t delay = (std::uint64_t)m_count * prescale() - m_prescaleCount;
+
+    m_eventPending = true;
+    m_eventId      = m_scheduler.schedule(delay, [this] ()
+    {
+        m_eventPending = false;
+        update();
+        reschedule();
+    });
 }
 
 std::uint16_t TimerCounter::inPort(uint16_t reg)
@@ -122,6 +129,7 @@ std::uint16_t TimerCounter::inPort(uint16_t reg)
         case TimerReg::Status:
             return m_status;
         case TimerReg::Count:
+            update();
             return m_count;
         case TimerReg::LoadCount:
             return m_loadCount;
@@ -132,13 +140,20 @@ std::uint16_t TimerCounter::inPort(uint16_t reg)
 
 void TimerCounter::outPort(uint16_t reg, uint16_t value)
 {
+    update();
+
     switch ((TimerReg)reg)
     {
         case TimerReg::Control:
             m_control = value;
 
             if (m_control & kControlLoad)
+            {
                 m_count = m_loadCount;
+                m_prescaleCount = 0;
+            }
+
+            reschedule();
 
             break;
         case TimerReg::Status:
@@ -156,6 +171,7 @@ void TimerCounter::outPort(uint16_t reg, uint16_t value)
             break;
         case TimerReg::Count:
             m_count = value;
+            reschedule();
             break;
         case TimerReg::LoadCount:
             m_loadCount = value;
@@ -164,3 +180,33 @@ void TimerCounter::outPort(uint16_t reg, uint16_t value)
             break;
     }
 }
+
+TimerCounter::State TimerCounter::saveState() const
+{
+    State state;
+
+    state.control       = m_control;
+    state.status        = m_status;
+    state.count         = m_count;
+    state.loadCount     = m_loadCount;
+    state.prescaleCount = m_prescaleCount;
+    state.lastUpdate    = m_lastUpdate;
+    state.eventPending  = m_eventPending;
+    state.eventId       = m_eventId;
+
+    return state;
+}
+
+void TimerCounter::restoreState(const State& state)
+{
+    // the expiry event (if any) is restored with the scheduler
+
+    m_control       = state.control;
+    m_status        = state.status;
+    m_count         = state.count;
+    m_loadCount     = state.loadCount;
+    m_prescaleCount = state.prescaleCount;
+    m_lastUpdate    = state.lastUpdate;
+    m_eventPending  = state.eventPending;
+    m_eventId       = state.eventId;
+}
@@ -1,9 +1,9 @@
 #pragma once
 
 #include "iportsink.h"
+#include "eventscheduler.h"
 
 #include <cstdint>
-#include <thread>
 
 enum class TimerReg
 {
@@ -13,16 +13,38 @@ enum class TimerReg
     LoadCount = 3,
 };
 
+//
+//  The counter runs in virtual time: rather than ticking it every cycle,
+//  the count is brought up to date whenever it is accessed and an event is
+//  scheduled for the cycle it reaches zero. All accesses are on the CPU
+//  thread.
+//
+
 class TimerCounter : public IPortSink
 {
 public:
 
-    TimerCounter();
+    TimerCounter(EventScheduler& sched);
 
     virtual std::uint16_t inPort(uint16_t reg) override;
     virtual void outPort(uint16_t reg, uint16_t value) override;
 
-    void shutDown();
+    void hardReset();
+
+    struct State
+    {
+        std::uint16_t control;
+        std::uint16_t status;
+        std::uint16_t count;
+        std::uint16_t loadCount;
+        std::uint64_t prescaleCount;
+        std::uint64_t lastUpdate;
+        bool          eventPending;
+        int           eventId;
+    };
+
+    State saveState() const;
+    void  restoreState(const State& state);
 
     const std::uint16_t kControlEnable      = 1 << 0;
     const std::uint16_t kControlLoad        = 1 << 1;
@@ -48,26 +70,30 @@ public:
 
     const int kTimerIRQ = 0;
 
-    void runThread();
-
     virtual void        setInterruptDelegate(IInterruptDelegate* intDel) override { m_intDel = intDel; }
 
 private:
 
-    void timerTick(int loops);
+    void update();
+    void timerTick(std::uint64_t cycles);
+    void expire();
+    void reschedule();
+
+    std::uint64_t prescale() const { return 1ULL << ((m_control & kControlPrescale_mask) >> kControlPrescale_shift); }
+
+    EventScheduler& m_scheduler;
 
     std::uint16_t m_control;
     std::uint16_t m_status;
     std::uint16_t m_count;
     std::uint16_t m_loadCount;
 
-    std::uint16_t m_prescaleCount;
+    std::uint64_t m_prescaleCount;
+    std::uint64_t m_lastUpdate;     // virtual time m_count was last brought up to date
 
-    IInterruptDelegate* m_intDel = nullptr;
+    bool m_eventPending;
+    int  m_eventId;
 
-    bool m_threadExit;
-    std::thread m_counterThread;
+    IInterruptDelegate* m_intDel = nullptr;
 
 };
-
-
@@ -0,0 +1,219 @@
+#include "timetravel.h"
+
+TimeTravel::TimeTravel(Memory& mem, IOPorts& ioports, EventScheduler& sched) :
+    m_memory(mem),
+    m_ioports(ioports),
+    m_scheduler(sched),
+    m_enabled(false),
+    m_semihostReplay(0)
+{
+}
+
+void TimeTravel::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    reset();
+}
+
+void TimeTravel::reset()
+{
+    m_checkpoints.clear();
+    m_inputLog.clear();
+    m_semihostLog.clear();
+    m_semihostReplay = 0;
+}
+
+void TimeTravel::takeCheckpoint(const CPU::State& cpu)
+{
+    if (m_checkpoints.size() == kMaxCheckpoints)
+        dropOldestCheckpoint();
+
+    m_checkpoints.emplace_back();
+
+    Checkpoint& cp = m_checkpoints.back();
+
+    cp.cycle      = m_scheduler.now();
+    cp.cpu        = cpu;
+    cp.scheduler  = m_scheduler.saveState();
+    cp.devices    = m_ioports.saveState();
+    cp.inputIndex = m_inputLog.size();
+    cp.semihostIndex = m_semihostLog.size();
+
+    std::uint32_t numPages = m_memory.getNumPages();
+
+    cp.generations.resize(numPages);
+
+    const Checkpoint* prev = m_checkpoints.size() > 1 ? &m_checkpoints[m_checkpoints.size() - 2] : nullptr;
+
+    for (std::uint32_t page = 0; page < numPages; page++)
+    {
+        if (m_memory.isAliasPage(page))
+            continue;
+
+        cp.generations[page] = m_memory.getPageGeneration(page);
+
+        if (prev == nullptr || prev->generations[page] != cp.generations[page])
+        {
+            std::vector<std::uint16_t>& words = cp.pages[page];
+
+            words.resize(m_memory.getPageSizeInWords());
+            m_memory.snapshotPage(page, words.data());
+        }
+    }
+}
+
+void TimeTravel::dropOldestCheckpoint()
+{
+    // The next checkpoint becomes the oldest, so it needs a copy of every
+    // page: take over the pages it doesn't have its own newer copy of.
+
+    Checkpoint& oldest = m_checkpoints[0];
+    Checkpoint& next   = m_checkpoints[1];
+
+    for (auto& page : oldest.pages)
+    {
+        if (next.pages.find(page.first) == next.pages.end())
+            next.pages[page.first].swap(page.second);
+    }
+
+    m_checkpoints.erase(m_checkpoints.begin());
+}
+
+void TimeTravel::logInput(const std::vector<std::uint8_t>& scancodes)
+{
+    if (! m_enabled)
+        return;
+
+    InputEntry entry;
+
+    entry.cycle     = m_scheduler.now();
+    entry.scancodes = scancodes;
+
+    m_inputLog.push_back(entry);
+}
+
+void TimeTravel::logSemihost(std::uint32_t op, const std::uint16_t* gpr)
+{
+    if (! m_enabled)
+        return;
+
+    m_semihostLog.emplace_back();
+
+    SemihostEntry& entry = m_semihostLog.back();
+
+    entry.cycle  = m_scheduler.now();
+    entry.result = gpr[0] | ((std::uint32_t)gpr[1] << 16);
+    entry.buffer = gpr[2] | ((std::uint32_t)gpr[3] << 16);
+
+    // a failed read returns an error, so there's nothing to copy back
+
+    if (op == Semihost::kRead && entry.result != 0xffffffff)
+    {
+        entry.bytes.resize(entry.result);
+
+        if (! m_memory.readBytes(entry.buffer, entry.bytes.data(), entry.result))
+            entry.bytes.clear();
+    }
+}
+
+bool TimeTravel::replaySemihost(std::uint16_t* gpr)
+{
+    std::uint64_t now = m_scheduler.now();
+
+    while (m_semihostReplay < m_semihostLog.size() && m_semihostLog[m_semihostReplay].cycle < now)
+        m_semihostReplay++;
+
+    if (m_semihostReplay == m_semihostLog.size() || m_semihostLog[m_semihostReplay].cycle != now)
+        return false;
+
+    const SemihostEntry& entry = m_semihostLog[m_semihostReplay++];
+
+    if (! entry.bytes.empty())
+        m_memory.writeBytes(entry.buffer, entry.bytes.data(), entry.bytes.size());
+
+    gpr[0] = entry.result & 0xffff;
+    gpr[1] = entry.result >> 16;
+
+    return true;
+}
+
+int TimeTravel::findCheckpointBefore(std::uint64_t cycle) const
+{
+    for (int i = (int)m_checkpoints.size() - 1; i >= 0; i--)
+    {
+        if (m_checkpoints[i].cycle < cycle)
+            return i;
+    }
+
+    return -1;
+}
+
+CPU::State TimeTravel::restoreCheckpoint(int index, std::uint64_t replayLimit)
+{
+    const Checkpoint& cp = m_checkpoints[index];
+
+    // A page only needs restoring if it has been written since the
+    // checkpoint. Its contents then are in the newest checkpoint at or
+    // before this one that holds a copy.
+
+    {
+        auto lock = m_ioports.lockFlash();
+
+        for (std::uint32_t page = 0; page < cp.generations.size(); page++)
+        {
+            if (m_memory.isAliasPage(page) || m_memory.getPageGeneration(page) == cp.generations[page])
+                continue;
+
+            for (int i = index; i >= 0; i--)
+            {
+                auto it = m_checkpoints[i].pages.find(page);
+
+                if (it != m_checkpoints[i].pages.end())
+                {
+                    m_memory.restorePage(page, it->second.data());
+
+                    // the image file has to be rewritten to match
+                    std::uint32_t flashOffset;
+
+                    if (m_memory.isFlashPage(page, flashOffset))
+                        m_ioports.flashRestored(flashOffset, m_memory.getPageSizeInWords());
+
+                    break;
+                }
+            }
+        }
+    }
+
+    m_scheduler.restoreState(cp.scheduler);
+    m_ioports.restoreState(cp.devices);
+
+    // Input from the host goes back in as ordinary events on the cycles
+    // it was originally delivered on.
+
+    for (std::size_t i = cp.inputIndex; i < m_inputLog.size() && m_inputLog[i].cycle <= replayLimit; i++)
+    {
+        const std::vector<std::uint8_t>& scancodes = m_inputLog[i].scancodes;
+
+        m_scheduler.schedule(m_inputLog[i].cycle - cp.cycle, [this, scancodes] ()
+        {
+            m_ioports.replayScancodes(scancodes);
+        });
+    }
+
+    m_semihostReplay = cp.semihostIndex;
+
+    return cp.cpu;
+}
+
+void TimeTravel::truncate(int index, std::uint64_t cycle)
+{
+    m_checkpoints.resize(index + 1);
+
+    while (! m_inputLog.empty() && m_inputLog.back().cycle > cycle)
+        m_inputLog.pop_back();
+
+    // a call on cycle itself hasn't been replayed, so it will be made again
+
+    while (! m_semihostLog.empty() && m_semihostLog.back().cycle >= cycle)
+        m_semihostLog.pop_back();
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "cpu.h"
+#include "memory.h"
+#include "ioports.h"
+#include "eventscheduler.h"
+
+#include <cstdint>
+#include <vector>
+#include <map>
+
+//
+//  History for reverse debugging. Every kCheckpointInterval cycles the CPU
+//  thread takes a checkpoint: CPU registers, device registers, the pending
+//  scheduler events and the memory pages written since the last checkpoint
+//  (found through the page generation counters). Everything in the SoC runs
+//  in virtual time, so the only nondeterminism is input from the host and
+//  the results of semihosting calls, which are logged with the cycle they
+//  happened on.
+//
+//  Going back is done by restoring the nearest checkpoint and re-executing
+//  forward, with the logged input delivered again as scheduler events and
+//  semihosting calls answered from the log.
+//
+//  All methods must be called on the CPU thread, or with the CPU paused
+//  and its lock held.
+//
+
+class TimeTravel
+{
+public:
+
+    TimeTravel(Memory& mem, IOPorts& ioports, EventScheduler& sched);
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled; }
+
+    // forget all history (on reset)
+    void reset();
+
+    bool checkpointDue() const
+    {
+        return m_enabled && (m_checkpoints.empty() ||
+                             m_scheduler.now() >= m_checkpoints.back().cycle + kCheckpointInterval);
+    }
+
+    void takeCheckpoint(const CPU::State& cpu);
+
+    // record host input, delivered at the current cycle
+    void logInput(const std::vector<std::uint8_t>& scancodes);
+
+    // record a semihosting call op just made at the current cycle: its
+    // result in r0:r1, and for kRead the bytes it put in memory
+    void logSemihost(std::uint32_t op, const std::uint16_t* gpr);
+
+    // while replaying, answer the semihosting call at the current cycle
+    // from the log: fills in r0:r1 and memory as the original call did.
+    // Returns false if it wasn't logged.
+    bool replaySemihost(std::uint16_t* gpr);
+
+    std::size_t   getNumCheckpoints() const             { return m_checkpoints.size(); }
+    std::uint64_t getCheckpointCycle(std::size_t i) const { return m_checkpoints[i].cycle; }
+
+    // index of the newest checkpoint taken before cycle, or -1
+    int findCheckpointBefore(std::uint64_t cycle) const;
+
+    // Put memory, devices and the scheduler back as they were at checkpoint
+    // index, with logged input up to and including cycle replayLimit
+    // scheduled for re-delivery, and semihosting replay rewound to it.
+    // Returns the CPU state to restore.
+    CPU::State restoreCheckpoint(int index, std::uint64_t replayLimit);
+
+    // History after cycle (which must be at or after checkpoint index) is
+    // about to be rewritten, so drop it.
+    void truncate(int index, std::uint64_t cycle);
+
+    const std::uint64_t kCheckpointInterval = 5000000;    // 100ms of virtual time
+    const std::size_t   kMaxCheckpoints     = 64;
+
+private:
+
+    struct Checkpoint
+    {
+        std::uint64_t           cycle;
+        CPU::State              cpu;
+        EventScheduler::State   scheduler;
+        IOPorts::State          devices;
+        std::size_t             inputIndex;     // first input log entry after the checkpoint
+        std::size_t             semihostIndex;  // likewise, semihosting log
+
+        // page generations when taken, and the contents of pages changed
+        // since the previous checkpoint (every page, for the oldest)
+        std::vector<std::uint32_t>                           generations;
+        std::map<std::uint32_t, std::vector<std::uint16_t>>  pages;
+    };
+
+    struct InputEntry
+    {
+        std::uint64_t             cycle;
+        std::vector<std::uint8_t> scancodes;
+    };
+
+    struct SemihostEntry
+    {
+        std::uint64_t             cycle;
+        std::uint32_t             result;
+        std::uint32_t             buffer;   // byte address bytes were read to
+        std::vector<std::uint8_t> bytes;
+    };
+
+    void dropOldestCheckpoint();
+
+    Memory&         m_memory;
+    IOPorts&        m_ioports;
+    EventScheduler& m_scheduler;
+
+    bool m_enabled;
+
+    std::vector<Checkpoint> m_checkpoints;
+    std::vector<InputEntry> m_inputLog;
+
+    std::vector<SemihostEntry> m_semihostLog;
+    std::size_t                m_semihostReplay;   // next entry to answer from
+};
@@ -0,0 +1,254 @@
+#include "timingmodel.h"
+
+#include "nbInstructionDecodeTable.h"
+#include "nbInstructionTiming.h"
+#include "types.h"
+
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+
+static_assert((int)Memory::kNumRegions == (int)kNbNumRegions, "memory regions differ from nbInstructionTiming.h");
+
+TimingModel::TimingModel(Memory& mem) :
+    m_memory(mem)
+{
+    reset();
+}
+
+void TimingModel::reset()
+{
+    m_cycle     = 0;
+    m_busFreeAt = 0;
+    m_loadDest  = -1;
+
+    for (int i = 0; i < kICacheLines; i++)
+        m_icacheTags[i] = 0;
+
+    m_total = Counters();
+    m_functions.clear();
+
+    m_current      = nullptr;
+    m_currentStart = 0;
+    m_currentEnd   = 0;
+}
+
+TimingModel::Counters& TimingModel::functionCounters(std::uint32_t pc)
+{
+    std::uint32_t byteAddress = pc << 1;
+
+    if (m_current != nullptr && byteAddress >= m_currentStart && byteAddress < m_currentEnd)
+        return *m_current;
+
+    const std::string* sym = m_symbols.symbolContaining(byteAddress, &m_currentStart, &m_currentEnd);
+
+    m_current = &m_functions[sym == nullptr ? kNoSymbol : m_currentStart];
+
+    return *m_current;
+}
+
+std::uint64_t TimingModel::fetch(std::uint32_t pc)
+{
+    // returns the cycles the fetch stalls for, 0 on a hit
+
+    std::uint32_t line = pc / kICacheLineWords;
+    std::uint32_t& tag = m_icacheTags[line % kICacheLines];
+
+    if (tag == line + 1)
+        return 0;
+
+    tag = line + 1;
+
+    int region = m_memory.getRegion(pc);
+
+    std::uint64_t start = std::max(m_cycle, m_busFreeAt);
+
+    m_busFreeAt = start + kNbFirstWordCycles[region] + (kICacheLineWords - 1) * kNbBurstWordCycles[region];
+
+    return m_busFreeAt - m_cycle;
+}
+
+std::uint64_t TimingModel::memoryAccess(std::uint32_t address, bool store)
+{
+    // returns the cycles the access stalls for beyond its own
+
+    int region = m_memory.getRegion(address);
+
+    std::uint64_t start = std::max(m_cycle, m_busFreeAt);
+
+    m_busFreeAt = start + kNbFirstWordCycles[region];
+
+    // stores are posted: only wait for the controller to take them
+    if (store)
+        return start - m_cycle;
+
+    return m_busFreeAt - m_cycle - 1;
+}
+
+void TimingModel::retire(std::uint32_t pc, std::uint32_t nextPc, std::uint16_t instruction,
+                         std::uint16_t imm, const std::uint16_t* gpr, const std::uint32_t* spr)
+{
+    Counters& func = functionCounters(pc);
+
+    std::uint64_t stalls[kNumStallKinds] = {};
+
+    stalls[kStallICache] = fetch(pc);
+
+    if (stalls[kStallICache] != 0)
+    {
+        func.icacheMisses++;
+        m_total.icacheMisses++;
+    }
+
+    const nbInstructionDecodeInfo* info = decodeInstruction(instructionDecodeTable(), instruction);
+    UniqueOpCode opcode = info == nullptr ? UniqueOpCode::None : info->opcode;
+
+    int regy = instruction & 0x0f;
+    int regi = (instruction & 0x300) >> 8;
+
+    int srcA, srcB, loadDest;
+
+    nbRegistersUsed(opcode, instruction, srcA, srcB, loadDest);
+
+    switch (opcode)
+    {
+        case UniqueOpCode::LDW_REG:
+        {
+            std::uint32_t memOffset = gpr[regy] + spr[regi + 8];
+            stalls[kStallMemory] = memoryAccess(memOffset >> 1, false);
+            break;
+        }
+        case UniqueOpCode::LDW_IMM:
+        {
+            std::uint32_t memOffset = spr[regi + 8] + ((imm << 4) | regy);
+            stalls[kStallMemory] = memoryAccess(memOffset >> 1, false);
+            break;
+        }
+        case UniqueOpCode::STW_REG:
+        {
+            std::uint32_t memOffset = gpr[regy] + spr[regi + 8];
+            stalls[kStallMemory] = memoryAccess(memOffset >> 1, true);
+            break;
+        }
+        case UniqueOpCode::STW_IMM:
+        {
+            std::uint32_t memOffset = spr[regi + 8] + ((imm << 4) | regy);
+            stalls[kStallMemory] = memoryAccess(memOffset >> 1, true);
+            break;
+        }
+        default:
+            break;
+    }
+
+    if (m_loadDest != -1 && (srcA == m_loadDest || srcB == m_loadDest))
+        stalls[kStallLoadUse] = kNbLoadUseStall;
+
+    m_loadDest = loadDest;
+
+    if (opcode == UniqueOpCode::IN || opcode == UniqueOpCode::OUT)
+        stalls[kStallPort] = nbExecuteCycles(opcode) - 1;
+    else
+        stalls[kStallExecute] = nbExecuteCycles(opcode) - 1;
+
+    // anything but falling through to the next instruction refetches
+
+    if (nextPc != pc + 1)
+        stalls[kStallBranch] = kNbBranchPenalty;
+
+    std::uint64_t cycles = 1;
+
+    for (int i = 0; i < kNumStallKinds; i++)
+    {
+        cycles          += stalls[i];
+        func.stalls[i]  += stalls[i];
+        m_total.stalls[i] += stalls[i];
+    }
+
+    m_cycle += cycles;
+
+    func.instructions++;
+    func.cycles += cycles;
+
+    m_total.instructions++;
+    m_total.cycles += cycles;
+}
+
+void TimingModel::interrupt(std::uint32_t pc)
+{
+    Counters& func = functionCounters(pc);
+
+    func.cycles                 += kNbBranchPenalty;
+    func.stalls[kStallBranch]   += kNbBranchPenalty;
+
+    m_total.cycles               += kNbBranchPenalty;
+    m_total.stalls[kStallBranch] += kNbBranchPenalty;
+
+    m_cycle += kNbBranchPenalty;
+    m_loadDest = -1;
+}
+
+void TimingModel::writeReport(std::ostream& os) const
+{
+    static const char* stallNames[kNumStallKinds] = { "branch", "load-use", "icache", "memory", "execute", "port" };
+
+    double cpi = m_total.instructions == 0 ? 0.0 : (double)m_total.cycles / (double)m_total.instructions;
+    std::uint64_t fetches = m_total.instructions;
+    double hitRate = fetches == 0 ? 0.0 : 100.0 * (double)(fetches - m_total.icacheMisses) / (double)fetches;
+
+    os << "Estimated " << m_total.cycles << " cycles for " << m_total.instructions << " instructions, CPI "
+       << std::fixed << std::setprecision(2) << cpi << ", icache hits " << std::setprecision(1) << hitRate << "%" << std::endl;
+
+    os << "Stall cycles:";
+
+    for (int i = 0; i < kNumStallKinds; i++)
+        os << " " << stallNames[i] << " " << m_total.stalls[i];
+
+    os << std::endl << std::endl;
+
+    // functions, most expensive first
+
+    std::vector<std::pair<std::uint32_t, const Counters*>> functions;
+
+    for (const auto& f : m_functions)
+        functions.push_back(std::make_pair(f.first, &f.second));
+
+    std::sort(functions.begin(), functions.end(), [] (const std::pair<std::uint32_t, const Counters*>& a,
+                                                      const std::pair<std::uint32_t, const Counters*>& b)
+    {
+        return a.second->cycles > b.second->cycles;
+    });
+
+    os << std::left << std::setw(24) << "function" << std::right
+       << std::setw(12) << "instrs" << std::setw(12) << "cycles" << std::setw(7) << "CPI";
+
+    for (int i = 0; i < kNumStallKinds; i++)
+        os << std::setw(10) << stallNames[i];
+
+    os << std::setw(10) << "misses" << std::endl;
+
+    for (const auto& f : functions)
+    {
+        const Counters& c = *f.second;
+
+        std::string name;
+
+        if (f.first == kNoSymbol)
+        {
+            name = "?";
+        }
+        else
+        {
+            const std::string* sym = m_symbols.symbolAt(f.first);
+            name = sym != nullptr ? *sym : "?";
+        }
+
+        os << std::left << std::setw(24) << name << std::right
+           << std::setw(12) << c.instructions << std::setw(12) << c.cycles
+           << std::setw(7) << std::setprecision(2) << (c.instructions == 0 ? 0.0 : (double)c.cycles / (double)c.instructions);
+
+        for (int i = 0; i < kNumStallKinds; i++)
+            os << std::setw(10) << c.stalls[i];
+
+        os << std::setw(10) << c.icacheMisses << std::endl;
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "memory.h"
+#include "symboltable.h"
+
+#include <cstdint>
+#include <string>
+#include <map>
+#include <ostream>
+
+//
+//  Cycle-approximate model of the RTL core, for comparing code layouts
+//  and compiler strategies. It watches instructions retire and estimates
+//  what they would cost on the FPGA:
+//
+//      - taken branches, calls, returns and interrupts flush the pipeline
+//      - an instruction using the result of the load before it stalls
+//      - fetches go through a direct mapped instruction cache; misses fill
+//        a line with a burst from the memory controller
+//      - loads wait for the memory controller; stores are posted, but hold
+//        the controller so a following fill or load waits for them
+//      - multiply, divide, floating point and port accesses take extra
+//        execute cycles
+//
+//  Estimates are kept apart from virtual time, so the functional model and
+//  devices behave exactly as without it. Latencies are in
+//  nbInstructionTiming.h, shared with nbasm's listing.
+//
+//  Cycles and stalls are attributed to the function (nearest symbol at or
+//  below the pc) that the instruction belongs to.
+//
+//  CPU thread only; read the report once the CPU has stopped.
+//
+
+class TimingModel
+{
+public:
+
+    TimingModel(Memory& mem);
+
+    bool loadSymbols(std::string path) { return m_symbols.load(path); }
+
+    void reset();
+
+    // An instruction at pc (word address) has executed and the next is
+    // at nextPc. gpr, spr and imm are the registers as it saw them.
+    void retire(std::uint32_t pc, std::uint32_t nextPc, std::uint16_t instruction,
+                std::uint16_t imm, const std::uint16_t* gpr, const std::uint32_t* spr);
+
+    // an interrupt was taken before the instruction at pc
+    void interrupt(std::uint32_t pc);
+
+    std::uint64_t getCycles() const { return m_cycle; }
+
+    void writeReport(std::ostream& os) const;
+
+    enum
+    {
+        kStallBranch    = 0,
+        kStallLoadUse   = 1,
+        kStallICache    = 2,
+        kStallMemory    = 3,
+        kStallExecute   = 4,
+        kStallPort      = 5,
+
+        kNumStallKinds  = 6
+    };
+
+private:
+
+    struct Counters
+    {
+        std::uint64_t instructions;
+        std::uint64_t cycles;
+        std::uint64_t stalls[kNumStallKinds];
+        std::uint64_t icacheMisses;
+    };
+
+    Counters& functionCounters(std::uint32_t pc);
+
+    std::uint64_t fetch(std::uint32_t pc);
+    std::uint64_t memoryAccess(std::uint32_t address, bool store);
+
+    // sizes
+    enum
+    {
+        kICacheLines        = 64,
+        kICacheLineWords    = 8
+    };
+
+    const std::uint32_t kNoSymbol = 0xffffffff;
+
+    Memory& m_memory;
+
+    SymbolTable m_symbols;
+
+    std::uint64_t m_cycle;
+    std::uint64_t m_busFreeAt;          // when the memory controller finishes what the core gave it
+    int           m_loadDest;           // register loaded by the previous instruction, or -1
+
+    std::uint32_t m_icacheTags[kICacheLines];   // line address + 1, 0 for invalid
+
+    Counters m_total;
+
+    std::map<std::uint32_t, Counters> m_functions;  // by symbol address
+
+    // function the last instruction was in, to skip the lookup
+    Counters*     m_current;
+    std::uint32_t m_currentStart;
+    std::uint32_t m_currentEnd;
+};
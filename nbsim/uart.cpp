@@ -26,7 +26,8 @@ void          UART::outPort(std::uint16_t reg, std::uint16_t value)
         case UARTReg::Status:
             break;
         case UARTReg::TXFifo:
-            printf("%c", value & 0xff);
+            if (! m_muted)
+                printf("%c", value & 0xff);
             //fflush(0);
             break;
     }
@@ -13,7 +13,14 @@ class UART : public IPortSink
 {
 public:
 
+    // suppress output while re-executing history, so it isn't printed twice
+    void setMuted(bool muted) { m_muted = muted; }
+
     virtual std::uint16_t inPort(std::uint16_t reg) override;
     virtual void          outPort(std::uint16_t reg, std::uint16_t value) override;
 
+private:
+
+    bool m_muted = false;
+
 };
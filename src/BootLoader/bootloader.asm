@@ -33,6 +33,9 @@ done_banner_loop:
 
 /*====================== UART Routines ====================*/
 
+        // each routine in its own section, so nbld -g can drop unused ones
+
+        .section text.OutByte
 OutByte:
 
         stw r1, [s8, 0]
@@ -62,6 +65,7 @@ OutByte:
 
         ret
 
+        .section text.WaitTxNotFull
 WaitTxNotFull:
 
         stw r0, [s8, 0]
@@ -84,6 +88,8 @@ WaitLoop:
 
 /*====================== Data section =====================*/
 
+        .section data
+
         .align 100h
 
 data:
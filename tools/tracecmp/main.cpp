@@ -0,0 +1,197 @@
+//
+//  tracecmp: compare two retirement traces (nbsim -t, or the RTL test
+//  bench's TraceWriter) record by record and report the first divergence.
+//
+//  Both traces are streamed, so they can be as long as the runs that made
+//  them. The RTL can only see what leaves the core, so by default all
+//  record kinds are compared but -k picks a subset, e.g. -k mp for memory
+//  and port writes only. Retired instruction records are always followed,
+//  whether compared or not, so a divergence can be placed at an instruction.
+//
+
+#include <fstream>
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <deque>
+
+void printUsage(char* exe)
+{
+    std::cout << "Usage: " << exe << " [-k <record kinds to compare>] [-n <lines of context>] [-s (lengths must match)] <reference trace> <trace to check>" << std::endl;
+}
+
+class TraceReader
+{
+public:
+
+    TraceReader(std::string fileName, std::string kinds) :
+        m_fileName(fileName),
+        m_kinds(kinds),
+        m_records(0),
+        m_instructions(0),
+        m_lineNumber(0)
+    {
+        m_file.open(fileName);
+    }
+
+    bool isOpen() const { return m_file.is_open(); }
+
+    // Next record of a kind being compared, with the fields separated by
+    // single spaces. Returns false at the end of the trace.
+    bool next(std::string& record)
+    {
+        std::string line;
+
+        while (std::getline(m_file, line))
+        {
+            m_lineNumber++;
+
+            std::istringstream fields(line);
+            std::string field;
+
+            record.clear();
+
+            while (fields >> field)
+                record += (record.empty() ? "" : " ") + field;
+
+            if (record.empty() || record[0] == '#')
+                continue;
+
+            if (record[0] == 'i')
+            {
+                m_instructions++;
+                m_lastInstruction = record;
+            }
+
+            if (m_kinds.find(record[0]) == std::string::npos)
+                continue;
+
+            m_records++;
+            return true;
+        }
+
+        return false;
+    }
+
+    const std::string& fileName() const         { return m_fileName; }
+    std::uint64_t records() const               { return m_records; }
+    std::uint64_t instructions() const          { return m_instructions; }
+    std::uint64_t lineNumber() const            { return m_lineNumber; }
+    const std::string& lastInstruction() const  { return m_lastInstruction; }
+
+private:
+
+    std::string   m_fileName;
+    std::string   m_kinds;
+    std::ifstream m_file;
+
+    std::uint64_t m_records;
+    std::uint64_t m_instructions;
+    std::uint64_t m_lineNumber;
+    std::string   m_lastInstruction;
+};
+
+void printPosition(const TraceReader& trace)
+{
+    std::cout << "  " << trace.fileName() << " line " << trace.lineNumber()
+              << ", after " << trace.instructions() << " instructions";
+
+    if (! trace.lastInstruction().empty())
+        std::cout << ", last retired: " << trace.lastInstruction();
+
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string kinds = "ixrsfmp";
+    int contextLines = 8;
+    bool strict = false;
+
+    int c;
+
+    while ((c = getopt (argc, argv, "k:n:s")) != -1)
+    switch (c)
+    {
+        case 'k':
+            kinds = optarg;
+            break;
+        case 'n':
+            contextLines = atoi(optarg);
+            break;
+        case 's':
+            strict = true;
+            break;
+        default:
+            printUsage(argv[0]);
+            exit(2);
+    }
+
+    if (argc - optind != 2)
+    {
+        printUsage(argv[0]);
+        exit(2);
+    }
+
+    TraceReader ref(argv[optind], kinds);
+    TraceReader dut(argv[optind + 1], kinds);
+
+    if (! ref.isOpen() || ! dut.isOpen())
+    {
+        std::cout << "ERROR: could not open " << (ref.isOpen() ? dut.fileName() : ref.fileName()) << std::endl;
+        exit(2);
+    }
+
+    // the last few records that matched, to show what led up to a divergence
+    std::deque<std::string> context;
+
+    std::string refRecord;
+    std::string dutRecord;
+
+    while (true)
+    {
+        bool refMore = ref.next(refRecord);
+        bool dutMore = dut.next(dutRecord);
+
+        if (! refMore || ! dutMore)
+        {
+            if (refMore == dutMore)
+            {
+                std::cout << "Traces match: " << ref.records() << " records compared" << std::endl;
+                return 0;
+            }
+
+            const TraceReader& shorter = refMore ? dut : ref;
+
+            std::cout << shorter.fileName() << " ends first; traces match for the "
+                      << shorter.records() << " records both have" << std::endl;
+
+            return strict ? 1 : 0;
+        }
+
+        if (refRecord != dutRecord)
+            break;
+
+        context.push_back(refRecord);
+
+        if ((int)context.size() > contextLines)
+            context.pop_front();
+    }
+
+    std::cout << "Traces diverge at record " << ref.records() << ":" << std::endl;
+    std::cout << std::endl;
+
+    for (const std::string& record : context)
+        std::cout << "    " << record << std::endl;
+
+    std::cout << "  < " << refRecord << std::endl;
+    std::cout << "  > " << dutRecord << std::endl;
+    std::cout << std::endl;
+
+    printPosition(ref);
+    printPosition(dut);
+
+    return 1;
+}